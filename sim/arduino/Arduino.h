@@ -0,0 +1,140 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+/* Host stand-in for the Arduino core
+   Description : Just enough of the Arduino API for ventilator/ventilator.cpp to compile and run on Linux.
+                 Time is virtual .. every call that would take time on the Uno (analogRead, I2C, serial, delay)
+                 advances the host clock instead, and the Timer1 interrupt is fired from that clock.
+                 See sim/host_clock.h for the harness side of the clock.
+   Note        : int is 32 bits here and 16 bits on the AVR - arithmetic that overflows on the Uno will not overflow here
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+#define NOT_AN_INTERRUPT -1
+
+#define DEC 10
+#define HEX 16
+
+const uint8_t A0 = 14;
+const uint8_t A1 = 15;
+const uint8_t A2 = 16;
+const uint8_t A3 = 17;
+
+// Flash is just memory on the host (avr/pgmspace.h on the Uno)
+#define PROGMEM
+#define pgm_read_byte(address) (*(const uint8_t *) (address))
+#define pgm_read_word(address) (*(const uint16_t *) (address))
+#define PSTR(str) (str)
+
+class __FlashStringHelper;
+#define F(str) (reinterpret_cast<const __FlashStringHelper *>(PSTR(str)))
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int val);
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void noInterrupts();
+void interrupts();
+
+// External interrupts - INT0 on pin 2 and INT1 on pin 3, as on the Uno
+int digitalPinToInterrupt(uint8_t pin);
+void attachInterrupt(uint8_t interruptNum, void (*isr)(), int mode);
+void detachInterrupt(uint8_t interruptNum);
+
+// Host only - stands in for the ADC's free-running mode with the conversion-complete interrupt enabled.
+// isr is called from the virtual clock with each conversion of 'pin' (every 104 us, as at the /128 prescaler)
+void hostAdcFreeRun(uint8_t pin, void (*isr)(uint16_t conversion));
+
+// Timer1 count and TOP, read only. TimerOne runs Timer1 in phase-correct PWM mode - up to ICR1, back down to BOTTOM,
+// overflow interrupt at BOTTOM - and the host works both out from the virtual clock and the TimerOne period
+uint16_t hostTimer1Count();
+uint16_t hostTimer1Top();
+#define TCNT1 hostTimer1Count()
+#define ICR1 hostTimer1Top()
+
+char *dtostrf(double val, signed char width, unsigned char prec, char *sout);
+
+class String {
+  public:
+    String(const char *str = "");
+    String(const String &other);
+    ~String();
+    String & operator=(const String &other);
+    const char *c_str() const { return buffer; }
+    unsigned int length() const { return len; }
+  private:
+    char *buffer;
+    unsigned int len;
+};
+
+class Print {
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    size_t write(const char *str) { return write((const uint8_t *) str, strlen(str)); }
+
+    size_t print(const __FlashStringHelper *str);
+    size_t print(const char str[]);
+    size_t print(const String &s);
+    size_t print(char c);
+    size_t print(int n, int base = DEC);
+    size_t print(unsigned int n, int base = DEC);
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC);
+    size_t print(double n, int digits = 2);
+
+    size_t println();
+    size_t println(const __FlashStringHelper *str);
+    size_t println(const char str[]);
+    size_t println(const String &s);
+    size_t println(char c);
+    size_t println(int n, int base = DEC);
+    size_t println(unsigned int n, int base = DEC);
+    size_t println(long n, int base = DEC);
+    size_t println(unsigned long n, int base = DEC);
+    size_t println(double n, int digits = 2);
+};
+
+class HardwareSerial : public Print {
+  public:
+    void begin(unsigned long baud);
+    void end() {}
+    int available();
+    int availableForWrite();
+    int read();
+    void flush();
+    size_t write(uint8_t c);
+    using Print::write;
+    operator bool() { return true; }
+};
+
+extern HardwareSerial Serial;
+
+#endif
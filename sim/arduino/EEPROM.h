@@ -0,0 +1,24 @@
+#ifndef HOST_EEPROM_H
+#define HOST_EEPROM_H
+
+/* Host stand-in for the Arduino EEPROM library (and eeprom_is_ready() from avr/eeprom.h, which it includes on the Uno)
+   1024 bytes, erased to 0xFF. A write takes 3.4 ms of virtual time to complete, as on the ATmega328P .. the CPU carries
+   on meanwhile, but another write (or a read) before it is done waits for it. The contents survive hostReset(), as they
+   survive a reset of the Uno; sim/host_clock.h has hostEepromErase() and direct access for the harness.
+*/
+
+#include <stdint.h>
+
+class EEPROMClass {
+  public:
+    uint8_t read(int address);
+    void write(int address, uint8_t value);
+    void update(int address, uint8_t value);      // writes only if the value is different
+    uint16_t length() { return 1024; }
+};
+
+extern EEPROMClass EEPROM;
+
+bool eeprom_is_ready();
+
+#endif
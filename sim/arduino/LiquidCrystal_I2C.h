@@ -0,0 +1,36 @@
+#ifndef HOST_LIQUIDCRYSTAL_I2C_H
+#define HOST_LIQUIDCRYSTAL_I2C_H
+
+#include <Arduino.h>
+
+/* Host stand-in for LiquidCrystal_I2C (HD44780 behind a PCF8574 backpack)
+   Keeps a copy of the character display so the harness can read it back, and charges the virtual clock
+   for the I2C traffic the real library generates (see LCD_* costs in sim/host_arduino.cpp)
+*/
+
+class LiquidCrystal_I2C : public Print {
+  public:
+    LiquidCrystal_I2C(uint8_t lcd_addr, uint8_t lcd_cols, uint8_t lcd_rows);
+    void begin();
+    void init() { begin(); }
+    void clear();
+    void home();
+    void setCursor(uint8_t col, uint8_t row);
+    void backlight();
+    void noBacklight();
+    size_t write(uint8_t c);
+    using Print::write;
+
+    const char *row(uint8_t r) const;         // host only - current contents of a display row
+
+  private:
+    static const uint8_t MAX_COLS = 20;
+    static const uint8_t MAX_ROWS = 4;
+    uint8_t cols;
+    uint8_t rows;
+    uint8_t col;
+    uint8_t line;
+    char text[MAX_ROWS][MAX_COLS + 1];
+};
+
+#endif
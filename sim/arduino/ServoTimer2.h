@@ -0,0 +1,24 @@
+#ifndef HOST_SERVOTIMER2_H
+#define HOST_SERVOTIMER2_H
+
+/* Host stand-in for ServoTimer2 (RC servo pulses generated from Timer2, so that TimerOne keeps Timer1)
+   The pulse width last written is remembered per pin so that the plant model can read the actuator output
+   (hostServoPulse() in sim/host_clock.h).
+*/
+
+#include <stdint.h>
+
+class ServoTimer2 {
+  public:
+    ServoTimer2() : pin(0xFF) {}
+    uint8_t attach(int pin);
+    void detach();
+    void write(int pulseWidth);                 // microseconds
+    int read();
+    bool attached() { return pin != 0xFF; }
+
+  private:
+    uint8_t pin;
+};
+
+#endif
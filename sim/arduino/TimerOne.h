@@ -0,0 +1,26 @@
+#ifndef HOST_TIMERONE_H
+#define HOST_TIMERONE_H
+
+/* Host stand-in for TimerOne .. https://playground.arduino.cc/Code/Timer1/
+   The attached interrupt is fired from the virtual clock in sim/host_arduino.cpp every 'period' microseconds.
+   PWM duty values are remembered per pin so that the plant model can read the actuator output.
+*/
+
+class TimerOne {
+  public:
+    void initialize(long microseconds = 1000000);
+    void setPeriod(long microseconds);
+    void start();
+    void stop();
+    void restart();
+    void resume();
+    void attachInterrupt(void (*isr)(), long microseconds = -1);
+    void detachInterrupt();
+    void pwm(char pin, unsigned int duty, long microseconds = -1);
+    void setPwmDuty(char pin, unsigned int duty);
+    void disablePwm(char pin);
+};
+
+extern TimerOne Timer1;
+
+#endif
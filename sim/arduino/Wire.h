@@ -0,0 +1,13 @@
+#ifndef HOST_WIRE_H
+#define HOST_WIRE_H
+
+// Host stand-in for the Arduino Wire (I2C) library .. the LCD stand-in accounts for the bus time itself
+
+class TwoWire {
+  public:
+    void begin() {}
+};
+
+extern TwoWire Wire;
+
+#endif
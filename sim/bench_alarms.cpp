@@ -0,0 +1,251 @@
+/* bench_alarms - time to detect each alarm (ventilator/alarms.h), with the fault injected into the lung model
+   Each fault is injected at [phases] points spread through a breath, from a clean start, and the run goes on until the
+   alarm is raised. The alarms are looked at after every control tick:
+     high pressure  - the pressure behind the bag doubles (a failed regulator on the gas that squeezes it), taking the
+                      inhale past ALARM_HIGH_PRESSURE_ON. The drive has to be at its minimum on the tick that raises it,
+                      and the inhale over
+     disconnect     - the circuit opened to the room at the wye. Limit to alarm is less the 0.5 s the pressure has to stay
+                      under ALARM_DISCONNECT_ON
+     apnea          - a spontaneously breathing patient stops. Limit to alarm is less the 20 s from the last patient-
+                      triggered breath; a backup breath has to start with the alarm
+     low pressure   - the bag is no longer squeezed (actuator pressure down to 3 cmH2O), so the breaths peak under
+                      ALARM_LOW_PEAK_ON. Two breaths in a row must do so before it counts
+   Limit to alarm is from the first tick at which the fast-channel pressure (the controller's own, pressure_filter.h) is
+   past the alarm's limit, less any time the alarm waits on purpose .. the filter's delay from the sensor comes on top. Any alarm before the fault is a false alarm. Exits 1 on a false alarm, a missed one, a missing
+   response, or a limit to alarm time longer than one control tick.
+   Usage : bench_alarms [phases]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "sim_harness.h"
+#include "alarms.h"
+#include "pressure_filter.h"
+#include "trigger.h"
+
+// From ventilator.cpp
+extern int currentMode;
+extern int respRate;
+extern int newRespRate;
+extern int tidal;
+extern int newTidal;
+extern int breathState;
+
+// As ventilator.cpp
+const int MODE_IPPV = 0;
+const int MODE_SPONTANEOUS = 1;
+const int INHALE_STATE = 0;
+const int RESP_RATE_DEFAULT = 20;
+const int TIDAL_DEFAULT = 250;
+const int ALARM_HIGH_PRESSURE_ON = 35;
+const int ALARM_DISCONNECT_ON = 2;
+const int ALARM_DISCONNECT_OFF = 3;
+const double ALARM_DISCONNECT_S = 0.5;
+const double ALARM_APNEA_S = 20;
+
+const double STEP_S = 0.01;
+const double WARM_UP_S = 10;
+const double TIMEOUT_S = 40;
+
+// The controller's pressureToFiltered() .. the limits as the control tick compares them
+static uint16_t pressureToFiltered(int pressure) {
+  return (pressure - -5.7f) / 0.1331f / (1.0f / 16);
+}
+
+enum Fault { FAULT_HIGH_PRESSURE, FAULT_DISCONNECT, FAULT_APNEA, FAULT_LOW_PRESSURE };
+
+struct FaultResult {
+  unsigned long runs;
+  unsigned long detected;
+  unsigned long falseAlarms;
+  unsigned long noResponse;        // over-pressure with the drive still up, or apnea with no backup breath
+  double detectSum;                // fault injected to alarm
+  double detectMax;
+  double beyondMax;                // alarm condition met to alarm, less the alarm's own delay
+  double beyondSum;
+  float peakPressure;              // highest at the sensor after the fault
+};
+
+static void setUp(Fault fault, LungParams &params) {
+  lungDefaults(params);
+  currentMode = MODE_IPPV;
+  respRate = newRespRate = RESP_RATE_DEFAULT;
+  tidal = newTidal = TIDAL_DEFAULT;
+  if (fault == FAULT_HIGH_PRESSURE) {
+    tidal = newTidal = 500;
+  }
+  if (fault == FAULT_APNEA) {
+    currentMode = MODE_SPONTANEOUS;
+    respRate = newRespRate = 15;
+    params.effortPeriod = 3;
+  }
+}
+
+static void inject(Fault fault, Lung &lung) {
+  switch (fault) {
+    case FAULT_HIGH_PRESSURE:
+      lung.params.sourcePressureMax *= 2;
+      break;
+    case FAULT_DISCONNECT:
+      lung.params.leakResistance = 0.2f;
+      break;
+    case FAULT_APNEA:
+      lung.params.effortPeriod = 0;
+      break;
+    case FAULT_LOW_PRESSURE:
+      lung.params.sourcePressureMax = 3;
+      break;
+  }
+}
+
+static uint8_t alarmFor(Fault fault) {
+  const uint8_t ALARMS[] = { ALARM_HIGH_PRESSURE, ALARM_DISCONNECT, ALARM_APNEA, ALARM_LOW_PRESSURE };
+  return ALARMS[fault];
+}
+
+// Watched after every control tick (simSetTickHandler), so every time here is the end of a tick
+static Fault watched;
+static bool injected = false;
+static double condition = -1;                     // when the alarm's condition was first met in the fast channel
+static double raised = -1;
+static double lastPatientBreath = -1;
+static int lastState = -1;
+static uint16_t lastTriggers = 0;
+static bool triggerPending = false;
+static int raisedDrive = 0;
+static int raisedState = -1;
+static float peakPressure = 0;
+
+static void onTick() {
+  double now = simSeconds();
+  uint16_t triggers = triggerCount();
+  if (triggers != lastTriggers) {
+    lastTriggers = triggers;
+    triggerPending = true;                        // the inhale it starts may come on a later tick
+  }
+  if (breathState == INHALE_STATE && lastState != INHALE_STATE) {
+    if (triggerPending) {
+      lastPatientBreath = now;
+    }
+    triggerPending = false;
+  }
+  lastState = breathState;
+  if (!injected || raised >= 0) {
+    return;
+  }
+
+  uint16_t fast = pressureFilterFast();
+  if (watched == FAULT_HIGH_PRESSURE && condition < 0 && fast >= pressureToFiltered(ALARM_HIGH_PRESSURE_ON)) {
+    condition = now;
+  }
+  if (watched == FAULT_DISCONNECT) {
+    if (fast >= pressureToFiltered(ALARM_DISCONNECT_OFF)) {
+      condition = -1;
+    } else if (condition < 0 && fast < pressureToFiltered(ALARM_DISCONNECT_ON)) {
+      condition = now + ALARM_DISCONNECT_S;
+    }
+  }
+  if (alarmActive() & alarmFor(watched)) {
+    raised = now;
+    raisedDrive = simActuatorDrive();
+    raisedState = breathState;
+    if (watched == FAULT_APNEA) {
+      condition = lastPatientBreath + ALARM_APNEA_S;
+    }
+    if (condition < 0 && watched == FAULT_HIGH_PRESSURE) {
+      condition = now;                            // a spike between two ticks .. only the controller saw it
+    }
+  }
+}
+
+static void run(Fault fault, double offset, FaultResult &r) {
+  LungParams params;
+  setUp(fault, params);
+  watched = fault;
+  injected = false;
+  condition = -1;
+  raised = -1;
+  lastPatientBreath = -1;
+  lastState = -1;
+  triggerPending = false;
+  peakPressure = 0;
+  simSetTickHandler(onTick);
+  simBegin(params);
+  lastTriggers = triggerCount();
+  r.runs++;
+
+  simRunSeconds(WARM_UP_S + offset);
+  if (alarmRaisedCount() != 0) {
+    r.falseAlarms++;
+    return;
+  }
+
+  inject(fault, simLung());
+  double injectedAt = simSeconds();
+  injected = true;
+  while (raised < 0 && simSeconds() < injectedAt + TIMEOUT_S) {
+    simRunSeconds(STEP_S);
+    if (simLung().airwayPressure > peakPressure) {
+      peakPressure = simLung().airwayPressure;
+    }
+  }
+  if (peakPressure > r.peakPressure) {
+    r.peakPressure = peakPressure;
+  }
+  if (raised < 0) {
+    return;
+  }
+  r.detected++;
+
+  if (fault == FAULT_HIGH_PRESSURE && (raisedDrive != 0 || raisedState == INHALE_STATE)) {
+    r.noResponse++;                               // the drive has to be down on the tick that raised it
+  }
+  if (fault == FAULT_APNEA && raisedState != INHALE_STATE) {
+    r.noResponse++;                               // .. and the backup breath under way
+  }
+
+  double detect = raised - injectedAt;
+  r.detectSum += detect;
+  if (detect > r.detectMax) {
+    r.detectMax = detect;
+  }
+  if (fault != FAULT_LOW_PRESSURE) {
+    double beyond = condition >= 0 ? raised - condition : 1e9;   // raised without the condition: counts as late
+    r.beyondSum += beyond;
+    if (beyond > r.beyondMax) {
+      r.beyondMax = beyond;
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  int phases = argc > 1 ? atoi(argv[1]) : 8;
+  const char *NAMES[] = { "high pressure", "disconnect", "apnea", "low pressure" };
+  const double bound = SIM_TICK_US * 1e-6 + 1e-7;
+  bool ok = true;
+
+  printf("Fault injected at %d points through a breath, %g ms control tick\n", phases, SIM_TICK_US / 1000.0);
+  printf("  %-14s %8s %6s %7s %9s   %-21s %s\n", "alarm", "detected", "false", "no resp", "peak",
+         "fault to alarm", "limit to alarm");
+  printf("  %-14s %8s %6s %7s %9s   %-21s %s\n", "", "", "", "", "cmH2O", "mean      worst", "mean      worst");
+  for (int f = FAULT_HIGH_PRESSURE; f <= FAULT_LOW_PRESSURE; f++) {
+    FaultResult r = { 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+    for (int k = 0; k < phases; k++) {
+      LungParams params;
+      setUp((Fault) f, params);
+      run((Fault) f, 60.0 / respRate * k / phases, r);
+    }
+    printf("  %-14s %5lu/%-2lu %6lu %7lu %9.1f   %6.0f ms %8.0f ms", NAMES[f], r.detected, r.runs, r.falseAlarms,
+           r.noResponse, r.peakPressure, r.detected ? r.detectSum / r.detected * 1000 : 0, r.detectMax * 1000);
+    if (f != FAULT_LOW_PRESSURE && r.detected) {
+      printf("   %6.1f ms %6.1f ms", r.beyondSum / r.detected * 1000, r.beyondMax * 1000);
+    } else {
+      printf("          -         -");
+    }
+    bool good = r.detected == r.runs && r.falseAlarms == 0 && r.noResponse == 0 && r.beyondMax <= bound;
+    printf("%s\n", good ? "" : "  FAIL");
+    ok = ok && good;
+  }
+  printf("  (limit to alarm is bounded by one control tick, %g ms)\n", SIM_TICK_US / 1000.0);
+  return ok ? 0 : 1;
+}
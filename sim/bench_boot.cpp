@@ -0,0 +1,295 @@
+/* bench_boot - start-up time, and the settings kept in EEPROM (ventilator/settings_store.h) through resets
+   Each "reset" here is simPowerCycle(): the host and the lung start again, the EEPROM keeps what was written, and the
+   controller's settings go back to their initial values as its RAM would.
+     boot       - reset to the first control tick (the first breath starts on it), from the controller's own report,
+                  with an erased EEPROM and with settings to restore .. beside V40, which tested the LEDs and held the
+                  splash screen first
+     restore    - settings committed, reset: the committed settings are back, and the first breath runs at them
+     torn write - a commit cut off by a reset after each number of bytes in turn: the old settings come back until the
+                  record is complete, then the new ones, and never anything else
+     corrupt    - a bit flipped in the newest record: the one before it comes back
+     range      - a valid record with a rate the menu cannot set: the defaults are used
+     blank      - a zeroed EEPROM: the defaults are used
+     calibration- a calibration map stored, reset: it is back. Cut off half way through a second map: the first comes
+                  back. A map that is out of order: not calibrated
+     wear       - the most any one EEPROM byte has been written over many commits
+   Exits 1 if any of these is wrong, or boot takes longer than 300 ms.
+   Usage : bench_boot [commits]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim_harness.h"
+#include "host_clock.h"
+#include "settings_store.h"
+#include "vent_params.h"
+#include "calibration.h"
+
+// From ventilator.cpp
+extern int currentMode;
+extern int respRate;
+extern int newRespRate;
+extern int tidal;
+extern int newTidal;
+extern float iERatio;
+extern float newIERatio;
+extern int targetInspPressure;
+extern int newInspPressure;
+extern int uiState;
+extern volatile unsigned long firstTickUs;     // with bootReported, RAM that a reset clears
+extern bool bootReported;
+extern bool settingsRestored;
+extern bool calibrationRestored;
+extern CalibrationMap calibrationMap;
+extern VentParams params;
+void commitSettings();
+
+// Defaults from ventilator.cpp
+const int MODE_IPPV = 0;
+const int MODE_PCV = 2;
+const int RESP_RATE_DEFAULT = 20;
+const int TIDAL_DEFAULT = 250;
+const float I_E_RATIO_DEFAULT = 1;
+const int INSP_PRESS_DEFAULT = 15;
+const int UI_IDLE = 0;
+
+const double V40_BOOT_MS = 5955;          // reset to first tick with V40 in this harness (LED test, then 2 s splash)
+const long BOOT_LIMIT_MS = 300;
+const double WRITE_STEP_S = 0.0005;
+const double COMMIT_WAIT_S = 0.2;
+const double CALIBRATION_WAIT_S = 1;      // a map is 73 bytes, one per 10 ms serial task .. ~730 ms
+const char BOOT_REPORT[] = "boot: ventilating ";
+
+struct Settings {
+  int mode;
+  int respRate;
+  int tidal;
+  float iERatio;
+  int inspPressure;
+};
+
+const Settings SETTINGS_A = { MODE_IPPV, 12, 400, 2.0f, 15 };
+const Settings SETTINGS_B = { MODE_PCV, 25, 550, 0.6f, 18 };
+const Settings DEFAULTS = { MODE_IPPV, RESP_RATE_DEFAULT, TIDAL_DEFAULT, I_E_RATIO_DEFAULT, INSP_PRESS_DEFAULT };
+
+static LungParams lung;
+static char bootLine[256];
+static int bootLineLength = 0;
+static long reportedBootMs = -1;                  // from the controller's "boot: ventilating N ms after reset"
+
+// The controller's text and its telemetry frames share the line .. look for the report anywhere in what came before
+// each newline
+static void onSerial(uint8_t c) {
+  if (c == '\n') {
+    const char *report = (const char *) memmem(bootLine, bootLineLength, BOOT_REPORT, strlen(BOOT_REPORT));
+    if (report) {
+      reportedBootMs = atol(report + strlen(BOOT_REPORT));
+    }
+    bootLineLength = 0;
+  } else if (bootLineLength < (int) sizeof(bootLine) - 1) {
+    bootLine[bootLineLength++] = c;
+    bootLine[bootLineLength] = 0;
+  } else {
+    bootLineLength = 0;
+  }
+}
+
+static void apply(const Settings &s) {
+  currentMode = s.mode;
+  respRate = newRespRate = s.respRate;
+  tidal = newTidal = s.tidal;
+  iERatio = newIERatio = s.iERatio;
+  targetInspPressure = newInspPressure = s.inspPressure;
+}
+
+static bool matches(const Settings &s) {
+  return currentMode == s.mode && respRate == s.respRate && tidal == s.tidal &&
+         (int) (iERatio * 10 + 0.5f) == (int) (s.iERatio * 10 + 0.5f) && targetInspPressure == s.inspPressure &&
+         params.mode == s.mode && params.respRate == s.respRate;
+}
+
+// A reset: RAM back to its initial values, then setup() .. the EEPROM is as the last run left it
+static void reset(bool erase) {
+  apply(DEFAULTS);
+  memset(&calibrationMap, 0, sizeof(calibrationMap));
+  calibrationRestored = false;
+  firstTickUs = 0;
+  bootReported = false;
+  reportedBootMs = -1;
+  if (erase) {
+    simBegin(lung);
+  } else {
+    simPowerCycle(lung);
+  }
+}
+
+// Commit from the menu's side, and give the record time to go in .. a byte per pass of loop() at most, and a pass can
+// take several ms while the display is being redrawn
+static void commit(const Settings &s) {
+  apply(s);
+  commitSettings();
+  simRunSeconds(COMMIT_WAIT_S);
+}
+
+// A map as a sweep might leave it .. drive evenly spread, pressure rising with it
+static void makeMap(CalibrationMap &map, uint16_t pressureStep) {
+  memset(&map, 0, sizeof(map));
+  map.points = CALIBRATION_POINTS;
+  map.unsettled = 1;
+  for (uint8_t i = 0; i < CALIBRATION_POINTS; i++) {
+    map.drive[i] = i * 1023 / (CALIBRATION_POINTS - 1);
+    map.pressure[i] = i * pressureStep;
+  }
+}
+
+// Which settings the controller has
+static const char *current() {
+  if (matches(SETTINGS_A)) {
+    return "A";
+  }
+  if (matches(SETTINGS_B)) {
+    return "B";
+  }
+  if (matches(DEFAULTS)) {
+    return "defaults";
+  }
+  return "other";
+}
+
+int main(int argc, char **argv) {
+  int commits = argc > 1 ? atoi(argv[1]) : 1000;
+  bool ok = true;
+  lungDefaults(lung);
+  hostSetSerialSink(onSerial);
+
+  // Boot
+  reset(true);
+  simRunSeconds(0.5);
+  long blankBoot = reportedBootMs;
+  bool blankDefaults = matches(DEFAULTS) && !settingsRestored;
+  while (uiState != UI_IDLE) {
+    simRunSeconds(0.01);
+  }
+  double selfTest = simSeconds();
+  commit(SETTINGS_A);
+  reset(false);
+  simRunSeconds(0.5);
+  long restoredBoot = reportedBootMs;
+  printf("boot       %ld ms erased, %ld ms restoring settings  (V40 %.0f ms; self-test and splash over at %.2f s)\n",
+         blankBoot, restoredBoot, V40_BOOT_MS, selfTest);
+  if (blankBoot < 0 || blankBoot > BOOT_LIMIT_MS || restoredBoot < 0 || restoredBoot > BOOT_LIMIT_MS || !blankDefaults) {
+    ok = false;
+  }
+
+  // Restore, and the breaths that follow
+  bool restored = matches(SETTINGS_A) && settingsRestored;
+  printf("restore    %s restored%s\n", current(), restored ? "" : " (WRONG)");
+  ok = ok && restored;
+
+  // A commit cut off after each number of bytes
+  printf("torn write bytes 0..%u:", SETTINGS_STORE_SLOT_BYTES);
+  bool torn = true;
+  for (int cut = 0; cut <= SETTINGS_STORE_SLOT_BYTES; cut++) {
+    reset(true);
+    commit(SETTINGS_A);
+    unsigned long writes = hostCounters().eepromWrites;
+    apply(SETTINGS_B);
+    commitSettings();
+    while (hostCounters().eepromWrites - writes < (unsigned long) cut) {
+      simRunSeconds(WRITE_STEP_S);
+    }
+    reset(false);
+    const Settings &expected = (cut == SETTINGS_STORE_SLOT_BYTES) ? SETTINGS_B : SETTINGS_A;
+    printf(" %s", current());
+    if (!matches(expected)) {
+      printf("(WRONG)");
+      torn = false;
+    }
+  }
+  printf("\n");
+  ok = ok && torn;
+
+  // The newest record corrupted
+  reset(true);
+  commit(SETTINGS_A);
+  commit(SETTINGS_B);
+  hostEeprom()[SETTINGS_STORE_BASE + SETTINGS_STORE_SLOT_BYTES + 3] ^= 0x10;   // B went into the second slot
+  reset(false);
+  bool corrupt = matches(SETTINGS_A);
+  printf("corrupt    newest record bad: %s restored%s\n", current(), corrupt ? "" : " (WRONG)");
+  ok = ok && corrupt;
+
+  // A good record of a bad setting
+  reset(true);
+  StoredSettings wild = { MODE_IPPV, 99, 400, 10, 15 };
+  settingsStoreSave(wild);
+  simRunSeconds(COMMIT_WAIT_S);
+  reset(false);
+  bool range = matches(DEFAULTS) && !settingsRestored;
+  printf("range      rate 99 stored: %s%s\n", current(), range ? "" : " (WRONG)");
+  ok = ok && range;
+
+  // All zeros
+  reset(true);
+  memset(hostEeprom(), 0, HOST_EEPROM_BYTES);
+  reset(false);
+  bool blank = matches(DEFAULTS) && !settingsRestored;
+  printf("blank      zeroed EEPROM: %s%s\n", current(), blank ? "" : " (WRONG)");
+  ok = ok && blank;
+
+  // The calibration map
+  CalibrationMap first, second;
+  makeMap(first, 40);
+  makeMap(second, 50);
+  reset(true);
+  calibrationStoreSave(first);
+  simRunSeconds(CALIBRATION_WAIT_S);
+  reset(false);
+  bool mapKept = calibrationRestored && memcmp(&calibrationMap, &first, sizeof(first)) == 0;
+  unsigned long writes = hostCounters().eepromWrites;
+  calibrationStoreSave(second);
+  while (hostCounters().eepromWrites - writes < CALIBRATION_STORE_SLOT_BYTES / 2) {
+    simRunSeconds(WRITE_STEP_S);
+  }
+  reset(false);
+  bool mapTorn = calibrationRestored && memcmp(&calibrationMap, &first, sizeof(first)) == 0;
+  reset(true);
+  second.drive[3] = second.drive[2];
+  calibrationStoreSave(second);
+  simRunSeconds(CALIBRATION_WAIT_S);
+  reset(false);
+  bool mapRange = !calibrationRestored && calibrationMap.points == 0;
+  printf("calibration map %s, cut off: %s, out of order: %s\n", mapKept ? "restored" : "LOST (WRONG)",
+         mapTorn ? "first restored" : "WRONG", mapRange ? "not calibrated" : "WRONG");
+  ok = ok && mapKept && mapTorn && mapRange;
+
+  // Wear
+  reset(true);
+  for (int i = 0; i < commits; i++) {
+    commit((i & 1) ? SETTINGS_B : SETTINGS_A);
+    commit((i & 1) ? SETTINGS_B : SETTINGS_A);    // unchanged .. not written again
+  }
+  unsigned long most = 0;
+  unsigned long total = 0;
+  for (int a = 0; a < HOST_EEPROM_BYTES; a++) {
+    unsigned long w = hostEepromCellWrites(a);
+    total += w;
+    if (w > most) {
+      most = w;
+    }
+  }
+  unsigned long fair = (commits + SETTINGS_STORE_SLOTS - 1) / SETTINGS_STORE_SLOTS;
+  reset(false);
+  bool last = matches((commits & 1) ? SETTINGS_A : SETTINGS_B) || commits == 0;
+  printf("wear       %d commits: %lu bytes written, at most %lu times to any one byte (%lu without levelling)%s\n",
+         commits, total, most, (unsigned long) commits, last ? "" : " (last commit not restored)");
+  if (most > fair || total != (unsigned long) commits * SETTINGS_STORE_SLOT_BYTES || !last) {
+    ok = false;
+  }
+
+  if (!ok) {
+    printf("FAIL: boot too slow, or settings or calibration not kept as they should be\n");
+  }
+  return ok ? 0 : 1;
+}
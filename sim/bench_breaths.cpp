@@ -0,0 +1,33 @@
+/* bench_breaths - simulated breaths per second of wall clock
+   Usage : bench_breaths [breaths]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "sim_harness.h"
+
+static double wallSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+  unsigned long breaths = argc > 1 ? strtoul(argv[1], 0, 10) : 2000;
+
+  LungParams params;
+  lungDefaults(params);
+  simBegin(params);
+
+  double start = wallSeconds();
+  simRunBreaths(breaths);
+  double elapsed = wallSeconds() - start;
+
+  printf("breaths            %lu\n", simBreaths());
+  printf("simulated time     %.1f s\n", simSeconds());
+  printf("wall time          %.3f s\n", elapsed);
+  printf("breaths per second %.0f\n", simBreaths() / elapsed);
+  printf("real-time factor   %.0fx\n", simSeconds() / elapsed);
+  return 0;
+}
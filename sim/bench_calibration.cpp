@@ -0,0 +1,185 @@
+/* bench_calibration - the automatic actuator calibration (ventilator/calibration.h) against actuators of known shape
+   For each actuator the lung model is given a deadband and a curve, the calibration is started from the front panel
+   (select held for 5 s) and run to the end, and the fitted map is checked against the model's true pressure for each
+   drive. Then PCV at each target is run with and without the map.
+     time     - from the sweep starting to the map being ready
+     map err  - worst error, over 8 - 35 cmH2O, of the pressure the map's drive actually holds .. beside the same for
+                the uncalibrated assumption that pressure is proportional to drive
+     PCV      - how far the pressure loop has had to move the drive from its feedforward by the end of the inhale, in
+                actuator counts, uncalibrated and calibrated .. the feedforward is the map's drive for the set pressure
+                the calibrated runs take the map from EEPROM through a reset, as a unit would
+   Exits 1 if a calibration did not finish, its map is out by more than 0.5 cmH2O, or the calibrated PCV correction is
+   not well under the uncalibrated one (half, and CORRECTION_SLACK over the three targets for the loop's own trim).
+   Usage : bench_calibration
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "sim_harness.h"
+#include "host_clock.h"
+#include "calibration.h"
+#include "vent_params.h"
+#include "drive.h"
+#include "settings_store.h"
+
+// From ventilator.cpp
+extern CalibrationMap calibrationMap;
+extern bool calibrationRestored;
+extern int currentMode;
+extern int targetInspPressure;
+extern int breathState;
+extern int uiState;
+extern VentParams params;
+uint16_t pressureToFiltered(int pressure);
+
+const int MODE_IPPV = 0;
+const int MODE_PCV = 2;
+const int INHALE_STATE = 0;
+const int EXHALE_STATE = 1;
+const int UI_IDLE = 0;
+const double ENTER_CALIBRATION_S = 5.5;           // ENTER_CALIBRATION, and a little
+const double CALIBRATION_TIMEOUT_S = 200;
+const double MAP_TOLERANCE = 0.5;                 // cmH2O
+const int SETTLE_STEPS = 20000;
+const float SETTLE_STEP_S = 0.001f;
+const double STORE_WAIT_S = 2;                   // a map into EEPROM, and plenty over
+const int CORRECTION_SLACK = 30;                  // actuator counts over the three targets .. the loop's own trim
+
+struct Actuator {
+  const char *name;
+  float deadband;
+  float exponent;
+  float noise;
+};
+
+const Actuator ACTUATORS[] = {
+  { "proportional", 0, 1.0f, 0 },
+  { "deadband 10%", 0.10f, 1.0f, 0 },
+  { "curve ^1.6", 0, 1.6f, 0 },
+  { "curve ^0.7", 0, 0.7f, 0 },
+  { "both, noisy", 0.08f, 1.4f, 0.3f },
+};
+const int PCV_TARGETS[] = { 10, 20, 30 };
+
+static LungParams lungFor(const Actuator &a) {
+  LungParams lung;
+  lungDefaults(lung);
+  lung.actuatorDeadband = a.deadband;
+  lung.actuatorExponent = a.exponent;
+  lung.sensorNoise = a.noise;
+  return lung;
+}
+
+// Pressure the model settles to at a drive value, held .. a little under the bag pressure, as the exhalation valve
+// lets go whenever the bag stops pushing
+static double truePressure(const LungParams &model, double drive) {
+  LungParams quiet = model;
+  quiet.sensorNoise = 0;
+  Lung lung;
+  lungReset(lung, quiet);
+  for (int i = 0; i < SETTLE_STEPS; i++) {
+    lungStep(lung, drive / 1023.0f, SETTLE_STEP_S);
+  }
+  return lung.airwayPressure;
+}
+
+// Drive the pressure loop holds at the end of a PCV inhale, less the feedforward. With a map, it goes into EEPROM and
+// the unit is reset, so that setup() restores it as it would on a unit .. simBegin() alone erases the EEPROM, and the map
+// with it
+static int pcvCorrection(const LungParams &lung, int target, const CalibrationMap *map) {
+  currentMode = MODE_PCV;
+  targetInspPressure = target;
+  simBegin(lung);
+  if (map) {
+    calibrationStoreSave(*map);
+    simRunSeconds(STORE_WAIT_S);
+    simPowerCycle(lung);
+    if (!calibrationRestored) {
+      printf("map not restored from EEPROM\n");
+      exit(1);
+    }
+  }
+  simRunBreaths(2);
+  while (breathState != INHALE_STATE) {
+    simRunSeconds(0.001);
+  }
+  int held = 0;
+  while (breathState == INHALE_STATE) {
+    held = simActuatorDrive();
+    simRunSeconds(0.001);
+  }
+  currentMode = MODE_IPPV;
+  return held - driveScale(1023, params.pcvDriveGain);
+}
+
+int main() {
+  bool ok = true;
+  printf("                                          map err cmH2O       PCV correction at 10/20/30 cmH2O\n");
+  printf("actuator        time    points unsettled  calibrated (uncal.)  uncalibrated      calibrated\n");
+  for (const Actuator &a : ACTUATORS) {
+    LungParams lung = lungFor(a);
+    int uncalibrated[3];
+    for (int t = 0; t < 3; t++) {
+      uncalibrated[t] = pcvCorrection(lung, PCV_TARGETS[t], 0);
+    }
+
+    currentMode = MODE_IPPV;
+    simBegin(lung);
+    while (uiState != UI_IDLE) {                  // past the self-test .. select would only skip it
+      simRunSeconds(0.1);
+    }
+    double pressStart = simSeconds();
+    simPressButton(ENTER_CALIBRATION_S);
+    double start = pressStart + ENTER_CALIBRATION_S - 0.5;
+    while (calibrationMap.points == 0 && simSeconds() - start < CALIBRATION_TIMEOUT_S) {
+      simRunSeconds(0.1);
+    }
+    double elapsed = simSeconds() - start;
+    simRunBreaths(2);                             // the map went over with a settings commit .. let it be adopted, so that it
+                                                  // does not turn up in the next run (static state outlives simBegin())
+    if (calibrationMap.points == 0) {
+      printf("%-14s did not finish in %.0f s\n", a.name, CALIBRATION_TIMEOUT_S);
+      ok = false;
+      continue;
+    }
+
+    double worst = 0;
+    double worstLinear = 0;
+    for (int target = 8; target <= 35; target++) {
+      double drive = calibrationDriveFor(calibrationMap, pressureToFiltered(target));
+      double error = truePressure(lung, drive) - target;
+      double linear = truePressure(lung, target * 1023.0 / lung.sourcePressureMax) - target;
+      if (fabs(error) > fabs(worst)) {
+        worst = error;
+      }
+      if (fabs(linear) > fabs(worstLinear)) {
+        worstLinear = linear;
+      }
+    }
+    if (fabs(worst) > MAP_TOLERANCE) {
+      ok = false;
+    }
+    CalibrationMap map = calibrationMap;
+
+    int calibrated[3];
+    int uncalibratedTotal = 0;
+    int calibratedTotal = 0;
+    for (int t = 0; t < 3; t++) {
+      calibrated[t] = pcvCorrection(lung, PCV_TARGETS[t], &map);
+      uncalibratedTotal += abs(uncalibrated[t]);
+      calibratedTotal += abs(calibrated[t]);
+    }
+    if (calibratedTotal > uncalibratedTotal / 2 + CORRECTION_SLACK) {
+      ok = false;                                 // the map has not taken work off the pressure loop
+    }
+    printf("%-14s %5.1f s  %4u  %6u      %+5.2f (%+6.2f)     %+4d %+4d %+4d    %+4d %+4d %+4d\n", a.name,
+           elapsed, map.points, map.unsettled, worst, worstLinear, uncalibrated[0], uncalibrated[1], uncalibrated[2],
+           calibrated[0], calibrated[1], calibrated[2]);
+  }
+  if (!ok) {
+    printf("FAIL: a calibration did not finish, its map is out by more than %.1f cmH2O, or PCV does not use it\n",
+           MAP_TOLERANCE);
+  }
+  return ok ? 0 : 1;
+}
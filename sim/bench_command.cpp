@@ -0,0 +1,332 @@
+/* bench_command - the serial command protocol (ventilator/command.h) from outside, over a pseudo-terminal
+   Starts ventpty (the controller in real time on a pty) and talks to it through the terminal as a test rig would:
+     round trip  - one command at a time, GET and STATUS in turn: wall-clock time from the first byte written to the
+                   whole reply read
+     throughput  - commands kept in flight, as many as fit in the controller's RX buffer: replies per second
+     sweep       - the respiratory rate set to each of a list in turn: the reply carries the new rate, the control tick
+                   takes it up at the next breath (pending clears), and the breaths from then on are that long (the
+                   period in the breath telemetry .. the breath that was under way when it was taken up may come first)
+     refused     - a rate out of range, a parameter that does not exist, a short payload, a command that does not exist
+                   and a frame with a bad CRC: the right status (no reply at all for the bad CRC), and the settings left
+                   as they were
+   The controller's telemetry and text share the line .. only the reply frames are looked at.
+   Exits 1 if a reply is lost or wrong, a set is not taken up or the breaths do not follow it, or a refused command
+   changes anything.
+   Usage : bench_command [round_trips] [throughput_seconds]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <algorithm>
+#include <sys/wait.h>
+#include "telemetry_decoder.h"
+#include "command.h"
+#include "breath_metrics.h"
+#include "sim_harness.h"
+
+const int REPLY_TIMEOUT_MS = 1000;
+const int ADOPT_TIMEOUT_MS = 10000;             // the longest breath, and then some
+const int PERIOD_TOLERANCE_TICKS = 1;
+const int WINDOW = 8;                           // GET frames in flight .. 48 bytes, inside the 64-byte RX buffer
+const int SWEEP_RATES[] = { 30, 25, 20 };
+const double ROUND_TRIP_LIMIT_MS = 50;
+
+static int tty = -1;
+static TelemetryDecoder decoder;
+static uint8_t sequence = 0;
+static unsigned long breathFrames = 0;          // TELEMETRY_FRAME_BREATH frames seen, and the last one's period
+static uint16_t breathPeriodTicks = 0;
+
+static double wallMs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
+
+static void sendFrame(uint8_t type, const uint8_t *payload, uint8_t length, bool corrupt = false) {
+  uint8_t frame[COMMAND_MAX_PAYLOAD + TELEMETRY_FRAME_OVERHEAD];
+  uint8_t crc = telemetryCrc8(telemetryCrc8(0, type), length);
+  frame[0] = TELEMETRY_SYNC_1;
+  frame[1] = TELEMETRY_SYNC_2;
+  frame[2] = type;
+  frame[3] = length;
+  for (uint8_t i = 0; i < length; i++) {
+    frame[4 + i] = payload[i];
+    crc = telemetryCrc8(crc, payload[i]);
+  }
+  frame[4 + length] = corrupt ? crc ^ 0x01 : crc;
+  if (write(tty, frame, length + TELEMETRY_FRAME_OVERHEAD) != length + TELEMETRY_FRAME_OVERHEAD) {
+    perror("bench_command: write");
+  }
+}
+
+static uint8_t sendCommand(uint8_t type) {
+  uint8_t seq = ++sequence;
+  sendFrame(type, &seq, 1);
+  return seq;
+}
+
+static uint8_t sendSet(uint8_t param, int value) {
+  uint8_t payload[4] = { ++sequence, param, (uint8_t) (value & 0xFF), (uint8_t) ((value >> 8) & 0xFF) };
+  sendFrame(COMMAND_SET, payload, sizeof(payload));
+  return sequence;
+}
+
+struct Reply {
+  uint8_t seq, type, status;
+  uint8_t data[COMMAND_REPLY_MAX];
+  uint8_t length;
+};
+
+// Replies are queued here as they are decoded, so that several can come in one read
+static Reply queue[64];
+static int queued = 0;
+
+static bool nextReply(Reply &r, int timeoutMs) {
+  double end = wallMs() + timeoutMs;
+  for (;;) {
+    if (queued > 0) {
+      r = queue[0];
+      memmove(queue, queue + 1, (queued - 1) * sizeof(Reply));
+      queued--;
+      return true;
+    }
+    int left = (int) (end - wallMs());
+    if (left <= 0) {
+      return false;
+    }
+    struct pollfd p = { tty, POLLIN, 0 };
+    if (poll(&p, 1, left) <= 0) {
+      continue;
+    }
+    uint8_t in[256];
+    ssize_t n = read(tty, in, sizeof(in));
+    for (ssize_t i = 0; i < n; i++) {
+      if (telemetryDecoderFeed(decoder, in[i]) != TELEMETRY_DECODE_FRAME) {
+        continue;
+      }
+      BreathMetrics metrics;
+      if (decoder.type == TELEMETRY_FRAME_BREATH && telemetryDecodeBreath(decoder, metrics)) {
+        breathFrames++;
+        breathPeriodTicks = metrics.periodTicks;
+      } else if (decoder.type == TELEMETRY_FRAME_REPLY && decoder.length >= 3 && queued < 64) {
+        Reply &q = queue[queued++];
+        q.seq = decoder.payload[0];
+        q.type = decoder.payload[1];
+        q.status = decoder.payload[2];
+        q.length = decoder.length;
+        memcpy(q.data, decoder.payload, decoder.length);
+      }
+    }
+  }
+}
+
+// Wait for the reply to seq, skipping any older ones still on their way
+static bool replyTo(uint8_t seq, Reply &r, int timeoutMs = REPLY_TIMEOUT_MS) {
+  double end = wallMs() + timeoutMs;
+  while (nextReply(r, std::max(0, (int) (end - wallMs())))) {
+    if (r.seq == seq) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static int replyRate(const Reply &r) {
+  return r.data[4];
+}
+
+static int replyPending(const Reply &r) {
+  return r.data[9];
+}
+
+static pid_t startVentpty(const char *self, char *path, size_t pathSize) {
+  char program[512];
+  snprintf(program, sizeof(program), "%s", self);
+  char *slash = strrchr(program, '/');
+  snprintf(slash ? slash + 1 : program, sizeof(program) - (slash ? slash + 1 - program : 0), "ventpty");
+  int out[2];
+  if (pipe(out) != 0) {
+    return -1;
+  }
+  pid_t pid = fork();
+  if (pid == 0) {
+    dup2(out[1], 1);
+    close(out[0]);
+    execl(program, program, (char *) 0);
+    perror("bench_command: ventpty");
+    _exit(127);
+  }
+  close(out[1]);
+  FILE *f = fdopen(out[0], "r");
+  char line[512];
+  path[0] = 0;
+  if (f && fgets(line, sizeof(line), f) && sscanf(line, "ventpty: %511s", line) == 1) {
+    snprintf(path, pathSize, "%s", line);
+  }
+  return pid;
+}
+
+int main(int argc, char **argv) {
+  int roundTrips = argc > 1 ? atoi(argv[1]) : 200;
+  double throughputS = argc > 2 ? atof(argv[2]) : 3;
+  bool ok = true;
+
+  char path[512];
+  pid_t ventpty = startVentpty(argv[0], path, sizeof(path));
+  tty = path[0] ? open(path, O_RDWR | O_NOCTTY | O_NONBLOCK) : -1;
+  if (ventpty < 0 || tty < 0) {
+    fprintf(stderr, "bench_command: no controller on a pty\n");
+    if (ventpty > 0) {
+      kill(ventpty, SIGTERM);
+    }
+    return 1;
+  }
+  telemetryDecoderReset(decoder);
+
+  // Round trip
+  double latency[4096];
+  int answered = 0;
+  int wrong = 0;
+  roundTrips = std::min(roundTrips, 4096);
+  for (int i = 0; i < roundTrips; i++) {
+    uint8_t type = (i & 1) ? COMMAND_STATUS : COMMAND_GET;
+    double start = wallMs();
+    uint8_t seq = sendCommand(type);
+    Reply r;
+    if (!replyTo(seq, r)) {
+      continue;
+    }
+    latency[answered++] = wallMs() - start;
+    if (r.type != type || r.status != COMMAND_STATUS_OK || r.length != COMMAND_GET_REPLY_BYTES) {
+      wrong++;
+    }
+  }
+  std::sort(latency, latency + answered);
+  double sum = 0;
+  for (int i = 0; i < answered; i++) {
+    sum += latency[i];
+  }
+  bool roundTripOk = answered == roundTrips && wrong == 0 && answered > 0 &&
+                     latency[answered * 99 / 100] <= ROUND_TRIP_LIMIT_MS;
+  printf("round trip   %d/%d answered, %d wrong: %.2f / %.2f / %.2f / %.2f ms (min / mean / 99%% / max)%s\n", answered,
+         roundTrips, wrong, answered ? latency[0] : 0, answered ? sum / answered : 0,
+         answered ? latency[answered * 99 / 100] : 0, answered ? latency[answered - 1] : 0, roundTripOk ? "" : "  FAIL");
+  ok = ok && roundTripOk;
+
+  // Throughput .. WINDOW in flight, another sent as each reply comes back
+  double start = wallMs();
+  double end = start + throughputS * 1000;
+  int inFlight = 0;
+  unsigned long replies = 0;
+  unsigned long lost = 0;
+  while (wallMs() < end) {
+    while (inFlight < WINDOW) {
+      sendCommand(COMMAND_GET);
+      inFlight++;
+    }
+    Reply r;
+    if (nextReply(r, REPLY_TIMEOUT_MS)) {
+      replies++;
+      inFlight--;
+    } else {
+      lost += inFlight;                          // whatever was in flight is not coming back
+      inFlight = 0;
+    }
+  }
+  Reply r;
+  while (inFlight > 0 && nextReply(r, REPLY_TIMEOUT_MS)) {
+    inFlight--;
+  }
+  double elapsed = (wallMs() - start) / 1000;
+  bool throughputOk = lost == 0 && inFlight == 0;
+  printf("throughput   %.0f commands/s, %d in flight (%lu replies in %.1f s, %lu lost)%s\n", replies / elapsed, WINDOW,
+         replies, elapsed, lost, throughputOk ? "" : "  FAIL");
+  ok = ok && throughputOk;
+
+  // Sweep
+  printf("sweep       ");
+  bool sweepOk = true;
+  for (size_t i = 0; i < sizeof(SWEEP_RATES) / sizeof(SWEEP_RATES[0]); i++) {
+    int rate = SWEEP_RATES[i];
+    long periodTicks = 60000000L / rate / SIM_TICK_US;
+    double setAt = wallMs();
+    Reply r;
+    bool set = replyTo(sendSet(COMMAND_PARAM_RESP_RATE, rate), r) && r.status == COMMAND_STATUS_OK &&
+               replyRate(r) == rate;
+    bool adopted = false;
+    while (set && wallMs() - setAt < ADOPT_TIMEOUT_MS) {
+      if (replyTo(sendCommand(COMMAND_GET), r) && replyRate(r) == rate && !replyPending(r)) {
+        adopted = true;
+        break;
+      }
+      usleep(20000);
+    }
+    // The first breath from the adoption on ends with the second breath frame at the latest
+    double adoptedAt = wallMs();
+    unsigned long framesAtAdoption = breathFrames;
+    unsigned long framesSeen = framesAtAdoption;
+    bool onRate = false;
+    while (adopted && !onRate && breathFrames < framesAtAdoption + 2 && wallMs() - adoptedAt < ADOPT_TIMEOUT_MS) {
+      nextReply(r, 20);                          // nothing is outstanding .. this only reads the telemetry
+      if (breathFrames != framesSeen) {
+        framesSeen = breathFrames;
+        onRate = abs(breathPeriodTicks - periodTicks) <= PERIOD_TOLERANCE_TICKS;
+      }
+    }
+    printf("%s %d bpm ", i > 0 ? "," : "", rate);
+    if (!set) {
+      printf("(not set)");
+    } else if (!adopted) {
+      printf("(not taken up)");
+    } else if (!onRate) {
+      printf("in %.2f s (then %.2f s breaths, not %.2f s)", (adoptedAt - setAt) / 1000,
+             breathPeriodTicks * (SIM_TICK_US * 1e-6), periodTicks * (SIM_TICK_US * 1e-6));
+    } else {
+      printf("in %.2f s (then %.2f s breaths)", (adoptedAt - setAt) / 1000, breathPeriodTicks * (SIM_TICK_US * 1e-6));
+    }
+    sweepOk = sweepOk && set && adopted && onRate;
+  }
+  printf("%s\n", sweepOk ? "" : "  FAIL");
+  ok = ok && sweepOk;
+
+  // Refused
+  Reply before;
+  bool refusedOk = replyTo(sendCommand(COMMAND_GET), before);
+  Reply bad;
+  bool range = replyTo(sendSet(COMMAND_PARAM_RESP_RATE, 99), bad) && bad.status == COMMAND_STATUS_RANGE;
+  bool unknownParam = replyTo(sendSet(9, 1), bad) && bad.status == COMMAND_STATUS_UNKNOWN;
+  uint8_t shortSet[3] = { ++sequence, COMMAND_PARAM_TIDAL, 100 };
+  sendFrame(COMMAND_SET, shortSet, sizeof(shortSet));
+  bool shortPayload = replyTo(shortSet[0], bad) && bad.status == COMMAND_STATUS_LENGTH;
+  uint8_t seq = ++sequence;
+  sendFrame(0x7F, &seq, 1);
+  bool unknownCommand = replyTo(seq, bad) && bad.status == COMMAND_STATUS_UNKNOWN;
+  seq = ++sequence;
+  uint8_t tidal[4] = { seq, COMMAND_PARAM_TIDAL, 0x90, 0x01 };
+  sendFrame(COMMAND_SET, tidal, sizeof(tidal), true);
+  bool badCrc = !replyTo(seq, bad, 300);
+  Reply after;
+  refusedOk = refusedOk && replyTo(sendCommand(COMMAND_GET), after);
+  bool unchanged = refusedOk && memcmp(before.data + 3, after.data + 3, COMMAND_GET_REPLY_BYTES - 3) == 0;
+  refusedOk = refusedOk && range && unknownParam && shortPayload && unknownCommand && badCrc && unchanged;
+  printf("refused      range %s, parameter %s, length %s, command %s, bad CRC %s, settings %s%s\n",
+         range ? "ok" : "WRONG", unknownParam ? "ok" : "WRONG", shortPayload ? "ok" : "WRONG",
+         unknownCommand ? "ok" : "WRONG", badCrc ? "ignored" : "ANSWERED", unchanged ? "unchanged" : "CHANGED",
+         refusedOk ? "" : "  FAIL");
+  ok = ok && refusedOk;
+
+  close(tty);
+  kill(ventpty, SIGTERM);
+  waitpid(ventpty, 0, 0);
+  if (!ok) {
+    printf("FAIL: a reply lost or wrong, a set not taken up, or a refused command not refused\n");
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,25 @@
+/* bench_drive - cycle counts of the inhale drive calculation, before and after the fixed-point change
+   The same driveBenchmark() runs on the Uno when RUN_DRIVE_BENCHMARK is set in ventilator.cpp
+   These are host figures only: the fastest of several passes of each tick, with the TSC reads fenced. They show the
+   order of the three - fixed point well under long division + float, the interpolation a few cycles on top - but not
+   what any of them costs on the AVR, which has no divider or FPU. Nothing has been measured on a board yet.
+*/
+
+#include <stdio.h>
+#include <Arduino.h>
+#include "drive.h"
+
+class StdoutPrint : public Print {
+  public:
+    size_t write(uint8_t c) {
+      putchar(c);
+      return 1;
+    }
+    using Print::write;
+};
+
+int main() {
+  StdoutPrint out;
+  driveBenchmark(out, 700);
+  return 0;
+}
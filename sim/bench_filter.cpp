@@ -0,0 +1,74 @@
+/* bench_filter - frequency response and per-sample cost of the pressure filter (ventilator/pressure_filter.h)
+   Feeds sine waves at the pressure sample rate and reports the gain of the fast and slow channels
+*/
+
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include "pressure_adc.h"
+#include "pressure_filter.h"
+
+const double SAMPLE_RATE = PRESSURE_ADC_CONVERSION_HZ / 10.0;   // ADC rate at PRESSURE_SAMPLE_RATE_HZ = 1000
+const double AMPLITUDE = 200;                                   // raw counts, around mid scale
+const double SCALE = 1 << PRESSURE_FILTER_FRACTION_BITS;
+
+static double wallSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void response(double frequency, double &fastDb, double &slowDb) {
+  pressureFilterReset();
+  double settle = 8.0 + 5.0 / frequency;
+  double measure = 2.0 + 5.0 / frequency;
+  long total = (long) ((settle + measure) * SAMPLE_RATE);
+  long start = (long) (settle * SAMPLE_RATE);
+  double fastMin = 1e9, fastMax = -1e9, slowMin = 1e9, slowMax = -1e9;
+
+  for (long n = 0; n < total; n++) {
+    uint16_t raw = (uint16_t) lround(512 + AMPLITUDE * sin(2 * M_PI * frequency * n / SAMPLE_RATE));
+    if (pressureFilterSample(raw) && n >= start) {
+      double fast = pressureFilterFast() / SCALE;
+      double slow = pressureFilterSlow() / SCALE;
+      fastMin = fmin(fastMin, fast);
+      fastMax = fmax(fastMax, fast);
+      slowMin = fmin(slowMin, slow);
+      slowMax = fmax(slowMax, slow);
+    }
+  }
+  fastDb = 20 * log10(fmax(fastMax - fastMin, 1e-3) / (2 * AMPLITUDE));
+  slowDb = 20 * log10(fmax(slowMax - slowMin, 1e-3) / (2 * AMPLITUDE));
+}
+
+int main() {
+  const double FREQUENCIES[] = { 0.1, 0.2, 0.5, 0.8, 1, 2, 5, 10, 20, 50, 100, 200 };
+
+  printf("Pressure filter at %.0f samples/s (fast channel %.0f/s)\n", SAMPLE_RATE, SAMPLE_RATE / PRESSURE_FILTER_DECIMATION);
+  printf("  frequency    fast      slow\n");
+  for (unsigned int i = 0; i < sizeof(FREQUENCIES) / sizeof(FREQUENCIES[0]); i++) {
+    double fastDb, slowDb;
+    response(FREQUENCIES[i], fastDb, slowDb);
+    printf("  %7.1f Hz  %6.1f dB  %6.1f dB\n", FREQUENCIES[i], fastDb, slowDb);
+  }
+
+  // DC accuracy at full scale - the accumulators must not overflow
+  pressureFilterReset();
+  for (int n = 0; n < 20000; n++) {
+    pressureFilterSample(1023);
+  }
+  printf("  full scale in 1023 -> fast %.2f, slow %.2f\n", pressureFilterFast() / SCALE, pressureFilterSlow() / SCALE);
+
+  const long SAMPLES = 50000000;
+  pressureFilterReset();
+  double begin = wallSeconds();
+  uint32_t sink = 0;
+  for (long n = 0; n < SAMPLES; n++) {
+    if (pressureFilterSample((uint16_t) (n & 1023))) {
+      sink += pressureFilterFast();
+    }
+  }
+  double elapsed = wallSeconds() - begin;
+  printf("  host cost %.1f ns per sample (checksum %u)\n", elapsed / SAMPLES * 1e9, sink);
+  return 0;
+}
@@ -0,0 +1,99 @@
+/* bench_hardware - cycle counts of the actuator output for each hardware variant (ventilator/actuator.h), beside the
+   same output written by hand and through a virtual call, and of the whole control tick (ventControlInterrupt()) for the
+   variant this is built as (make variants runs it for each)
+   The same actuatorBenchmark() runs on the Uno when RUN_ACTUATOR_BENCHMARK is set in ventilator.cpp, and the profiler
+   ('p') gives the tick there. The host has no way to hold off the OS, so the actuator writes are each the fastest of
+   several passes; the whole tick is timed once a tick, and its worst case carries a preemption now and then .. compare
+   its means
+
+   These are host figures only. Timer1.setPwmDuty() and ServoTimer2::write() are stand-ins (sim/arduino) that cost a
+   few cycles, so the comparison shows the policy types add nothing over a direct call on x86 - not what either takes
+   on the AVR. Nothing has been measured on a board yet, and the "by hand" writers are written again in
+   actuator_bench.cpp, not the code of the Controller_int_* sketches. make disasm compares the code of the two directly.
+*/
+
+#include <stdio.h>
+#include <Arduino.h>
+#include "host_clock.h"
+#include "sim_harness.h"
+#include "actuator.h"
+#include "pressure_adc.h"
+#include "scheduler.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+// From ventilator.cpp
+void ventControlInterrupt();
+
+const double WARM_UP_S = 10;          // breaths before the ticks are timed
+const int TIMED_TICKS = 3000;         // 30 s at 100 Hz
+
+class StdoutPrint : public Print {
+  public:
+    size_t write(uint8_t c) {
+      putchar(c);
+      return 1;
+    }
+    using Print::write;
+};
+
+static unsigned long long cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+// The controller breathing the default lung, with the tick fired by hand (as replay does) so that each tick is timed on
+// its own, and only the tick .. the background tasks run in between, as they would
+static void controlTick() {
+  LungParams lung;
+  lungDefaults(lung);
+  simBegin(lung);
+  simRunSeconds(WARM_UP_S);
+  hostSetManualInterrupts(true);
+  uint8_t decimation = (PRESSURE_ADC_CONVERSION_HZ + pressureAdcSampleRate() / 2) / pressureAdcSampleRate();
+  unsigned long samplesPerTick = (pressureAdcSampleRate() * SIM_TICK_US + 500000) / 1000000;
+  if (samplesPerTick < 1) {
+    samplesPerTick = 1;
+  }
+
+  unsigned long long worst = 0;
+  unsigned long long total = 0;
+  for (int i = 0; i < TIMED_TICKS; i++) {
+    for (unsigned long s = 0; s < samplesPerTick; s++) {
+      hostAdvance(SIM_TICK_US / samplesPerTick);
+      for (uint8_t c = 0; c < decimation; c++) {
+        hostFireAdc(simPressureToRaw(simLung().airwayPressure));
+      }
+      schedulerRun();
+    }
+    noInterrupts();
+    unsigned long long start = cycles();
+    ventControlInterrupt();
+    unsigned long long stop = cycles();
+    interrupts();
+    if (stop - start > worst) {
+      worst = stop - start;
+    }
+    total += stop - start;
+  }
+  hostSetManualInterrupts(false);
+
+  const char *ACTUATORS[] = { "PWM", "4-20 mA current loop", "servo" };
+  printf("Control tick (ventControlInterrupt), %s actuator, over %d ticks:\n", ACTUATORS[VENT_ACTUATOR], TIMED_TICKS);
+  printf("  tick                       : worst %llu cycles, mean %llu cycles\n", worst, total / TIMED_TICKS);
+}
+
+int main() {
+  StdoutPrint out;
+  actuatorBenchmark(out);
+  controlTick();
+  return 0;
+}
@@ -0,0 +1,144 @@
+/* bench_pcv - pressure-controlled ventilation against the lung model (ventilator/pressure_control.h)
+   For a range of lungs and target pressures, reports the airway pressure rise time (10 - 90 % of PEEP to target),
+   the overshoot above the target, the error over the last quarter of the inhale and how often the output was pinned.
+   Then times pressureControlStep() on its own.
+   Usage : bench_pcv [rate]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include <time.h>
+#include "sim_harness.h"
+#include "host_clock.h"
+#include "pressure_control.h"
+
+// From ventilator.cpp
+extern int currentMode;
+extern int targetInspPressure;
+extern int respRate;
+extern int newRespRate;
+extern int breathState;
+
+const int MODE_PCV = 2;
+const int INHALE_STATE = 0;
+const int WARM_UP_BREATHS = 3;
+const double SAMPLE_S = 0.001;
+const int MAX_SAMPLES = 20000;
+
+struct PcvResult {
+  double riseTime;            // seconds, 10 - 90 %
+  double overshoot;           // cmH2O above target
+  double plateauError;        // cmH2O, mean over the last quarter of the inhale
+};
+
+static float trace[MAX_SAMPLES];
+static unsigned long long traceAt[MAX_SAMPLES];   // host microseconds .. a step runs on to the end of a loop() pass, so
+                                                  // samples are not SAMPLE_S apart
+
+// Runs one inhale after the warm-up breaths, sampling the airway pressure about every millisecond
+static PcvResult measure(float compliance, float resistance, int target, int rate) {
+  LungParams params;
+  lungDefaults(params);
+  params.compliance = compliance;
+  params.resistance = resistance;
+  currentMode = MODE_PCV;
+  targetInspPressure = target;
+  respRate = newRespRate = rate;
+  simBegin(params);
+  simRunBreaths(WARM_UP_BREATHS);
+
+  float base = simLung().airwayPressure;            // end-expiratory pressure, the inhale has just started
+  int n = 0;
+  while (breathState == INHALE_STATE && n < MAX_SAMPLES) {
+    simRunSeconds(SAMPLE_S);
+    traceAt[n] = hostMicros();
+    trace[n++] = simLung().airwayPressure;
+  }
+
+  PcvResult r;
+  float low = base + 0.1f * (target - base);
+  float high = base + 0.9f * (target - base);
+  int lowAt = -1;
+  int highAt = -1;
+  float peak = base;
+  double plateau = 0;
+  int plateauCount = 0;
+  for (int i = 0; i < n; i++) {
+    if (lowAt < 0 && trace[i] >= low) {
+      lowAt = i;
+    }
+    if (highAt < 0 && trace[i] >= high) {
+      highAt = i;
+    }
+    if (trace[i] > peak) {
+      peak = trace[i];
+    }
+    if (n > 0 && traceAt[i] - traceAt[0] >= (traceAt[n - 1] - traceAt[0]) * 3 / 4) {
+      plateau += trace[i];
+      plateauCount++;
+    }
+  }
+  r.riseTime = (lowAt >= 0 && highAt >= 0) ? (traceAt[highAt] - traceAt[lowAt]) * 1e-6 : NAN;
+  r.overshoot = peak - target > 0 ? peak - target : 0;
+  r.plateauError = plateauCount ? plateau / plateauCount - target : NAN;
+  return r;
+}
+
+static double stepCost() {
+  const int CALLS = 1000000;
+  volatile uint16_t measured = 0;
+  volatile int sink = 0;
+  pressureControlStart(1800, 1300);
+  pressureControlTrack(400, 1023);
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned long long start = __rdtsc();
+#else
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+#endif
+  for (int i = 0; i < CALLS; i++) {
+    measured = 1700 + (i & 255);
+    sink = pressureControlStep(measured);
+  }
+#if defined(__x86_64__) || defined(__i386__)
+  double cost = (double) (__rdtsc() - start) / CALLS;
+#else
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  double cost = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / CALLS;
+#endif
+  pressureControlStop();
+  (void) sink;
+  return cost;
+}
+
+int main(int argc, char **argv) {
+  int rate = argc > 1 ? atoi(argv[1]) : 15;
+  const float COMPLIANCES[] = { 0.02f, 0.05f, 0.08f };
+  const float RESISTANCES[] = { 5.0f, 10.0f, 20.0f };
+  const int TARGETS[] = { 10, 15, 20 };
+
+  printf("PCV at %d bpm, I:E 1:1 - airway pressure during one inhale\n", rate);
+  printf("  C (L/cmH2O)  R (cmH2O/L/s)  target   rise 10-90%%   overshoot   plateau error   saturated steps\n");
+  for (unsigned int c = 0; c < sizeof(COMPLIANCES) / sizeof(COMPLIANCES[0]); c++) {
+    for (unsigned int r = 0; r < sizeof(RESISTANCES) / sizeof(RESISTANCES[0]); r++) {
+      for (unsigned int t = 0; t < sizeof(TARGETS) / sizeof(TARGETS[0]); t++) {
+        uint16_t saturatedBefore = pressureControlSaturated();
+        PcvResult result = measure(COMPLIANCES[c], RESISTANCES[r], TARGETS[t], rate);
+        printf("  %10.2f  %13.0f  %6d  %9.0f ms  %6.2f cmH2O  %+8.2f cmH2O  %8u\n", COMPLIANCES[c], RESISTANCES[r],
+               TARGETS[t], result.riseTime * 1000, result.overshoot, result.plateauError,
+               (uint16_t) (pressureControlSaturated() - saturatedBefore));
+      }
+    }
+  }
+
+#if defined(__x86_64__) || defined(__i386__)
+  printf("pressureControlStep(): %.1f host cycles per call\n", stepCost());
+#else
+  printf("pressureControlStep(): %.1f ns per call\n", stepCost());
+#endif
+  return 0;
+}
@@ -0,0 +1,204 @@
+/* bench_scheduler - the loop() tasks (ventilator/scheduler.h) in spontaneous mode, quiet and with the menu in use
+   Each window starts with 'r' over serial (the task counters cleared) and ends with 's' (the controller's task report):
+     quiet - ventilating, nothing touched
+     menu  - the knob spun through the modes and back, over and over, then the menu clicked through unchanged .. the
+             LCD busy redrawing the whole time
+   For each window: every task's runs against its period, its overruns and missed releases, and the longest run. The
+   yellow LED is watched on its pin throughout: its flash period and on time should not change with what the LCD is doing
+   (with V43 it counted passes of loop(), which the LCD stretched).
+   Exits 1 on an overrun or a missed release in any task, a task that ran less than its period asks, or a flash off by more
+   than a period of the LED task.
+   Usage : bench_scheduler [seconds]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sim_harness.h"
+#include "host_clock.h"
+
+// From ventilator.cpp
+extern int currentMode;
+extern int respRate;
+extern int newRespRate;
+extern int uiState;
+
+// As ventilator.cpp
+const int MODE_SPONTANEOUS = 1;
+const int UI_IDLE = 0;
+const uint8_t SPONTANEOUS_LED = 7;
+const double LED_ON_S = 0.5;
+const double LED_PERIOD_S = 1.0;
+const double LED_TASK_S = 0.02;
+
+const double SAMPLE_S = 0.001;
+const double MENU_PRESS_S = 0.1;
+const double MENU_STEP_S = 0.03;                  // between steps of the knob ..
+const double KNOB_STEP_S = 0.002;                 // .. each over quickly, as the LED is not watched meanwhile
+const int MAX_TASKS = 16;
+const char REPORT[] = "sched: ";
+const int LINE_KEEP = 128;
+
+struct TaskLine {
+  char name[16];
+  unsigned long periodUs;
+  unsigned long budgetUs;
+  unsigned long runs;
+  unsigned long overruns;
+  unsigned long late;
+  unsigned long longestUs;
+};
+
+static TaskLine taskLines[MAX_TASKS];
+static int taskCount = 0;
+static char line[256];
+static int lineLength = 0;
+
+// The report shares the line with telemetry frames .. look for it anywhere in what came before each newline
+static void onSerial(uint8_t c) {
+  if (c == '\n') {
+    const char *report = (const char *) memmem(line, lineLength, REPORT, strlen(REPORT));
+    if (report && taskCount < MAX_TASKS) {
+      TaskLine &t = taskLines[taskCount];
+      if (sscanf(report + strlen(REPORT), "%15s period %lu us budget %lu us runs %lu overruns %lu late %lu longest %lu",
+                 t.name, &t.periodUs, &t.budgetUs, &t.runs, &t.overruns, &t.late, &t.longestUs) == 7) {
+        taskCount++;
+      }
+    }
+    lineLength = 0;
+  } else {
+    if (lineLength == (int) sizeof(line) - 1) {   // a long run of frames .. keep the end, where a report may be starting
+      memmove(line, line + lineLength - LINE_KEEP, LINE_KEEP);
+      lineLength = LINE_KEEP;
+    }
+    line[lineLength++] = c;
+    line[lineLength] = 0;
+  }
+}
+
+// The yellow LED, sampled every SAMPLE_S
+struct Flashes {
+  unsigned long count;                  // whole flashes (rising edge to rising edge)
+  double periodMin, periodMax, periodSum;
+  double onMin, onMax;
+};
+
+static int ledLevel = LOW;
+static double lastRise = -1;
+static double lastFall = -1;
+static Flashes flashes;
+
+static void flashesClear() {
+  memset(&flashes, 0, sizeof(flashes));
+  flashes.periodMin = flashes.onMin = 1e9;
+  lastRise = -1;
+}
+
+static void watch(double seconds) {
+  double end = simSeconds() + seconds;
+  while (simSeconds() < end) {
+    simRunSeconds(SAMPLE_S);
+    int level = hostPinLevel(SPONTANEOUS_LED);
+    double now = simSeconds();
+    if (level == HIGH && ledLevel == LOW) {
+      if (lastRise >= 0 && lastFall > lastRise) {
+        double period = now - lastRise;
+        double on = lastFall - lastRise;
+        flashes.count++;
+        flashes.periodSum += period;
+        flashes.periodMin = fmin(flashes.periodMin, period);
+        flashes.periodMax = fmax(flashes.periodMax, period);
+        flashes.onMin = fmin(flashes.onMin, on);
+        flashes.onMax = fmax(flashes.onMax, on);
+      }
+      lastRise = now;
+    } else if (level == LOW && ledLevel == HIGH) {
+      lastFall = now;
+    }
+    ledLevel = level;
+  }
+}
+
+// Through the modes and back, then click through the rest of the menu with nothing changed
+static void useMenu(double seconds) {
+  double end = simSeconds() + seconds;
+  simPressButton(MENU_PRESS_S);
+  while (simSeconds() < end) {
+    for (int i = 0; i < 2; i++) {
+      simTurnKnob(1, KNOB_STEP_S);
+      watch(MENU_STEP_S);
+    }
+    for (int i = 0; i < 2; i++) {
+      simTurnKnob(-1, KNOB_STEP_S);
+      watch(MENU_STEP_S);
+    }
+  }
+  while (uiState != UI_IDLE) {
+    simPressButton(MENU_PRESS_S);
+  }
+}
+
+static bool window(const char *name, double seconds, bool menu) {
+  hostSerialInput("r");
+  simRunSeconds(0.05);
+  flashesClear();
+  ledLevel = hostPinLevel(SPONTANEOUS_LED);
+  unsigned long lcdBytes = hostCounters().lcdBytes;
+  double start = simSeconds();
+  if (menu) {
+    useMenu(seconds);
+  } else {
+    watch(seconds);
+  }
+  double elapsed = simSeconds() - start;
+  lcdBytes = hostCounters().lcdBytes - lcdBytes;
+  taskCount = 0;
+  hostSerialInput("s");
+  simRunSeconds(0.2);                             // the report out at 115200 baud
+
+  bool ok = taskCount > 0;
+  printf("%s, %.0f s: %.0f LCD bytes per second\n", name, elapsed, lcdBytes / elapsed);
+  printf("  %-10s %9s %9s %8s %8s %9s %6s %10s\n", "task", "period", "budget", "runs/s", "asked", "overruns", "late",
+         "longest");
+  for (int i = 0; i < taskCount; i++) {
+    const TaskLine &t = taskLines[i];
+    double rate = t.runs / elapsed;
+    double asked = 1e6 / t.periodUs;
+    bool starved = t.periodUs * 1e-6 < elapsed / 2 && rate < asked * 0.98;
+    bool good = t.overruns == 0 && t.late == 0 && !starved;
+    printf("  %-10s %6.1f ms %6.1f ms %8.2f %8.2f %9lu %6lu %7.2f ms%s\n", t.name, t.periodUs / 1000.0,
+           t.budgetUs / 1000.0, rate, asked, t.overruns, t.late, t.longestUs / 1000.0, good ? "" : "  FAIL");
+    ok = ok && good;
+  }
+
+  bool led = flashes.count > 0 && fabs(flashes.periodMin - LED_PERIOD_S) <= LED_TASK_S &&
+             fabs(flashes.periodMax - LED_PERIOD_S) <= LED_TASK_S && fabs(flashes.onMin - LED_ON_S) <= LED_TASK_S &&
+             fabs(flashes.onMax - LED_ON_S) <= LED_TASK_S;
+  printf("  yellow LED %lu flashes: period %.0f / %.0f / %.0f ms (min / mean / max), on %.0f - %.0f ms%s\n",
+         flashes.count, flashes.periodMin * 1000, flashes.count ? flashes.periodSum / flashes.count * 1000 : 0,
+         flashes.periodMax * 1000, flashes.onMin * 1000, flashes.onMax * 1000, led ? "" : "  FAIL");
+  return ok && led;
+}
+
+int main(int argc, char **argv) {
+  double seconds = argc > 1 ? atof(argv[1]) : 30;
+  LungParams params;
+  lungDefaults(params);
+  params.effortPeriod = 3;                        // breathing for itself, so no apnea alarm takes the yellow LED
+  currentMode = MODE_SPONTANEOUS;
+  respRate = newRespRate = 15;
+  hostSetSerialSink(onSerial);
+  simBegin(params);
+  while (uiState != UI_IDLE) {
+    simRunSeconds(0.01);                          // past the self-test, which has the LEDs
+  }
+  simRunSeconds(1);
+
+  bool ok = window("quiet", seconds, false);
+  ok = window("menu", seconds, true) && ok;
+  if (!ok) {
+    printf("FAIL: a task overran, missed a release or ran too seldom, or the LED flash moved\n");
+  }
+  return ok ? 0 : 1;
+}
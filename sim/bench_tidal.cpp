@@ -0,0 +1,185 @@
+/* bench_tidal - adaptive tidal drive gain against the lung model (ventilator/tidal_adapt.h)
+   For a range of lungs, tidal settings and bag faults, runs the same breaths open loop and then with adaptation on,
+   and reports the delivered volume (the lung model's own, not the controller's estimate) against the setting:
+     open loop  - mean error once the breaths have settled, with the drive gain straight from the tidal setting
+     settled    - breaths until every one after is within SETTLE_BAND of the setting
+     error      - mean and worst error over the last STEADY_BREATHS breaths
+     estimate   - the controller's exhaled volume (mean over the same breaths) and its dynamic compliance
+     PIP        - the highest over the same breaths
+   The sensor carries noise throughout, so the fit sees a pressure as ragged as a real one. Exits 1 if adaptation takes
+   more than SETTLE_MAX breaths, leaves a mean error over STEADY_MEAN_MAX or a breath off by more than SETTLE_BAND, or
+   (with the volume out of reach) leaves PIP over the pressure limit.
+   First checks that the unit correction (adaptation off) leaves every tidal gain as it was, full scale included, so
+   that the drive with adaptTidal off is the drive from before adaptation was added.
+   Usage : bench_tidal [breaths]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "sim_harness.h"
+#include "tidal_adapt.h"
+#include "drive.h"
+
+// From ventilator.cpp
+extern int tidal;
+extern int newTidal;
+extern int respRate;
+extern int newRespRate;
+extern bool adaptTidal;
+
+// As ventilator.cpp
+const int ALARM_HIGH_PRESSURE_OFF = 30;
+const int TIDAL_MAX = 700;
+
+const int MACHINE_RATE = 15;                // bpm
+const int STEADY_BREATHS = 20;
+const double SETTLE_BAND = 0.1;
+const int SETTLE_MAX = 8;
+const double STEADY_MEAN_MAX = 0.05;
+const double PRESSURE_MARGIN = 1.0;         // cmH2O over the limit .. the PIP at the sensor carries the noise too
+
+struct Case {
+  const char *name;
+  float compliance;           // L/cmH2O
+  int tidal;                  // ml
+  float sourcePressureMax;    // cmH2O, the bag at full drive (40 new)
+  float deadband;             // share of the drive taken up before the bag moves
+  float noise;                // cmH2O
+  bool reachable;             // false: the volume needs more than the pressure limit
+};
+
+struct TidalResult {
+  int settled;                // breaths
+  double openMean;            // share of the setting
+  double mean;
+  double worst;
+  double estimate;            // ml
+  double compliance;          // ml/cmH2O
+  double peak;                // cmH2O, highest PIP once settled
+};
+
+static int breaths;
+static int count;
+static int target;
+static int lastOutside;
+static double errorSum;
+static double errorWorst;
+static double estimateSum;
+static double complianceSum;
+static double peak;
+
+static void onBreath(const SimBreath &breath) {
+  count++;
+  double error = breath.tidalVolume * 1000 / target - 1;
+  if (fabs(error) > SETTLE_BAND) {
+    lastOutside = count;
+  }
+  if (count > breaths - STEADY_BREATHS) {
+    if (breath.peakPressure > peak) {
+      peak = breath.peakPressure;
+    }
+    errorSum += error;
+    if (fabs(error) > errorWorst) {
+      errorWorst = fabs(error);
+    }
+    estimateSum += tidalAdaptVolume();
+    complianceSum += tidalAdaptCompliance();
+  }
+}
+
+static void run(const Case &c, bool adapt) {
+  LungParams params;
+  lungDefaults(params);
+  params.compliance = c.compliance;
+  params.sourcePressureMax = c.sourcePressureMax;
+  params.actuatorDeadband = c.deadband;
+  params.sensorNoise = c.noise;
+  tidal = newTidal = c.tidal;
+  respRate = newRespRate = MACHINE_RATE;
+  adaptTidal = adapt;
+  target = c.tidal;
+  count = 0;
+  lastOutside = 0;
+  errorSum = 0;
+  errorWorst = 0;
+  estimateSum = 0;
+  complianceSum = 0;
+  peak = 0;
+  simSetBreathHandler(onBreath);
+  simBegin(params);
+  simRunBreaths(breaths);
+}
+
+static TidalResult measure(const Case &c) {
+  TidalResult r;
+  run(c, false);
+  r.openMean = errorSum / STEADY_BREATHS;
+  run(c, true);
+  r.settled = lastOutside;
+  r.mean = errorSum / STEADY_BREATHS;
+  r.worst = errorWorst;
+  r.estimate = estimateSum / STEADY_BREATHS;
+  r.compliance = complianceSum / STEADY_BREATHS;
+  r.peak = peak;
+  return r;
+}
+
+int main(int argc, char **argv) {
+  breaths = argc > 1 ? atoi(argv[1]) : 40;
+  if (breaths < STEADY_BREATHS + SETTLE_MAX) {
+    breaths = STEADY_BREATHS + SETTLE_MAX;
+  }
+  const Case CASES[] = {
+    { "stiff",          0.02f, 250, 40, 0,    0.1f, true },
+    { "stiff",          0.02f, 400, 40, 0,    0.1f, true },
+    { "",               0.03f, 250, 40, 0,    0.1f, true },
+    { "",               0.03f, 400, 40, 0,    0.1f, true },
+    { "",               0.05f, 250, 40, 0,    0.1f, true },
+    { "",               0.05f, 400, 40, 0,    0.1f, true },
+    { "compliant",      0.07f, 250, 40, 0,    0.1f, true },
+    { "compliant",      0.07f, 400, 40, 0,    0.1f, true },
+    { "worn bag",       0.05f, 400, 30, 0,    0.1f, true },
+    { "deadband",       0.05f, 400, 40, 0.2f, 0.1f, true },
+    { "noisy sensor",   0.07f, 400, 40, 0,    0.3f, true },
+    { "out of reach",   0.02f, 600, 40, 0,    0.1f, false },
+  };
+  bool ok = true;
+
+  // Adaptation off: the correction is exactly one, and the gain must come through untouched up to full scale
+  const uint16_t CORRECTION_ONE = 1 << DRIVE_CORRECTION_SHIFT;
+  long changed = 0;
+  for (uint32_t gain = 0; gain <= (1UL << DRIVE_GAIN_SHIFT); gain++) {
+    if (driveGainCorrect((uint16_t) gain, CORRECTION_ONE) != gain) {
+      changed++;
+    }
+  }
+  printf("Adaptation off: %ld of %lu tidal gains changed by the unit correction, %d ml gives gain %u%s\n", changed,
+         (1UL << DRIVE_GAIN_SHIFT) + 1, TIDAL_MAX, driveGainCorrect(driveGain(TIDAL_MAX, TIDAL_MAX), CORRECTION_ONE),
+         changed ? "  FAIL" : "");
+  ok = changed == 0;
+
+  printf("Adaptive tidal volume, %d breaths at %d bpm, I:E 1:1 - volume delivered against the setting\n", breaths,
+         MACHINE_RATE);
+  printf("  %-14s %6s %6s %9s %8s %15s %12s %16s %6s\n", "lung", "C", "tidal", "open loop", "settled",
+         "error", "estimate", "compliance", "PIP");
+  printf("  %-14s %6s %6s %9s %8s %15s %12s %16s %6s\n", "", "L/cmH2O", "ml", "mean", "breaths",
+         "mean   worst", "ml", "ml/cmH2O", "cmH2O");
+  for (unsigned int i = 0; i < sizeof(CASES) / sizeof(CASES[0]); i++) {
+    const Case &c = CASES[i];
+    TidalResult r = measure(c);
+    printf("  %-14s %6.2f %6d %+8.1f%% %8d %+6.1f%% %6.1f%% %12.0f %16.1f %6.1f", c.name, c.compliance, c.tidal,
+           r.openMean * 100, r.settled, r.mean * 100, r.worst * 100, r.estimate, r.compliance, r.peak);
+    bool good;
+    if (c.reachable) {
+      good = r.settled <= SETTLE_MAX && fabs(r.mean) <= STEADY_MEAN_MAX && r.worst <= SETTLE_BAND;
+    } else {
+      good = r.peak <= ALARM_HIGH_PRESSURE_OFF + PRESSURE_MARGIN;
+    }
+    printf("%s\n", good ? "" : "  FAIL");
+    ok = ok && good;
+  }
+  printf("  (settled within %.0f%% by breath %d, mean error within %.0f%%; out of reach: PIP up to %d cmH2O)\n",
+         SETTLE_BAND * 100, SETTLE_MAX, STEADY_MEAN_MAX * 100, ALARM_HIGH_PRESSURE_OFF);
+  return ok ? 0 : 1;
+}
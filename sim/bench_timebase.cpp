@@ -0,0 +1,107 @@
+/* bench_timebase - long-run breath period and I:E of the breath timebase (ventilator/breath_timer.h)
+   Runs the phase clock for 24 simulated hours at a range of rates, I:E ratios and control tick lengths and reports how
+   far the start of the last breath is from where an exact clock would put it, against the truncated whole-tick phases
+   that the controller used up to V38, at the same settings.
+     drift   - start of the last breath, measured minus exact
+     worst   - largest error of any breath start over the run .. never more than two ticks
+     I:E     - total exhale time / total inhale time
+   Exits 1 if any breath start is out by two ticks or more, or the I:E is out by more than 0.01%.
+   Usage : bench_timebase [hours]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "breath_timer.h"
+
+struct Setting {
+  uint8_t respRate;
+  uint8_t ieTenths;
+};
+
+const Setting SETTINGS[] = { { 7, 10 }, { 12, 20 }, { 23, 14 }, { 30, 30 } };
+const uint32_t TICKS_US[] = { 10000, 1000, 250 };
+
+struct TimebaseResult {
+  unsigned long breaths;
+  double drift;                 // us
+  double worst;                 // us
+  double ie;
+};
+
+static TimebaseResult runPhaseClock(const Setting &setting, uint32_t tickUs, double hours) {
+  BreathTiming timing;
+  breathTimingSet(timing, setting.respRate, setting.ieTenths, tickUs);
+  double period = 60e6 / setting.respRate;
+  unsigned long long ticks = (unsigned long long) (hours * 3600e6 / tickUs);
+
+  TimebaseResult r = { 0, 0, 0, 0 };
+  BreathClock clock;
+  breathClockReset(clock);
+  bool inhaling = true;
+  unsigned long long inhaleTicks = 0;
+  unsigned long long exhaleTicks = 0;
+  for (unsigned long long t = 1; t <= ticks; t++) {
+    if (inhaling) {
+      inhaleTicks++;
+    } else {
+      exhaleTicks++;
+    }
+    if (!breathClockStep(clock, timing, inhaling)) {
+      continue;
+    }
+    if (!inhaling) {
+      r.breaths++;                                    // the next breath starts at the end of this tick
+      r.drift = (double) t * tickUs - r.breaths * period;
+      if (fabs(r.drift) > r.worst) {
+        r.worst = fabs(r.drift);
+      }
+    }
+    inhaling = !inhaling;
+  }
+  r.ie = inhaleTicks ? (double) exhaleTicks / inhaleTicks : 0;
+  return r;
+}
+
+// Whole-tick phases, worked out as up to V38
+static TimebaseResult runTruncated(const Setting &setting, uint32_t tickUs, double hours) {
+  long ticksPerMinute = 60000000 / tickUs;
+  float iERatio = setting.ieTenths / 10.0f;
+  int ticksPerBreath = ticksPerMinute / setting.respRate;
+  float iPlusE = 1 + iERatio;
+  int ticksPerInhale = int (ticksPerBreath / iPlusE);
+  int ticksPerExhale = int (ticksPerBreath * (iERatio / iPlusE));
+
+  TimebaseResult r;
+  double period = 60e6 / setting.respRate;
+  double actual = (double) (ticksPerInhale + ticksPerExhale) * tickUs;
+  r.breaths = (unsigned long) (hours * 3600e6 / actual);
+  r.drift = r.breaths * (actual - period);
+  r.worst = fabs(r.drift);
+  r.ie = (double) ticksPerExhale / ticksPerInhale;
+  return r;
+}
+
+int main(int argc, char **argv) {
+  double hours = argc > 1 ? atof(argv[1]) : 24;
+  bool ok = true;
+
+  printf("%.0f simulated hours\n", hours);
+  printf("                             truncated (V38)          phase clock\n");
+  printf(" bpm   I:E   tick   breaths   drift s   I:E         drift us  worst us  I:E\n");
+  for (const Setting &setting : SETTINGS) {
+    for (uint32_t tickUs : TICKS_US) {
+      TimebaseResult old = runTruncated(setting, tickUs, hours);
+      TimebaseResult r = runPhaseClock(setting, tickUs, hours);
+      printf("%4u  1:%.1f %5luus %8lu  %+8.2f   1:%.4f  %+9.0f  %8.0f  1:%.4f\n", setting.respRate,
+             setting.ieTenths / 10.0, (unsigned long) tickUs, r.breaths, old.drift * 1e-6, old.ie, r.drift, r.worst, r.ie);
+      if (r.worst >= 2.0 * tickUs || fabs(r.ie * 10 / setting.ieTenths - 1) > 1e-4) {
+        ok = false;
+      }
+    }
+  }
+  if (!ok) {
+    printf("FAIL: a breath started two ticks or more from where it should, or the I:E is out\n");
+  }
+  return ok ? 0 : 1;
+}
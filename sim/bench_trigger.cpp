@@ -0,0 +1,188 @@
+/* bench_trigger - patient trigger latency and false triggers in spontaneous mode (ventilator/trigger.h)
+   Runs the controller against a lung with simulated efforts, for a range of effort strengths, sensor noise and lung
+   compliance, then against a passive (apnoeic) lung where every trigger is false.
+     latency - effort onset to the start of the triggered inhale
+     missed  - efforts that began during an exhale, after the refractory period, and ended without a trigger
+     false   - triggers with no effort in progress
+   Usage : bench_trigger [-s] [breaths] [sensitivity]
+           sensitivity in place of TRIGGER_SENSITIVITY as shipped (ventilator.cpp)
+           -s sweeps the sensitivity from TRIGGER_SENSITIVITY_MIN to _MAX instead, against the efforts the noise hides
+              and the noise that passes for an effort .. what TRIGGER_SENSITIVITY was picked from
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim_harness.h"
+#include "trigger.h"
+
+// From ventilator.cpp
+extern int currentMode;
+extern int respRate;
+extern int newRespRate;
+extern int breathState;
+
+const int MODE_SPONTANEOUS = 1;
+const int INHALE_STATE = 0;
+const int EXHALE_STATE = 1;
+const double STEP_S = 0.001;
+const double REFRACTORY_S = 0.3;                  // TRIGGER_REFRACTORY_MS
+const int MACHINE_RATE = 15;                      // bpm .. a 4 s machine cycle
+const double EFFORT_PERIOD_S = 3.3;               // against the machine cycle, so efforts land all through the exhale
+const uint16_t REFRACTORY_SAMPLES = 75;           // TRIGGER_REFRACTORY_MS at the fast-channel rate, as setup() works it out
+
+static uint8_t sensitivity = 0;                   // 0 for TRIGGER_SENSITIVITY as shipped
+
+struct TriggerResult {
+  unsigned long efforts;       // that began in a watchable part of an exhale
+  unsigned long triggered;
+  unsigned long missed;
+  unsigned long falseTriggers;
+  double latencySum;
+  double latencyMax;
+};
+
+static TriggerResult run(float amplitude, float noise, float compliance, unsigned long breaths) {
+  LungParams params;
+  lungDefaults(params);
+  params.compliance = compliance;
+  params.sensorNoise = noise;
+  params.effortAmplitude = amplitude;
+  params.effortPeriod = amplitude > 0 ? EFFORT_PERIOD_S : 0;
+  currentMode = MODE_SPONTANEOUS;
+  respRate = newRespRate = MACHINE_RATE;        // not the default, which has moved
+  simBegin(params);
+  if (sensitivity) {
+    triggerConfigure(sensitivity, REFRACTORY_SAMPLES);   // after setup() has configured it
+  }
+
+  TriggerResult r = { 0, 0, 0, 0, 0, 0 };
+  int lastState = breathState;
+  double exhaleStart = 0;
+  float lastEffort = 0;
+  double effortStart = -1;                  // onset of the effort in progress, if it is one we are watching
+  bool effortTriggered = false;
+  uint16_t lastCount = triggerCount();
+
+  while (simBreaths() < breaths) {
+    simRunSeconds(STEP_S);
+    const Lung &lung = simLung();
+    double now = lung.time;
+
+    if (breathState == EXHALE_STATE && lastState != EXHALE_STATE) {
+      exhaleStart = now;
+    }
+
+    if (lastEffort == 0 && lung.musclePressure > 0) {           // an effort starts
+      effortTriggered = false;
+      if (breathState == EXHALE_STATE && now - exhaleStart >= REFRACTORY_S) {
+        effortStart = now;
+        r.efforts++;
+      } else {
+        effortStart = -1;
+      }
+    }
+
+    uint16_t count = triggerCount();
+    if (count != lastCount) {
+      lastCount = count;
+      if (lung.musclePressure <= 0) {
+        r.falseTriggers++;
+      } else if (effortStart >= 0) {
+        effortTriggered = true;
+      }
+    }
+
+    if (breathState == INHALE_STATE && lastState == EXHALE_STATE && effortTriggered && effortStart >= 0) {
+      double latency = now - effortStart;
+      r.triggered++;
+      r.latencySum += latency;
+      if (latency > r.latencyMax) {
+        r.latencyMax = latency;
+      }
+      effortStart = -1;
+    }
+
+    if (lastEffort > 0 && lung.musclePressure == 0 && effortStart >= 0) {   // watched effort ended untriggered
+      if (!effortTriggered) {
+        r.missed++;
+      }
+      effortStart = -1;
+    }
+
+    lastEffort = lung.musclePressure;
+    lastState = breathState;
+  }
+  return r;
+}
+
+static void print(const char *label, const TriggerResult &r) {
+  printf("  %-32s %7lu %9lu %7lu %7lu", label, r.efforts, r.triggered, r.missed, r.falseTriggers);
+  if (r.triggered) {
+    printf("  %6.0f ms %6.0f ms\n", r.latencySum / r.triggered * 1000, r.latencyMax * 1000);
+  } else {
+    printf("       -         -\n");
+  }
+}
+
+// Each sensitivity against small efforts on a clean signal, and a passive lung with noise
+static void sweep(unsigned long breaths) {
+  const float EFFORTS[][3] = { { 1.0f, 0, 0.02f }, { 2.0f, 0, 0.02f }, { 2.0f, 0, 0.05f }, { 3.0f, 0.5f, 0.05f } };
+  const float PASSIVE_NOISES[] = { 0.2f, 0.5f, 1.0f };
+  printf("Sensitivity sweep, %lu breaths per run .. triggered / efforts (effort / noise / compliance), and false triggers\n"
+         "on a passive lung (noise, compliance 0.02)\n", breaths);
+  printf("  %-11s", "sensitivity");
+  for (unsigned int e = 0; e < sizeof(EFFORTS) / sizeof(EFFORTS[0]); e++) {
+    printf("  %3.0f / %.1f / %.2f", EFFORTS[e][0], EFFORTS[e][1], EFFORTS[e][2]);
+  }
+  for (unsigned int n = 0; n < sizeof(PASSIVE_NOISES) / sizeof(PASSIVE_NOISES[0]); n++) {
+    printf("  %4.1f", PASSIVE_NOISES[n]);
+  }
+  printf("\n");
+  for (sensitivity = TRIGGER_SENSITIVITY_MIN; sensitivity <= TRIGGER_SENSITIVITY_MAX; sensitivity++) {
+    printf("  %-11u", sensitivity);
+    for (unsigned int e = 0; e < sizeof(EFFORTS) / sizeof(EFFORTS[0]); e++) {
+      TriggerResult r = run(EFFORTS[e][0], EFFORTS[e][1], EFFORTS[e][2], breaths);
+      printf("     %3lu / %-5lu", r.triggered, r.efforts);
+    }
+    for (unsigned int n = 0; n < sizeof(PASSIVE_NOISES) / sizeof(PASSIVE_NOISES[0]); n++) {
+      printf("  %4lu", run(0, PASSIVE_NOISES[n], 0.02f, breaths).falseTriggers);
+    }
+    printf("\n");
+    fflush(stdout);
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1 && strcmp(argv[1], "-s") == 0) {
+    sweep(argc > 2 ? strtoul(argv[2], 0, 10) : 60);
+    return 0;
+  }
+  unsigned long breaths = argc > 1 ? strtoul(argv[1], 0, 10) : 60;
+  sensitivity = argc > 2 ? atoi(argv[2]) : 0;
+  const float AMPLITUDES[] = { 1.0f, 2.0f, 3.0f, 5.0f };
+  const float NOISES[] = { 0.0f, 0.2f, 0.5f };
+  const float COMPLIANCES[] = { 0.02f, 0.05f };
+  char label[64];
+
+  printf("Spontaneous trigger, %lu breaths per run (efforts %.1f s apart, 0.6 s long)\n", breaths, EFFORT_PERIOD_S);
+  printf("  %-32s %7s %9s %7s %7s  %9s %9s\n", "effort / noise / compliance", "efforts", "triggered", "missed", "false",
+         "latency", "worst");
+  for (unsigned int c = 0; c < sizeof(COMPLIANCES) / sizeof(COMPLIANCES[0]); c++) {
+    for (unsigned int a = 0; a < sizeof(AMPLITUDES) / sizeof(AMPLITUDES[0]); a++) {
+      for (unsigned int n = 0; n < sizeof(NOISES) / sizeof(NOISES[0]); n++) {
+        snprintf(label, sizeof(label), "%.0f cmH2O / %.1f cmH2O / %.2f", AMPLITUDES[a], NOISES[n], COMPLIANCES[c]);
+        print(label, run(AMPLITUDES[a], NOISES[n], COMPLIANCES[c], breaths));
+      }
+    }
+  }
+  printf("passive lung (every trigger is false)\n");
+  const float PASSIVE_NOISES[] = { 0.0f, 0.2f, 0.5f, 1.0f };
+  for (unsigned int c = 0; c < sizeof(COMPLIANCES) / sizeof(COMPLIANCES[0]); c++) {
+    for (unsigned int n = 0; n < sizeof(PASSIVE_NOISES) / sizeof(PASSIVE_NOISES[0]); n++) {
+      snprintf(label, sizeof(label), "no effort / %.1f cmH2O / %.2f", PASSIVE_NOISES[n], COMPLIANCES[c]);
+      print(label, run(0, PASSIVE_NOISES[n], COMPLIANCES[c], breaths));
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,371 @@
+/* bench_ventmon - ventmon (the multi-unit telemetry monitor) against dozens of emulated units on pseudo-terminals
+   The controller is first run here against the lung model with each of a few settings, and what it writes to Serial is
+   kept with the byte count at every 10 ms. Each emulated unit is a pseudo-terminal given one of those streams back at
+   the pace it was written, from a different starting breath so that the units' breaths do not line up .. at 1x that is
+   the controller's full telemetry rate, a tick record every 10 ms and a breath frame per breath.
+   ventmon, from the same build directory, is started on all the terminals with a CSV and its live view going to
+   /dev/null. The runs:
+     16 and 48 units at 1x, and 48 at 8x (each unit close to the 115200 baud line rate, all at once)
+   For each: the frames sent against those ventmon counted, the CSV's rows against the breaths sent, how far the writes
+   ever got ahead of ventmon's reads, and ventmon's CPU time as a share of one core.
+   Exits 1 if a frame is lost or garbled, a breath is missing from the CSV, or ventmon needs more than MAX_CPU of a core.
+   Usage : bench_ventmon [seconds]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <termios.h>
+#include <sys/wait.h>
+#include "host_clock.h"
+#include "sim_harness.h"
+#include "telemetry_decoder.h"
+
+// From ventilator.cpp
+extern int respRate;
+extern int newRespRate;
+extern int currentMode;
+
+const double SLICE_S = 0.01;
+const int SLICES_PER_S = 100;
+const int START_SLICES = 300;                   // past the self-test ..
+const int START_SPREAD = 500;                   // .. and then up to this much further in
+const int MAX_UNITS = 64;
+const double MAX_CPU = 0.5;
+const int OPEN_TIMEOUT_MS = 5000;
+const int DRAIN_MS = 500;
+
+struct Setting {
+  int rate;
+  float compliance;
+  float effortPeriod;         // 0 = mandatory breaths
+};
+
+const Setting SETTINGS[] = {
+  { 12, 0.05f, 0 },
+  { 15, 0.03f, 0 },
+  { 20, 0.02f, 0 },
+  { 15, 0.05f, 3 },
+};
+const int STREAMS = sizeof(SETTINGS) / sizeof(SETTINGS[0]);
+
+struct Stream {
+  uint8_t *bytes;
+  unsigned long length;
+  unsigned long capacity;
+  unsigned long *sliceEnd;    // bytes written by the end of each slice
+  int slices;
+  unsigned long *frameEnd;    // the offset just past each tick or breath frame ..
+  uint8_t *frameType;         // .. and its type
+  unsigned long frames;
+};
+
+struct Run {
+  int units;
+  int speed;                  // slices of the stream per slice of wall time
+};
+
+const Run RUNS[] = {
+  { 16, 1 },
+  { 48, 1 },
+  { 48, 8 },
+};
+
+static Stream streams[STREAMS];
+static Stream *capturing = 0;
+
+static void onSerial(uint8_t c) {
+  Stream &s = *capturing;
+  if (s.length == s.capacity) {
+    s.capacity = s.capacity ? s.capacity * 2 : 65536;
+    s.bytes = (uint8_t *) realloc(s.bytes, s.capacity);
+  }
+  s.bytes[s.length++] = c;
+}
+
+static void capture(Stream &s, const Setting &setting, int slices) {
+  LungParams params;
+  lungDefaults(params);
+  params.compliance = setting.compliance;
+  params.effortPeriod = setting.effortPeriod;
+  currentMode = setting.effortPeriod > 0 ? 1 : 0;
+  respRate = newRespRate = setting.rate;
+  capturing = &s;
+  hostSetSerialSink(onSerial);
+  simBegin(params);
+  s.sliceEnd = (unsigned long *) calloc(slices, sizeof(unsigned long));
+  for (int i = 0; i < slices; i++) {
+    simRunSeconds(SLICE_S);
+    s.sliceEnd[i] = s.length;
+  }
+  s.slices = slices;
+
+  TelemetryDecoder decoder;
+  telemetryDecoderReset(decoder);
+  s.frameEnd = (unsigned long *) calloc(s.length, sizeof(unsigned long));
+  s.frameType = (uint8_t *) calloc(s.length, 1);
+  for (unsigned long i = 0; i < s.length; i++) {
+    if (telemetryDecoderFeed(decoder, s.bytes[i]) == TELEMETRY_DECODE_FRAME &&
+        (decoder.type == TELEMETRY_FRAME_TICK || decoder.type == TELEMETRY_FRAME_BREATH)) {
+      s.frameEnd[s.frames] = i + 1;
+      s.frameType[s.frames++] = decoder.type;
+    }
+  }
+}
+
+// A unit plays its stream from just after a frame, so that ventmon's first byte is never mid-frame
+struct Unit {
+  int master;
+  char path[64];
+  const Stream *stream;
+  int startSlice;
+  unsigned long from;
+  unsigned long to;
+  unsigned long written;
+};
+
+static Unit units[MAX_UNITS];
+
+static bool unitOpen(Unit &u, const Stream &s, int startSlice, int slices) {
+  u.master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (u.master < 0 || grantpt(u.master) != 0 || unlockpt(u.master) != 0) {
+    perror("bench_ventmon: posix_openpt");
+    return false;
+  }
+  snprintf(u.path, sizeof(u.path), "%s", ptsname(u.master));
+  int slave = open(u.path, O_RDWR | O_NOCTTY);
+  struct termios tio;
+  if (slave < 0 || tcgetattr(slave, &tio) != 0) {
+    perror("bench_ventmon: slave");
+    return false;
+  }
+  cfmakeraw(&tio);
+  tcsetattr(slave, TCSANOW, &tio);
+  close(slave);                                 // the master sees POLLHUP until ventmon opens it
+  fcntl(u.master, F_SETFL, fcntl(u.master, F_GETFL) | O_NONBLOCK);
+  fcntl(u.master, F_SETFD, FD_CLOEXEC);         // ventmon must not hold the masters, or it never sees the units go
+
+  u.stream = &s;
+  u.startSlice = startSlice;
+  unsigned long begin = s.sliceEnd[startSlice];
+  unsigned long f = 0;
+  while (f < s.frames && s.frameEnd[f] < begin) {
+    f++;
+  }
+  u.from = f < s.frames ? s.frameEnd[f] : begin;
+  u.to = s.sliceEnd[startSlice + slices];
+  u.written = u.from;
+  return true;
+}
+
+static void framesBetween(const Stream &s, unsigned long from, unsigned long to, unsigned long &ticks,
+                          unsigned long &breaths) {
+  for (unsigned long f = 0; f < s.frames; f++) {
+    if (s.frameEnd[f] > from && s.frameEnd[f] <= to) {
+      if (s.frameType[f] == TELEMETRY_FRAME_TICK) {
+        ticks++;
+      } else {
+        breaths++;
+      }
+    }
+  }
+}
+
+static double wallSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void sleepUntil(double t) {
+  struct timespec ts;
+  ts.tv_sec = (time_t) t;
+  ts.tv_nsec = (long) ((t - ts.tv_sec) * 1e9);
+  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0);
+}
+
+// Write what is due, as far as the terminal takes it .. returns the bytes still to go
+static unsigned long unitWrite(Unit &u, unsigned long due) {
+  if (due > u.to) {
+    due = u.to;
+  }
+  if (u.written < due) {
+    ssize_t n = write(u.master, u.stream->bytes + u.written, due - u.written);
+    if (n > 0) {
+      u.written += n;
+    }
+  }
+  return due - u.written;
+}
+
+static pid_t startVentmon(const char *self, const char *csvPath, int count, int &summary) {
+  char program[512];
+  snprintf(program, sizeof(program), "%s", self);
+  char *slash = strrchr(program, '/');
+  snprintf(slash ? slash + 1 : program, sizeof(program) - (slash ? slash + 1 - program : 0), "ventmon");
+  const char *args[MAX_UNITS + 8];
+  int n = 0;
+  args[n++] = program;
+  args[n++] = "-c";
+  args[n++] = csvPath;
+  for (int i = 0; i < count; i++) {
+    args[n++] = units[i].path;
+  }
+  args[n] = 0;
+  int err[2];
+  if (pipe(err) != 0) {
+    return -1;
+  }
+  pid_t pid = fork();
+  if (pid == 0) {
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, 1);
+    dup2(err[1], 2);
+    close(err[0]);
+    execv(program, (char **) args);
+    perror("bench_ventmon: ventmon");
+    _exit(127);
+  }
+  close(err[1]);
+  summary = err[0];
+  return pid;
+}
+
+static bool allOpened(int count) {
+  for (int i = 0; i < count; i++) {
+    struct pollfd p = { units[i].master, POLLOUT, 0 };
+    if (poll(&p, 1, 0) < 0 || (p.revents & POLLHUP)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static unsigned long csvRows(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    return 0;
+  }
+  unsigned long lines = 0;
+  int c;
+  while ((c = fgetc(f)) != EOF) {
+    lines += c == '\n';
+  }
+  fclose(f);
+  return lines ? lines - 1 : 0;               // less the header
+}
+
+static bool run(const char *self, const Run &r, double seconds) {
+  int slices = (int) (seconds * SLICES_PER_S);
+  unsigned long sentTicks = 0, sentBreaths = 0, sentBytes = 0;
+  for (int i = 0; i < r.units; i++) {
+    const Stream &s = streams[i % STREAMS];
+    int start = START_SLICES + (i / STREAMS) * 137 % START_SPREAD;
+    if (!unitOpen(units[i], s, start, slices * r.speed)) {
+      return false;
+    }
+    framesBetween(s, units[i].from, units[i].to, sentTicks, sentBreaths);
+    sentBytes += units[i].to - units[i].from;
+  }
+
+  char csvPath[512];
+  snprintf(csvPath, sizeof(csvPath), "%s.csv", self);
+  unlink(csvPath);
+  int summary = -1;
+  pid_t pid = startVentmon(self, csvPath, r.units, summary);
+  double deadline = wallSeconds() + OPEN_TIMEOUT_MS * 1e-3;
+  while (pid > 0 && !allOpened(r.units) && wallSeconds() < deadline) {
+    usleep(1000);
+  }
+
+  unsigned long behindMax = 0;
+  double start = wallSeconds();
+  for (int k = 1; k <= slices; k++) {
+    sleepUntil(start + k * SLICE_S);
+    for (int i = 0; i < r.units; i++) {
+      Unit &u = units[i];
+      unsigned long behind = unitWrite(u, u.stream->sliceEnd[u.startSlice + k * r.speed]);
+      if (behind > behindMax) {
+        behindMax = behind;
+      }
+    }
+  }
+  double end = wallSeconds() + DRAIN_MS * 1e-3;
+  bool pending = true;
+  while (pending && wallSeconds() < end) {
+    pending = false;
+    for (int i = 0; i < r.units; i++) {
+      pending = unitWrite(units[i], units[i].to) > 0 || pending;
+    }
+    usleep(1000);
+  }
+  usleep(DRAIN_MS * 1000);                      // for ventmon to read the last of it
+  double elapsed = wallSeconds() - start;
+  for (int i = 0; i < r.units; i++) {
+    close(units[i].master);                     // ventmon sees every unit go, and stops
+  }
+
+  char line[512] = "";
+  FILE *f = summary >= 0 ? fdopen(summary, "r") : 0;
+  while (f && fgets(line, sizeof(line), f) && strncmp(line, "ventmon: ", 9) != 0) {
+  }
+  if (f) {
+    fclose(f);
+  }
+  int status = -1;
+  if (pid > 0) {
+    waitpid(pid, &status, 0);
+  }
+  int units = 0;
+  double monitored = 0, cpu = 0;
+  unsigned long bytes = 0, ticks = 0, lost = 0, breaths = 0, bad = 0;
+  bool parsed = sscanf(line, "ventmon: units %d seconds %lf bytes %lu ticks %lu lost %lu breaths %lu bad %lu cpu %lf s",
+                       &units, &monitored, &bytes, &ticks, &lost, &breaths, &bad, &cpu) == 8;
+  unsigned long rows = csvRows(csvPath);
+  unlink(csvPath);
+
+  double share = monitored > 0 ? cpu / monitored : 1;
+  bool ok = parsed && status == 0 && units == r.units && bytes == sentBytes && ticks == sentTicks &&
+            breaths == sentBreaths && bad == 0 && rows == sentBreaths && share <= MAX_CPU;
+  printf("%2d units at %dx, %.1f s: %.0f bytes/s in all (%.0f per unit), %.0f records/s\n", r.units, r.speed, elapsed,
+         sentBytes / elapsed, sentBytes / elapsed / r.units, sentTicks / elapsed);
+  printf("  sent     %lu bytes, %lu tick records, %lu breaths\n", sentBytes, sentTicks, sentBreaths);
+  printf("  ventmon  %lu bytes, %lu tick records (%lu missing from the run), %lu breaths, %lu bad frames, "
+         "%lu CSV rows\n", bytes, ticks, lost, breaths, bad, rows);
+  printf("  ventmon  cpu %.3f s over %.1f s: %.1f%% of one core, %.2f us per record; writes at most %lu bytes ahead "
+         "of its reads%s\n", cpu, monitored, share * 100, ticks ? cpu / (ticks + breaths) * 1e6 : 0, behindMax,
+         ok ? "" : "  FAIL");
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  double seconds = argc > 1 ? atof(argv[1]) : 10;
+  int maxSpeed = 1;
+  for (size_t i = 0; i < sizeof(RUNS) / sizeof(RUNS[0]); i++) {
+    if (RUNS[i].speed > maxSpeed) {
+      maxSpeed = RUNS[i].speed;
+    }
+  }
+  int slices = START_SLICES + START_SPREAD + (int) (seconds * SLICES_PER_S) * maxSpeed + 1;
+  double capture0 = wallSeconds();
+  for (int i = 0; i < STREAMS; i++) {
+    capture(streams[i], SETTINGS[i], slices);
+  }
+  printf("%d streams of %.0f s captured in %.1f s\n", STREAMS, slices * SLICE_S, wallSeconds() - capture0);
+  signal(SIGPIPE, SIG_IGN);
+
+  bool ok = true;
+  for (size_t i = 0; i < sizeof(RUNS) / sizeof(RUNS[0]); i++) {
+    ok = run(argv[0], RUNS[i], seconds) && ok;
+  }
+  if (!ok) {
+    printf("FAIL: ventmon lost or garbled telemetry, missed a breath in the CSV, or needed over %.0f%% of a core\n",
+           MAX_CPU * 100);
+  }
+  return ok ? 0 : 1;
+}
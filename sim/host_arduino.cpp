@@ -0,0 +1,816 @@
+/* Host stand-in for the Arduino core, TimerOne, ServoTimer2, LiquidCrystal_I2C, Wire and EEPROM
+   Description : Implements the virtual clock declared in host_clock.h. Each API call charges the time it takes on a
+                 16 MHz Uno, so loop() runs at a realistic rate relative to the 10 ms control interrupt.
+*/
+
+#include <stdio.h>
+#include <Arduino.h>
+#include <Wire.h>
+#include <EEPROM.h>
+#include <TimerOne.h>
+#include <ServoTimer2.h>
+#include <LiquidCrystal_I2C.h>
+#include "host_clock.h"
+
+// What things cost on the real hardware (microseconds)
+const unsigned long ANALOG_READ_US = 112;          // one blocking 10-bit conversion at the default ADC prescaler
+const unsigned long ADC_CONVERSION_US = 104;       // free-running: 13 ADC clocks at 16 MHz / 128
+const unsigned long DIGITAL_IO_US = 5;             // digitalRead / digitalWrite through the Arduino pin tables
+const unsigned long ISR_ENTRY_US = 3;              // vector, register saves and the call through the library's function pointer
+const unsigned long ISR_EXIT_US = 2;               // register restores and reti
+const unsigned long CLOCK_READ_US = 1;             // millis() / micros()
+const unsigned long FLOAT_FORMAT_US = 120;         // dtostrf / Print::print(double) - soft-float divides on the AVR
+const unsigned long I2C_BYTE_US = 90;              // one byte at 100 kHz including ACK
+const unsigned long LCD_I2C_BYTES_PER_BYTE = 12;   // PCF8574 4-bit mode: 2 nibbles x (data, EN high, EN low) x (addr + data)
+const unsigned long LCD_CLEAR_US = 2000;           // HD44780 clear / home execution time
+const unsigned long LCD_BEGIN_US = 50000;          // power-on initialisation sequence
+const unsigned long EEPROM_WRITE_US = 3400;        // erase and write of one EEPROM byte (3.3 ms in the datasheet, and a little)
+const int SERIAL_TX_BUFFER = 64;                   // HardwareSerial TX ring size on the Uno
+const int SERIAL_RX_BUFFER = 64;                   // .. and RX, one slot always kept empty
+const unsigned long F_CPU_MHZ = 16;
+const unsigned long TIMER1_RESOLUTION = 65536;     // Timer1 is 16 bits
+
+const int HOST_PINS = 32;
+
+static unsigned long long nowUs = 0;
+static unsigned long long plantUs = 0;
+static bool inIsr = false;
+static bool irqEnabled = true;
+static bool manualInterrupts = false;
+
+static HostPlantFn plantFn = 0;
+static HostTickHookFn tickHookFn = 0;
+static HostAnalogFn analogFn = 0;
+static HostCounters counters;
+
+static int pinLevels[HOST_PINS];
+static int pwmDuties[HOST_PINS];
+static int servoPulses[HOST_PINS];
+
+const int HOST_EXTERNAL_INTERRUPTS = 2;
+const uint8_t EXTERNAL_INTERRUPT_PINS[HOST_EXTERNAL_INTERRUPTS] = { 2, 3 };
+static void (*externalIsr[HOST_EXTERNAL_INTERRUPTS])();
+static int externalMode[HOST_EXTERNAL_INTERRUPTS];
+static bool externalPending[HOST_EXTERNAL_INTERRUPTS];
+
+static bool timerRunning = false;
+static void (*timerIsr)() = 0;
+static unsigned long timerPeriod = 1000000;
+static unsigned long long timerDue = 0;
+
+static void (*adcIsr)(uint16_t) = 0;
+static uint8_t adcPin = 0;
+static unsigned long long adcDue = 0;
+
+static unsigned long serialByteUs = 1042;          // 9600 baud, 10 bits per byte
+static unsigned long long serialBusyUntil = 0;     // time at which the TX buffer will have drained
+static bool serialEcho = false;
+static HostSerialSinkFn serialSinkFn = 0;
+
+const int HOST_RX_PENDING = 4096;                  // bytes on their way down the wire to the controller
+static uint8_t rxPending[HOST_RX_PENDING];
+static unsigned long long rxPendingAt[HOST_RX_PENDING];
+static int rxPendingHead = 0;
+static int rxPendingTail = 0;
+static unsigned long long rxLineFreeAt = 0;        // when the last byte sent to the controller finishes arriving
+static uint8_t rxBuffer[SERIAL_RX_BUFFER];
+static int rxHead = 0;
+static int rxTail = 0;
+
+static uint8_t eepromData[HOST_EEPROM_BYTES];
+static unsigned long eepromCellWrites[HOST_EEPROM_BYTES];
+static bool eepromErased = false;
+static unsigned long long eepromBusyUntil = 0;     // when the write in progress completes
+
+HardwareSerial Serial;
+TwoWire Wire;
+TimerOne Timer1;
+EEPROMClass EEPROM;
+
+// ------------------------------------------------------------------------------------------------------------------
+// Virtual clock
+
+// The plant is stepped in whole slices, so it may lag the clock by up to one slice. Stepping on every small
+// advance (a digitalRead is 5 us) would make the plant model the most expensive part of the simulation.
+static void stepPlantTo(unsigned long long t) {
+  while (plantUs + HOST_PLANT_SLICE_US <= t) {
+    if (plantFn) {
+      plantFn(HOST_PLANT_SLICE_US);
+    }
+    plantUs += HOST_PLANT_SLICE_US;
+  }
+}
+
+static bool timerCanFire() {
+  return timerRunning && timerIsr && irqEnabled && !inIsr && !manualInterrupts;
+}
+
+static bool adcCanFire() {
+  return adcIsr && irqEnabled && !inIsr && !manualInterrupts;
+}
+
+static int analogValue(uint8_t pin) {
+  int raw = analogFn ? analogFn(pin) : 0;
+  if (raw < 0) {
+    raw = 0;
+  }
+  if (raw > 1023) {
+    raw = 1023;
+  }
+  return raw;
+}
+
+static void fireTimer() {
+  timerDue += timerPeriod;                         // from here until the next overflow, timerDue - timerPeriod is BOTTOM
+
+  inIsr = true;
+  counters.isrCalls++;
+  hostAdvance(ISR_ENTRY_US);
+  timerIsr();
+  hostAdvance(ISR_EXIT_US);
+  inIsr = false;
+
+  // The AVR only remembers one pending overflow - ticks that fall entirely inside a long ISR are lost
+  if (timerDue + timerPeriod <= nowUs) {
+    timerDue = nowUs - ((nowUs - timerDue) % timerPeriod);
+  }
+  if (tickHookFn) {
+    tickHookFn();
+  }
+}
+
+static void fireAdc(uint16_t conversion) {
+  adcDue += ADC_CONVERSION_US;
+
+  inIsr = true;
+  counters.adcConversions++;
+  hostAdvance(ISR_ENTRY_US);
+  adcIsr(conversion);
+  hostAdvance(ISR_EXIT_US);
+  inIsr = false;
+
+  if (adcDue + ADC_CONVERSION_US <= nowUs) {
+    adcDue = nowUs - ((nowUs - adcDue) % ADC_CONVERSION_US);
+  }
+}
+
+// INT0 / INT1 have the highest priority of all the AVR's interrupt vectors
+static void fireExternal() {
+  for (int i = 0; i < HOST_EXTERNAL_INTERRUPTS; i++) {
+    if (externalPending[i] && externalIsr[i] && irqEnabled && !inIsr) {
+      externalPending[i] = false;
+      inIsr = true;
+      hostAdvance(ISR_ENTRY_US);
+      externalIsr[i]();
+      hostAdvance(ISR_EXIT_US);
+      inIsr = false;
+    }
+  }
+}
+
+void hostAdvance(unsigned long us) {
+  unsigned long long end = nowUs + us;
+
+  fireExternal();
+
+  // Service interrupts in time order. When both are due, Timer1 overflow wins - it has the lower vector number
+  while (true) {
+    unsigned long long limit = end > nowUs ? end : nowUs;
+    bool timerDueNow = timerCanFire() && timerDue <= limit;
+    bool adcDueNow = adcCanFire() && adcDue <= limit;
+    if (!timerDueNow && !adcDueNow) {
+      break;
+    }
+    bool timerFirst = timerDueNow && (!adcDueNow || timerDue <= adcDue);
+    unsigned long long due = timerFirst ? timerDue : adcDue;
+    if (due > nowUs) {
+      stepPlantTo(due);
+      nowUs = due;
+    }
+    if (timerFirst) {
+      fireTimer();
+    } else {
+      fireAdc((uint16_t) analogValue(adcPin));
+    }
+  }
+
+  if (nowUs < end) {
+    stepPlantTo(end);
+    nowUs = end;
+  }
+}
+
+void hostReset() {
+  nowUs = 0;
+  plantUs = 0;
+  inIsr = false;
+  irqEnabled = true;
+  manualInterrupts = false;
+  memset(&counters, 0, sizeof(counters));
+  for (int i = 0; i < HOST_PINS; i++) {
+    pinLevels[i] = HIGH;                 // undriven inputs float high through their pull-ups
+    pwmDuties[i] = 0;
+    servoPulses[i] = 0;                  // no pulses until attached
+  }
+  timerRunning = false;
+  timerIsr = 0;
+  adcIsr = 0;
+  for (int i = 0; i < HOST_EXTERNAL_INTERRUPTS; i++) {
+    externalIsr[i] = 0;
+    externalPending[i] = false;
+  }
+  serialBusyUntil = 0;
+  rxPendingHead = rxPendingTail = 0;
+  rxHead = rxTail = 0;
+  rxLineFreeAt = 0;
+  eepromBusyUntil = 0;                   // the contents stay .. a write cut off by the reset is as far as it got
+  if (!eepromErased) {
+    hostEepromErase();                   // as shipped
+  }
+}
+
+unsigned long long hostMicros() {
+  return nowUs;
+}
+
+void hostSetPlant(HostPlantFn fn) {
+  plantFn = fn;
+}
+
+void hostSetTickHook(HostTickHookFn fn) {
+  tickHookFn = fn;
+}
+
+void hostSetAnalogSource(HostAnalogFn fn) {
+  analogFn = fn;
+}
+
+void hostSetManualInterrupts(bool manual) {
+  manualInterrupts = manual;
+}
+
+void hostFireTimer() {
+  if (timerRunning && timerIsr && !inIsr) {
+    timerDue = nowUs;                    // the overflow is now, as far as TCNT1 is concerned
+    fireTimer();
+  }
+}
+
+void hostFireAdc(uint16_t conversion) {
+  if (adcIsr && !inIsr) {
+    adcDue = nowUs;
+    fireAdc(conversion);
+  }
+}
+
+void hostSetPin(uint8_t pin, int level) {
+  if (pin >= HOST_PINS) {
+    return;
+  }
+  int previous = pinLevels[pin];
+  pinLevels[pin] = level;
+  if (previous == level) {
+    return;
+  }
+  for (int i = 0; i < HOST_EXTERNAL_INTERRUPTS; i++) {
+    if (EXTERNAL_INTERRUPT_PINS[i] == pin && externalIsr[i]) {
+      int mode = externalMode[i];
+      if (mode == CHANGE || (mode == RISING && level == HIGH) || (mode == FALLING && level == LOW)) {
+        externalPending[i] = true;
+      }
+    }
+  }
+  fireExternal();
+}
+
+int hostPinLevel(uint8_t pin) {
+  return pin < HOST_PINS ? pinLevels[pin] : LOW;
+}
+
+int hostPwmDuty(uint8_t pin) {
+  return pin < HOST_PINS ? pwmDuties[pin] : 0;
+}
+
+void hostSetSerialEcho(bool echo) {
+  serialEcho = echo;
+}
+
+void hostSetSerialSink(HostSerialSinkFn fn) {
+  serialSinkFn = fn;
+}
+
+void hostSerialInput(const uint8_t *data, size_t length) {
+  if (rxLineFreeAt < nowUs) {
+    rxLineFreeAt = nowUs;
+  }
+  for (size_t i = 0; i < length; i++) {
+    int next = (rxPendingTail + 1) % HOST_RX_PENDING;
+    if (next == rxPendingHead) {
+      counters.serialRxDropped++;
+      continue;
+    }
+    rxLineFreeAt += serialByteUs;
+    rxPending[rxPendingTail] = data[i];
+    rxPendingAt[rxPendingTail] = rxLineFreeAt;
+    rxPendingTail = next;
+  }
+}
+
+void hostSerialInput(const char *text) {
+  hostSerialInput((const uint8_t *) text, strlen(text));
+}
+
+// The RX interrupt, run late: moves every byte that has finished arriving into the RX buffer. As on the Uno, a byte
+// that arrives to a full buffer is lost
+static void serialReceive() {
+  while (rxPendingHead != rxPendingTail && rxPendingAt[rxPendingHead] <= nowUs) {
+    int next = (rxHead + 1) % SERIAL_RX_BUFFER;
+    if (next == rxTail) {
+      counters.serialRxDropped++;
+    } else {
+      rxBuffer[rxHead] = rxPending[rxPendingHead];
+      rxHead = next;
+    }
+    rxPendingHead = (rxPendingHead + 1) % HOST_RX_PENDING;
+  }
+}
+
+const HostCounters & hostCounters() {
+  return counters;
+}
+
+// ------------------------------------------------------------------------------------------------------------------
+// Arduino core
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (mode == INPUT_PULLUP) {
+    hostSetPin(pin, HIGH);
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  hostAdvance(DIGITAL_IO_US);
+  hostSetPin(pin, val ? HIGH : LOW);
+}
+
+int digitalRead(uint8_t pin) {
+  hostAdvance(DIGITAL_IO_US);
+  return hostPinLevel(pin);
+}
+
+int analogRead(uint8_t pin) {
+  counters.analogReads++;
+  hostAdvance(ANALOG_READ_US);
+  return analogValue(pin);
+}
+
+void hostAdcFreeRun(uint8_t pin, void (*isr)(uint16_t conversion)) {
+  adcPin = pin;
+  adcIsr = isr;
+  adcDue = nowUs + ADC_CONVERSION_US;
+}
+
+void analogWrite(uint8_t pin, int val) {
+  hostAdvance(DIGITAL_IO_US);
+  if (pin < HOST_PINS) {
+    pwmDuties[pin] = val;
+  }
+}
+
+unsigned long millis() {
+  hostAdvance(CLOCK_READ_US);
+  return (unsigned long) (nowUs / 1000);
+}
+
+unsigned long micros() {
+  hostAdvance(CLOCK_READ_US);
+  return (unsigned long) nowUs;
+}
+
+void delay(unsigned long ms) {
+  hostAdvance(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  hostAdvance(us);
+}
+
+void noInterrupts() {
+  irqEnabled = false;
+}
+
+void interrupts() {
+  irqEnabled = true;
+  fireExternal();
+}
+
+int digitalPinToInterrupt(uint8_t pin) {
+  for (int i = 0; i < HOST_EXTERNAL_INTERRUPTS; i++) {
+    if (EXTERNAL_INTERRUPT_PINS[i] == pin) {
+      return i;
+    }
+  }
+  return NOT_AN_INTERRUPT;
+}
+
+void attachInterrupt(uint8_t interruptNum, void (*isr)(), int mode) {
+  if (interruptNum < HOST_EXTERNAL_INTERRUPTS) {
+    externalIsr[interruptNum] = isr;
+    externalMode[interruptNum] = mode;
+    externalPending[interruptNum] = false;
+  }
+}
+
+void detachInterrupt(uint8_t interruptNum) {
+  if (interruptNum < HOST_EXTERNAL_INTERRUPTS) {
+    externalIsr[interruptNum] = 0;
+  }
+}
+
+char *dtostrf(double val, signed char width, unsigned char prec, char *sout) {
+  hostAdvance(FLOAT_FORMAT_US);
+  sprintf(sout, "%*.*f", width, prec, val);
+  return sout;
+}
+
+// ------------------------------------------------------------------------------------------------------------------
+// EEPROM
+
+static void eepromWait() {
+  if (nowUs < eepromBusyUntil) {
+    hostAdvance((unsigned long) (eepromBusyUntil - nowUs));
+  }
+}
+
+uint8_t EEPROMClass::read(int address) {
+  eepromWait();
+  return eepromData[address & (HOST_EEPROM_BYTES - 1)];
+}
+
+void EEPROMClass::write(int address, uint8_t value) {
+  eepromWait();
+  hostAdvance(DIGITAL_IO_US);
+  eepromData[address & (HOST_EEPROM_BYTES - 1)] = value;
+  eepromCellWrites[address & (HOST_EEPROM_BYTES - 1)]++;
+  counters.eepromWrites++;
+  eepromBusyUntil = nowUs + EEPROM_WRITE_US;
+}
+
+void EEPROMClass::update(int address, uint8_t value) {
+  if (read(address) != value) {
+    write(address, value);
+  }
+}
+
+bool eeprom_is_ready() {
+  return nowUs >= eepromBusyUntil;
+}
+
+void hostEepromErase() {
+  memset(eepromData, 0xFF, sizeof(eepromData));
+  memset(eepromCellWrites, 0, sizeof(eepromCellWrites));
+  eepromErased = true;
+  eepromBusyUntil = 0;
+}
+
+uint8_t * hostEeprom() {
+  return eepromData;
+}
+
+unsigned long hostEepromCellWrites(int address) {
+  return eepromCellWrites[address & (HOST_EEPROM_BYTES - 1)];
+}
+
+// ------------------------------------------------------------------------------------------------------------------
+// String
+
+String::String(const char *str) {
+  len = strlen(str);
+  buffer = (char *) malloc(len + 1);
+  memcpy(buffer, str, len + 1);
+}
+
+String::String(const String &other) {
+  len = other.len;
+  buffer = (char *) malloc(len + 1);
+  memcpy(buffer, other.buffer, len + 1);
+}
+
+String::~String() {
+  free(buffer);
+}
+
+String & String::operator=(const String &other) {
+  if (this != &other) {
+    free(buffer);
+    len = other.len;
+    buffer = (char *) malloc(len + 1);
+    memcpy(buffer, other.buffer, len + 1);
+  }
+  return *this;
+}
+
+// ------------------------------------------------------------------------------------------------------------------
+// Print
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  size_t n = 0;
+  while (size--) {
+    n += write(*buffer++);
+  }
+  return n;
+}
+
+static size_t printNumber(Print &p, const char *fmt, long long n, int base) {
+  char buf[32];
+  if (base == HEX) {
+    snprintf(buf, sizeof(buf), "%llX", (unsigned long long) n);
+  } else {
+    snprintf(buf, sizeof(buf), fmt, n);
+  }
+  return p.write(buf);
+}
+
+size_t Print::print(const __FlashStringHelper *str) { return write(reinterpret_cast<const char *>(str)); }
+size_t Print::print(const char str[]) { return write(str); }
+size_t Print::print(const String &s) { return write(s.c_str()); }
+size_t Print::print(char c) { return write((uint8_t) c); }
+size_t Print::print(int n, int base) { return printNumber(*this, "%lld", n, base); }
+size_t Print::print(unsigned int n, int base) { return printNumber(*this, "%llu", n, base); }
+size_t Print::print(long n, int base) { return printNumber(*this, "%lld", n, base); }
+size_t Print::print(unsigned long n, int base) { return printNumber(*this, "%llu", n, base); }
+
+size_t Print::print(double n, int digits) {
+  hostAdvance(FLOAT_FORMAT_US);
+  char buf[48];
+  snprintf(buf, sizeof(buf), "%.*f", digits, n);
+  return write(buf);
+}
+
+size_t Print::println() { return write("\r\n"); }
+size_t Print::println(const char str[]) { return print(str) + println(); }
+size_t Print::println(const __FlashStringHelper *str) { return print(str) + println(); }
+size_t Print::println(const String &s) { return print(s) + println(); }
+size_t Print::println(char c) { return print(c) + println(); }
+size_t Print::println(int n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned int n, int base) { return print(n, base) + println(); }
+size_t Print::println(long n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned long n, int base) { return print(n, base) + println(); }
+size_t Print::println(double n, int digits) { return print(n, digits) + println(); }
+
+// ------------------------------------------------------------------------------------------------------------------
+// HardwareSerial - bytes drain from a 64 byte TX buffer at the configured baud rate, writers block when it is full
+
+void HardwareSerial::begin(unsigned long baud) {
+  serialByteUs = (10UL * 1000000UL + baud - 1) / baud;
+  serialBusyUntil = nowUs;
+}
+
+int HardwareSerial::available() {
+  serialReceive();
+  return (rxHead - rxTail + SERIAL_RX_BUFFER) % SERIAL_RX_BUFFER;
+}
+
+int HardwareSerial::availableForWrite() {
+  if (serialBusyUntil <= nowUs) {
+    return SERIAL_TX_BUFFER - 1;
+  }
+  int queued = (int) ((serialBusyUntil - nowUs + serialByteUs - 1) / serialByteUs);
+  return queued >= SERIAL_TX_BUFFER - 1 ? 0 : SERIAL_TX_BUFFER - 1 - queued;
+}
+
+int HardwareSerial::read() {
+  serialReceive();
+  if (rxHead == rxTail) {
+    return -1;
+  }
+  uint8_t c = rxBuffer[rxTail];
+  rxTail = (rxTail + 1) % SERIAL_RX_BUFFER;
+  return c;
+}
+
+void HardwareSerial::flush() {
+  if (serialBusyUntil > nowUs) {
+    hostAdvance((unsigned long) (serialBusyUntil - nowUs));
+  }
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  unsigned long long roomAt = serialBusyUntil > (unsigned long long) SERIAL_TX_BUFFER * serialByteUs
+                              ? serialBusyUntil - (unsigned long long) SERIAL_TX_BUFFER * serialByteUs : 0;
+  if (roomAt > nowUs) {
+    unsigned long wait = (unsigned long) (roomAt - nowUs);
+    counters.serialStallUs += wait;
+    if (inIsr) {
+      counters.isrStallUs += wait;
+    }
+    hostAdvance(wait);
+  }
+  if (serialBusyUntil < nowUs) {
+    serialBusyUntil = nowUs;
+  }
+  serialBusyUntil += serialByteUs;
+  counters.serialBytes++;
+  if (serialEcho) {
+    putchar(c);
+  }
+  if (serialSinkFn) {
+    serialSinkFn(c);
+  }
+  return 1;
+}
+
+// ------------------------------------------------------------------------------------------------------------------
+// TimerOne
+
+// TOP as TimerOne::setPeriod() works it out: the smallest prescaler that fits half the period in 16 bits
+uint16_t hostTimer1Top() {
+  unsigned long cycles = F_CPU_MHZ / 2 * timerPeriod;
+  static const unsigned long PRESCALERS[] = { 1, 8, 64, 256, 1024 };
+  for (unsigned int i = 0; i < sizeof(PRESCALERS) / sizeof(PRESCALERS[0]); i++) {
+    if (cycles < TIMER1_RESOLUTION * PRESCALERS[i]) {
+      return (uint16_t) (cycles / PRESCALERS[i]);
+    }
+  }
+  return (uint16_t) (TIMER1_RESOLUTION - 1);
+}
+
+// Up from BOTTOM (the last overflow) to TOP in the first half of the period, back down in the second
+uint16_t hostTimer1Count() {
+  if (!timerRunning || nowUs + timerPeriod < timerDue) {
+    return 0;
+  }
+  unsigned long long top = hostTimer1Top();
+  unsigned long long since = nowUs + timerPeriod - timerDue;     // time since BOTTOM
+  unsigned long long count = since % timerPeriod * 2 * top / timerPeriod;
+  return (uint16_t) (count <= top ? count : 2 * top - count);
+}
+
+void TimerOne::initialize(long microseconds) {
+  setPeriod(microseconds);
+  timerRunning = true;
+  timerDue = nowUs + timerPeriod;
+}
+
+void TimerOne::setPeriod(long microseconds) {
+  if (microseconds > 0) {
+    timerPeriod = (unsigned long) microseconds;
+  }
+}
+
+void TimerOne::start() {
+  timerRunning = true;
+  timerDue = nowUs + timerPeriod;
+}
+
+void TimerOne::stop() {
+  timerRunning = false;
+}
+
+void TimerOne::restart() {
+  start();
+}
+
+void TimerOne::resume() {
+  timerRunning = true;
+  if (timerDue < nowUs) {
+    timerDue = nowUs;
+  }
+}
+
+void TimerOne::attachInterrupt(void (*isr)(), long microseconds) {
+  if (microseconds > 0) {
+    setPeriod(microseconds);
+  }
+  timerIsr = isr;
+}
+
+void TimerOne::detachInterrupt() {
+  timerIsr = 0;
+}
+
+void TimerOne::pwm(char pin, unsigned int duty, long microseconds) {
+  if (microseconds > 0) {
+    setPeriod(microseconds);
+  }
+  setPwmDuty(pin, duty);
+}
+
+void TimerOne::setPwmDuty(char pin, unsigned int duty) {
+  if ((uint8_t) pin < HOST_PINS) {
+    pwmDuties[(uint8_t) pin] = duty;
+  }
+}
+
+void TimerOne::disablePwm(char pin) {
+  setPwmDuty(pin, 0);
+}
+
+// ------------------------------------------------------------------------------------------------------------------
+// ServoTimer2 - writes only set the next pulse width, the pulses themselves come from Timer2
+
+const int SERVO_PULSE_DEFAULT_US = 1500;           // the library's centre position, until the first write
+
+uint8_t ServoTimer2::attach(int p) {
+  hostAdvance(DIGITAL_IO_US);
+  pin = (uint8_t) p;
+  if (pin < HOST_PINS) {
+    servoPulses[pin] = SERVO_PULSE_DEFAULT_US;
+  }
+  return pin;
+}
+
+void ServoTimer2::detach() {
+  if (pin < HOST_PINS) {
+    servoPulses[pin] = 0;
+  }
+  pin = 0xFF;
+}
+
+void ServoTimer2::write(int pulseWidth) {
+  if (pin < HOST_PINS) {
+    servoPulses[pin] = pulseWidth;
+  }
+}
+
+int ServoTimer2::read() {
+  return pin < HOST_PINS ? servoPulses[pin] : 0;
+}
+
+int hostServoPulse(uint8_t pin) {
+  return pin < HOST_PINS ? servoPulses[pin] : 0;
+}
+
+// ------------------------------------------------------------------------------------------------------------------
+// LiquidCrystal_I2C
+
+static void lcdBusTime(unsigned long lcdBytes) {
+  counters.lcdBytes += lcdBytes;
+  counters.i2cBytes += lcdBytes * LCD_I2C_BYTES_PER_BYTE;
+  hostAdvance(lcdBytes * LCD_I2C_BYTES_PER_BYTE * I2C_BYTE_US);
+}
+
+LiquidCrystal_I2C::LiquidCrystal_I2C(uint8_t lcd_addr, uint8_t lcd_cols, uint8_t lcd_rows) {
+  (void) lcd_addr;
+  cols = lcd_cols > MAX_COLS ? MAX_COLS : lcd_cols;
+  rows = lcd_rows > MAX_ROWS ? MAX_ROWS : lcd_rows;
+  col = 0;
+  line = 0;
+  for (uint8_t r = 0; r < MAX_ROWS; r++) {
+    memset(text[r], ' ', MAX_COLS);
+    text[r][MAX_COLS] = '\0';
+  }
+}
+
+void LiquidCrystal_I2C::begin() {
+  hostAdvance(LCD_BEGIN_US);
+  clear();
+}
+
+void LiquidCrystal_I2C::clear() {
+  for (uint8_t r = 0; r < MAX_ROWS; r++) {
+    memset(text[r], ' ', cols);
+  }
+  col = 0;
+  line = 0;
+  lcdBusTime(1);
+  hostAdvance(LCD_CLEAR_US);
+}
+
+void LiquidCrystal_I2C::home() {
+  col = 0;
+  line = 0;
+  lcdBusTime(1);
+  hostAdvance(LCD_CLEAR_US);
+}
+
+void LiquidCrystal_I2C::setCursor(uint8_t c, uint8_t r) {
+  col = c;
+  line = r;
+  lcdBusTime(1);
+}
+
+void LiquidCrystal_I2C::backlight() {
+  counters.i2cBytes += 2;
+  hostAdvance(2 * I2C_BYTE_US);
+}
+
+void LiquidCrystal_I2C::noBacklight() {
+  backlight();
+}
+
+size_t LiquidCrystal_I2C::write(uint8_t c) {
+  if (line < rows && col < cols) {
+    text[line][col] = (char) c;
+  }
+  col++;
+  lcdBusTime(1);
+  return 1;
+}
+
+const char *LiquidCrystal_I2C::row(uint8_t r) const {
+  static char out[MAX_COLS + 1];
+  memcpy(out, text[r < MAX_ROWS ? r : 0], MAX_COLS + 1);
+  out[cols] = '\0';
+  return out;
+}
@@ -0,0 +1,67 @@
+#ifndef HOST_CLOCK_H
+#define HOST_CLOCK_H
+
+#include <Arduino.h>
+
+/* Harness side of the host Arduino stand-in
+   Description : The controller only ever sees the Arduino API. Everything that takes time on the Uno charges a fixed
+                 cost to a virtual microsecond clock. Advancing the clock fires the Timer1 interrupt on schedule and
+                 hands each slice of elapsed time to the plant model, so the control loop, the plant and loop() all
+                 interleave the way they would on the bench .. only much faster than real time.
+*/
+
+// Plant model hook - called with each HOST_PLANT_SLICE_US slice of elapsed virtual time (the plant lags by less than a slice)
+typedef void (*HostPlantFn)(unsigned long dtUs);
+// Called after every Timer1 interrupt (ie once per control tick)
+typedef void (*HostTickHookFn)();
+// Receives every byte the controller writes to Serial
+typedef void (*HostSerialSinkFn)(uint8_t c);
+// Supplies the raw 10-bit ADC value for a pin
+typedef int (*HostAnalogFn)(uint8_t pin);
+
+const unsigned long HOST_PLANT_SLICE_US = 250;
+const int HOST_EEPROM_BYTES = 1024;             // ATmega328P
+
+struct HostCounters {
+  unsigned long isrCalls;               // Timer1 interrupts fired
+  unsigned long analogReads;            // blocking analogRead() calls
+  unsigned long adcConversions;         // free-running conversions delivered to the ADC interrupt
+  unsigned long lcdBytes;               // characters and commands sent to the LCD
+  unsigned long i2cBytes;               // bytes on the I2C bus
+  unsigned long serialBytes;            // bytes written to Serial
+  unsigned long long serialStallUs;     // time spent waiting for room in the serial TX buffer
+  unsigned long long isrStallUs;        // part of serialStallUs that happened inside the Timer1 interrupt
+  unsigned long serialRxDropped;        // bytes sent to the controller that arrived to a full RX buffer
+  unsigned long eepromWrites;           // EEPROM bytes written
+};
+
+void hostReset();
+unsigned long long hostMicros();
+void hostAdvance(unsigned long us);
+
+void hostSetPlant(HostPlantFn fn);
+void hostSetTickHook(HostTickHookFn fn);
+void hostSetAnalogSource(HostAnalogFn fn);
+
+// Replay: Timer1 and the ADC stop firing from the clock, and fire only when the harness calls these
+void hostSetManualInterrupts(bool manual);
+void hostFireTimer();                           // the Timer1 interrupt, now
+void hostFireAdc(uint16_t conversion);          // the ADC interrupt with this conversion result, now
+
+void hostSetPin(uint8_t pin, int level);        // drive an input pin from the outside world
+int hostPinLevel(uint8_t pin);                  // level last written to an output pin
+int hostPwmDuty(uint8_t pin);                   // Timer1 PWM duty (0..1023) last set on a pin
+int hostServoPulse(uint8_t pin);                // ServoTimer2 pulse width (us) last set on a pin, 0 if none
+
+void hostSetSerialEcho(bool echo);              // copy serial output to stdout
+void hostSetSerialSink(HostSerialSinkFn fn);
+void hostSerialInput(const uint8_t *data, size_t length);   // bytes for the controller .. they arrive at the baud rate from now
+void hostSerialInput(const char *text);
+const HostCounters & hostCounters();
+
+// EEPROM keeps its contents through hostReset(), as through a reset of the Uno
+void hostEepromErase();                         // all 0xFF, and the write counts cleared
+uint8_t * hostEeprom();                         // HOST_EEPROM_BYTES, to look at or corrupt between runs
+unsigned long hostEepromCellWrites(int address);   // times a byte has been written since the last hostEepromErase()
+
+#endif
@@ -0,0 +1,119 @@
+#include <math.h>
+#include "lung_model.h"
+
+void lungDefaults(LungParams &params) {
+  params.compliance = 0.05f;
+  params.resistance = 10.0f;
+  params.sourceResistance = 5.0f;
+  params.valveResistance = 5.0f;
+  params.leakResistance = 0.0f;
+  params.sourcePressureMax = 40.0f;
+  params.actuatorDeadband = 0.0f;
+  params.actuatorExponent = 1.0f;
+  params.peep = 5.0f;
+  params.sensorNoise = 0.0f;
+  params.effortPeriod = 0.0f;
+  params.effortAmplitude = 3.0f;
+  params.effortDuration = 0.6f;
+  params.effortStart = 1.0f;
+}
+
+void lungReset(Lung &lung, const LungParams &params) {
+  lung.params = params;
+  lung.time = 0;
+  lung.volume = 0;
+  lung.airwayPressure = params.peep;
+  lung.flow = 0;
+  lung.musclePressure = 0;
+  lung.efforts = 0;
+  lung.noiseState = 12345;
+}
+
+static float effortAt(Lung &lung) {
+  const LungParams &p = lung.params;
+  if (p.effortPeriod <= 0 || lung.time < p.effortStart) {
+    return 0;
+  }
+  double phase = fmod(lung.time - p.effortStart, p.effortPeriod);
+  if (phase >= p.effortDuration) {
+    return 0;
+  }
+  return p.effortAmplitude * (float) sin(M_PI * phase / p.effortDuration);
+}
+
+// Cheap repeatable gaussian-ish noise (sum of uniforms)
+static float noise(Lung &lung) {
+  float sum = 0;
+  for (int i = 0; i < 4; i++) {
+    lung.noiseState = lung.noiseState * 1103515245u + 12345u;
+    sum += ((lung.noiseState >> 8) & 0xFFFF) / 65535.0f - 0.5f;
+  }
+  return sum * 1.732f;         // unit variance
+}
+
+void lungStep(Lung &lung, float driveFraction, float dt) {
+  const LungParams &p = lung.params;
+
+  if (driveFraction < 0) {
+    driveFraction = 0;
+  }
+  if (driveFraction > 1) {
+    driveFraction = 1;
+  }
+
+  float previousEffort = lung.musclePressure;
+  lung.musclePressure = effortAt(lung);
+  if (previousEffort == 0 && lung.musclePressure > 0) {
+    lung.efforts++;
+  }
+
+  float alveolar = lung.volume / p.compliance + p.peep - lung.musclePressure;
+  float pushed = driveFraction;
+  if (p.actuatorDeadband > 0) {
+    pushed = driveFraction > p.actuatorDeadband ? (driveFraction - p.actuatorDeadband) / (1 - p.actuatorDeadband) : 0;
+  }
+  if (p.actuatorExponent != 1.0f) {
+    pushed = powf(pushed, p.actuatorExponent);
+  }
+  float source = pushed * p.sourcePressureMax;
+
+  float gPatient = 1.0f / p.resistance;
+  float gSource = 1.0f / p.sourceResistance;
+  float gValve = 1.0f / p.valveResistance;
+  float gLeak = p.leakResistance > 0 ? 1.0f / p.leakResistance : 0.0f;
+
+  // Find the consistent combination of the two one-way valves
+  float airway = alveolar;
+  for (int combo = 0; combo < 4; combo++) {
+    bool sourceOpen = (combo & 1) != 0;
+    bool valveOpen = (combo & 2) != 0;
+    if (sourceOpen && valveOpen) {
+      continue;                               // the non-rebreathing valve closes the exhaust while the bag pushes
+    }
+    float g = gPatient + gLeak;                 // the leak goes to 0 cmH2O, so adds nothing to i
+    float i = gPatient * alveolar;
+    if (sourceOpen) {
+      g += gSource;
+      i += gSource * source;
+    }
+    if (valveOpen) {
+      g += gValve;
+      i += gValve * p.peep;
+    }
+    float candidate = i / g;
+    bool sourceFlows = source > candidate;
+    bool valveFlows = candidate > p.peep && !sourceFlows;
+    if (sourceFlows == sourceOpen && valveFlows == valveOpen) {
+      airway = candidate;
+      break;
+    }
+  }
+
+  lung.flow = (airway - alveolar) * gPatient;
+  lung.volume += lung.flow * dt;
+  lung.airwayPressure = airway;
+  if (p.sensorNoise > 0) {
+    lung.airwayPressure += p.sensorNoise * noise(lung);
+  }
+  lung.time += dt;
+}
@@ -0,0 +1,53 @@
+#ifndef LUNG_MODEL_H
+#define LUNG_MODEL_H
+
+/* Single compartment resistance / compliance lung behind a bag-valve-mask
+   Description : The actuator squeezes the bag - modelled as a pressure source rising with the drive value (in proportion,
+                 unless the actuator is given a deadband or a curve), feeding the airway through the bag's one-way valve.
+                 When the bag is not pushing, the patient exhales through the exhalation valve to PEEP. The patient can add
+                 negative muscle pressure (spontaneous efforts). A leak to the room at the wye (a loose or disconnected
+                 circuit) can be opened with leakResistance.
+                 The airway pressure (at the sensor) is solved from the three branches meeting at the patient wye:
+
+                     bag source --R_source-->|-- airway --R_patient-- alveoli (V/C + PEEP - P_muscle)
+                                                  |
+                                                  +--R_valve-->|-- PEEP (exhalation valve)
+                                                  |
+                                                  +--R_leak-- room (0)
+
+   Units       : cmH2O, litres, seconds
+*/
+
+struct LungParams {
+  float compliance;           // L/cmH2O (0.05 = normal adult, 0.02 = stiff)
+  float resistance;           // patient airway resistance, cmH2O/(L/s)
+  float sourceResistance;     // bag and inspiratory limb, cmH2O/(L/s)
+  float valveResistance;      // exhalation valve, cmH2O/(L/s)
+  float leakResistance;       // leak to the room, cmH2O/(L/s) (0 = none)
+  float sourcePressureMax;    // pressure the bag develops at full drive (1023), cmH2O
+  float actuatorDeadband;     // fraction of full drive taken up before the bag is pushed at all (0 = none)
+  float actuatorExponent;     // beyond the deadband, bag pressure goes as drive to this power (1 = proportional)
+  float peep;                 // exhalation valve setting, cmH2O
+  float sensorNoise;          // standard deviation of the sensor noise, cmH2O
+  float effortPeriod;         // seconds between spontaneous efforts (0 = apnoeic patient)
+  float effortAmplitude;      // peak muscle pressure of an effort, cmH2O
+  float effortDuration;       // length of each effort, seconds
+  float effortStart;          // time of the first effort, seconds
+};
+
+struct Lung {
+  LungParams params;
+  double time;                // seconds since reset
+  float volume;               // volume above FRC, litres
+  float airwayPressure;       // pressure at the sensor, cmH2O
+  float flow;                 // into the patient, L/s (negative when exhaling)
+  float musclePressure;       // current patient effort, cmH2O
+  unsigned long efforts;      // efforts started since reset
+  unsigned int noiseState;
+};
+
+void lungDefaults(LungParams &params);
+void lungReset(Lung &lung, const LungParams &params);
+void lungStep(Lung &lung, float driveFraction, float dt);     // driveFraction 0..1 of full actuator drive
+
+#endif
@@ -0,0 +1,319 @@
+/* replay - run a recorded capture back through ventilator.cpp and compare the actuator output tick by tick
+   Usage : replay [-a] [-v] capture
+           capture is the raw serial stream of a unit running with recordInputs set (recorder.h) .. ventsim -w writes one
+           -a for a capture made with the adaptive tidal gain on (adaptTidal, ventsim -a)
+           -v lists the ticks whose drive differs
+
+   The recorded pressure samples, encoder edges, select button and remote sets are fed to the controller in the order
+   the unit saw them, with the control tick fired wherever the unit's tick came. Between inputs loop() runs on the
+   virtual clock as usual. Timer1 and the ADC are fired by hand (hostSetManualInterrupts), so a tick sees exactly the samples it saw on
+   the unit, whatever the host clock would have done.
+   The unit's TELEMETRY_FRAME_TICK frames in the same capture are the reference. Exits 1 if any tick's drive differs, if
+   no tick is compared, or if far fewer are than the unit sent (unless the recording has a gap).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "host_clock.h"
+#include "sim_harness.h"
+#include "telemetry_decoder.h"
+#include "pressure_adc.h"
+#include "recorder.h"
+#include "command.h"
+
+// From ventilator.cpp
+void setup();
+void loop();
+extern int respRate;
+extern int newRespRate;
+extern int tidal;
+extern int newTidal;
+extern float iERatio;
+extern float newIERatio;
+extern int currentMode;
+extern int targetInspPressure;
+extern bool adaptTidal;
+uint8_t remoteSet(const uint8_t *values, uint8_t length);
+
+const int MAX_TICK_EVENTS = 256;        // inputs between two ticks .. about 10 samples and a few edges in practice
+const int MAX_LISTED = 20;
+const unsigned long SHORT_FRACTION = 10;  // fails if it compares fewer than all but 1/this of the unit's tick frames
+
+enum EventType { EVENT_SAMPLE, EVENT_LEVELS, EVENT_REMOTE_SET };
+
+struct Event {
+  uint8_t type;
+  uint16_t value;
+};
+
+struct DriveLog {
+  uint16_t *drive;            // by tick number, unwrapped
+  bool *seen;
+  unsigned long size;
+  unsigned long ticks;        // highest tick number + 1
+  uint16_t lastTick;
+  unsigned long wraps;
+};
+
+static TelemetryDecoder replayDecoder;
+static DriveLog replayed;
+
+static void driveLogInit(DriveLog &log, unsigned long size) {
+  log.drive = (uint16_t *) calloc(size, sizeof(uint16_t));
+  log.seen = (bool *) calloc(size, sizeof(bool));
+  log.size = size;
+  log.ticks = 0;
+  log.lastTick = 0;
+  log.wraps = 0;
+}
+
+static void driveLogAdd(DriveLog &log, const TelemetryRecord &record) {
+  if (record.tick < log.lastTick) {
+    log.wraps++;
+  }
+  log.lastTick = record.tick;
+  unsigned long index = log.wraps * 65536UL + record.tick;
+  if (index < log.size) {
+    log.drive[index] = record.drive;
+    log.seen[index] = true;
+    if (index + 1 > log.ticks) {
+      log.ticks = index + 1;
+    }
+  }
+}
+
+static void onReplaySerial(uint8_t c) {
+  TelemetryRecord record;
+  if (telemetryDecoderFeed(replayDecoder, c) == TELEMETRY_DECODE_FRAME && telemetryDecodeTick(replayDecoder, record)) {
+    driveLogAdd(replayed, record);
+  }
+}
+
+static void runLoopUntil(unsigned long long t) {
+  while (hostMicros() < t) {
+    loop();
+    hostAdvance(SIM_LOOP_OVERHEAD_US);
+  }
+}
+
+static void setLevels(uint8_t levels) {
+  hostSetPin(SIM_SELECT_BUTTON, (levels & RECORD_INPUT_SELECT) ? HIGH : LOW);
+  hostSetPin(SIM_ROTARY_CLK, (levels & RECORD_INPUT_CLK) ? HIGH : LOW);
+  hostSetPin(SIM_ROTARY_DT, (levels & RECORD_INPUT_DT) ? HIGH : LOW);
+}
+
+// A recorded remote set, as the COMMAND_SET that made it .. through remoteSet(), as on the unit
+static void remoteSetFrom(const uint8_t *recorded) {
+  uint8_t values[COMMAND_PARAMS * 3];
+  const uint8_t PARAMS[COMMAND_PARAMS] = { COMMAND_PARAM_MODE, COMMAND_PARAM_RESP_RATE, COMMAND_PARAM_TIDAL,
+                                           COMMAND_PARAM_IE_RATIO, COMMAND_PARAM_INSP_PRESSURE };
+  const uint16_t settings[COMMAND_PARAMS] = { recorded[0], recorded[1], (uint16_t) (recorded[2] | (recorded[3] << 8)),
+                                              recorded[4], recorded[5] };
+  for (uint8_t i = 0; i < COMMAND_PARAMS; i++) {
+    values[i * 3] = PARAMS[i];
+    values[i * 3 + 1] = settings[i] & 0xFF;
+    values[i * 3 + 2] = settings[i] >> 8;
+  }
+  if (remoteSet(values, sizeof(values)) != COMMAND_STATUS_OK) {
+    fprintf(stderr, "replay: a recorded remote set was refused .. the replay has gone its own way\n");
+  }
+}
+
+static int signExtend(int value, int bits) {
+  int sign = 1 << (bits - 1);
+  return (value & (sign - 1)) - (value & sign);
+}
+
+static bool readFile(const char *path, uint8_t *&data, size_t &length) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    return false;
+  }
+  fseek(f, 0, SEEK_END);
+  length = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  data = (uint8_t *) malloc(length ? length : 1);
+  bool ok = fread(data, 1, length, f) == length;
+  fclose(f);
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  bool verbose = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "av")) != -1) {
+    switch (opt) {
+      case 'a': adaptTidal = true; break;
+      case 'v': verbose = true; break;
+      default:
+        fprintf(stderr, "usage: %s [-a] [-v] capture\n", argv[0]);
+        return 2;
+    }
+  }
+  if (optind >= argc) {
+    fprintf(stderr, "usage: %s [-a] [-v] capture\n", argv[0]);
+    return 2;
+  }
+
+  uint8_t *capture;
+  size_t captureLength;
+  if (!readFile(argv[optind], capture, captureLength)) {
+    fprintf(stderr, "replay: cannot read %s\n", argv[optind]);
+    return 2;
+  }
+
+  // Split the capture into the input token stream and the unit's own per-tick drive
+  uint8_t *tokens = (uint8_t *) malloc(captureLength ? captureLength : 1);
+  size_t tokenCount = 0;
+  DriveLog reference;
+  driveLogInit(reference, captureLength + 1);       // every tick leaves at least its tick token in the capture
+  TelemetryDecoder decoder;
+  telemetryDecoderReset(decoder);
+  for (size_t i = 0; i < captureLength; i++) {
+    TelemetryRecord record;
+    if (telemetryDecoderFeed(decoder, capture[i]) != TELEMETRY_DECODE_FRAME) {
+      continue;
+    }
+    if (decoder.type == TELEMETRY_FRAME_INPUTS) {
+      memcpy(tokens + tokenCount, decoder.payload, decoder.length);
+      tokenCount += decoder.length;
+    } else if (telemetryDecodeTick(decoder, record)) {
+      driveLogAdd(reference, record);
+    }
+  }
+  if (decoder.crcErrors) {
+    printf("warning          %lu frames in the capture failed their CRC .. the replay may go wrong after them\n",
+           decoder.crcErrors);
+  }
+  if (tokenCount < 1 + RECORD_SETTINGS_BYTES || tokens[0] != RECORD_SETTINGS) {
+    fprintf(stderr, "replay: %s has no recording from reset (was recordInputs set?)\n", argv[optind]);
+    return 2;
+  }
+
+  // The settings the unit started with
+  size_t pos = 1;
+  currentMode = tokens[pos];
+  respRate = newRespRate = tokens[pos + 1];
+  tidal = newTidal = tokens[pos + 2] | (tokens[pos + 3] << 8);
+  iERatio = newIERatio = tokens[pos + 4] / 10.0f;
+  targetInspPressure = tokens[pos + 5];
+  pos += RECORD_SETTINGS_BYTES;
+
+  hostReset();
+  hostSetManualInterrupts(true);
+  telemetryDecoderReset(replayDecoder);
+  driveLogInit(replayed, reference.size);
+  hostSetSerialSink(onReplaySerial);
+  setup();
+  uint8_t decimation = (PRESSURE_ADC_CONVERSION_HZ + pressureAdcSampleRate() / 2) / pressureAdcSampleRate();
+
+  struct timespec wallStart, wallEnd;
+  clock_gettime(CLOCK_MONOTONIC, &wallStart);
+
+  static Event events[MAX_TICK_EVENTS];
+  static size_t remoteSets[MAX_TICK_EVENTS];       // where each EVENT_REMOTE_SET's settings are in the tokens
+  int eventCount = 0;
+  int remoteCount = 0;
+  unsigned long ticks = 0;
+  unsigned long samples = 0;
+  unsigned long edges = 0;
+  unsigned long commits = 0;
+  unsigned long remotes = 0;
+  uint16_t sample = 0;
+  bool gap = false;
+  unsigned long long tickStart = hostMicros();
+  while (pos < tokenCount && !gap) {
+    uint8_t token = tokens[pos++];
+    if (eventCount > MAX_TICK_EVENTS - 2) {
+      fprintf(stderr, "replay: more than %d inputs in one tick .. capture is corrupt\n", MAX_TICK_EVENTS);
+      return 2;
+    }
+    if ((token & 0xC0) == RECORD_PAIR) {
+      sample += signExtend(token >> 3, 3);
+      events[eventCount++] = (Event) { EVENT_SAMPLE, sample };
+      sample += signExtend(token, 3);
+      events[eventCount++] = (Event) { EVENT_SAMPLE, sample };
+    } else if ((token & 0xC0) == RECORD_DELTA) {
+      sample += signExtend(token, 6);
+      events[eventCount++] = (Event) { EVENT_SAMPLE, sample };
+    } else if ((token & 0xF0) == RECORD_ABSOLUTE && pos < tokenCount) {
+      sample = ((token & 0x03) << 8) | tokens[pos++];
+      events[eventCount++] = (Event) { EVENT_SAMPLE, sample };
+    } else if ((token & 0xF0) == RECORD_INPUTS) {
+      events[eventCount++] = (Event) { EVENT_LEVELS, (uint16_t) (token & 0x07) };
+      edges++;
+    } else if (token == RECORD_SETTINGS && pos + RECORD_SETTINGS_BYTES <= tokenCount) {
+      pos += RECORD_SETTINGS_BYTES;                  // committed by the menu or a remote set .. the replay gets there itself
+      commits++;
+    } else if (token == RECORD_REMOTE_SET && pos + RECORD_SETTINGS_BYTES <= tokenCount) {
+      remoteSets[remoteCount] = pos;
+      events[eventCount++] = (Event) { EVENT_REMOTE_SET, (uint16_t) remoteCount++ };
+      pos += RECORD_SETTINGS_BYTES;
+      remotes++;
+    } else if (token == RECORD_TICK) {
+      // Spread this tick's inputs across the tick period, running loop() in between, then fire the tick
+      for (int i = 0; i < eventCount; i++) {
+        runLoopUntil(tickStart + (unsigned long long) (i + 1) * SIM_TICK_US / (eventCount + 1));
+        if (events[i].type == EVENT_SAMPLE) {
+          for (uint8_t c = 0; c < decimation; c++) {
+            hostFireAdc(events[i].value);
+          }
+          samples++;
+        } else if (events[i].type == EVENT_REMOTE_SET) {
+          remoteSetFrom(tokens + remoteSets[events[i].value]);
+        } else {
+          setLevels((uint8_t) events[i].value);
+        }
+      }
+      eventCount = 0;
+      remoteCount = 0;
+      tickStart += SIM_TICK_US;
+      runLoopUntil(tickStart);
+      hostFireTimer();
+      ticks++;
+    } else {
+      gap = true;                                    // RECORD_OVERFLOW (or garbage) .. the inputs are incomplete from here
+    }
+  }
+  runLoopUntil(hostMicros() + 100000);               // let the last telemetry out
+
+  clock_gettime(CLOCK_MONOTONIC, &wallEnd);
+  double wall = (wallEnd.tv_sec - wallStart.tv_sec) + (wallEnd.tv_nsec - wallStart.tv_nsec) * 1e-9;
+  double simulated = ticks * (SIM_TICK_US * 1e-6);
+
+  unsigned long frames = 0;                          // the unit's tick frames .. the ones a full replay should match
+  unsigned long compared = 0;
+  unsigned long differ = 0;
+  for (unsigned long t = 0; t < reference.ticks; t++) {
+    frames += reference.seen[t];
+  }
+  for (unsigned long t = 0; t < reference.ticks && t < replayed.ticks; t++) {
+    if (!reference.seen[t] || !replayed.seen[t]) {
+      continue;
+    }
+    compared++;
+    if (reference.drive[t] != replayed.drive[t]) {
+      if (verbose && differ < (unsigned long) MAX_LISTED) {
+        printf("tick %6lu  unit drive %4u  replay drive %4u\n", t, reference.drive[t], replayed.drive[t]);
+      }
+      differ++;
+    }
+  }
+
+  printf("capture          %lu ticks, %lu samples, %lu input edges, %lu settings commits (%lu remote)%s\n",
+         ticks, samples, edges, commits, remotes, gap ? " (recording has a gap - replayed up to it)" : "");
+  printf("replayed         %.1f s in %.2f s (%.0fx real time)\n", simulated, wall, wall > 0 ? simulated / wall : 0);
+  printf("actuator         %lu ticks compared, %lu differ\n", compared, differ);
+  printf("settings at end  mode %d, %d bpm, %d ml, I:E 1:%.1f, %d cmH2O\n",
+         currentMode, respRate, tidal, iERatio, targetInspPressure);
+
+  // A replay that puts out no tick frames, or stops well short of the unit's, has not been checked .. fail it
+  bool shortRun = (compared == 0) || (!gap && compared < frames - frames / SHORT_FRACTION);
+  if (shortRun) {
+    printf("replay short     %lu of the unit's %lu tick frames compared\n", compared, frames);
+  }
+  return (differ || shortRun) ? 1 : 0;
+}
@@ -0,0 +1,200 @@
+#include <math.h>
+#include <Arduino.h>
+#include "host_clock.h"
+#include "sim_harness.h"
+#include "actuator.h"
+#include "timebase.h"
+
+// From ventilator.cpp
+void setup();
+void loop();
+extern int breathState;
+
+const int SIM_INHALE_STATE = 0;
+
+// Pressure sensor convert from raw to CM H20 - the controller's constants (PRESS_SENSOR_MULTIPLIER / CONSTANT)
+const float SENSOR_MULTIPLIER = 0.1331f;
+const float SENSOR_CONSTANT = -5.7f;
+
+static Lung lung;
+static SimBreathFn breathFn = 0;
+static SimTickFn tickFn = 0;
+static unsigned long breaths = 0;
+static unsigned long loopPasses = 0;
+static int lastState = -1;
+static SimBreath current;
+static float startVolume = 0;
+static float maxVolume = 0;
+static double inhaleEnd = 0;
+static uint8_t knobState = 3;          // CLK << 1 | DT, both high at a detent
+
+// Clockwise order of the encoder's CLK/DT states (CLK leads DT)
+static const uint8_t KNOB_SEQUENCE[4] = { 3, 1, 0, 2 };
+const double SIM_BUTTON_SETTLE_S = 0.05;
+
+int simPressureToRaw(float cmH2O) {
+  return (int) lroundf((cmH2O - SENSOR_CONSTANT) / SENSOR_MULTIPLIER);
+}
+
+float simFilteredToPressure(uint16_t filtered) {
+  return filtered / 16.0f * SENSOR_MULTIPLIER + SENSOR_CONSTANT;
+}
+
+static int analogSource(uint8_t pin) {
+  if (pin != SIM_PRESSURE_PIN) {
+    return 0;
+  }
+  return simPressureToRaw(lung.airwayPressure);
+}
+
+int simActuatorDrive() {
+  long drive;
+#if VENT_ACTUATOR == VENT_ACTUATOR_SERVO
+  drive = lroundf((hostServoPulse(SIM_SERVO_PIN) - SERVO_PULSE_MIN_US) * (float) ACTUATOR_DRIVE_MAX /
+                  (SERVO_PULSE_MAX_US - SERVO_PULSE_MIN_US));
+#elif VENT_ACTUATOR == VENT_ACTUATOR_CURRENT_LOOP
+  drive = lroundf((hostPwmDuty(SIM_PWM_PIN) - CURRENT_LOOP_DUTY_ZERO) * (float) ACTUATOR_DRIVE_MAX /
+                  (ACTUATOR_DRIVE_MAX - CURRENT_LOOP_DUTY_ZERO));
+#else
+  drive = hostPwmDuty(SIM_PWM_PIN);
+#endif
+  return drive < 0 ? 0 : (drive > ACTUATOR_DRIVE_MAX ? ACTUATOR_DRIVE_MAX : (int) drive);
+}
+
+static void plantStep(unsigned long dtUs) {
+  lungStep(lung, simActuatorDrive() / (float) ACTUATOR_DRIVE_MAX, dtUs * 1e-6f);
+  if (lung.airwayPressure > current.peakPressure) {
+    current.peakPressure = lung.airwayPressure;
+  }
+  if (lung.volume > maxVolume) {
+    maxVolume = lung.volume;
+  }
+}
+
+static void startBreath() {
+  current.start = lung.time;
+  current.peakPressure = lung.airwayPressure;
+  current.patientTriggered = lung.musclePressure > 0;
+  startVolume = lung.volume;
+  maxVolume = lung.volume;
+}
+
+static void tickHook() {
+  if (tickFn) {
+    tickFn();
+  }
+  if (breathState == lastState) {
+    return;
+  }
+  if (breathState == SIM_INHALE_STATE) {
+    if (lastState >= 0) {
+      breaths++;
+      current.index = breaths;
+      current.period = (float) (lung.time - current.start);
+      current.inhaleTime = (float) (inhaleEnd - current.start);
+      current.endExpiratoryPressure = lung.airwayPressure;
+      current.tidalVolume = maxVolume - startVolume;
+      if (breathFn) {
+        breathFn(current);
+      }
+    }
+    startBreath();
+  } else {
+    inhaleEnd = lung.time;
+  }
+  lastState = breathState;
+}
+
+void simBegin(const LungParams &params) {
+  hostEepromErase();
+  simPowerCycle(params);
+}
+
+void simPowerCycle(const LungParams &params) {
+  hostReset();
+  lungReset(lung, params);
+  breaths = 0;
+  loopPasses = 0;
+  lastState = -1;
+  knobState = 3;
+  startBreath();
+  hostSetPlant(plantStep);
+  hostSetAnalogSource(analogSource);
+  hostSetTickHook(tickHook);
+  setup();
+}
+
+void simSetBreathHandler(SimBreathFn fn) {
+  breathFn = fn;
+}
+
+void simSetTickHandler(SimTickFn fn) {
+  tickFn = fn;
+}
+
+void simRunBreaths(unsigned long count) {
+  unsigned long target = breaths + count;
+  while (breaths < target) {
+    loop();
+    loopPasses++;
+    hostAdvance(SIM_LOOP_OVERHEAD_US);
+#if VENT_TIMEBASE == VENT_TIMEBASE_LOOP
+    tickHook();                                    // the tick ran (or not) from loop() .. Timer1 never fires
+#endif
+  }
+}
+
+void simRunSeconds(double seconds) {
+  unsigned long long end = hostMicros() + (unsigned long long) (seconds * 1e6);
+  while (hostMicros() < end) {
+    loop();
+    loopPasses++;
+    hostAdvance(SIM_LOOP_OVERHEAD_US);
+#if VENT_TIMEBASE == VENT_TIMEBASE_LOOP
+    tickHook();                                    // the tick ran (or not) from loop() .. Timer1 never fires
+#endif
+  }
+}
+
+unsigned long simBreaths() {
+  return breaths;
+}
+
+unsigned long simLoopPasses() {
+  return loopPasses;
+}
+
+double simSeconds() {
+  return hostMicros() * 1e-6;
+}
+
+Lung & simLung() {
+  return lung;
+}
+
+static void knobEdge(int direction) {
+  int position = 0;
+  while (KNOB_SEQUENCE[position] != knobState) {
+    position++;
+  }
+  knobState = KNOB_SEQUENCE[(position + direction + 4) % 4];
+  hostSetPin(SIM_ROTARY_CLK, (knobState & 2) ? HIGH : LOW);
+  hostSetPin(SIM_ROTARY_DT, (knobState & 1) ? HIGH : LOW);
+}
+
+void simTurnKnob(int steps, double secondsPerStep) {
+  int direction = steps < 0 ? -1 : 1;
+  for (int i = 0; i != steps; i += direction) {
+    knobEdge(direction);
+    simRunSeconds(secondsPerStep / 2);
+    knobEdge(direction);
+    simRunSeconds(secondsPerStep / 2);
+  }
+}
+
+void simPressButton(double seconds) {
+  hostSetPin(SIM_SELECT_BUTTON, LOW);
+  simRunSeconds(seconds);
+  hostSetPin(SIM_SELECT_BUTTON, HIGH);
+  simRunSeconds(SIM_BUTTON_SETTLE_S);
+}
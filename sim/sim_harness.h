@@ -0,0 +1,63 @@
+#ifndef SIM_HARNESS_H
+#define SIM_HARNESS_H
+
+#include <stdint.h>
+#include "lung_model.h"
+
+/* Closed-loop harness: ventilator.cpp + host clock + lung model
+   Description : Feeds the PWM output of the controller to the lung model and the lung's airway pressure back to
+                 PRESSURE_SENSOR_PIN, then spins loop() on the virtual clock. Breaths are counted from the controller's
+                 own breathState transitions, so the harness needs no knowledge of how the controller times them.
+*/
+
+// Pin assignments mirrored from ventilator.cpp (consts there have internal linkage)
+const unsigned char SIM_PWM_PIN = 9;
+const unsigned char SIM_SERVO_PIN = 10;
+const unsigned char SIM_PRESSURE_PIN = 14;         // A0
+const unsigned char SIM_ROTARY_CLK = 2;
+const unsigned char SIM_ROTARY_DT = 3;
+const unsigned char SIM_SELECT_BUTTON = 4;         // pulled up, low while pressed
+#ifndef CONTROL_TICK_US
+#define CONTROL_TICK_US 10000                      // as ventilator.cpp .. both follow -DCONTROL_TICK_US
+#endif
+const unsigned long SIM_TICK_US = CONTROL_TICK_US; // TIME_BETWEEN_TICKS
+
+const unsigned long SIM_LOOP_OVERHEAD_US = 10;     // charged per loop() pass so that a pass with no I/O still advances time
+
+struct SimBreath {
+  unsigned long index;        // breaths completed since setup()
+  double start;               // seconds
+  float period;               // seconds, inhale start to next inhale start
+  float inhaleTime;           // seconds
+  float peakPressure;         // cmH2O at the sensor
+  float endExpiratoryPressure;// cmH2O at the sensor as the next inhale starts
+  float tidalVolume;          // litres delivered to the lung
+  bool patientTriggered;      // an effort was in progress when the inhale started
+};
+
+typedef void (*SimBreathFn)(const SimBreath &breath);
+typedef void (*SimTickFn)();
+
+void simBegin(const LungParams &lung);              // resets the host (EEPROM erased), wires up the lung and runs setup()
+void simPowerCycle(const LungParams &lung);         // .. the same, but the EEPROM keeps what the last run wrote. The
+                                                    // controller's globals are left as they are: the caller puts back the
+                                                    // ones that a real reset would re-initialise
+void simSetBreathHandler(SimBreathFn fn);
+void simSetTickHandler(SimTickFn fn);               // called after every control tick (after every loop() pass when the
+                                                    // tick is run from loop(), VENT_TIMEBASE_LOOP)
+void simRunBreaths(unsigned long breaths);          // run until this many more breaths have completed
+void simRunSeconds(double seconds);
+unsigned long simBreaths();
+unsigned long simLoopPasses();                      // calls to loop() so far
+double simSeconds();
+Lung & simLung();
+
+// The user at the front panel. Both keep loop() running on the virtual clock while they act
+void simTurnKnob(int steps, double secondsPerStep);  // +ve = clockwise, two CLK/DT edges per step
+void simPressButton(double seconds);                 // press, hold, release, then wait out the debounce
+
+int simActuatorDrive();                              // the actuator output as drive 0..1023, whichever actuator is built in
+int simPressureToRaw(float cmH2O);                   // MPX5010DP transfer used by the controller, inverted
+float simFilteredToPressure(uint16_t filtered);      // the controller's Q4 filtered sensor units to cmH2O
+
+#endif
@@ -0,0 +1,96 @@
+#include "telemetry_decoder.h"
+
+enum {
+  WAIT_SYNC_1,
+  WAIT_SYNC_2,
+  WAIT_TYPE,
+  WAIT_LENGTH,
+  WAIT_PAYLOAD,
+  WAIT_CRC
+};
+
+void telemetryDecoderReset(TelemetryDecoder &d) {
+  d.state = WAIT_SYNC_1;
+  d.frames = 0;
+  d.crcErrors = 0;
+}
+
+TelemetryDecodeResult telemetryDecoderFeed(TelemetryDecoder &d, uint8_t c) {
+  switch (d.state) {
+    case WAIT_SYNC_1:
+      if (c == TELEMETRY_SYNC_1) {
+        d.state = WAIT_SYNC_2;
+        return TELEMETRY_DECODE_PENDING;
+      }
+      return TELEMETRY_DECODE_TEXT;
+
+    case WAIT_SYNC_2:
+      if (c == TELEMETRY_SYNC_2) {
+        d.state = WAIT_TYPE;
+        return TELEMETRY_DECODE_PENDING;
+      }
+      d.state = (c == TELEMETRY_SYNC_1) ? WAIT_SYNC_2 : WAIT_SYNC_1;
+      return d.state == WAIT_SYNC_1 ? TELEMETRY_DECODE_TEXT : TELEMETRY_DECODE_PENDING;
+
+    case WAIT_TYPE:
+      d.type = c;
+      d.crc = telemetryCrc8(0, c);
+      d.state = WAIT_LENGTH;
+      return TELEMETRY_DECODE_PENDING;
+
+    case WAIT_LENGTH:
+      if (c > TELEMETRY_MAX_PAYLOAD) {
+        d.crcErrors++;
+        d.state = WAIT_SYNC_1;
+        return TELEMETRY_DECODE_BAD_CRC;
+      }
+      d.length = c;
+      d.index = 0;
+      d.crc = telemetryCrc8(d.crc, c);
+      d.state = c ? WAIT_PAYLOAD : WAIT_CRC;
+      return TELEMETRY_DECODE_PENDING;
+
+    case WAIT_PAYLOAD:
+      d.payload[d.index++] = c;
+      d.crc = telemetryCrc8(d.crc, c);
+      if (d.index == d.length) {
+        d.state = WAIT_CRC;
+      }
+      return TELEMETRY_DECODE_PENDING;
+
+    default:
+      d.state = WAIT_SYNC_1;
+      if (c != d.crc) {
+        d.crcErrors++;
+        return TELEMETRY_DECODE_BAD_CRC;
+      }
+      d.frames++;
+      return TELEMETRY_DECODE_FRAME;
+  }
+}
+
+bool telemetryDecodeTick(const TelemetryDecoder &d, TelemetryRecord &record) {
+  if (d.type != TELEMETRY_FRAME_TICK || d.length != TELEMETRY_RECORD_BYTES) {
+    return false;
+  }
+  record.tick = d.payload[0] | (d.payload[1] << 8);
+  record.state = d.payload[2];
+  record.events = d.payload[3];
+  record.drive = d.payload[4] | (d.payload[5] << 8);
+  record.pressure = d.payload[6] | (d.payload[7] << 8);
+  return true;
+}
+
+bool telemetryDecodeBreath(const TelemetryDecoder &d, BreathMetrics &metrics) {
+  if (d.type != TELEMETRY_FRAME_BREATH || d.length != BREATH_METRICS_BYTES) {
+    return false;
+  }
+  metrics.index = d.payload[0] | (d.payload[1] << 8);
+  metrics.pip = d.payload[2] | (d.payload[3] << 8);
+  metrics.peep = d.payload[4] | (d.payload[5] << 8);
+  metrics.meanPressure = d.payload[6] | (d.payload[7] << 8);
+  metrics.periodTicks = d.payload[8] | (d.payload[9] << 8);
+  metrics.inhaleTicks = d.payload[10] | (d.payload[11] << 8);
+  metrics.flags = d.payload[12];
+  return true;
+}
@@ -0,0 +1,39 @@
+#ifndef TELEMETRY_DECODER_H
+#define TELEMETRY_DECODER_H
+
+#include <stdint.h>
+#include "telemetry.h"
+#include "breath_metrics.h"
+
+/* Incremental decoder for the controller's serial stream (frame format in ventilator/telemetry.h)
+   Bytes are fed one at a time. Anything outside a frame is handed back as text, so the controller's
+   Serial.print output and the binary telemetry can share one link.
+*/
+
+enum TelemetryDecodeResult {
+  TELEMETRY_DECODE_PENDING,   // byte consumed, frame not yet complete
+  TELEMETRY_DECODE_TEXT,      // byte is not part of a frame
+  TELEMETRY_DECODE_FRAME,     // a frame with a good CRC is ready in type / length / payload
+  TELEMETRY_DECODE_BAD_CRC    // a frame was dropped
+};
+
+struct TelemetryDecoder {
+  uint8_t state;
+  uint8_t type;
+  uint8_t length;
+  uint8_t index;
+  uint8_t crc;
+  uint8_t payload[TELEMETRY_MAX_PAYLOAD];
+  unsigned long frames;
+  unsigned long crcErrors;
+};
+
+void telemetryDecoderReset(TelemetryDecoder &d);
+TelemetryDecodeResult telemetryDecoderFeed(TelemetryDecoder &d, uint8_t c);
+
+// Unpack a TELEMETRY_FRAME_TICK payload
+bool telemetryDecodeTick(const TelemetryDecoder &d, TelemetryRecord &record);
+// Unpack a TELEMETRY_FRAME_BREATH payload
+bool telemetryDecodeBreath(const TelemetryDecoder &d, BreathMetrics &metrics);
+
+#endif
@@ -0,0 +1,411 @@
+/* ventmon - the telemetry of many ventilators at once, on one thread
+   Usage : ventmon [-c csv] [-i interval] [-t seconds] [-k tick_us] [-q] device ...
+           each device is a unit's serial port (its USB serial adapter, or a ventpty terminal)
+           -c appends a row per breath, from every unit, to csv
+           -i redraws the live view every interval seconds (default 1), -q leaves the view out
+           -t stops after seconds .. otherwise it runs until interrupted, or until every unit has gone
+           -k the units' control tick in us (default 10000, CONTROL_TICK_US as shipped), to turn ticks into seconds
+
+   Every port is opened non-blocking, raw at 115200 baud, and watched with epoll. Whatever a read returns is fed through
+   the unit's own TelemetryDecoder a byte at a time, so a frame split across reads needs no copying and one unit's
+   stream never waits on another's. For each unit ventmon keeps, in fixed arrays set up before the first read:
+     - a ring of its last UNIT_BREATHS breaths (BreathEntry, 16 bytes each) .. the live view's one-minute figures
+     - the pressure range and the tick counter's gaps (records lost in the unit or on the link) since the last redraw
+     - the last line of text it printed
+   Nothing is allocated once the ports are open.
+
+   Output      : the live view on stdout, a line per unit (the screen is cleared first on a terminal)
+                 the CSV: time_s,unit,device,breath,period_s,inhale_s,rate_bpm,pip_cmh2o,peep_cmh2o,pmean_cmh2o,patient
+                 on exit, on stderr:
+                   "ventmon: units N seconds S bytes B ticks T lost L breaths R bad X cpu C s"
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <termios.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include "telemetry_decoder.h"
+
+const int MAX_UNITS = 128;
+const int UNIT_BREATHS = 256;                   // a power of two .. over 20 minutes at 12 bpm
+const int TEXT_MAX = 64;
+const size_t DEVICE_COLUMN = 16;
+const int READ_BYTES = 4096;
+const int MAX_EVENTS = 64;
+const double WINDOW_S = 60;                     // the live view's averages are over this long
+const unsigned long TICK_US_DEFAULT = 10000;
+const char CSV_HEADER[] =
+    "time_s,unit,device,breath,period_s,inhale_s,rate_bpm,pip_cmh2o,peep_cmh2o,pmean_cmh2o,patient\n";
+
+// As ventilator.cpp
+const float PRESS_SENSOR_MULTIPLIER = 0.1331f;
+const float PRESS_SENSOR_CONSTANT = -5.7f;
+const float PRESS_FILTERED_SCALE = 1.0f / 16;
+const uint8_t INHALE_STATE = 0;
+
+struct BreathEntry {
+  uint32_t receivedMs;        // since ventmon started
+  uint16_t periodTicks;
+  uint16_t inhaleTicks;
+  int16_t pip;                // cmH2O x 10
+  int16_t peep;
+  int16_t meanPressure;
+  uint8_t flags;              // BREATH_* bits
+};
+
+struct Unit {
+  const char *path;
+  int fd;                     // -1 once the unit has gone
+  TelemetryDecoder decoder;
+  unsigned long bytes;
+  unsigned long ticks;        // tick frames
+  unsigned long lost;         // tick records missing from the counter's run
+  unsigned long breaths;      // breath frames .. the newest is ring[(breaths - 1) % UNIT_BREATHS]
+  unsigned long alarms;       // ticks with TELEMETRY_EVENT_ALARM
+  uint16_t lastTick;
+  uint16_t tickStep;          // ticks between records (TICKS_PER_TELEMETRY), 0 until two have come
+  bool ticking;
+  uint8_t state;
+  float pressure;             // cmH2O, the latest record
+  float pressureMin;          // .. and the range since the last redraw
+  float pressureMax;
+  unsigned long viewBytes;    // at the last redraw
+  unsigned long viewTicks;
+  BreathEntry ring[UNIT_BREATHS];
+  char text[TEXT_MAX];        // the line being printed ..
+  uint8_t textLength;
+  char lastText[TEXT_MAX];    // .. and the last one finished
+};
+
+static Unit units[MAX_UNITS];
+static int unitCount = 0;
+static int unitsOpen = 0;
+static unsigned long tickUs = TICK_US_DEFAULT;
+static FILE *csv = 0;
+static char csvBuffer[65536];
+static uint8_t readBuffer[READ_BYTES];
+static double startTime = 0;
+static volatile sig_atomic_t stopping = 0;
+
+static double wallSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void onSignal(int) {
+  stopping = 1;
+}
+
+static float rawToPressure(uint16_t raw) {
+  return raw * PRESS_SENSOR_MULTIPLIER + PRESS_SENSOR_CONSTANT;
+}
+
+static int16_t filteredToTenths(uint16_t filtered) {
+  return (int16_t) ((filtered * PRESS_FILTERED_SCALE * PRESS_SENSOR_MULTIPLIER + PRESS_SENSOR_CONSTANT) * 10);
+}
+
+static void pressureRangeClear(Unit &u) {
+  u.pressureMin = 1e9f;
+  u.pressureMax = -1e9f;
+}
+
+static void onTick(Unit &u, const TelemetryRecord &record) {
+  if (u.ticking) {
+    uint16_t delta = record.tick - u.lastTick;
+    if (delta != 0 && (u.tickStep == 0 || delta < u.tickStep)) {
+      u.tickStep = delta;
+    }
+    if (u.tickStep != 0 && delta > u.tickStep) {
+      u.lost += delta / u.tickStep - 1;
+    }
+  }
+  u.ticking = true;
+  u.lastTick = record.tick;
+  u.ticks++;
+  u.state = record.state;
+  if (record.events & TELEMETRY_EVENT_ALARM) {
+    u.alarms++;
+  }
+  u.pressure = rawToPressure(record.pressure);
+  if (u.pressure < u.pressureMin) {
+    u.pressureMin = u.pressure;
+  }
+  if (u.pressure > u.pressureMax) {
+    u.pressureMax = u.pressure;
+  }
+}
+
+static void onBreath(Unit &u, const BreathMetrics &metrics, double now) {
+  BreathEntry &e = u.ring[u.breaths % UNIT_BREATHS];
+  e.receivedMs = (uint32_t) ((now - startTime) * 1000);
+  e.periodTicks = metrics.periodTicks;
+  e.inhaleTicks = metrics.inhaleTicks;
+  e.pip = filteredToTenths(metrics.pip);
+  e.peep = filteredToTenths(metrics.peep);
+  e.meanPressure = filteredToTenths(metrics.meanPressure);
+  e.flags = metrics.flags;
+  u.breaths++;
+  if (csv) {
+    double period = e.periodTicks * (tickUs * 1e-6);
+    fprintf(csv, "%.3f,%d,%s,%u,%.3f,%.3f,%.1f,%.1f,%.1f,%.1f,%d\n", now - startTime, (int) (&u - units), u.path,
+            metrics.index, period, e.inhaleTicks * (tickUs * 1e-6), period > 0 ? 60 / period : 0, e.pip * 0.1,
+            e.peep * 0.1, e.meanPressure * 0.1, (e.flags & BREATH_PATIENT_TRIGGERED) ? 1 : 0);
+  }
+}
+
+static void onText(Unit &u, uint8_t c) {
+  if (c == '\n') {
+    memcpy(u.lastText, u.text, u.textLength);
+    u.lastText[u.textLength] = 0;
+    u.textLength = 0;
+  } else if (c != '\r' && u.textLength < TEXT_MAX - 1) {
+    u.text[u.textLength++] = (c >= ' ' && c < 0x7f) ? c : '.';
+  }
+}
+
+static void unitClose(Unit &u, int epoll) {
+  epoll_ctl(epoll, EPOLL_CTL_DEL, u.fd, 0);
+  close(u.fd);
+  u.fd = -1;
+  unitsOpen--;
+}
+
+// One read per wakeup, so a busy unit cannot hold the others up
+static void unitRead(Unit &u, int epoll, double now) {
+  ssize_t n = read(u.fd, readBuffer, sizeof(readBuffer));
+  if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+    return;
+  }
+  if (n <= 0) {
+    unitClose(u, epoll);          // unplugged, or the terminal's other end closed
+    return;
+  }
+  u.bytes += n;
+  for (ssize_t i = 0; i < n; i++) {
+    TelemetryDecodeResult result = telemetryDecoderFeed(u.decoder, readBuffer[i]);
+    if (result == TELEMETRY_DECODE_FRAME) {
+      TelemetryRecord record;
+      BreathMetrics metrics;
+      if (telemetryDecodeTick(u.decoder, record)) {
+        onTick(u, record);
+      } else if (telemetryDecodeBreath(u.decoder, metrics)) {
+        onBreath(u, metrics, now);
+      }
+    } else if (result == TELEMETRY_DECODE_TEXT) {
+      onText(u, readBuffer[i]);
+    }
+  }
+}
+
+static bool unitOpen(Unit &u, const char *path, int epoll) {
+  memset(&u, 0, sizeof(u));
+  u.path = path;
+  u.fd = open(path, O_RDONLY | O_NOCTTY | O_NONBLOCK);
+  if (u.fd < 0) {
+    perror(path);
+    return false;
+  }
+  struct termios tio;
+  if (tcgetattr(u.fd, &tio) == 0) {
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, B115200);
+    cfsetospeed(&tio, B115200);
+    tcsetattr(u.fd, TCSANOW, &tio);
+  }
+  telemetryDecoderReset(u.decoder);
+  pressureRangeClear(u);
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.u32 = &u - units;
+  if (epoll_ctl(epoll, EPOLL_CTL_ADD, u.fd, &ev) != 0) {
+    perror(path);
+    close(u.fd);
+    return false;
+  }
+  unitsOpen++;
+  return true;
+}
+
+// Means over the breaths of the last WINDOW_S, newest first through the ring
+struct Window {
+  unsigned long count;
+  double period, inhale, pip, peep, mean;
+};
+
+static void windowOf(const Unit &u, double now, Window &w) {
+  memset(&w, 0, sizeof(w));
+  uint32_t since = (uint32_t) ((now - startTime - WINDOW_S) * 1000);
+  bool all = now - startTime < WINDOW_S;
+  for (unsigned long i = 0; i < u.breaths && i < (unsigned long) UNIT_BREATHS; i++) {
+    const BreathEntry &e = u.ring[(u.breaths - 1 - i) % UNIT_BREATHS];
+    if (!all && e.receivedMs < since) {
+      break;
+    }
+    w.count++;
+    w.period += e.periodTicks;
+    w.inhale += e.inhaleTicks;
+    w.pip += e.pip;
+    w.peep += e.peep;
+    w.mean += e.meanPressure;
+  }
+  if (w.count) {
+    double tick = tickUs * 1e-6;
+    w.period = w.period / w.count * tick;
+    w.inhale = w.inhale / w.count * tick;
+    w.pip = w.pip / w.count * 0.1;
+    w.peep = w.peep / w.count * 0.1;
+    w.mean = w.mean / w.count * 0.1;
+  }
+}
+
+static void view(double now, double interval, bool terminal) {
+  if (terminal) {
+    fputs("\x1b[H\x1b[2J", stdout);
+  }
+  printf("ventmon  %.0f s  %d of %d units  (breath figures: means over the last %.0f s)\n", now - startTime, unitsOpen,
+         unitCount, WINDOW_S);
+  printf("%-3s %-16s %3s %6s %6s %5s %4s %6s %5s %5s %5s %5s %5s %5s %11s %6s  %s\n", "#", "device", "", "B/s", "rec/s",
+         "lost", "bad", "breath", "bpm", "Ti s", "I:E", "PIP", "PEEP", "Pmean", "P range", "alarms", "last text");
+  for (int i = 0; i < unitCount; i++) {
+    Unit &u = units[i];
+    Window w;
+    windowOf(u, now, w);
+    size_t length = strlen(u.path);
+    const char *name = length > DEVICE_COLUMN ? u.path + length - DEVICE_COLUMN : u.path;   // the end tells them apart
+    const char *state = u.fd < 0 ? "off" : !u.ticking ? "-" : u.state == INHALE_STATE ? "in" : "ex";
+    printf("%-3d %-16.16s %3s %6.0f %6.1f %5lu %4lu %6lu", i, name, state, (u.bytes - u.viewBytes) / interval,
+           (u.ticks - u.viewTicks) / interval, u.lost, u.decoder.crcErrors, u.breaths);
+    if (w.count) {
+      printf(" %5.1f %5.2f 1:%3.1f %5.1f %5.1f %5.1f", 60 / w.period, w.inhale,
+             w.inhale > 0 ? (w.period - w.inhale) / w.inhale : 0, w.pip, w.peep, w.mean);
+    } else {
+      printf(" %5s %5s %5s %5s %5s %5s", "-", "-", "-", "-", "-", "-");
+    }
+    if (u.pressureMax >= u.pressureMin) {
+      printf(" %5.1f-%5.1f", u.pressureMin, u.pressureMax);
+    } else {
+      printf(" %11s", "-");
+    }
+    printf(" %6lu  %s\n", u.alarms, u.lastText);
+    u.viewBytes = u.bytes;
+    u.viewTicks = u.ticks;
+    pressureRangeClear(u);
+  }
+  fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+  const char *csvPath = 0;
+  double interval = 1;
+  double seconds = 0;
+  bool quiet = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "c:i:t:k:q")) != -1) {
+    switch (opt) {
+      case 'c': csvPath = optarg; break;
+      case 'i': interval = atof(optarg); break;
+      case 't': seconds = atof(optarg); break;
+      case 'k': tickUs = strtoul(optarg, 0, 10); break;
+      case 'q': quiet = true; break;
+      default:
+        fprintf(stderr, "usage: %s [-c csv] [-i interval] [-t seconds] [-k tick_us] [-q] device ...\n", argv[0]);
+        return 2;
+    }
+  }
+  if (optind == argc || argc - optind > MAX_UNITS || interval <= 0 || tickUs == 0) {
+    fprintf(stderr, "usage: %s [-c csv] [-i interval] [-t seconds] [-k tick_us] [-q] device ... (at most %d)\n",
+            argv[0], MAX_UNITS);
+    return 2;
+  }
+  if (csvPath) {
+    csv = fopen(csvPath, "a");
+    if (!csv) {
+      perror(csvPath);
+      return 1;
+    }
+    setvbuf(csv, csvBuffer, _IOFBF, sizeof(csvBuffer));
+    if (ftell(csv) == 0) {
+      fputs(CSV_HEADER, csv);
+    }
+  }
+
+  int epoll = epoll_create1(0);
+  if (epoll < 0) {
+    perror("ventmon: epoll_create1");
+    return 1;
+  }
+  for (int i = optind; i < argc; i++) {
+    if (!unitOpen(units[unitCount], argv[i], epoll)) {
+      return 1;
+    }
+    unitCount++;
+  }
+  signal(SIGTERM, onSignal);
+  signal(SIGINT, onSignal);
+
+  bool terminal = isatty(STDOUT_FILENO);
+  startTime = wallSeconds();
+  double nextView = startTime + interval;
+  struct epoll_event events[MAX_EVENTS];
+  while (!stopping && unitsOpen > 0) {
+    double now = wallSeconds();
+    if (seconds > 0 && now - startTime >= seconds) {
+      break;
+    }
+    double wait = nextView - now;
+    if (seconds > 0 && startTime + seconds - now < wait) {
+      wait = startTime + seconds - now;
+    }
+    int n = epoll_wait(epoll, events, MAX_EVENTS, wait > 0 ? (int) (wait * 1000) + 1 : 0);
+    now = wallSeconds();
+    for (int i = 0; i < n; i++) {
+      Unit &u = units[events[i].data.u32];
+      if (u.fd >= 0) {
+        unitRead(u, epoll, now);
+      }
+    }
+    if (now >= nextView) {
+      if (!quiet) {
+        view(now, interval + (now - nextView), terminal);
+      }
+      if (csv) {
+        fflush(csv);
+      }
+      nextView += interval;
+      if (nextView < now) {
+        nextView = now + interval;
+      }
+    }
+  }
+
+  double elapsed = wallSeconds() - startTime;
+  unsigned long bytes = 0, ticks = 0, lost = 0, breaths = 0, bad = 0;
+  for (int i = 0; i < unitCount; i++) {
+    bytes += units[i].bytes;
+    ticks += units[i].ticks;
+    lost += units[i].lost;
+    breaths += units[i].breaths;
+    bad += units[i].decoder.crcErrors;
+    if (units[i].fd >= 0) {
+      close(units[i].fd);
+    }
+  }
+  if (csv) {
+    fclose(csv);
+  }
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  double cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 + usage.ru_stime.tv_sec +
+               usage.ru_stime.tv_usec * 1e-6;
+  fprintf(stderr, "ventmon: units %d seconds %.2f bytes %lu ticks %lu lost %lu breaths %lu bad %lu cpu %.3f s\n",
+          unitCount, elapsed, bytes, ticks, lost, breaths, bad, cpu);
+  return 0;
+}
@@ -0,0 +1,127 @@
+/* ventpty - ventilator.cpp against the lung model in real time, with its Serial on a pseudo-terminal
+   The virtual clock is held to the wall clock, so anything that opens the terminal talks to the controller as it would
+   to a unit on a USB serial adapter: bytes sent arrive at 115200 baud into its 64-byte RX buffer, and what it writes
+   comes back at the rate loop() gets it out. The terminal is raw (no echo, no line editing).
+   Prints "ventpty: <path>" on stdout once the terminal is ready, then runs until it is stopped or for [-t seconds].
+   Usage : ventpty [-t seconds] [-r rate] [-e effort_period] [-c compliance]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <termios.h>
+#include "host_clock.h"
+#include "sim_harness.h"
+
+// From ventilator.cpp
+extern int respRate;
+extern int newRespRate;
+extern int currentMode;
+
+const double SLICE_S = 0.0002;                 // virtual time run between looks at the terminal
+const size_t OUT_BUFFER = 4096;
+
+static int master = -1;
+static uint8_t outBuffer[OUT_BUFFER];
+static size_t outLength = 0;
+static unsigned long outDropped = 0;
+static volatile sig_atomic_t stopping = 0;
+
+static void onSerial(uint8_t c) {
+  if (outLength < OUT_BUFFER) {
+    outBuffer[outLength++] = c;
+  } else {
+    outDropped++;
+  }
+}
+
+// What the controller wrote, into the terminal .. a reader that has fallen far behind loses bytes, as a full USB
+// adapter would
+static void flushOut() {
+  size_t sent = 0;
+  while (sent < outLength) {
+    ssize_t n = write(master, outBuffer + sent, outLength - sent);
+    if (n <= 0) {
+      outDropped += outLength - sent;
+      break;
+    }
+    sent += n;
+  }
+  outLength = 0;
+}
+
+static double wallSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void onSignal(int) {
+  stopping = 1;
+}
+
+int main(int argc, char **argv) {
+  double seconds = 0;
+  LungParams params;
+  lungDefaults(params);
+  int opt;
+  while ((opt = getopt(argc, argv, "t:r:e:c:")) != -1) {
+    switch (opt) {
+      case 't': seconds = atof(optarg); break;
+      case 'r': respRate = newRespRate = atoi(optarg); break;
+      case 'e': params.effortPeriod = atof(optarg); currentMode = 1; break;
+      case 'c': params.compliance = atof(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-t seconds] [-r rate] [-e effort_period] [-c compliance]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+    perror("ventpty: posix_openpt");
+    return 1;
+  }
+  const char *path = ptsname(master);
+  int slave = open(path, O_RDWR | O_NOCTTY);    // held open, so the terminal stays up between readers
+  struct termios tio;
+  if (slave < 0 || tcgetattr(slave, &tio) != 0) {
+    perror("ventpty: slave");
+    return 1;
+  }
+  cfmakeraw(&tio);
+  tcsetattr(slave, TCSANOW, &tio);
+  fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+  signal(SIGTERM, onSignal);
+  signal(SIGINT, onSignal);
+
+  hostSetSerialSink(onSerial);
+  simBegin(params);
+  printf("ventpty: %s\n", path);
+  fflush(stdout);
+
+  double start = wallSeconds() - simSeconds();
+  while (!stopping && (seconds <= 0 || simSeconds() < seconds)) {
+    uint8_t in[256];
+    ssize_t n = read(master, in, sizeof(in));
+    if (n > 0) {
+      hostSerialInput(in, n);
+    }
+    simRunSeconds(SLICE_S);
+    flushOut();
+    double ahead = simSeconds() - (wallSeconds() - start);
+    if (ahead > 0) {
+      struct timespec ts = { 0, (long) (ahead * 1e9) };
+      nanosleep(&ts, 0);
+    }
+  }
+  fprintf(stderr, "ventpty: %.1f s, %lu bytes from the controller lost, %lu to it lost (RX buffer full)\n",
+          simSeconds(), outDropped, hostCounters().serialRxDropped);
+  close(slave);
+  close(master);
+  return 0;
+}
@@ -0,0 +1,286 @@
+/* ventsim - run ventilator.cpp against the lung model, faster than real time
+   Usage : ventsim [-n breaths] [-r rate] [-t tidal] [-i ie] [-c compliance] [-R resistance] [-e effort_period] [-P pressure] [-u rate] [-s rate] [-a] [-p] [-w capture] [-b] [-v]
+           -P runs pressure-controlled (PCV) at this inspiratory pressure, cmH2O
+           -u changes the respiratory rate through the knob and menu half way through the run
+           -s changes it with a COMMAND_SET over serial (command.h) half way through the run
+           -a turns on the adaptive tidal gain (adaptTidal) .. -b then shows the controller's exhaled volume and compliance
+           -p asks the controller for its profiler and task reports ('p' and 's' over serial) at the end of the run
+           -w records the controller's inputs from reset (recordInputs) and writes its serial output to a file for replay
+           -b prints one line per breath, -v echoes the controller's serial text and telemetry events
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "host_clock.h"
+#include "sim_harness.h"
+#include "telemetry_decoder.h"
+#include "pressure_adc.h"
+#include "vent_params.h"
+#include "timebase.h"
+#include "alarms.h"
+#include "tidal_adapt.h"
+#include "command.h"
+
+// Control variables from ventilator.cpp .. set before setup() in place of the rotary knob
+extern int respRate;
+extern int newRespRate;
+extern int tidal;
+extern int newTidal;
+extern float iERatio;
+extern float newIERatio;
+extern int currentMode;
+extern int targetInspPressure;
+extern int uiState;
+extern bool recordInputs;
+extern bool adaptTidal;
+extern volatile unsigned long firstTickUs;
+extern uint8_t alarmsAcknowledged;
+
+const int UI_IDLE = 0;                  // menu state from ventilator.cpp
+
+const double MENU_PRESS_S = 0.1;        // how long the simulated user holds the select button
+const double MENU_STEP_S = 0.004;       // a quick spin of the knob .. 250 steps per second
+
+static bool perBreath = false;
+static float pipSum = 0;
+static float peepSum = 0;
+static float vtSum = 0;
+static unsigned long triggered = 0;
+static bool verbose = false;
+static bool showText = false;           // echo the controller's serial text (not the telemetry)
+static unsigned long measuredBreaths = 0;  // TELEMETRY_FRAME_BREATH frames .. the controller's own breath metrics
+static float measuredPip = 0;
+static float measuredPeep = 0;
+static float measuredMean = 0;
+static float measuredPeriod = 0;
+static float measuredIe = 0;
+static TelemetryDecoder decoder;
+static FILE *capture = 0;
+
+// Walk the menu as a user would: select, keep the mode, dial the rate, then click through the rest of the settings.
+// The controller keeps breathing throughout, and picks the new settings up at the end of the breath in progress
+static void changeRateWithKnob(int rate) {
+  while (uiState != UI_IDLE) {
+    simRunSeconds(0.01);                               // the self-test after reset is still on the screen
+  }
+  double start = simSeconds();
+  unsigned long startBreaths = simBreaths();
+  while (alarmLatched() & ~alarmsAcknowledged) {
+    simPressButton(MENU_PRESS_S);                      // the first press is the alarm's
+  }
+  simPressButton(MENU_PRESS_S);                        // into the menu (mode)
+  simPressButton(MENU_PRESS_S);                        // keep the mode, on to respiratory rate
+  simTurnKnob(rate - respRate, MENU_STEP_S);
+  while (uiState != UI_IDLE) {
+    simPressButton(MENU_PRESS_S);                      // keep the other settings as they are .. the last press commits
+  }
+  double committed = simSeconds();
+  while (ventParamsPending()) {
+    simRunSeconds(0.01);
+  }
+  printf("menu             rate %d bpm adopted at %.2f s: %.2f s in the menu, %.2f s until the breath ended, "
+         "%lu breaths meanwhile\n", respRate, simSeconds(), committed - start, simSeconds() - committed,
+         simBreaths() - startBreaths);
+}
+
+// The same change from a host over the serial line .. one COMMAND_SET frame, then the wait for the breath to end
+static void changeRateRemotely(int rate) {
+  uint8_t payload[4] = { 1, COMMAND_PARAM_RESP_RATE, (uint8_t) rate, 0 };
+  uint8_t frame[sizeof(payload) + TELEMETRY_FRAME_OVERHEAD];
+  uint8_t crc = telemetryCrc8(telemetryCrc8(0, COMMAND_SET), sizeof(payload));
+  frame[0] = TELEMETRY_SYNC_1;
+  frame[1] = TELEMETRY_SYNC_2;
+  frame[2] = COMMAND_SET;
+  frame[3] = sizeof(payload);
+  for (uint8_t i = 0; i < sizeof(payload); i++) {
+    frame[4 + i] = payload[i];
+    crc = telemetryCrc8(crc, payload[i]);
+  }
+  frame[4 + sizeof(payload)] = crc;
+  double start = simSeconds();
+  unsigned long startBreaths = simBreaths();
+  hostSerialInput(frame, sizeof(frame));
+  while (respRate != rate && simSeconds() - start < 1) {
+    simRunSeconds(0.01);
+  }
+  if (respRate != rate) {
+    printf("remote           rate %d bpm refused\n", rate);
+    return;
+  }
+  double committed = simSeconds();
+  while (ventParamsPending()) {
+    simRunSeconds(0.01);
+  }
+  printf("remote           rate %d bpm adopted at %.2f s: %.2f s to commit, %.2f s until the breath ended, "
+         "%lu breaths meanwhile\n", respRate, simSeconds(), committed - start, simSeconds() - committed,
+         simBreaths() - startBreaths);
+}
+
+static void onSerial(uint8_t c) {
+  if (capture) {
+    fputc(c, capture);
+  }
+  TelemetryDecodeResult result = telemetryDecoderFeed(decoder, c);
+  TelemetryRecord record;
+  BreathMetrics breath;
+  if (result == TELEMETRY_DECODE_FRAME && telemetryDecodeBreath(decoder, breath)) {
+    float period = breath.periodTicks * (SIM_TICK_US * 1e-6f);
+    float ie = breath.inhaleTicks ? (float) (breath.periodTicks - breath.inhaleTicks) / breath.inhaleTicks : 0;
+    measuredBreaths++;
+    measuredPip += simFilteredToPressure(breath.pip);
+    measuredPeep += simFilteredToPressure(breath.peep);
+    measuredMean += simFilteredToPressure(breath.meanPressure);
+    measuredPeriod += period;
+    measuredIe += ie;
+    if (verbose) {
+      printf("breath %5u  PIP=%5.1f  PEEP=%4.1f  Pmean=%4.1f  period=%5.2fs  I:E=1:%.2f%s\n", breath.index,
+             simFilteredToPressure(breath.pip), simFilteredToPressure(breath.peep),
+             simFilteredToPressure(breath.meanPressure), period, ie,
+             (breath.flags & BREATH_PATIENT_TRIGGERED) ? "  (patient)" : "");
+    }
+    return;
+  }
+  if (result == TELEMETRY_DECODE_TEXT && showText) {
+    putchar(c);
+    return;
+  }
+  if (!verbose) {
+    return;
+  }
+  if (result == TELEMETRY_DECODE_TEXT) {
+    putchar(c);
+  } else if (result == TELEMETRY_DECODE_FRAME && telemetryDecodeTick(decoder, record) && record.events) {
+    printf("tick %5u  %s%s%s%s%s drive=%4u pressure=%4u\n", record.tick,
+           (record.events & TELEMETRY_EVENT_INHALE) ? "inhale " : "",
+           (record.events & TELEMETRY_EVENT_EXHALE) ? "exhale " : "",
+           (record.events & TELEMETRY_EVENT_PATIENT_TRIGGER) ? "patient-trigger " : "",
+           (record.events & TELEMETRY_EVENT_PARAMS_ADOPTED) ? "params " : "",
+           (record.events & TELEMETRY_EVENT_ALARM) ? "alarm " : "",
+           record.drive, record.pressure);
+  }
+}
+
+static void onBreath(const SimBreath &b) {
+  pipSum += b.peakPressure;
+  peepSum += b.endExpiratoryPressure;
+  vtSum += b.tidalVolume;
+  if (b.patientTriggered) {
+    triggered++;
+  }
+  if (perBreath) {
+    printf("breath %5lu  t=%8.2fs  period=%5.2fs  Ti=%4.2fs  PIP=%5.1f  PEEP=%4.1f  Vt=%4.0fml", b.index, b.start,
+           b.period, b.inhaleTime, b.peakPressure, b.endExpiratoryPressure, b.tidalVolume * 1000);
+    if (adaptTidal) {
+      printf("  exhaled=%4.0fml  C=%4.1fml/cmH2O", tidalAdaptVolume(), tidalAdaptCompliance());   // the breath before
+    }
+    printf("%s\n", b.patientTriggered ? "  (patient)" : "");
+  }
+}
+
+int main(int argc, char **argv) {
+  unsigned long breaths = 100;
+  int menuRate = 0;
+  int remoteRate = 0;
+  bool profile = false;
+  LungParams params;
+  lungDefaults(params);
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:r:t:i:c:R:e:P:u:s:apw:bv")) != -1) {
+    switch (opt) {
+      case 'n': breaths = strtoul(optarg, 0, 10); break;
+      case 'r': respRate = newRespRate = atoi(optarg); break;
+      case 't': tidal = newTidal = atoi(optarg); break;
+      case 'i': iERatio = newIERatio = atof(optarg); break;
+      case 'c': params.compliance = atof(optarg); break;
+      case 'R': params.resistance = atof(optarg); break;
+      case 'e': params.effortPeriod = atof(optarg); currentMode = 1; break;
+      case 'P': targetInspPressure = atoi(optarg); currentMode = 2; break;
+      case 'u': menuRate = atoi(optarg); break;
+      case 's': remoteRate = atoi(optarg); break;
+      case 'a': adaptTidal = true; break;
+      case 'p': profile = true; break;
+      case 'w':
+        capture = fopen(optarg, "wb");
+        if (!capture) {
+          fprintf(stderr, "%s: cannot write %s\n", argv[0], optarg);
+          return 2;
+        }
+        recordInputs = true;
+        break;
+      case 'b': perBreath = true; break;
+      case 'v': verbose = true; break;
+      default:
+        fprintf(stderr, "usage: %s [-n breaths] [-r rate] [-t tidal] [-i ie] [-c compliance] [-R resistance] "
+                        "[-e effort_period] [-P pressure] [-u rate] [-s rate] [-a] [-p] [-w capture] [-b] [-v]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  telemetryDecoderReset(decoder);
+  hostSetSerialSink(onSerial);
+  simSetBreathHandler(onBreath);
+  simBegin(params);
+  if (menuRate > 0 || remoteRate > 0) {
+    simRunBreaths(breaths / 2);
+    if (menuRate > 0) {
+      changeRateWithKnob(menuRate);
+    }
+    if (remoteRate > 0) {
+      changeRateRemotely(remoteRate);
+    }
+    simRunBreaths(breaths - simBreaths());
+  } else {
+    simRunBreaths(breaths);
+  }
+
+  if (profile) {
+    showText = true;
+    hostSerialInput("ps");
+    simRunSeconds(0.5);                                // time to arrive, be read and print at 115200 baud
+    showText = false;
+  }
+
+  if (capture) {
+    simRunSeconds(0.1);                                // the last frames out of the TX buffer
+    fclose(capture);
+  }
+
+  const HostCounters &c = hostCounters();
+  unsigned long n = simBreaths();
+  printf("breaths          %lu (%lu patient triggered)\n", n, triggered);
+  printf("simulated time   %.1f s\n", simSeconds());
+  printf("boot             ventilating %.1f ms after reset\n", firstTickUs / 1000.0);
+  printf("mean PIP         %.1f cmH2O\n", pipSum / n);
+  printf("mean PEEP        %.1f cmH2O\n", peepSum / n);
+  printf("mean Vt          %.0f ml\n", vtSum / n * 1000);
+  if (measuredBreaths > 0) {
+    printf("controller says  PIP %.1f  PEEP %.1f  Pmean %.1f cmH2O, period %.2f s, I:E 1:%.2f (mean of %lu)\n",
+           measuredPip / measuredBreaths, measuredPeep / measuredBreaths, measuredMean / measuredBreaths,
+           measuredPeriod / measuredBreaths, measuredIe / measuredBreaths, measuredBreaths);
+  }
+#if VENT_TIMEBASE == VENT_TIMEBASE_LOOP
+  printf("control ticks    run from loop() .. no Timer1 interrupts\n");
+#else
+  printf("control ticks    %lu\n", c.isrCalls);
+#endif
+  printf("analogRead calls %lu\n", c.analogReads);
+  printf("ADC conversions  %lu (%u pressure samples/s)\n", c.adcConversions, pressureAdcSampleRate());
+  printf("loop() passes    %lu (%.0f per second)\n", simLoopPasses(), simLoopPasses() / simSeconds());
+  printf("LCD bytes        %lu (%lu on I2C, %.0f I2C bytes per second)\n",
+         c.lcdBytes, c.i2cBytes, c.i2cBytes / simSeconds());
+  printf("serial bytes     %lu, stalled %.1f ms (%.1f ms inside the control interrupt)\n",
+         c.serialBytes, c.serialStallUs / 1000.0, c.isrStallUs / 1000.0);
+  printf("EEPROM writes    %lu bytes\n", c.eepromWrites);
+  printf("alarms           %u raised", alarmRaisedCount());
+  for (uint8_t alarm = ALARM_HIGH_PRESSURE; alarm <= ALARM_LOW_PRESSURE; alarm <<= 1) {
+    if (alarmLatched() & alarm) {
+      printf(", %s", (const char *) alarmName(alarm));
+    }
+  }
+  printf("\n");
+  printf("telemetry frames %lu (%lu bad, %u dropped by the controller)\n",
+         decoder.frames, decoder.crcErrors, telemetryDropped());
+  return 0;
+}
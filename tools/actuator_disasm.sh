@@ -0,0 +1,65 @@
+#!/bin/sh
+# actuator_disasm.sh - check that each Actuator::write() compiles to the same code as the call written by hand
+#
+#   Usage : tools/actuator_disasm.sh path/to/binary
+#
+# actuator_bench.cpp keeps one out-of-line function each way for every actuator (actuatorDisasm<Name>Policy and
+# actuatorDisasm<Name>Hand). This disassembles each pair, drops the instruction addresses, the PC-relative offsets and the
+# alignment padding after the return, and compares what is left. Prints each pair as the same or different (with a diff)
+# and exits 1 if any differs.
+#
+# Host: sim/build/bench_hardware (make disasm in sim/). Uno: the sketch ELF from the Arduino build folder, with
+# OBJDUMP=avr-objdump .. the functions are only there if the linker has kept them, so build with RUN_ACTUATOR_BENCHMARK
+# set, and only the servo pair for a servo build.
+
+set -e
+
+BIN=$1
+OBJDUMP=${OBJDUMP:-objdump}
+
+if [ -z "$BIN" ] || [ ! -f "$BIN" ]; then
+  echo "usage: $0 path/to/binary" >&2
+  exit 2
+fi
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+# One function's instructions, one a line, without what only says where it is
+body() {
+  $OBJDUMP -d --no-show-raw-insn -C "$BIN" | awk -v name="<$1>:" '
+    $2 == name { p = 1; next }
+    p && NF == 0 { exit }
+    p {
+      sub(/^ *[0-9a-f]+:[ \t]*/, "")
+      gsub(/-?0x[0-9a-f]+\(%rip\)/, "(%rip)")
+      sub(/[ \t]*# [0-9a-f]+ </, " # <")
+      if ($0 ~ /^(nop|xchg +%ax,%ax|data16|cs nopw|int3)/) next
+      print
+    }'
+}
+
+FAILED=0
+FOUND=0
+for NAME in Pwm CurrentLoop Servo; do
+  body "actuatorDisasm${NAME}Policy" > "$DIR/policy"
+  body "actuatorDisasm${NAME}Hand" > "$DIR/hand"
+  if [ ! -s "$DIR/policy" ] || [ ! -s "$DIR/hand" ]; then
+    printf "%-12s not in %s\n" "$NAME" "$BIN"
+    continue
+  fi
+  FOUND=$((FOUND + 1))
+  if cmp -s "$DIR/policy" "$DIR/hand"; then
+    printf "%-12s same code, %d instructions\n" "$NAME" "$(wc -l < "$DIR/policy")"
+  else
+    printf "%-12s DIFFERENT\n" "$NAME"
+    diff "$DIR/policy" "$DIR/hand" | sed 's/^/  /' || true
+    FAILED=1
+  fi
+done
+
+if [ $FOUND -eq 0 ]; then
+  echo "no actuatorDisasm functions in $BIN" >&2
+  exit 2
+fi
+exit $FAILED
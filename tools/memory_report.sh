@@ -0,0 +1,42 @@
+#!/bin/sh
+# memory_report.sh - RAM and flash use of a ventilator build, per symbol
+#
+#   Usage : tools/memory_report.sh path/to/ventilator.ino.elf [count]
+#
+# The ELF is in the Arduino build folder (File > Preferences > "Show verbose output during compilation" prints where,
+# or use arduino-cli compile --output-dir). Prints the section totals against the Uno's 2048 bytes of SRAM and
+# 32256 bytes of flash, then the largest 'count' (default 20) symbols in RAM (.data and .bss) and in flash (.text,
+# which includes PROGMEM tables and F() strings). Everything in .data is counted twice - it is copied from flash at reset.
+# The stack and heap are not in the ELF .. memory_probe.h measures those on the running board.
+
+set -e
+
+ELF=$1
+COUNT=${2:-20}
+NM=${AVR_NM:-avr-nm}
+SIZE=${AVR_SIZE:-avr-size}
+SRAM=2048
+FLASH=32256
+
+if [ -z "$ELF" ] || [ ! -f "$ELF" ]; then
+  echo "usage: $0 path/to/sketch.elf [count]" >&2
+  exit 2
+fi
+
+$SIZE -A "$ELF" | awk -v sram=$SRAM -v flash=$FLASH '
+  $1 == ".data" { data = $2 }
+  $1 == ".bss"  { bss = $2 }
+  $1 == ".text" { text = $2 }
+  END {
+    printf "SRAM   %5d of %d bytes (.data %d + .bss %d), %d left for heap and stack\n", data + bss, sram, data, bss, sram - data - bss
+    printf "flash  %5d of %d bytes (.text %d + .data %d)\n", text + data, flash, text, data
+  }'
+
+# nm -S -t d prints address, size (decimal), type, name. b/B/d/D are RAM, t/T/r/R flash
+echo
+echo "largest RAM symbols"
+$NM -S -C -t d --size-sort -r "$ELF" | awk '$3 ~ /^[bBdD]$/ { printf "  %6d  %s  ", $2 + 0, $3; $1 = $2 = $3 = ""; sub(/^ +/, ""); print }' | head -n "$COUNT"
+
+echo
+echo "largest flash symbols"
+$NM -S -C -t d --size-sort -r "$ELF" | awk '$3 ~ /^[tTrRwW]$/ { printf "  %6d  %s  ", $2 + 0, $3; $1 = $2 = $3 = ""; sub(/^ +/, ""); print }' | head -n "$COUNT"
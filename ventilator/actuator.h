@@ -0,0 +1,99 @@
+#ifndef ACTUATOR_H
+#define ACTUATOR_H
+
+/* Actuator output
+   Description : Every drive value the controller puts out - the breath tick, the PCV loop in the ADC interrupt, the
+                 calibration sweep - goes through Actuator::write(), where Actuator is one of the types below, picked at
+                 compile time with -DVENT_ACTUATOR=... (ventilator.cpp). Drive runs from 0 (exhale, valve open) to
+                 ACTUATOR_DRIVE_MAX whatever the hardware.
+
+                   PwmActuator<PIN>          Timer1 PWM, duty = drive, into the PWM to current converter (V22 on)
+                   CurrentLoopActuator<PIN>  Timer1 PWM into a 0-20 mA converter, drive 0 .. max as 4 .. 20 mA. The live
+                                             zero lets the valve driver tell a broken loop (0 mA) from "open"
+                   ServoActuator<PIN>        RC servo on Timer2 (ServoTimer2, as V17 - V19 .. the Servo library clashes with
+                                             TimerOne), drive 0 .. max as SERVO_PULSE_MIN_US .. SERVO_PULSE_MAX_US
+
+                 They are types with static inline members, not objects: no virtual calls and no pointer to follow, so
+                 Actuator::write() should compile to what the hand-written call for that hardware was. The scaling of
+                 the last two is a multiply by a compile-time Q16 constant and a shift.
+
+   Note        : tools/actuator_disasm.sh compares each write() with the same call written by hand (actuator_bench.cpp),
+                 instruction by instruction. On the host build (make disasm in sim/) all three compile to the same code.
+                 It has not been run on an AVR build, and actuatorBenchmark() has not been run on a board: the host
+                 cycle counts are of stand-in Arduino calls and say nothing about the Uno. Run both there
+                 (OBJDUMP=avr-objdump, RUN_ACTUATOR_BENCHMARK) before relying on the claim above for the AVR.
+
+                 begin() comes after the timebase has started .. the PWM period is the Timer1 period, the control tick.
+*/
+
+#include <Arduino.h>
+#include <TimerOne.h>
+
+#define VENT_ACTUATOR_PWM 0
+#define VENT_ACTUATOR_CURRENT_LOOP 1
+#define VENT_ACTUATOR_SERVO 2
+
+#ifndef VENT_ACTUATOR
+#define VENT_ACTUATOR VENT_ACTUATOR_PWM
+#endif
+
+const uint16_t ACTUATOR_DRIVE_MAX = 1023;           // full scale drive .. Timer1 PWM resolution
+const uint16_t CURRENT_LOOP_DUTY_ZERO = 205;        // 4 mA of 20 mA full scale
+const uint16_t SERVO_PULSE_MIN_US = 750;            // valve open
+const uint16_t SERVO_PULSE_MAX_US = 2250;
+
+// Q16 scale for drive 0 .. ACTUATOR_DRIVE_MAX onto a span, rounded up so that full drive reaches the end of the span
+constexpr uint32_t actuatorSpanQ16(uint32_t span) {
+  return ((span << 16) + ACTUATOR_DRIVE_MAX - 1) / ACTUATOR_DRIVE_MAX;
+}
+
+template <uint8_t PIN>
+struct PwmActuator {
+  static void begin(long periodUs) {
+    Timer1.pwm(PIN, 0, periodUs);
+  }
+  static inline void write(uint16_t drive) {
+    Timer1.setPwmDuty(PIN, drive);
+  }
+};
+
+template <uint8_t PIN>
+struct CurrentLoopActuator {
+  static constexpr uint32_t SCALE_Q16 = actuatorSpanQ16(ACTUATOR_DRIVE_MAX - CURRENT_LOOP_DUTY_ZERO);
+  static void begin(long periodUs) {
+    Timer1.pwm(PIN, CURRENT_LOOP_DUTY_ZERO, periodUs);
+  }
+  static inline void write(uint16_t drive) {
+    Timer1.setPwmDuty(PIN, CURRENT_LOOP_DUTY_ZERO + (uint16_t) (((uint32_t) drive * SCALE_Q16) >> 16));
+  }
+};
+
+#if (VENT_ACTUATOR == VENT_ACTUATOR_SERVO) || !defined(__AVR__)    // the host stand-ins always have ServoTimer2
+#include <ServoTimer2.h>
+
+template <uint8_t PIN>
+struct ServoActuator {
+  static constexpr uint32_t SCALE_Q16 = actuatorSpanQ16(SERVO_PULSE_MAX_US - SERVO_PULSE_MIN_US);
+  static ServoTimer2 servo;
+  static void begin(long periodUs) {
+    (void) periodUs;                                // Timer2 runs the servo frame on its own
+    servo.attach(PIN);
+    servo.write(SERVO_PULSE_MIN_US);
+  }
+  static inline void write(uint16_t drive) {
+    servo.write(SERVO_PULSE_MIN_US + (uint16_t) (((uint32_t) drive * SCALE_Q16) >> 16));
+  }
+};
+
+template <uint8_t PIN>
+ServoTimer2 ServoActuator<PIN>::servo;
+#endif
+
+// Cycles taken by write() for each actuator compiled in, beside the same output written by hand (written again in
+// actuator_bench.cpp, not taken from the sketches), over the whole drive range, after an untimed sweep. Each drive is the
+// fastest of several writes, the two taking turns at going first. AVR: counts CPU cycles on Timer1 - call before Timer1
+// is set up for the control tick.
+// Host: uses the TSC (sim/bench_hardware, which times the whole tick too)
+void actuatorBenchmark(Print &out);
+
+#endif
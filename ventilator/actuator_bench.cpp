@@ -0,0 +1,124 @@
+#include "actuator.h"
+#include "bench_cycles.h"
+
+const uint8_t BENCH_PWM_PIN = 9;
+const uint8_t BENCH_SERVO_PIN = 10;
+const int BENCH_PASSES = 8;
+
+// The drive is volatile so the compiler cannot fold the writes away
+static volatile uint16_t benchDrive;
+
+// What the policy types replace: one interface, a virtual write() .. called through a pointer the compiler cannot see
+// through, as it would be with the driver picked at run time
+struct DynamicActuator {
+  virtual void write(uint16_t drive) = 0;
+};
+struct DynamicPwmActuator : DynamicActuator {
+  void write(uint16_t drive) {
+    Timer1.setPwmDuty(BENCH_PWM_PIN, drive);
+  }
+};
+static DynamicPwmActuator dynamicPwm;
+static DynamicActuator *volatile dynamicActuator = &dynamicPwm;
+
+// One write() of the drive, timed on its own
+template <typename WRITER>
+static unsigned long timeWrite() {
+  noInterrupts();
+  uint32_t start = cyclesNow();
+  WRITER::write(benchDrive);
+  uint32_t stop = cyclesNow();
+  interrupts();
+  return (uint16_t) (stop - start);
+}
+
+// The same drive sweep through two ways of writing it .. after a sweep that is not timed, so that neither is timed
+// cold. Each drive is written BENCH_PASSES times each way, taking turns at going first, and the fastest of each kept
+// (as drive_bench.cpp), so that a worst case is the write's own and not an interrupt's
+template <typename POLICY, typename HAND>
+static void compare(Print &out, const __FlashStringHelper *label, const __FlashStringHelper *otherLabel,
+                    unsigned long overhead) {
+  BenchResult policy = { 0, 0, 0 };
+  BenchResult written = { 0, 0, 0 };
+  for (uint16_t d = 0; d <= ACTUATOR_DRIVE_MAX; d++) {
+    benchDrive = d;
+    POLICY::write(benchDrive);
+    HAND::write(benchDrive);
+  }
+  for (uint16_t d = 0; d <= ACTUATOR_DRIVE_MAX; d++) {
+    benchDrive = d;
+    unsigned long policyBest = 0xFFFF;
+    unsigned long writtenBest = 0xFFFF;
+    for (int pass = 0; pass < BENCH_PASSES; pass++) {
+      if ((d + pass) & 1) {
+        writtenBest = fastest(writtenBest, timeWrite<HAND>());
+        policyBest = fastest(policyBest, timeWrite<POLICY>());
+      } else {
+        policyBest = fastest(policyBest, timeWrite<POLICY>());
+        writtenBest = fastest(writtenBest, timeWrite<HAND>());
+      }
+    }
+    record(policy, policyBest, overhead);
+    record(written, writtenBest, overhead);
+  }
+  out.println(label);
+  printResult(out, F("  Actuator::write()          :"), policy);
+  printResult(out, otherLabel, written);
+}
+
+// The hand-written calls, with the constants worked out by hand .. written again here, not the sketches' code. The PWM one
+// is the call in Controller_int_PWM_v22/v23; V19 wrote the servo pulse width itself, and no sketch had the current loop.
+// The products are uint32_t, as unsigned long is on the AVR (on x86-64 unsigned long would make them 64-bit), and the
+// servo is the policy's own, so that only the code differs
+struct HandPwm {
+  static inline void write(uint16_t drive) {
+    Timer1.setPwmDuty(BENCH_PWM_PIN, drive);
+  }
+};
+struct HandCurrentLoop {
+  static inline void write(uint16_t drive) {
+    Timer1.setPwmDuty(BENCH_PWM_PIN, 205 + (uint16_t) (((uint32_t) drive * 52404) >> 16));   // 818/1023 in Q16
+  }
+};
+#if (VENT_ACTUATOR == VENT_ACTUATOR_SERVO) || !defined(__AVR__)
+struct HandServo {
+  static inline void write(uint16_t drive) {
+    ServoActuator<BENCH_SERVO_PIN>::servo.write(750 + (uint16_t) (((uint32_t) drive * 96094) >> 16));   // 1500/1023 in Q16
+  }
+};
+#endif
+// Each write() both ways, out of line, so that the code of the two can be compared instruction by instruction
+// (tools/actuator_disasm.sh, make disasm in sim/) .. never called, and dropped from the sketch by the linker
+#define ACTUATOR_DISASM_PAIR(NAME, POLICY, HAND) \
+  extern "C" void __attribute__((noinline, used)) actuatorDisasm##NAME##Policy(uint16_t drive) { POLICY::write(drive); } \
+  extern "C" void __attribute__((noinline, used)) actuatorDisasm##NAME##Hand(uint16_t drive) { HAND::write(drive); }
+
+ACTUATOR_DISASM_PAIR(Pwm, PwmActuator<BENCH_PWM_PIN>, HandPwm)
+ACTUATOR_DISASM_PAIR(CurrentLoop, CurrentLoopActuator<BENCH_PWM_PIN>, HandCurrentLoop)
+#if (VENT_ACTUATOR == VENT_ACTUATOR_SERVO) || !defined(__AVR__)
+ACTUATOR_DISASM_PAIR(Servo, ServoActuator<BENCH_SERVO_PIN>, HandServo)
+#endif
+
+struct Dynamic {
+  static inline void write(uint16_t drive) {
+    dynamicActuator->write(drive);
+  }
+};
+
+void actuatorBenchmark(Print &out) {
+  cyclesBegin();
+  unsigned long overhead = cyclesOverhead();
+
+  out.println(F("Actuator output, over drive 0 .. 1023:"));
+  compare<PwmActuator<BENCH_PWM_PIN>, HandPwm>(out, F(" PWM (Timer1.setPwmDuty)"), F("  by hand                    :"), overhead);
+  compare<CurrentLoopActuator<BENCH_PWM_PIN>, HandCurrentLoop>(out, F(" 4-20 mA current loop"), F("  by hand                    :"), overhead);
+#if (VENT_ACTUATOR == VENT_ACTUATOR_SERVO) || !defined(__AVR__)
+  ServoActuator<BENCH_SERVO_PIN>::begin(0);
+  compare<ServoActuator<BENCH_SERVO_PIN>, HandServo>(out, F(" servo (ServoTimer2)"), F("  by hand                    :"), overhead);
+#endif
+  compare<PwmActuator<BENCH_PWM_PIN>, Dynamic>(out, F(" PWM, against a virtual write()"), F("  virtual write()            :"),
+                                              overhead);
+  out.print(F("  (timer read overhead of "));
+  out.print(overhead);
+  out.println(F(" cycles subtracted)"));
+}
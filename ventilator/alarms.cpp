@@ -0,0 +1,140 @@
+#include "alarms.h"
+
+// Only the control tick changes these, apart from latched (loop() clears it with interrupts off) and the samples since the
+// last tick (the ADC interrupt) .. the two interrupts never interrupt each other
+static AlarmLimits limits = { 0xFFFF, 0xFFFF, 0, 0, 0xFFFFFFFF, 0, 0, 0xFF, 0xFFFFFFFF };   // nothing raised until configured
+static volatile uint8_t active = 0;
+static volatile uint8_t latched = 0;
+static volatile uint16_t raisedCount = 0;
+static uint32_t disconnectCount = 0;              // ticks under disconnectOn
+static uint32_t apneaCount = 0;                   // ticks since the patient last triggered a breath
+static uint8_t lowPeakCount = 0;                  // inhales in a row that peaked under lowPeakOn
+static uint16_t inhalePeak = 0;
+static bool wasInhaling = false;
+static uint16_t highest = 0;                      // highest fast-channel sample since the last tick
+static bool sampled = false;
+
+void alarmConfigure(const AlarmLimits &newLimits) {
+  noInterrupts();
+  limits = newLimits;
+  active = 0;
+  latched = 0;
+  raisedCount = 0;
+  disconnectCount = 0;
+  apneaCount = 0;
+  lowPeakCount = 0;
+  inhalePeak = 0;
+  wasInhaling = false;
+  sampled = false;
+  interrupts();
+}
+
+void alarmSample(uint16_t pressure) {
+  if (!sampled || (pressure > highest)) {
+    highest = pressure;
+  }
+  sampled = true;
+}
+
+uint8_t alarmTick(uint16_t pressure, bool inhaling, bool spontaneous, bool patientBreath) {
+  uint8_t now = active;
+  if (sampled) {
+    sampled = false;                              // a new set of samples from here
+  } else {
+    highest = pressure;                           // none since the last tick (a tick faster than the filter)
+  }
+
+  // Over-pressure .. on any one sample
+  if (highest >= limits.highOn) {
+    now |= ALARM_HIGH_PRESSURE;
+  } else if (highest < limits.highOff) {
+    now &= ~ALARM_HIGH_PRESSURE;
+  }
+
+  // Disconnect .. every sample low, for long enough
+  if (highest >= limits.disconnectOff) {
+    disconnectCount = 0;
+    now &= ~ALARM_DISCONNECT;
+  } else if ((highest < limits.disconnectOn) && (disconnectCount < limits.disconnectTicks)) {
+    if (++disconnectCount >= limits.disconnectTicks) {
+      now |= ALARM_DISCONNECT;
+    }
+  }
+
+  // Apnea .. spontaneous mode only
+  if (!spontaneous || patientBreath) {
+    apneaCount = 0;
+    now &= ~ALARM_APNEA;
+  } else if (apneaCount < limits.apneaTicks) {
+    if (++apneaCount >= limits.apneaTicks) {
+      now |= ALARM_APNEA;
+    }
+  }
+
+  // Low pressure .. judged on each inhale's peak as the inhale ends
+  if (inhaling) {
+    if (!wasInhaling || (highest > inhalePeak)) {
+      inhalePeak = highest;
+    }
+  } else if (wasInhaling) {
+    if (inhalePeak >= limits.lowPeakOff) {
+      lowPeakCount = 0;
+      now &= ~ALARM_LOW_PRESSURE;
+    } else if ((inhalePeak < limits.lowPeakOn) && (lowPeakCount < limits.lowPeakBreaths)) {
+      if (++lowPeakCount >= limits.lowPeakBreaths) {
+        now |= ALARM_LOW_PRESSURE;
+      }
+    }
+  }
+  wasInhaling = inhaling;
+
+  uint8_t raised = now & ~active;
+  active = now;
+  if (raised) {
+    latched |= raised;
+    raisedCount++;
+  }
+  return raised;
+}
+
+void alarmPause() {
+  sampled = false;
+  disconnectCount = 0;
+  apneaCount = 0;
+  wasInhaling = false;
+}
+
+uint8_t alarmActive() {
+  return active;
+}
+
+uint8_t alarmLatched() {
+  return latched;
+}
+
+void alarmAcknowledge() {
+  noInterrupts();
+  latched = active;
+  interrupts();
+}
+
+uint16_t alarmRaisedCount() {
+  noInterrupts();
+  uint16_t count = raisedCount;
+  interrupts();
+  return count;
+}
+
+const __FlashStringHelper *alarmName(uint8_t alarm) {
+  switch (alarm) {
+    case ALARM_HIGH_PRESSURE:
+      return F("HIGH PRESSURE");
+    case ALARM_DISCONNECT:
+      return F("DISCONNECTED");
+    case ALARM_APNEA:
+      return F("APNEA");
+    case ALARM_LOW_PRESSURE:
+      return F("LOW PRESSURE");
+  }
+  return F("");
+}
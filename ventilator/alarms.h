@@ -0,0 +1,75 @@
+#ifndef ALARMS_H
+#define ALARMS_H
+
+/* Alarms
+   Description : Evaluated in the control tick, once a tick, from the fast-channel pressure (240 samples/s filtered, as
+                 pressureFilterFast) .. a fixed handful of compares and counts whatever is going on, no loops, no
+                 division, so the tick costs the same with or without an alarm. alarmSample() in the ADC interrupt keeps
+                 the highest sample since the last tick, so a spike between two ticks is not missed. Every alarm is
+                 raised on the first tick after the sample that meets its condition, so the worst-case time to detect
+                 is the time the condition takes, plus the filter's delay, plus one tick:
+
+                   ALARM_HIGH_PRESSURE  pressure at or over highOn. Clears below highOff
+                   ALARM_DISCONNECT     pressure under disconnectOn for disconnectTicks (the patient circuit is open to
+                                        the room: no PEEP, and no pressure rise on the inhale). Clears at or over
+                                        disconnectOff. Between the two the count holds
+                   ALARM_APNEA          spontaneous mode, no patient-triggered breath for apneaTicks. Clears on the next
+                                        one
+                   ALARM_LOW_PRESSURE   the highest pressure of an inhale under lowPeakOn, lowPeakBreaths breaths in a
+                                        row (a leak, or a bag that is not being squeezed). Clears on a breath that
+                                        reaches lowPeakOff
+
+                 The bits are in order of priority, highest first (ALARM_HIGH_PRIORITY are the two that need someone at
+                 the bedside now). An alarm that is raised is latched: it stays in alarmLatched() after its condition
+                 clears, until alarmAcknowledge() from the front panel.
+
+                 The response is the control tick's (ventilator.cpp): over-pressure ends the inhale on the tick it is
+                 seen, with the drive at its minimum from that tick; apnea starts a backup breath at once if the patient
+                 is exhaling. The LEDs, buzzer and display are driven from loop() off alarmLatched() and alarmActive().
+                 Pressures are Q4 raw counts (as pressureFilterFast).
+
+   Note        : The disconnect alarm needs a PEEP above disconnectOff .. with no PEEP a connected patient looks the same
+                 as an open circuit for the whole exhale.
+*/
+
+#include <Arduino.h>
+
+const uint8_t ALARM_HIGH_PRESSURE = 0x01;
+const uint8_t ALARM_DISCONNECT = 0x02;
+const uint8_t ALARM_APNEA = 0x04;
+const uint8_t ALARM_LOW_PRESSURE = 0x08;
+const uint8_t ALARM_HIGH_PRIORITY = ALARM_HIGH_PRESSURE | ALARM_DISCONNECT;
+
+struct AlarmLimits {
+  uint16_t highOn;            // Q4 raw counts
+  uint16_t highOff;
+  uint16_t disconnectOn;
+  uint16_t disconnectOff;
+  uint32_t disconnectTicks;   // control ticks .. 32 bits, so a fast control tick (CONTROL_TICK_US) does not overflow them
+  uint16_t lowPeakOn;
+  uint16_t lowPeakOff;
+  uint8_t lowPeakBreaths;
+  uint32_t apneaTicks;
+};
+
+void alarmConfigure(const AlarmLimits &limits);   // setup() .. and clears every alarm
+
+void alarmSample(uint16_t pressure);              // ADC interrupt, each fast-channel output
+
+// Control tick, every tick while ventilating. patientBreath: a patient-triggered inhale started on this tick.
+// Returns the alarms raised on this tick
+uint8_t alarmTick(uint16_t pressure, bool inhaling, bool spontaneous, bool patientBreath);
+void alarmPause();                                // control tick, in place of alarmTick() while not ventilating (calibration)
+
+uint8_t alarmActive();                            // conditions present now
+uint8_t alarmLatched();                           // raised since the last acknowledge (includes the active ones)
+void alarmAcknowledge();                          // loop() .. unlatches the alarms whose condition has cleared
+uint16_t alarmRaisedCount();                      // alarms raised since alarmConfigure() (wraps)
+
+// Highest priority alarm in a set of ALARM_* bits (0 if none), and its name for the display (at most 19 characters)
+inline uint8_t alarmHighest(uint8_t alarms) {
+  return alarms & (uint8_t) -alarms;
+}
+const __FlashStringHelper *alarmName(uint8_t alarm);
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef BENCH_CYCLES_H
+#define BENCH_CYCLES_H
+
+/* Cycle counting for the start-up benchmarks (drive_bench.cpp, actuator_bench.cpp)
+   Description : cyclesBegin() once, then cyclesNow() either side of the code being timed, with interrupts off. The
+                 difference less cyclesOverhead() (reading the counter itself) is the cost, kept in a BenchResult:
+
+                   AVR  - Timer1 with no prescaler counts CPU cycles (wraps at 65536, plenty for one calculation) ..
+                          call before Timer1 is set up for the control tick
+                   x86  - the TSC, read between lfences so that the work being timed falls between the two reads
+                   else - CLOCK_MONOTONIC nanoseconds
+*/
+
+#include <Arduino.h>
+
+#if !defined(__AVR__)
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+#endif
+
+#if defined(__AVR__)
+static inline void cyclesBegin() {
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10);
+}
+static inline uint16_t cyclesNow() {
+  return TCNT1;
+}
+#elif defined(__x86_64__) || defined(__i386__)
+static inline void cyclesBegin() {}
+static inline uint32_t cyclesNow() {
+  _mm_lfence();                                   // the TSC read waits for the work before it, and holds up the work after
+  uint32_t now = (uint32_t) __rdtsc();
+  _mm_lfence();
+  return now;
+}
+#else
+static inline void cyclesBegin() {}
+static inline uint32_t cyclesNow() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t) ts.tv_nsec;
+}
+#endif
+
+// Cost of reading the counter itself - the smallest of a few back to back reads
+static inline unsigned long cyclesOverhead() {
+  unsigned long overhead = 0xFFFF;
+  for (int i = 0; i < 16; i++) {
+    noInterrupts();
+    uint32_t start = cyclesNow();
+    uint32_t stop = cyclesNow();
+    interrupts();
+    if ((uint16_t) (stop - start) < overhead) {
+      overhead = (uint16_t) (stop - start);
+    }
+  }
+  return overhead;
+}
+
+struct BenchResult {
+  unsigned long worst;
+  unsigned long total;
+  unsigned long count;
+};
+
+static inline void record(BenchResult &r, unsigned long cycles, unsigned long overhead) {
+  cycles = cycles > overhead ? cycles - overhead : 0;
+  if (cycles > r.worst) {
+    r.worst = cycles;
+  }
+  r.total += cycles;
+  r.count++;
+}
+
+static inline unsigned long fastest(unsigned long best, unsigned long cycles) {
+  return cycles < best ? cycles : best;
+}
+
+static inline void printResult(Print &out, const __FlashStringHelper *label, const BenchResult &r) {
+  out.print(label);
+  out.print(F(" worst "));
+  out.print(r.worst);
+  out.print(F(" cycles, mean "));
+  out.print(r.total / r.count);
+  out.println(F(" cycles"));
+}
+
+#endif
@@ -0,0 +1,125 @@
+#include "breath_metrics.h"
+
+// Breath in progress .. the ADC interrupt and the control tick both write these, and neither interrupts the other
+static bool started = false;                      // an inhale has been seen, so a whole breath is being measured
+static uint16_t inhaleStart = 0;
+static uint16_t exhaleStart = 0;
+static bool inhaling = false;
+static bool triggered = false;
+static uint16_t peak = 0;
+static uint16_t last = 0;                         // latest sample .. the PEEP once the next inhale starts
+static uint32_t sum = 0;
+static uint16_t samples = 0;
+static uint32_t exhaleSums[BREATH_EXHALE_SEGMENT_COUNT];
+static uint16_t segmentSamples = 0;
+static uint8_t segment = BREATH_EXHALE_SEGMENT_COUNT;   // exhale segment being summed (all done, or not exhaling yet)
+static uint16_t segmentLeft = 0;                  // samples still to go in it
+static uint8_t settleLeft = 0;                    // samples still to pass before the first segment
+
+// Last complete breath, waiting for loop()
+static BreathMetrics published;
+static volatile bool ready = false;
+static uint16_t breaths = 0;
+
+void breathMetricsSample(uint16_t pressure) {
+  last = pressure;
+  if (inhaling && pressure > peak) {
+    peak = pressure;
+  }
+  if (samples != 0xFFFF) {                        // 4.5 minutes of samples .. a breath is at most 12 s
+    sum += pressure;
+    samples++;
+  }
+  if (settleLeft) {
+    settleLeft--;
+  } else if (segment < BREATH_EXHALE_SEGMENT_COUNT) {    // counted down, so there is no division here
+    exhaleSums[segment] += pressure;
+    if (--segmentLeft == 0) {
+      segment++;
+      segmentLeft = segmentSamples;
+    }
+  }
+}
+
+void breathMetricsInhale(uint16_t startTick, bool patientTriggered) {
+  if (started) {
+    published.index = ++breaths;
+    published.pip = peak;
+    published.peep = last;
+    published.meanPressure = samples ? (uint16_t) (sum / samples) : last;   // once per breath, not per sample
+    published.periodTicks = startTick - inhaleStart;
+    published.inhaleTicks = exhaleStart - inhaleStart;
+    published.flags = triggered ? BREATH_PATIENT_TRIGGERED : 0;
+    if (segmentSamples && segment == BREATH_EXHALE_SEGMENT_COUNT) {
+      published.flags |= BREATH_EXHALE_SEGMENTS;
+    }
+    for (uint8_t i = 0; i < BREATH_EXHALE_SEGMENT_COUNT; i++) {
+      published.exhaleSums[i] = exhaleSums[i];
+    }
+    published.exhaleSegmentSamples = segmentSamples;
+    ready = true;
+  }
+  started = true;
+  inhaleStart = startTick;
+  exhaleStart = startTick;
+  inhaling = true;
+  triggered = patientTriggered;
+  peak = last;
+  sum = 0;
+  samples = 0;
+  segmentSamples = 0;
+  segment = BREATH_EXHALE_SEGMENT_COUNT;
+  settleLeft = 0;
+}
+
+void breathMetricsExhale(uint16_t startTick, uint8_t settleSamples, uint16_t samplesPerSegment) {
+  exhaleStart = startTick;
+  inhaling = false;
+  for (uint8_t i = 0; i < BREATH_EXHALE_SEGMENT_COUNT; i++) {
+    exhaleSums[i] = 0;
+  }
+  segmentSamples = samplesPerSegment;
+  settleLeft = settleSamples;
+  segmentLeft = samplesPerSegment;
+  segment = samplesPerSegment ? 0 : BREATH_EXHALE_SEGMENT_COUNT;
+}
+
+void breathMetricsRestart() {
+  started = false;
+  inhaling = false;
+}
+
+void breathMetricsReset() {
+  breathMetricsRestart();
+  segment = BREATH_EXHALE_SEGMENT_COUNT;
+  settleLeft = 0;
+  breaths = 0;
+  ready = false;
+}
+
+bool breathMetricsTake(BreathMetrics &metrics) {
+  if (!ready) {
+    return false;
+  }
+  noInterrupts();
+  metrics = published;
+  ready = false;
+  interrupts();
+  return true;
+}
+
+void breathMetricsPack(const BreathMetrics &metrics, uint8_t *payload) {
+  payload[0] = metrics.index & 0xFF;
+  payload[1] = metrics.index >> 8;
+  payload[2] = metrics.pip & 0xFF;
+  payload[3] = metrics.pip >> 8;
+  payload[4] = metrics.peep & 0xFF;
+  payload[5] = metrics.peep >> 8;
+  payload[6] = metrics.meanPressure & 0xFF;
+  payload[7] = metrics.meanPressure >> 8;
+  payload[8] = metrics.periodTicks & 0xFF;
+  payload[9] = metrics.periodTicks >> 8;
+  payload[10] = metrics.inhaleTicks & 0xFF;
+  payload[11] = metrics.inhaleTicks >> 8;
+  payload[12] = metrics.flags;
+}
@@ -0,0 +1,57 @@
+#ifndef BREATH_METRICS_H
+#define BREATH_METRICS_H
+
+/* Per-breath ventilation metrics
+   Description : Built up sample by sample while the breath is delivered and published once per breath. Nothing is
+                 buffered .. each sample costs a compare, an add and a count, and the whole state is a few words:
+
+                   PIP    - highest pressure during the inhale
+                   PEEP   - pressure at the end of the exhale (the last sample before the next inhale starts)
+                   Pmean  - mean pressure over the whole breath
+                   period - control ticks from one inhale start to the next
+                   Ti     - control ticks of inhale .. the measured I:E is (period - Ti) : Ti
+                   exhale - pressure summed over three equal segments from the start of the exhale, for the exhaled
+                            volume (tidal_adapt.h). The segments are sized by the control tick for the planned exhale, and
+                            start once the inhale pressure has cleared the filter
+
+                 breathMetricsSample() runs from the ADC interrupt with every fast-channel output of the pressure filter;
+                 the control tick marks the phase changes. The two never interrupt each other, so there is no locking
+                 between them. A breath is published when the next inhale starts, and loop() picks it up with
+                 breathMetricsTake(); if loop() has not taken the last one it is replaced by the newer breath.
+                 Pressures are Q4 raw counts (as pressureFilterFast).
+*/
+
+#include <Arduino.h>
+
+const uint8_t BREATH_PATIENT_TRIGGERED = 0x01;    // BreathMetrics::flags .. the inhale was started by the patient
+const uint8_t BREATH_EXHALE_SEGMENTS = 0x02;      // .. the exhale lasted long enough to fill all three exhaleSums
+const uint8_t BREATH_EXHALE_SEGMENT_COUNT = 3;
+
+struct BreathMetrics {
+  uint16_t index;             // breaths published since reset (wraps)
+  uint16_t pip;               // Q4 raw counts
+  uint16_t peep;
+  uint16_t meanPressure;
+  uint16_t periodTicks;
+  uint16_t inhaleTicks;
+  uint8_t flags;              // BREATH_* bits
+  uint32_t exhaleSums[BREATH_EXHALE_SEGMENT_COUNT];   // pressure summed over equal segments from the exhale start ..
+  uint16_t exhaleSegmentSamples;                      // .. of this many samples each (loop() only, not sent)
+};
+
+const uint8_t BREATH_METRICS_BYTES = 13;          // packed size on the wire (TELEMETRY_FRAME_BREATH)
+
+void breathMetricsSample(uint16_t pressure);      // ADC interrupt, each fast-channel output
+
+// Control tick. startTick is the control tick on which the new phase's first drive value goes out
+void breathMetricsInhale(uint16_t startTick, bool patientTriggered);
+// The exhale segments start settleSamples after this call, and have segmentSamples each (0 for none)
+void breathMetricsExhale(uint16_t startTick, uint8_t settleSamples, uint16_t segmentSamples);
+void breathMetricsRestart();                      // breathing stopped (calibration) .. the breath in progress is not published
+void breathMetricsReset();                        // as at power-up .. nothing measured, nothing waiting for loop()
+
+bool breathMetricsTake(BreathMetrics &metrics);   // loop() .. true once for each published breath
+
+void breathMetricsPack(const BreathMetrics &metrics, uint8_t *payload);
+
+#endif
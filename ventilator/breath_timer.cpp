@@ -0,0 +1,13 @@
+#include "breath_timer.h"
+
+const uint32_t US_PER_MINUTE = 60000000UL;
+
+void breathTimingSet(BreathTiming &timing, uint8_t respRate, uint8_t ieTenths, uint32_t tickUs) {
+  timing.tickWeight = tickUs * respRate * (uint32_t) (BREATH_IE_SCALE + ieTenths);
+  timing.inhaleLength = US_PER_MINUTE * BREATH_IE_SCALE;
+  timing.exhaleLength = US_PER_MINUTE * ieTenths;
+}
+
+uint16_t breathTimingInhaleTicks(const BreathTiming &timing) {
+  return timing.inhaleLength / timing.tickWeight;
+}
@@ -0,0 +1,65 @@
+#ifndef BREATH_TIMER_H
+#define BREATH_TIMER_H
+
+/* Breath timebase
+   Description : Rounding each phase down to whole control ticks (as the tick counts did up to V38) loses up to a tick per
+                 phase, every breath - at 7 bpm the breath came out 8.56 s instead of 8.571 s, and the error never goes
+                 away. Here the phases are timed the way a line is drawn with Bresenham's algorithm: each phase has a
+                 clock that counts up by a fixed weight every tick of that phase, the phase ends on the tick that takes
+                 its clock to the phase length, and whatever the clock went past by is carried into the same phase of the
+                 next breath. A phase still starts and ends on a tick, but its length dithers between the two whole
+                 numbers of ticks either side of the exact length, so over any number of breaths the inhale time, the
+                 exhale time - and so the period and the I:E - are exact (to the crystal). A breath never starts more
+                 than two ticks from where an exact clock would start it.
+                 (One clock for both phases would keep the period but not the I:E: at 12 bpm 1:2 on a 10 ms tick every
+                 inhale would be rounded the same way, 1.67 s, and the exhale 3.33 s.)
+
+                 All three numbers are whole, in units of 1 / (respRate x (10 + I:E x 10)) microseconds:
+
+                   tickWeight   = tickUs x respRate x (10 + ieTenths)      added each control tick
+                   inhaleLength = 60000000 x 10                            60 s / respRate x 10 / (10 + ieTenths)
+                   exhaleLength = 60000000 x ieTenths                      60 s / respRate x ieTenths / (10 + ieTenths)
+
+                 so the control tick only adds and compares 32-bit numbers - no division and no float, whatever the tick
+                 rate. breathTimingSet() (loop()) does the multiplies. Fits 32 bits for I:E up to 1:6 and a tick of up to
+                 65 ms; the control tick can be made as short as the CPU allows without changing the breath.
+*/
+
+#include <Arduino.h>
+
+const uint8_t BREATH_IE_SCALE = 10;               // I:E is held in tenths .. 1:2.5 is 25
+
+struct BreathTiming {
+  uint32_t tickWeight;
+  uint32_t inhaleLength;
+  uint32_t exhaleLength;
+};
+
+void breathTimingSet(BreathTiming &timing, uint8_t respRate, uint8_t ieTenths, uint32_t tickUs);
+
+// Whole ticks in the shortest inhale (one less than the longest when the inhale is not a whole number of ticks)
+uint16_t breathTimingInhaleTicks(const BreathTiming &timing);
+
+struct BreathClock {
+  uint32_t inhale;
+  uint32_t exhale;
+};
+
+inline void breathClockReset(BreathClock &clock) {
+  clock.inhale = 0;
+  clock.exhale = 0;
+}
+
+// Control tick, once every tick. True on the last tick of the phase; the part of the tick beyond it stays in the clock
+inline bool breathClockStep(BreathClock &clock, const BreathTiming &timing, bool inhaling) {
+  uint32_t &phase = inhaling ? clock.inhale : clock.exhale;
+  uint32_t length = inhaling ? timing.inhaleLength : timing.exhaleLength;
+  phase += timing.tickWeight;
+  if (phase < length) {
+    return false;
+  }
+  phase -= length;
+  return true;
+}
+
+#endif
@@ -0,0 +1,213 @@
+#include "calibration.h"
+
+const uint8_t PHASE_RAMP = 0;
+const uint8_t PHASE_SETTLE = 1;
+const uint8_t PHASE_RETURN = 2;
+const uint8_t WINDOW_SHIFT_MAX = 12;              // keeps the window sum inside 32 bits
+
+static volatile uint8_t state = CALIBRATION_IDLE;
+static volatile uint8_t point = 0;
+
+// Sweep set-up .. written by calibrationStart() with interrupts off, then only read by the control tick
+static uint16_t target[CALIBRATION_POINTS];
+static int driveMinimum = 0;
+static uint16_t limit = 0;
+static int rampStep = 1;
+static uint8_t windowShift = 4;
+static uint16_t settleTimeoutTicks = 0;
+
+// Sweep in progress .. control tick only, until the state is DONE
+static uint8_t phase = PHASE_RAMP;
+static int drive = 0;
+static uint16_t windowTicks = 0;
+static uint32_t windowSum = 0;
+static uint16_t means[CALIBRATION_SETTLE_WINDOWS];   // the last few window means, oldest at meanIndex once full
+static uint8_t meanIndex = 0;
+static uint8_t meanCount = 0;
+static uint16_t settleTicks = 0;
+static uint16_t measured[CALIBRATION_POINTS];
+static uint8_t measuredPoints = 0;
+static uint8_t unsettledPoints = 0;
+
+void calibrationStart(int driveMin, int driveMax, uint16_t pressureLimit, int rampPerSecond, long tickUs) {
+  noInterrupts();                                 // the control tick must not see half a set-up
+  for (uint8_t i = 0; i < CALIBRATION_POINTS; i++) {
+    target[i] = driveMin + (long) (driveMax - driveMin) * i / (CALIBRATION_POINTS - 1);
+  }
+  driveMinimum = driveMin;
+  limit = pressureLimit;
+  rampStep = (long) rampPerSecond * tickUs / 1000000L;
+  if (rampStep < 1) {
+    rampStep = 1;
+  }
+  windowShift = 0;
+  while (windowShift < WINDOW_SHIFT_MAX && ((long) tickUs << windowShift) < CALIBRATION_WINDOW_MS * 1000L) {
+    windowShift++;
+  }
+  settleTimeoutTicks = CALIBRATION_SETTLE_TIMEOUT_MS * 1000L / tickUs;
+  phase = PHASE_RAMP;
+  drive = driveMin;
+  measuredPoints = 0;
+  unsettledPoints = 0;
+  point = 0;
+  state = CALIBRATION_RUNNING;
+  interrupts();
+}
+
+void calibrationAbort() {
+  if (state == CALIBRATION_RUNNING) {
+    state = CALIBRATION_ABORTED;
+  }
+}
+
+uint8_t calibrationState() {
+  return state;
+}
+
+uint8_t calibrationPoint() {
+  return point;
+}
+
+bool calibrationRunning() {
+  return state == CALIBRATION_RUNNING;
+}
+
+// One tick's move towards a drive value .. true once there
+static bool rampTowards(int value) {
+  if (drive < value) {
+    drive = (value - drive > rampStep) ? drive + rampStep : value;
+  } else if (drive > value) {
+    drive = (drive - value > rampStep) ? drive - rampStep : value;
+  }
+  return drive == value;
+}
+
+static void settleBegin() {
+  phase = PHASE_SETTLE;
+  windowTicks = 0;
+  windowSum = 0;
+  meanIndex = 0;
+  meanCount = 0;
+  settleTicks = 0;
+}
+
+int calibrationTick(uint16_t pressure) {
+  switch (phase) {
+    case PHASE_RAMP:
+      if (rampTowards(target[point])) {
+        settleBegin();
+      }
+      break;
+
+    case PHASE_SETTLE:
+      windowSum += pressure;
+      settleTicks++;
+      if (++windowTicks < (1u << windowShift)) {
+        break;
+      }
+      {
+        uint16_t mean = windowSum >> windowShift;
+        bool settled = (meanCount == CALIBRATION_SETTLE_WINDOWS) &&
+                       ((uint16_t) abs((int) mean - (int) means[meanIndex]) <= CALIBRATION_SETTLE_BAND);
+        if (settled || settleTicks >= settleTimeoutTicks) {
+          if (!settled) {
+            unsettledPoints++;
+          }
+          measured[point] = mean;
+          measuredPoints = point + 1;
+          if ((point + 1 >= CALIBRATION_POINTS) || (mean >= limit)) {
+            phase = PHASE_RETURN;                 // done, or as high as it is safe to go
+          } else {
+            point = point + 1;
+            phase = PHASE_RAMP;
+          }
+        } else {
+          means[meanIndex] = mean;
+          meanIndex = (meanIndex + 1) % CALIBRATION_SETTLE_WINDOWS;
+          if (meanCount < CALIBRATION_SETTLE_WINDOWS) {
+            meanCount++;
+          }
+          windowTicks = 0;
+          windowSum = 0;
+        }
+      }
+      break;
+
+    case PHASE_RETURN:
+      if (rampTowards(driveMinimum)) {
+        state = CALIBRATION_DONE;
+      }
+      break;
+  }
+  return drive;
+}
+
+// Pool adjacent violators: the closest (least squares) non-decreasing sequence. Each run of points that goes down is
+// replaced by its mean, merging back as far as needed
+static void fitNonDecreasing(uint16_t *values, uint8_t n) {
+  uint32_t sum[CALIBRATION_POINTS];
+  uint8_t count[CALIBRATION_POINTS];
+  uint8_t blocks = 0;
+  for (uint8_t i = 0; i < n; i++) {
+    sum[blocks] = values[i];
+    count[blocks] = 1;
+    blocks++;
+    while (blocks > 1 && sum[blocks - 2] * count[blocks - 1] > sum[blocks - 1] * count[blocks - 2]) {
+      sum[blocks - 2] += sum[blocks - 1];
+      count[blocks - 2] += count[blocks - 1];
+      blocks--;
+    }
+  }
+  uint8_t i = 0;
+  for (uint8_t b = 0; b < blocks; b++) {
+    uint16_t mean = sum[b] / count[b];
+    for (uint8_t c = 0; c < count[b]; c++) {
+      values[i++] = mean;
+    }
+  }
+}
+
+bool calibrationTakeResult(CalibrationMap &map) {
+  if (state != CALIBRATION_DONE) {
+    return false;
+  }
+  map.points = measuredPoints;                    // the control tick is finished with these
+  map.unsettled = unsettledPoints;
+  for (uint8_t i = 0; i < measuredPoints; i++) {
+    map.drive[i] = target[i];
+    map.pressure[i] = measured[i];
+  }
+  fitNonDecreasing(map.pressure, map.points);
+  state = CALIBRATION_IDLE;
+  return true;
+}
+
+uint16_t calibrationDriveFor(const CalibrationMap &map, uint16_t pressure) {
+  if (map.points == 0) {
+    return 0;
+  }
+  if (pressure <= map.pressure[0]) {
+    return map.drive[0];
+  }
+  for (uint8_t i = 1; i < map.points; i++) {
+    if (map.pressure[i] >= pressure) {
+      // map.pressure[i - 1] < pressure <= map.pressure[i]
+      uint16_t span = map.pressure[i] - map.pressure[i - 1];
+      return map.drive[i - 1] + (uint32_t) (map.drive[i] - map.drive[i - 1]) * (pressure - map.pressure[i - 1]) / span;
+    }
+  }
+  return map.drive[map.points - 1];               // more than the actuator was seen to give
+}
+
+bool calibrationMapValid(const CalibrationMap &map, uint16_t driveMax) {
+  if ((map.points > CALIBRATION_POINTS) || (map.unsettled > map.points)) {
+    return false;
+  }
+  for (uint8_t i = 0; i < map.points; i++) {
+    if ((map.drive[i] > driveMax) || ((i > 0) && ((map.drive[i] <= map.drive[i - 1]) ||
+                                                  (map.pressure[i] < map.pressure[i - 1])))) {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,68 @@
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+/* Automatic actuator calibration
+   Description : Finds the pressure the actuator holds at each drive value, so that PCV can start each inhale from the drive
+                 that will actually give the set pressure rather than assuming that pressure is proportional to drive.
+                 Replaces the hand calibration of V19 (turn the knob a step, push, read the raw pressure off the screen).
+
+                 A state machine stepped by the control tick, one step per tick .. nothing waits, Timer1 keeps running and
+                 loop() carries on with the display and telemetry. The sweep goes up through CALIBRATION_POINTS drive
+                 values spread evenly from driveMin to driveMax:
+
+                   RAMP   - move the drive towards the next point at rampPerSecond (no abrupt changes for the mechanism)
+                   SETTLE - average the pressure over windows of 2^windowShift ticks (~150 ms). The point is settled when
+                            a window agrees with the one CALIBRATION_SETTLE_WINDOWS before it to within
+                            CALIBRATION_SETTLE_BAND, and its pressure is that window's mean. Comparing windows 600 ms apart
+                            rather than next to each other matters: the sensor only resolves ~0.13 cmH2O, and the last part
+                            of a slow approach can sit on one ADC count for a few windows. A point that has not settled
+                            after CALIBRATION_SETTLE_TIMEOUT_MS is taken as it is and counted as unsettled
+                   RETURN - after the last point (or once a point reaches pressureLimit .. the points above it are not
+                            visited) ramp back down to driveMin
+
+                 17 points take well under a minute against a test lung, and never more than
+                 17 x (ramp + CALIBRATION_SETTLE_TIMEOUT_MS), a little over 90 s.
+                 When the sweep is over, loop() takes the result with calibrationTakeResult(), which fits a
+                 non-decreasing pressure to the points by pool-adjacent-violators (noise or a sticky mechanism can make a
+                 higher drive read a slightly lower pressure) and returns the map. calibrationDriveFor() reads the map
+                 backwards, interpolating the drive that holds a pressure.
+                 Pressures are Q4 raw counts (as pressureFilterFast).
+                 loop() keeps the map in EEPROM (settings_store.h) and setup() restores it, so a reset does not lose it.
+
+   Note        : Holds each pressure for seconds - for a test lung only, never a patient.
+*/
+
+#include <Arduino.h>
+
+const uint8_t CALIBRATION_POINTS = 17;
+const uint16_t CALIBRATION_SETTLE_BAND = 3;               // Q4 raw counts, ~0.025 cmH2O
+const uint8_t CALIBRATION_SETTLE_WINDOWS = 4;             // .. between a window's mean and the mean this many windows before
+const uint16_t CALIBRATION_SETTLE_TIMEOUT_MS = 5000;
+const uint16_t CALIBRATION_WINDOW_MS = 150;               // at least this long, rounded up to a power of two ticks
+
+const uint8_t CALIBRATION_IDLE = 0;
+const uint8_t CALIBRATION_RUNNING = 1;
+const uint8_t CALIBRATION_DONE = 2;                       // result waiting for calibrationTakeResult()
+const uint8_t CALIBRATION_ABORTED = 3;
+
+struct CalibrationMap {
+  uint8_t points;                                         // 0 = not calibrated
+  uint8_t unsettled;                                      // points taken at the timeout
+  uint16_t drive[CALIBRATION_POINTS];
+  uint16_t pressure[CALIBRATION_POINTS];                  // non-decreasing
+};
+
+// loop() side
+void calibrationStart(int driveMin, int driveMax, uint16_t pressureLimit, int rampPerSecond, long tickUs);
+void calibrationAbort();                                  // drive goes straight to driveMin on the next tick
+uint8_t calibrationState();
+uint8_t calibrationPoint();                               // the point being measured, 0 .. CALIBRATION_POINTS - 1
+bool calibrationTakeResult(CalibrationMap &map);          // true once for each finished sweep
+uint16_t calibrationDriveFor(const CalibrationMap &map, uint16_t pressure);
+bool calibrationMapValid(const CalibrationMap &map, uint16_t driveMax);   // one read back from EEPROM (settings_store.h)
+
+// Control tick
+bool calibrationRunning();
+int calibrationTick(uint16_t pressure);                   // the drive for this tick
+
+#endif
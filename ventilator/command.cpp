@@ -0,0 +1,103 @@
+#include "command.h"
+#include "telemetry.h"
+
+enum {
+  WAIT_SYNC_1,
+  WAIT_SYNC_2,
+  WAIT_TYPE,
+  WAIT_LENGTH,
+  WAIT_PAYLOAD,
+  WAIT_CRC
+};
+
+static uint8_t state = WAIT_SYNC_1;
+static uint8_t type = 0;
+static uint8_t length = 0;
+static uint8_t received = 0;           // payload bytes so far
+static uint8_t crc = 0;
+static uint8_t payload[COMMAND_MAX_PAYLOAD];
+static uint16_t errors = 0;
+
+void commandReset() {
+  state = WAIT_SYNC_1;
+  errors = 0;
+}
+
+static CommandFeedResult dropFrame() {
+  state = WAIT_SYNC_1;
+  if (errors != 0xFFFF) {
+    errors++;
+  }
+  return COMMAND_FEED_BAD;
+}
+
+CommandFeedResult commandFeed(uint8_t c) {
+  switch (state) {
+    case WAIT_SYNC_1:
+      if (c == TELEMETRY_SYNC_1) {
+        state = WAIT_SYNC_2;
+        return COMMAND_FEED_PENDING;
+      }
+      return COMMAND_FEED_TEXT;
+
+    case WAIT_SYNC_2:
+      if (c == TELEMETRY_SYNC_2) {
+        state = WAIT_TYPE;
+        return COMMAND_FEED_PENDING;
+      }
+      if (c == TELEMETRY_SYNC_1) {
+        return COMMAND_FEED_PENDING;          // a repeated first sync byte .. it may still be a frame
+      }
+      state = WAIT_SYNC_1;
+      return COMMAND_FEED_TEXT;
+
+    case WAIT_TYPE:
+      type = c;
+      crc = telemetryCrc8(0, c);
+      state = WAIT_LENGTH;
+      return COMMAND_FEED_PENDING;
+
+    case WAIT_LENGTH:
+      if (c > COMMAND_MAX_PAYLOAD) {
+        return dropFrame();
+      }
+      length = c;
+      received = 0;
+      crc = telemetryCrc8(crc, c);
+      state = c ? WAIT_PAYLOAD : WAIT_CRC;
+      return COMMAND_FEED_PENDING;
+
+    case WAIT_PAYLOAD:
+      payload[received++] = c;
+      crc = telemetryCrc8(crc, c);
+      if (received == length) {
+        state = WAIT_CRC;
+      }
+      return COMMAND_FEED_PENDING;
+
+    case WAIT_CRC:
+      if (c != crc) {
+        return dropFrame();
+      }
+      state = WAIT_SYNC_1;
+      return COMMAND_FEED_FRAME;
+  }
+  state = WAIT_SYNC_1;
+  return COMMAND_FEED_TEXT;
+}
+
+uint8_t commandType() {
+  return type;
+}
+
+uint8_t commandLength() {
+  return length;
+}
+
+const uint8_t *commandPayload() {
+  return payload;
+}
+
+uint16_t commandErrors() {
+  return errors;
+}
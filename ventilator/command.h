@@ -0,0 +1,69 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+/* Serial command protocol
+   Description : Settings and status over Serial, for test rigs and a central station, beside the knob. Commands come in
+                 framed as telemetry goes out (telemetry.h: 0xA5 0x5A <type> <length> <payload ...> <crc8>), and each is
+                 answered with a TELEMETRY_FRAME_REPLY frame. The single-letter requests typed into the serial monitor
+                 ('p', 'm' ..) are plain ASCII, so they can never start a frame and both share the line.
+
+                 commandFeed() takes one byte at a time from loop() and never waits: the frame is built up in a fixed
+                 buffer here, no heap and no String. A frame with a bad CRC or a length over COMMAND_MAX_PAYLOAD is
+                 dropped and counted, and the parser looks for the next sync bytes .. the sender times out and asks
+                 again.
+
+   Commands    : every payload starts with a sequence byte, which comes back first in the reply, followed by the
+                 command type and a COMMAND_STATUS_* byte. Multi-byte values are little-endian.
+
+                   COMMAND_GET      (seq)                         -> mode, respRate, tidal (2), iERatio x 10,
+                                                                     inspPressure, pending (the settings last committed,
+                                                                     and 1 until the control tick has taken them up)
+                   COMMAND_SET      (seq, {param, value (2)} x n)  -> as COMMAND_GET, after the change
+                   COMMAND_STATUS   (seq)                         -> breathState, alarms active, alarms latched,
+                                                                     pressure (2, cmH2O x 10), control tick (2)
+
+                 A set is all or nothing: every value is checked against the range the menu allows before any of it is
+                 taken, then the whole set is committed as the menu commits it (commitSettings), to start with the next
+                 breath. Nothing is set while the menu or the calibration sweep is in use (COMMAND_STATUS_BUSY).
+*/
+
+#include <Arduino.h>
+
+const uint8_t COMMAND_MAX_PAYLOAD = 16;         // a sequence byte and five settings
+
+const uint8_t COMMAND_GET = 0x41;
+const uint8_t COMMAND_SET = 0x42;
+const uint8_t COMMAND_STATUS = 0x43;
+
+const uint8_t COMMAND_PARAM_MODE = 0;
+const uint8_t COMMAND_PARAM_RESP_RATE = 1;
+const uint8_t COMMAND_PARAM_TIDAL = 2;
+const uint8_t COMMAND_PARAM_IE_RATIO = 3;       // x 10
+const uint8_t COMMAND_PARAM_INSP_PRESSURE = 4;
+const uint8_t COMMAND_PARAMS = 5;
+
+const uint8_t COMMAND_STATUS_OK = 0;
+const uint8_t COMMAND_STATUS_UNKNOWN = 1;       // no such command, or no such parameter
+const uint8_t COMMAND_STATUS_LENGTH = 2;        // payload the wrong length for the command
+const uint8_t COMMAND_STATUS_RANGE = 3;         // a value outside what the menu allows .. nothing was changed
+const uint8_t COMMAND_STATUS_BUSY = 4;          // the menu or the calibration sweep is in use .. nothing was changed
+
+const uint8_t COMMAND_GET_REPLY_BYTES = 10;     // seq, type, status, then the settings
+const uint8_t COMMAND_STATUS_REPLY_BYTES = 10;
+const uint8_t COMMAND_REPLY_MAX = 10;
+
+enum CommandFeedResult {
+  COMMAND_FEED_PENDING,       // byte taken, no frame yet
+  COMMAND_FEED_TEXT,          // byte outside a frame .. a single-letter request
+  COMMAND_FEED_FRAME,         // a whole frame with a good CRC (commandType() / commandPayload())
+  COMMAND_FEED_BAD            // a frame was dropped
+};
+
+void commandReset();
+CommandFeedResult commandFeed(uint8_t c);
+uint8_t commandType();                          // of the frame last completed
+uint8_t commandLength();
+const uint8_t *commandPayload();
+uint16_t commandErrors();                       // frames dropped since reset
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+/* Display
+   Description : Where the LCD frame (lcd_frame.h) goes, picked at compile time with -DVENT_DISPLAY=... (ventilator.cpp).
+                 Types with static members, as the actuator (actuator.h) and the timebase (timebase.h).
+
+                   LcdDisplay<ADDRESS>   20 x 4 character LCD on a PCF8574 I2C backpack. 0x27, or 0x3F as on the units
+                                         built to V9 - V22 (-DVENT_LCD_ADDRESS=0x3F)
+                   NoDisplay             None .. the frame is still drawn, and never sent. Settings and readings are
+                                         on the serial line only
+*/
+
+#include <Arduino.h>
+#include <LiquidCrystal_I2C.h>
+#include "lcd_frame.h"
+
+#define VENT_DISPLAY_LCD 0
+#define VENT_DISPLAY_NONE 1
+
+#ifndef VENT_DISPLAY
+#define VENT_DISPLAY VENT_DISPLAY_LCD
+#endif
+#ifndef VENT_LCD_ADDRESS
+#define VENT_LCD_ADDRESS 0x27
+#endif
+
+template <uint8_t ADDRESS>
+struct LcdDisplay {
+  static LiquidCrystal_I2C lcd;
+  static void begin() {
+    lcd.begin();
+    lcd.backlight();
+  }
+  static inline uint8_t flush(LcdFrame &frame, uint8_t maxCells) {
+    return frame.flush(lcd, maxCells);
+  }
+};
+
+template <uint8_t ADDRESS>
+LiquidCrystal_I2C LcdDisplay<ADDRESS>::lcd(ADDRESS, LcdFrame::COLS, LcdFrame::ROWS);
+
+struct NoDisplay {
+  static void begin() {}
+  static inline uint8_t flush(LcdFrame &frame, uint8_t maxCells) {
+    (void) frame;
+    (void) maxCells;
+    return 0;
+  }
+};
+
+#endif
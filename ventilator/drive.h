@@ -0,0 +1,51 @@
+#ifndef DRIVE_H
+#define DRIVE_H
+
+/* Fixed-point inhale drive
+   Description : The AVR has no divider and no FPU, so the per-tick drive calculation is reduced to adds, shifts and one
+                 16 x 16 -> 32 bit multiply. The divisions are done once per breath when the parameters are derived:
+
+                   driveTableStep - how far down the drive table one tick moves, Q16.16 table entries per tick
+                   driveGain      - tidal / TIDAL_MAX as a Q1.15 fraction (32768 = full scale)
+
+                 Each inhale tick:  position += step;  index = position >> 16;  drive = (table[index] * gain) >> 15
+*/
+
+#include <Arduino.h>
+
+const uint8_t DRIVE_POSITION_SHIFT = 16;    // Q16.16 position down the drive table
+const uint8_t DRIVE_GAIN_SHIFT = 15;        // Q1.15 tidal gain
+const uint8_t DRIVE_CORRECTION_SHIFT = 14;  // Q2.14 correction of the tidal gain (tidal_adapt.h)
+
+// Table entries advanced per tick so that the end of the table is reached on the last tick of the inhale.
+// Rounded up, so the last tick always reaches the end of the table (waveformAt() clamps the index)
+inline uint32_t driveTableStep(int tableSize, int ticksPerInhale) {
+  if (ticksPerInhale <= 0) {
+    return (uint32_t) tableSize << DRIVE_POSITION_SHIFT;
+  }
+  return (((uint32_t) tableSize << DRIVE_POSITION_SHIFT) + ticksPerInhale - 1) / (uint32_t) ticksPerInhale;
+}
+
+inline uint16_t driveGain(int tidal, int tidalMax) {
+  return (uint16_t) (((uint32_t) tidal << DRIVE_GAIN_SHIFT) / (uint32_t) tidalMax);
+}
+
+// The tidal gain with the adaptive correction applied, at most full scale .. once per breath
+inline uint16_t driveGainCorrect(uint16_t gain, uint16_t correction) {
+  uint32_t corrected = ((uint32_t) gain * correction) >> DRIVE_CORRECTION_SHIFT;
+  return corrected > (1UL << DRIVE_GAIN_SHIFT) ? (uint16_t) (1UL << DRIVE_GAIN_SHIFT) : (uint16_t) corrected;
+}
+
+inline int driveScale(int unscaledDrive, uint16_t gain) {
+  return (int) (((uint32_t) unscaledDrive * gain) >> DRIVE_GAIN_SHIFT);
+}
+
+// Runs the inhale drive calculation three ways over every tick of a range of breaths - long division + float on a RAM
+// table (as V25), fixed point on a RAM table (V26) and fixed point interpolated from the flash waveform (waveform.h) -
+// and prints worst-case and mean cycle counts for each, the largest difference between the first two, and how many
+// distinct drive levels a long inhale gets with and without interpolation. Each tick is timed over several passes and the
+// fastest kept, so the worst case is the costliest tick rather than one that was interrupted.
+// AVR: counts CPU cycles on Timer1 - call before Timer1 is set up for the control tick. Host: uses the TSC.
+void driveBenchmark(Print &out, int tidalMax);
+
+#endif
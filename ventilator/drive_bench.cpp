@@ -0,0 +1,146 @@
+#include "drive.h"
+#include "waveform.h"
+#include "bench_cycles.h"
+
+// Each tick is timed this many times over and the fastest kept, so that a tick's figure is what the calculation costs and
+// not whatever interrupted it .. the worst case is then the costliest tick, not the unluckiest. On the Uno, with interrupts
+// off and no cache, the passes agree and one would do; on the host they shed the interrupts and preemptions of the OS
+#if defined(__AVR__)
+const int DRIVE_BENCH_PASSES = 2;
+#else
+const int DRIVE_BENCH_PASSES = 32;
+#endif
+
+// Inputs and outputs are volatile so the compiler cannot fold the calculations away
+static volatile int benchTick;
+static volatile int benchTicksPerInhale;
+static volatile int benchTidal;
+static volatile uint32_t benchPosition;
+static volatile uint32_t benchStep;
+static volatile uint16_t benchGain;
+static volatile int benchOut;
+
+void driveBenchmark(Print &out, int tidalMax) {
+  const int TICKS_PER_INHALE[] = { 25, 50, 100, 250, 500, 1000 };
+  const int TIDALS[] = { 200, 450, 700 };
+  const int LEVELS_TICKS = 1000;                  // a slow inhale .. where truncation shows up as stairs
+  const int tableSize = WAVEFORM_SEGMENTS;
+  BenchResult legacy = { 0, 0, 0 };
+  BenchResult fixed = { 0, 0, 0 };
+  BenchResult interpolated = { 0, 0, 0 };
+  int maxDifference = 0;
+  int truncatedLevels = 0;
+  int interpolatedLevels = 0;
+
+  // The RAM table the first two calculations index, as INHALE_DRIVE was
+  int table[WAVEFORM_SEGMENTS + 1];
+  for (int i = 0; i <= tableSize; i++) {
+    table[i] = pgm_read_word(&waveforms.table[WAVEFORM_LEGACY][i]);
+  }
+
+  cyclesBegin();
+  unsigned long overhead = cyclesOverhead();
+
+  for (unsigned int t = 0; t < sizeof(TICKS_PER_INHALE) / sizeof(TICKS_PER_INHALE[0]); t++) {
+    for (unsigned int v = 0; v < sizeof(TIDALS) / sizeof(TIDALS[0]); v++) {
+      benchTicksPerInhale = TICKS_PER_INHALE[t];
+      benchTidal = TIDALS[v];
+      benchStep = driveTableStep(tableSize, benchTicksPerInhale);
+      benchGain = driveGain(benchTidal, tidalMax);
+      benchPosition = 0;
+      int lastTruncated = -1;
+      int lastInterpolated = -1;
+
+      for (int tick = 1; tick <= benchTicksPerInhale; tick++) {
+        benchTick = tick;
+        uint32_t before = benchPosition;
+        unsigned long legacyBest = 0xFFFF;
+        unsigned long fixedBest = 0xFFFF;
+        unsigned long interpolatedBest = 0xFFFF;
+        int legacyDrive = 0;
+        int truncatedDrive = 0;
+
+        for (int pass = 0; pass < DRIVE_BENCH_PASSES; pass++) {
+          // As the control interrupt did it before: 32-bit division, then a float multiply and divide
+          noInterrupts();
+          uint32_t start = cyclesNow();
+          int position = int((long) tableSize * (long) benchTick / benchTicksPerInhale);
+          if (position > tableSize) {
+            position = tableSize;
+          }
+          benchOut = table[position] * (float) benchTidal / (float) tidalMax;
+          uint32_t stop = cyclesNow();
+          interrupts();
+          legacyBest = fastest(legacyBest, (uint16_t) (stop - start));
+          legacyDrive = benchOut;
+
+          // Fixed point: add, shift, one multiply
+          benchPosition = before;
+          noInterrupts();
+          start = cyclesNow();
+          uint32_t p = benchPosition + benchStep;
+          benchPosition = p;
+          int index = p >> DRIVE_POSITION_SHIFT;
+          if (index > tableSize) {
+            index = tableSize;
+          }
+          benchOut = driveScale(table[index], benchGain);
+          stop = cyclesNow();
+          interrupts();
+          fixedBest = fastest(fixedBest, (uint16_t) (stop - start));
+          truncatedDrive = benchOut;
+
+          // Fixed point, interpolated from flash
+          benchPosition = before;
+          noInterrupts();
+          start = cyclesNow();
+          p = benchPosition + benchStep;
+          benchPosition = p;
+          benchOut = driveScale(waveformAt(WAVEFORM_LEGACY, p), benchGain);
+          stop = cyclesNow();
+          interrupts();
+          interpolatedBest = fastest(interpolatedBest, (uint16_t) (stop - start));
+        }
+        record(legacy, legacyBest, overhead);
+        record(fixed, fixedBest, overhead);
+        record(interpolated, interpolatedBest, overhead);
+
+        int difference = truncatedDrive - legacyDrive;
+        if (difference < 0) {
+          difference = -difference;
+        }
+        if (difference > maxDifference) {
+          maxDifference = difference;
+        }
+
+        if (benchTicksPerInhale == LEVELS_TICKS && v == 0) {
+          if (truncatedDrive != lastTruncated) {
+            truncatedLevels++;
+            lastTruncated = truncatedDrive;
+          }
+          if (benchOut != lastInterpolated) {
+            interpolatedLevels++;
+            lastInterpolated = benchOut;
+          }
+        }
+      }
+    }
+  }
+
+  out.print(F("Inhale drive calculation, fastest of "));
+  out.print(DRIVE_BENCH_PASSES);
+  out.println(F(" passes of each tick, worst and mean over the ticks:"));
+  printResult(out, F("  long division + float      :"), legacy);
+  printResult(out, F("  fixed point                :"), fixed);
+  printResult(out, F("  fixed point, interpolated  :"), interpolated);
+  out.print(F("  (timer read overhead of "));
+  out.print(overhead);
+  out.println(F(" cycles subtracted)"));
+  out.print(F("  largest drive difference, first two: "));
+  out.println(maxDifference);
+  out.print(F("  distinct drive levels over a 1000 tick inhale: "));
+  out.print(truncatedLevels);
+  out.print(F(" truncated, "));
+  out.print(interpolatedLevels);
+  out.println(F(" interpolated"));
+}
@@ -0,0 +1,84 @@
+#include "lcd_frame.h"
+
+const uint8_t LCD_CURSOR_UNKNOWN = 0xFF;
+
+LcdFrame::LcdFrame() {
+  memset(cells, ' ', sizeof(cells));
+  col = 0;
+  row = 0;
+  invalidate();
+}
+
+void LcdFrame::invalidate() {
+  for (uint8_t r = 0; r < ROWS; r++) {
+    dirty[r] = (1UL << COLS) - 1;
+  }
+  lcdCol = LCD_CURSOR_UNKNOWN;
+  lcdRow = LCD_CURSOR_UNKNOWN;
+}
+
+void LcdFrame::clear() {
+  for (uint8_t r = 0; r < ROWS; r++) {
+    for (uint8_t c = 0; c < COLS; c++) {
+      if (cells[r][c] != ' ') {
+        cells[r][c] = ' ';
+        dirty[r] |= 1UL << c;
+      }
+    }
+  }
+  col = 0;
+  row = 0;
+}
+
+void LcdFrame::setCursor(uint8_t c, uint8_t r) {
+  col = c;
+  row = r;
+}
+
+size_t LcdFrame::write(uint8_t c) {
+  if (row < ROWS && col < COLS) {
+    if (cells[row][col] != (char) c) {
+      cells[row][col] = (char) c;
+      dirty[row] |= 1UL << col;
+    }
+  }
+  col++;                                     // text past the end of a row is dropped, as it would be off screen
+  return 1;
+}
+
+bool LcdFrame::pending() const {
+  for (uint8_t r = 0; r < ROWS; r++) {
+    if (dirty[r]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+uint8_t LcdFrame::flush(LiquidCrystal_I2C &lcd, uint8_t maxCells) {
+  uint8_t sent = 0;
+  for (uint8_t r = 0; r < ROWS && sent < maxCells; r++) {
+    uint8_t c = 0;
+    while (dirty[r] && c < COLS && sent < maxCells) {
+      if (!(dirty[r] & (1UL << c))) {
+        c++;
+        continue;
+      }
+      if (lcdRow != r || lcdCol != c) {
+        lcd.setCursor(c, r);
+      }
+      while (c < COLS && (dirty[r] & (1UL << c)) && sent < maxCells) {
+        lcd.write(cells[r][c]);
+        dirty[r] &= ~(1UL << c);
+        c++;
+        sent++;
+      }
+      lcdRow = r;
+      lcdCol = c;
+      if (c >= COLS) {
+        lcdRow = LCD_CURSOR_UNKNOWN;         // the HD44780 wraps rows in an odd order - don't rely on it
+      }
+    }
+  }
+  return sent;
+}
@@ -0,0 +1,43 @@
+#ifndef LCD_FRAME_H
+#define LCD_FRAME_H
+
+/* Shadow frame buffer for the 20 x 4 character LCD
+   Description : Each character sent to the LCD costs around a millisecond of blocking I2C (PCF8574 backpack in 4-bit mode),
+                 so the display code draws into RAM instead and flush() sends only the cells that actually changed.
+                 A cell is only marked dirty when a write changes it, so repainting a whole screen with the same text
+                 costs nothing on the bus. Changed cells are sent as runs - one setCursor per run, and none at all when
+                 the run starts where the LCD cursor already is.
+                 flush() takes a budget of cells, so a caller can bound how long one call blocks and leave the rest for
+                 the next pass.
+*/
+
+#include <Arduino.h>
+#include <LiquidCrystal_I2C.h>
+
+class LcdFrame : public Print {
+  public:
+    static const uint8_t COLS = 20;
+    static const uint8_t ROWS = 4;
+
+    LcdFrame();
+
+    void clear();                                    // blank the frame (RAM only)
+    void setCursor(uint8_t col, uint8_t row);
+    size_t write(uint8_t c);
+    using Print::write;
+
+    // Send changed cells, at most maxCells of them. Returns the number of cells sent
+    uint8_t flush(LiquidCrystal_I2C &lcd, uint8_t maxCells = COLS * ROWS);
+    void invalidate();                               // the LCD was cleared behind our back - repaint everything
+    bool pending() const;                            // there are changed cells still to send
+
+  private:
+    char cells[ROWS][COLS];
+    uint32_t dirty[ROWS];                            // bit n set = cell n of the row has changed since the last flush
+    uint8_t col;
+    uint8_t row;
+    uint8_t lcdCol;                                  // where the LCD's own cursor is after the last flush ..
+    uint8_t lcdRow;                                  // .. (LCD_CURSOR_UNKNOWN if we can't be sure)
+};
+
+#endif
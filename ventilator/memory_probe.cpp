@@ -0,0 +1,119 @@
+#include "memory_probe.h"
+
+#if defined(__AVR__)
+
+extern uint8_t __data_start;
+extern uint8_t __heap_start;
+extern uint8_t *__brkval;                        // malloc's break, 0 until the first allocation
+
+struct __freelist {                              // avr-libc malloc's free block header
+  size_t sz;
+  struct __freelist *nx;
+};
+extern struct __freelist *__flp;
+
+// Runs before main(), with nothing on the stack yet worth keeping. Naked .init3 code may not call anything or use the stack
+void memoryPaint() __attribute__((naked, used, section(".init3")));
+void memoryPaint() {
+  uint8_t *p = &__heap_start;
+  while (p < (uint8_t *) SP) {
+    *p++ = MEMORY_PAINT;
+  }
+}
+
+static uint8_t *heapEnd() {
+  return __brkval ? __brkval : &__heap_start;
+}
+
+// The run of unbroken paint above the heap. A stray byte that happens to equal the paint can only make it look longer
+// by that byte, whereas searching down from the stack could stop at any such byte in old stack frames
+static uint8_t *paintStart;
+static uint8_t *paintEnd;
+
+static void findPaint() {
+  uint8_t *p = heapEnd();
+  uint8_t *top = (uint8_t *) SP;
+  while (p < top && *p != MEMORY_PAINT) {
+    p++;                                         // skip anything the heap wrote past its current break
+  }
+  paintStart = p;
+  while (p < top && *p == MEMORY_PAINT) {
+    p++;
+  }
+  paintEnd = p;
+}
+
+uint16_t memoryStackPeak() {
+  findPaint();
+  return (uint8_t *) RAMEND + 1 - paintEnd;
+}
+
+uint16_t memoryNeverUsed() {
+  findPaint();
+  return paintEnd - paintStart;
+}
+
+void memoryStats(MemoryStats &stats) {
+  noInterrupts();
+  stats.staticBytes = &__heap_start - &__data_start;
+  stats.heapBytes = heapEnd() - &__heap_start;
+  stats.freeListBytes = 0;
+  stats.freeListBlocks = 0;
+  stats.freeListLargest = 0;
+  for (struct __freelist *block = __flp; block; block = block->nx) {
+    uint16_t size = block->sz + sizeof(size_t);
+    stats.freeListBytes += size;
+    stats.freeListBlocks++;
+    if (size > stats.freeListLargest) {
+      stats.freeListLargest = size;
+    }
+  }
+  stats.freeBytes = (uint8_t *) SP - heapEnd() + stats.freeListBytes;
+  stats.stackBytes = RAMEND - SP;
+  interrupts();
+  stats.stackPeak = memoryStackPeak();
+  stats.neverUsed = memoryNeverUsed();
+}
+
+#else
+
+void memoryStats(MemoryStats &stats) {
+  memset(&stats, 0, sizeof(stats));
+}
+
+uint16_t memoryStackPeak() {
+  return 0;
+}
+
+uint16_t memoryNeverUsed() {
+  return 0;
+}
+
+#endif
+
+void memoryReport(Print &out) {
+#if defined(__AVR__)
+  MemoryStats stats;
+  memoryStats(stats);
+  out.print(F("mem: static "));
+  out.print(stats.staticBytes);
+  out.print(F(" heap "));
+  out.print(stats.heapBytes);
+  out.print(F(" ("));
+  out.print(stats.freeListBytes);
+  out.print(F(" free in "));
+  out.print(stats.freeListBlocks);
+  out.print(F(", largest "));
+  out.print(stats.freeListLargest);
+  out.print(F(") free "));
+  out.print(stats.freeBytes);
+  out.print(F(" stack "));
+  out.print(stats.stackBytes);
+  out.print(F(" peak "));
+  out.print(stats.stackPeak);
+  out.print(F(" never used "));
+  out.println(stats.neverUsed);
+#else
+  out.println(F("mem: not measured on the host"));
+#endif
+}
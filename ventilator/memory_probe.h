@@ -0,0 +1,39 @@
+#ifndef MEMORY_PROBE_H
+#define MEMORY_PROBE_H
+
+/* SRAM instrumentation
+   Description : The Uno has 2048 bytes of SRAM shared by static data, the heap (growing up) and the stack (growing down):
+
+                   | .data .bss | heap -->        free        <-- stack |
+                   __data_start  __heap_start  __brkval          SP    RAMEND
+
+                 Before main() runs, everything between the end of the static data and the stack pointer is painted with
+                 MEMORY_PAINT (memoryPaint() runs from the .init3 section). Anything that has since been used, by the
+                 stack or the heap, has overwritten the paint, so the paint still left is a high-water mark of how close
+                 the two have ever come. The heap's free list is walked to show fragmentation.
+                 tools/memory_report.sh gives the build-time picture (per-symbol RAM and flash use from the ELF).
+                 Nothing is measured on the host build - the queries return 0.
+*/
+
+#include <Arduino.h>
+
+const uint8_t MEMORY_PAINT = 0xC5;
+
+struct MemoryStats {
+  uint16_t staticBytes;        // .data + .bss
+  uint16_t heapBytes;          // heap break above __heap_start, including free blocks
+  uint16_t freeListBytes;      // bytes in freed heap blocks
+  uint16_t freeListBlocks;
+  uint16_t freeListLargest;
+  uint16_t freeBytes;          // between the heap break and the stack pointer now, plus the free list
+  uint16_t stackBytes;         // in use now
+  uint16_t stackPeak;          // deepest the stack has been since reset
+  uint16_t neverUsed;          // paint still intact .. the real margin
+};
+
+void memoryStats(MemoryStats &stats);
+uint16_t memoryStackPeak();
+uint16_t memoryNeverUsed();
+void memoryReport(Print &out);                   // one line, e.g. "mem: static 1012 heap 0 (0 free in 0, largest 0) ..."
+
+#endif
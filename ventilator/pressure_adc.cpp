@@ -0,0 +1,68 @@
+#include "pressure_adc.h"
+#include "shared_sample.h"
+
+static SharedSample pressureSample;
+static PressureSampleFn sampleFn = 0;
+static uint8_t adcDecimation = 1;           // conversions per sample
+static uint16_t adcReciprocal = 0;          // 65536 / adcDecimation, rounded up .. the average without a division
+static uint16_t adcSum = 0;
+static uint8_t adcCount = 0;
+
+void pressureAdcBegin(uint8_t pin, uint16_t sampleRateHz, PressureSampleFn onSample) {
+  uint16_t decimation = (PRESSURE_ADC_CONVERSION_HZ + sampleRateHz / 2) / sampleRateHz;
+  if (decimation < 1) {
+    decimation = 1;
+  }
+  if (decimation > 64) {
+    decimation = 64;                         // 64 x 1023 still fits the 16-bit sum
+  }
+  adcDecimation = decimation;
+  adcReciprocal = decimation == 1 ? 0 : (uint16_t) ((65536UL + decimation - 1) / decimation);
+  adcSum = 0;
+  adcCount = 0;
+  sampleFn = onSample;
+
+#if defined(__AVR__)
+  uint8_t channel = (pin >= A0) ? pin - A0 : pin;
+  noInterrupts();
+  ADMUX = _BV(REFS0) | (channel & 0x07);                          // AVcc reference, as analogRead() uses
+  ADCSRB = 0;                                                      // auto trigger source = free running
+  DIDR0 |= _BV(channel & 0x07);                                    // digital input buffer off on the analog pin
+  ADCSRA = _BV(ADEN) | _BV(ADATE) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0) | _BV(ADSC);
+  interrupts();
+#else
+  hostAdcFreeRun(pin, pressureAdcIsr);        // the host stand-in fires conversions from its virtual clock
+#endif
+}
+
+void pressureAdcIsr(uint16_t conversion) {
+  adcSum += conversion;
+  if (++adcCount < adcDecimation) {
+    return;
+  }
+  uint16_t sample = adcDecimation == 1 ? adcSum : (uint16_t) (((uint32_t) adcSum * adcReciprocal) >> 16);
+  adcSum = 0;
+  adcCount = 0;
+  sharedSamplePublish(pressureSample, sample);
+  if (sampleFn) {
+    sampleFn(sample);
+  }
+}
+
+#if defined(__AVR__)
+ISR(ADC_vect) {
+  pressureAdcIsr(ADC);
+}
+#endif
+
+uint16_t pressureAdcLatest() {
+  return sharedSampleRead(pressureSample);
+}
+
+uint8_t pressureAdcSequence() {
+  return pressureSample.sequence;
+}
+
+uint16_t pressureAdcSampleRate() {
+  return (PRESSURE_ADC_CONVERSION_HZ + adcDecimation / 2) / adcDecimation;
+}
@@ -0,0 +1,30 @@
+#ifndef PRESSURE_ADC_H
+#define PRESSURE_ADC_H
+
+/* Interrupt driven pressure acquisition
+   Description : The ADC runs free at its full rate (16 MHz / 128 prescaler / 13 cycles = 9615 conversions per second) and
+                 raises the ADC-complete interrupt after each conversion. The interrupt averages groups of conversions into
+                 samples at the configured rate, so each sample also gets a little anti-alias smoothing for free.
+                 Samples are published through a double buffer (shared_sample.h) - the control interrupt and loop() read
+                 the latest one without waiting for a conversion.
+                 The sample rate is the conversion rate divided by a whole number, so the rate actually achieved is the
+                 nearest one to what was asked for (1000 Hz gives 962 Hz) - see pressureAdcSampleRate().
+   Note        : Once started, analogRead() must not be used - it would stop the free-running conversions.
+*/
+
+#include <Arduino.h>
+
+const uint16_t PRESSURE_ADC_CONVERSION_HZ = 9615;
+
+// Called from the ADC interrupt with every new sample. Keep it short.
+typedef void (*PressureSampleFn)(uint16_t raw);
+
+void pressureAdcBegin(uint8_t pin, uint16_t sampleRateHz, PressureSampleFn onSample = 0);
+uint16_t pressureAdcLatest();             // most recent raw sample, 0..1023 .. never blocks
+uint8_t pressureAdcSequence();            // changes each time a new sample is published
+uint16_t pressureAdcSampleRate();         // samples per second actually achieved
+
+// Conversion-complete handler (the AVR ISR, or the host stand-in, calls this with the raw 10-bit result)
+void pressureAdcIsr(uint16_t conversion);
+
+#endif
@@ -0,0 +1,76 @@
+#include "pressure_control.h"
+
+const int32_t INTEGRAL_LIMIT = (int32_t) PRESSURE_CONTROL_DRIVE_MAX << PRESSURE_CONTROL_GAIN_SHIFT;
+
+// Shared by the control tick and the ADC interrupt. Neither interrupts the other, so no further locking is needed
+static volatile bool active = false;
+static volatile uint16_t targetPressure = 0;
+static volatile uint16_t startPressure = 0;
+static volatile uint16_t setpoint = 0;
+static volatile int feedforward = 0;
+static int32_t integral = 0;                      // Q16 drive counts
+static int output = 0;
+static uint16_t saturated = 0;
+
+void pressureControlStart(uint16_t target, uint16_t start) {
+  targetPressure = target;
+  startPressure = start;
+  setpoint = start;
+  feedforward = 0;
+  integral = 0;
+  active = true;
+}
+
+void pressureControlTrack(int drive, int progress) {
+  // (progress + 1) >> 10 is progress / 1023 without the division .. exactly the target at full scale
+  int32_t rise = ((int32_t) targetPressure - (int32_t) startPressure) * (progress + 1);
+  setpoint = startPressure + (int16_t) (rise >> 10);
+  feedforward = drive;
+}
+
+void pressureControlStop() {
+  active = false;
+  feedforward = 0;
+}
+
+bool pressureControlActive() {
+  return active;
+}
+
+int pressureControlStep(uint16_t measured) {
+  int16_t error = (int16_t) (setpoint - measured);
+  int32_t proportional = (int32_t) error * PRESSURE_CONTROL_KP;
+  int32_t nextIntegral = integral + (int32_t) error * PRESSURE_CONTROL_KI;
+  if (nextIntegral > INTEGRAL_LIMIT) {
+    nextIntegral = INTEGRAL_LIMIT;
+  } else if (nextIntegral < -INTEGRAL_LIMIT) {
+    nextIntegral = -INTEGRAL_LIMIT;
+  }
+
+  int32_t drive = feedforward + ((proportional + nextIntegral) >> PRESSURE_CONTROL_GAIN_SHIFT);
+  if (drive > PRESSURE_CONTROL_DRIVE_MAX) {
+    drive = PRESSURE_CONTROL_DRIVE_MAX;
+    saturated++;
+    if (error < 0) {
+      integral = nextIntegral;                    // pinned high .. only let the integrator wind down
+    }
+  } else if (drive < PRESSURE_CONTROL_DRIVE_MIN) {
+    drive = PRESSURE_CONTROL_DRIVE_MIN;
+    saturated++;
+    if (error > 0) {
+      integral = nextIntegral;                    // pinned low .. only let the integrator wind up
+    }
+  } else {
+    integral = nextIntegral;
+  }
+  output = (int) drive;
+  return output;
+}
+
+int pressureControlOutput() {
+  return output;
+}
+
+uint16_t pressureControlSaturated() {
+  return saturated;
+}
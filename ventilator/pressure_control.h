@@ -0,0 +1,44 @@
+#ifndef PRESSURE_CONTROL_H
+#define PRESSURE_CONTROL_H
+
+/* Inner pressure loop for pressure-controlled ventilation (PCV)
+   Description : A PI regulator that runs from the ADC interrupt on every fast-channel output of the pressure filter
+                 (240 per second), more than twice the rate of the 10 ms control tick. The control tick still owns the
+                 breath timing: at the start of an inhale it calls pressureControlStart() with the target and the pressure
+                 the breath starts from, on every inhale tick it calls pressureControlTrack() with the drive table, played
+                 over the rise time, and at the end of the inhale it calls pressureControlStop(). The table does two jobs:
+                 scaled to the drive that holds the target it is the feedforward, and its progress from 0 to full scale
+                 moves the setpoint from the starting pressure to the target, so the pressure rises with the table's shape
+                 instead of as a step.
+
+                   drive = feedforward + Kp * error + Ki * sum(error)          error = setpoint - measured (Q4 raw counts)
+
+                 Anti-windup is by conditional integration: while the output is pinned at either end of the actuator range
+                 the integrator only moves in the direction that brings it back off the end. Gains are Q16 and the
+                 arithmetic is two 16 x 16 -> 32 bit multiplies and a few 32 bit adds, with no division.
+                 sim/bench_pcv prints rise time, overshoot and the cost of pressureControlStep() against the lung model.
+*/
+
+#include <stdint.h>
+
+const uint8_t PRESSURE_CONTROL_GAIN_SHIFT = 16;   // Q16 gains, drive counts per Q4 raw count of error
+// About 30 drive counts per cmH2O of error (1 cmH2O = 120 Q4 counts) and an integral time of 57 ms at 240 updates/s.
+// Tuned on sim/bench_pcv: 50 - 120 ms rise and at most ~1 cmH2O overshoot for C = 0.02 - 0.08 L/cmH2O, R = 5 - 20
+const int32_t PRESSURE_CONTROL_KP = 16384;        // 0.25
+const int32_t PRESSURE_CONTROL_KI = 1200;         // Kp / (0.057 s * 240/s)
+const int PRESSURE_CONTROL_DRIVE_MIN = 0;
+const int PRESSURE_CONTROL_DRIVE_MAX = 1023;
+
+// Pressures in Q4 raw counts (as pressureFilterFast). Clears the integrator
+void pressureControlStart(uint16_t target, uint16_t start);
+// Open-loop drive for this part of the inhale, and how far (0 .. PRESSURE_CONTROL_DRIVE_MAX) the setpoint is from start to target
+void pressureControlTrack(int feedforward, int progress);
+void pressureControlStop();
+bool pressureControlActive();
+
+// Call with each new fast-channel output while active. Returns the drive to send to the actuator
+int pressureControlStep(uint16_t measured);
+int pressureControlOutput();                       // last value returned by pressureControlStep()
+uint16_t pressureControlSaturated();               // steps that ended with the output pinned (wraps)
+
+#endif
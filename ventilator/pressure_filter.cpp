@@ -0,0 +1,75 @@
+#include "pressure_filter.h"
+#include "shared_sample.h"
+
+const uint8_t SLOW_STATE_SHIFT = 8;
+const uint8_t CIC_ORDER = 2;
+
+// CIC state - only touched by the ADC interrupt
+static uint32_t integrator1 = 0;
+static uint32_t integrator2 = 0;
+static uint32_t combDelay1 = 0;
+static uint32_t combDelay2 = 0;
+static uint8_t phase = 0;
+static uint8_t warmUp = CIC_ORDER;                    // fast outputs still inside the CIC start-up transient
+
+// IIR state - Q4 raw counts with 8 more fraction bits
+static int32_t slowStage1 = 0;
+static int32_t slowStage2 = 0;
+
+static SharedSample fastChannel;
+static SharedSample slowChannel;
+
+void pressureFilterReset() {
+  integrator1 = 0;
+  integrator2 = 0;
+  combDelay1 = 0;
+  combDelay2 = 0;
+  phase = 0;
+  warmUp = CIC_ORDER;
+  sharedSamplePublish(fastChannel, 0);                     // as at power-up .. nothing left over from before
+  sharedSamplePublish(slowChannel, 0);
+}
+
+bool pressureFilterSample(uint16_t raw) {
+  integrator1 += raw;
+  integrator2 += integrator1;
+  if (++phase < PRESSURE_FILTER_DECIMATION) {
+    return false;
+  }
+  phase = 0;
+
+  uint32_t comb1 = integrator2 - combDelay1;
+  combDelay1 = integrator2;
+  uint32_t comb2 = comb1 - combDelay2;
+  combDelay2 = comb1;
+  uint16_t fast = (uint16_t) comb2;                       // gain 16 = Q4 raw counts
+
+  if (warmUp) {
+    warmUp--;
+    if (warmUp) {
+      return false;                                        // comb still filling .. output not meaningful yet
+    }
+    slowStage1 = (int32_t) fast << SLOW_STATE_SHIFT;       // start the display where the pressure is, not at zero
+    slowStage2 = slowStage1;
+  }
+
+  int32_t input = (int32_t) fast << SLOW_STATE_SHIFT;
+  slowStage1 += (input - slowStage1) >> PRESSURE_FILTER_SLOW_SHIFT;
+  slowStage2 += (slowStage1 - slowStage2) >> PRESSURE_FILTER_SLOW_SHIFT;
+
+  sharedSamplePublish(fastChannel, fast);
+  sharedSamplePublish(slowChannel, (uint16_t) (slowStage2 >> SLOW_STATE_SHIFT));
+  return true;
+}
+
+uint16_t pressureFilterFast() {
+  return sharedSampleRead(fastChannel);
+}
+
+uint16_t pressureFilterSlow() {
+  return sharedSampleRead(slowChannel);
+}
+
+uint8_t pressureFilterFastSequence() {
+  return fastChannel.sequence;
+}
@@ -0,0 +1,34 @@
+#ifndef PRESSURE_FILTER_H
+#define PRESSURE_FILTER_H
+
+/* Fixed-rate pressure filter
+   Description : Runs on every pressure sample from the ADC interrupt, so its response is set by the sample rate and
+                 not by how fast loop() happens to go.
+
+                   raw samples --> 2nd order CIC, decimate by 4 --> fast channel  (control and patient triggering)
+                                                                   |
+                                                                   +--> two 1st order IIR stages --> slow channel (display)
+
+                 The CIC gain is 4^2 = 16, so both channels come out in sixteenths of an ADC count (Q4) with no scaling.
+                 At 962 samples/s the fast channel runs at 240 Hz with its first null at 240 Hz and -3 dB near 80 Hz;
+                 the slow channel's -3 dB point is near 0.8 Hz (sim/bench_filter prints the measured response).
+                 Work per sample is two adds, plus a few adds and shifts on every 4th sample. CIC arithmetic is modulo
+                 2^32, so the integrators may wrap freely.
+*/
+
+#include <stdint.h>
+
+const uint8_t PRESSURE_FILTER_DECIMATION = 4;      // raw samples per fast-channel output
+const uint8_t PRESSURE_FILTER_FRACTION_BITS = 4;   // outputs are raw ADC counts x 16
+const uint8_t PRESSURE_FILTER_SLOW_SHIFT = 5;      // each IIR stage: y += (x - y) / 32
+
+// Call with each raw sample (0..1023). Returns true when a new fast-channel output has been produced.
+bool pressureFilterSample(uint16_t raw);
+
+uint16_t pressureFilterFast();                     // Q4 raw counts .. safe to call from anywhere, never blocks
+uint16_t pressureFilterSlow();                     // Q4 raw counts
+uint8_t pressureFilterFastSequence();              // changes with every new fast-channel output
+
+void pressureFilterReset();
+
+#endif
@@ -0,0 +1,198 @@
+#include "profiler.h"
+
+#if PROFILER_ENABLED
+
+struct ProfileStat {
+  uint32_t count;
+  uint32_t sum;
+  uint16_t min;
+  uint16_t max;
+};
+
+static unsigned long tickPeriod = 0;           // microseconds
+
+// Tick measurements belong to the control ISR .. loop() only looks at them with interrupts off
+static ProfileStat tickExec;                   // Timer1 counts
+static ProfileStat tickLatency;
+static ProfileStat tickJitter;                 // |latency - previous latency|
+static uint16_t tickEntry = 0;
+static uint16_t lastLatency = 0;
+static bool haveLatency = false;
+#if PROFILER_HISTOGRAM
+static uint16_t execHistogram[PROFILER_BUCKETS];
+static uint16_t jitterHistogram[PROFILER_BUCKETS];
+#endif
+
+static ProfileStat sections[PROFILE_SECTIONS]; // microseconds
+static unsigned long sectionStart[PROFILE_SECTIONS];
+
+static void statClear(ProfileStat &stat) {
+  stat.count = 0;
+  stat.sum = 0;
+  stat.min = 0xFFFF;
+  stat.max = 0;
+}
+
+static void statAdd(ProfileStat &stat, uint16_t value) {
+  if (stat.sum > 0xFFFFFFFFUL - value) {       // halve both rather than wrap .. the mean stays right
+    stat.sum >>= 1;
+    stat.count >>= 1;
+  }
+  stat.sum += value;
+  stat.count++;
+  if (value < stat.min) {
+    stat.min = value;
+  }
+  if (value > stat.max) {
+    stat.max = value;
+  }
+}
+
+#if PROFILER_HISTOGRAM
+static void histogramAdd(uint16_t *histogram, uint16_t value) {
+  uint16_t bucket = value >> PROFILER_BUCKET_SHIFT;
+  if (bucket >= PROFILER_BUCKETS) {
+    bucket = PROFILER_BUCKETS - 1;
+  }
+  if (histogram[bucket] != 0xFFFF) {
+    histogram[bucket]++;
+  }
+}
+#endif
+
+void profilerBegin(unsigned long tickPeriodUs) {
+  tickPeriod = tickPeriodUs;
+  profilerReset();
+}
+
+void profilerReset() {
+  noInterrupts();
+  statClear(tickExec);
+  statClear(tickLatency);
+  statClear(tickJitter);
+  haveLatency = false;
+#if PROFILER_HISTOGRAM
+  memset(execHistogram, 0, sizeof(execHistogram));
+  memset(jitterHistogram, 0, sizeof(jitterHistogram));
+#endif
+  interrupts();
+  for (uint8_t i = 0; i < PROFILE_SECTIONS; i++) {
+    statClear(sections[i]);
+  }
+}
+
+void profilerTickEnter() {
+  tickEntry = TCNT1;                           // counts since the overflow at BOTTOM
+}
+
+void profilerTickExit() {
+  uint16_t exec = TCNT1 - tickEntry;
+  statAdd(tickExec, exec);
+  statAdd(tickLatency, tickEntry);
+  if (haveLatency) {
+    uint16_t jitter = tickEntry > lastLatency ? tickEntry - lastLatency : lastLatency - tickEntry;
+    statAdd(tickJitter, jitter);
+#if PROFILER_HISTOGRAM
+    histogramAdd(jitterHistogram, jitter);
+#endif
+  }
+#if PROFILER_HISTOGRAM
+  histogramAdd(execHistogram, exec);
+#endif
+  lastLatency = tickEntry;
+  haveLatency = true;
+}
+
+void profilerSectionBegin(uint8_t section) {
+  sectionStart[section] = micros();
+}
+
+void profilerSectionEnd(uint8_t section) {
+  unsigned long elapsed = micros() - sectionStart[section];
+  statAdd(sections[section], elapsed > 0xFFFF ? 0xFFFF : (uint16_t) elapsed);
+}
+
+static void printStat(Print &out, const __FlashStringHelper *name, const ProfileStat &stat, float usPerUnit) {
+  out.print(F("prof: "));
+  out.print(name);
+  out.print(F(" n "));
+  out.print(stat.count);
+  if (stat.count == 0) {
+    out.println();
+    return;
+  }
+  out.print(F(" us min "));
+  out.print(stat.min * usPerUnit, 1);
+  out.print(F(" mean "));
+  out.print((float) stat.sum / stat.count * usPerUnit, 1);
+  out.print(F(" max "));
+  out.println(stat.max * usPerUnit, 1);
+}
+
+#if PROFILER_HISTOGRAM
+// Non-empty buckets only, each as "<lower edge us>:<count>" .. the last bucket is "<lower edge>+"
+static void printHistogram(Print &out, const __FlashStringHelper *name, const uint16_t *histogram, float usPerUnit) {
+  out.print(F("prof: "));
+  out.print(name);
+  out.print(F(" histogram"));
+  for (uint8_t i = 0; i < PROFILER_BUCKETS; i++) {
+    if (histogram[i] == 0) {
+      continue;
+    }
+    out.print(' ');
+    out.print((unsigned long) (((uint32_t) i << PROFILER_BUCKET_SHIFT) * usPerUnit));
+    if (i == PROFILER_BUCKETS - 1) {
+      out.print('+');
+    }
+    out.print(':');
+    out.print(histogram[i]);
+  }
+  out.println();
+}
+#endif
+
+void profilerReport(Print &out) {
+  ProfileStat exec, latency, jitter;
+#if PROFILER_HISTOGRAM
+  uint16_t execCopy[PROFILER_BUCKETS];
+  uint16_t jitterCopy[PROFILER_BUCKETS];
+#endif
+  noInterrupts();                              // a consistent set, not one torn by a tick half way through
+  exec = tickExec;
+  latency = tickLatency;
+  jitter = tickJitter;
+#if PROFILER_HISTOGRAM
+  memcpy(execCopy, execHistogram, sizeof(execCopy));
+  memcpy(jitterCopy, jitterHistogram, sizeof(jitterCopy));
+#endif
+  uint16_t top = ICR1;
+  interrupts();
+
+  float usPerCount = top ? (float) tickPeriod / (2.0f * top) : 0;
+  printStat(out, F("tick exec"), exec, usPerCount);
+  printStat(out, F("tick latency"), latency, usPerCount);
+  printStat(out, F("tick jitter"), jitter, usPerCount);
+#if PROFILER_HISTOGRAM
+  printHistogram(out, F("tick exec"), execCopy, usPerCount);
+  printHistogram(out, F("tick jitter"), jitterCopy, usPerCount);
+#endif
+  printStat(out, F("loop"), sections[PROFILE_LOOP], 1);
+  printStat(out, F("loop telemetry"), sections[PROFILE_TELEMETRY], 1);
+  printStat(out, F("loop ui"), sections[PROFILE_UI], 1);
+  printStat(out, F("loop pressure"), sections[PROFILE_PRESSURE], 1);
+  printStat(out, F("loop lcd"), sections[PROFILE_LCD], 1);
+}
+
+#else
+
+void profilerBegin(unsigned long) {
+}
+
+void profilerReset() {
+}
+
+void profilerReport(Print &out) {
+  out.println(F("prof: compiled out (PROFILER_ENABLED 0)"));
+}
+
+#endif
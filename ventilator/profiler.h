@@ -0,0 +1,60 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+/* Execution-time and jitter profiler
+   Description : Control tick - TimerOne runs Timer1 in phase-correct PWM mode and the overflow interrupt fires at BOTTOM,
+                 so TCNT1 read first thing in the ISR is how long after the tick it started (latency), and read again
+                 last thing gives the execution time. Both are in Timer1 counts of TIME_BETWEEN_TICKS / (2 x ICR1)
+                 microseconds, 0.5 us at the 10 ms tick. The change in latency from one tick to the next is the period
+                 jitter. An ISR that runs past half the period is on the down-count and reads short.
+                 loop() sections - timed with micros() (4 us resolution on the Uno).
+
+                 Each measurement keeps min / max / mean. Tick execution time and period jitter also fill a histogram of
+                 PROFILER_BUCKETS fixed buckets, 2^PROFILER_BUCKET_SHIFT counts wide (the last bucket takes everything
+                 above). profilerReport() prints it all .. 'p' on the serial monitor.
+
+                 Compile-time removable: PROFILER_HISTOGRAM 0 drops the histograms (64 bytes of SRAM), PROFILER_ENABLED 0
+                 drops the profiler altogether - the hooks below become empty inline functions.
+*/
+
+#include <Arduino.h>
+
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+#ifndef PROFILER_HISTOGRAM
+#define PROFILER_HISTOGRAM 1
+#endif
+
+const uint8_t PROFILER_BUCKETS = 16;
+const uint8_t PROFILER_BUCKET_SHIFT = 6;       // 64 Timer1 counts, 32 us at the 10 ms tick
+
+// loop() sections
+const uint8_t PROFILE_LOOP = 0;                // the whole pass
+const uint8_t PROFILE_TELEMETRY = 1;           // draining the telemetry ring to Serial
+const uint8_t PROFILE_UI = 2;                  // settings menu step
+const uint8_t PROFILE_PRESSURE = 3;            // display pressure from the ADC's slow channel, drawn into the frame
+const uint8_t PROFILE_LCD = 4;                 // frame buffer flush over I2C
+const uint8_t PROFILE_SECTIONS = 5;
+
+void profilerBegin(unsigned long tickPeriodUs);  // the Timer1 period, to turn counts into microseconds
+void profilerReset();
+void profilerReport(Print &out);
+
+#if PROFILER_ENABLED
+
+void profilerTickEnter();                      // first thing in the control tick ISR
+void profilerTickExit();                       // last thing
+void profilerSectionBegin(uint8_t section);
+void profilerSectionEnd(uint8_t section);
+
+#else
+
+inline void profilerTickEnter() {}
+inline void profilerTickExit() {}
+inline void profilerSectionBegin(uint8_t) {}
+inline void profilerSectionEnd(uint8_t) {}
+
+#endif
+
+#endif
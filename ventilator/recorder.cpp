@@ -0,0 +1,206 @@
+#include "recorder.h"
+#include "telemetry.h"
+
+// Stop the compiler moving the ring writes past the index update (the ring itself is not volatile)
+#define RECORDER_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+const uint8_t RECORD_RING_MASK = RECORD_RING_SIZE - 1;
+const uint8_t RECORD_FRAMES_PER_DRAIN = 4;
+
+static uint8_t ring[RECORD_RING_SIZE];
+static volatile uint8_t head = 0;                 // only written with interrupts off (by an interrupt, or loop() in cli)
+static volatile uint8_t tail = 0;                 // only written by loop()
+static volatile bool active = false;
+static bool lost = false;                         // bytes have been dropped and the overflow token is not out yet
+static volatile uint16_t lostCount = 0;
+
+// Sample encoder state .. only the ADC interrupt and the control tick use these, and they never interrupt each other
+static uint16_t previous = 0;
+static bool havePrevious = false;                 // false: the next sample goes out absolute
+static int8_t held = 0;                           // a small delta waiting for a second one to share its byte
+static bool holding = false;
+static uint8_t levels = RECORD_INPUT_SELECT | RECORD_INPUT_CLK | RECORD_INPUT_DT;   // inputs idle high
+
+// Room for n more bytes. After a loss, the overflow token has to fit in front of them
+static bool reserve(uint8_t n) {
+  uint8_t room = (tail - head - 1) & RECORD_RING_MASK;
+  if (lost) {
+    if (room < n + 1) {
+      return false;
+    }
+    ring[head] = RECORD_OVERFLOW;
+    head = (head + 1) & RECORD_RING_MASK;
+    lost = false;
+  } else if (room < n) {
+    lost = true;
+    lostCount++;
+    havePrevious = false;                         // the decoder loses track of the sample value
+    holding = false;
+    return false;
+  }
+  return true;
+}
+
+static void put(uint8_t byte) {
+  uint8_t h = head;
+  ring[h] = byte;
+  RECORDER_BARRIER();
+  head = (h + 1) & RECORD_RING_MASK;
+}
+
+static void flushHeld() {
+  if (holding && reserve(1)) {
+    put(RECORD_DELTA | (held & 0x3F));
+  }
+  holding = false;
+}
+
+static void putAbsolute(uint16_t raw) {
+  if (reserve(2)) {
+    put(RECORD_ABSOLUTE | (raw >> 8));
+    put(raw & 0xFF);
+    previous = raw;
+    havePrevious = true;
+  }
+}
+
+static void putSettings(uint8_t token, const RecordedSettings &settings) {
+  if (reserve(1 + RECORD_SETTINGS_BYTES)) {
+    put(token);
+    put(settings.mode);
+    put(settings.respRate);
+    put(settings.tidal & 0xFF);
+    put(settings.tidal >> 8);
+    put(settings.iERatioTenths);
+    put(settings.inspPressure);
+  }
+}
+
+void recorderBegin(const RecordedSettings &settings) {
+  head = tail = 0;
+  lost = false;
+  havePrevious = false;
+  holding = false;
+  putSettings(RECORD_SETTINGS, settings);
+  active = true;
+}
+
+bool recorderActive() {
+  return active;
+}
+
+void recorderSample(uint16_t raw) {
+  if (!active) {
+    return;
+  }
+  if (!havePrevious) {
+    flushHeld();
+    putAbsolute(raw);
+    return;
+  }
+  int16_t delta = (int16_t) raw - (int16_t) previous;
+  if (holding) {
+    if (delta >= -4 && delta <= 3) {
+      if (reserve(1)) {
+        put(RECORD_PAIR | ((held & 0x07) << 3) | (delta & 0x07));
+        previous = raw;
+      }
+      holding = false;
+      return;
+    }
+    flushHeld();
+    if (!havePrevious) {                          // lost while flushing
+      putAbsolute(raw);
+      return;
+    }
+  }
+  if (delta >= -4 && delta <= 3) {
+    held = delta;                                 // wait for the next one to share the byte
+    holding = true;
+    previous = raw;
+  } else if (delta >= -32 && delta <= 31) {
+    if (reserve(1)) {
+      put(RECORD_DELTA | (delta & 0x3F));
+      previous = raw;
+    }
+  } else {
+    putAbsolute(raw);
+  }
+}
+
+static void putLevels(uint8_t newLevels) {
+  if (newLevels == levels) {
+    return;
+  }
+  flushHeld();
+  if (reserve(1)) {
+    put(RECORD_INPUTS | newLevels);
+    levels = newLevels;
+  }
+}
+
+void recorderKnob(uint8_t clkDt) {
+  if (active) {
+    putLevels((levels & RECORD_INPUT_SELECT) | (clkDt & (RECORD_INPUT_CLK | RECORD_INPUT_DT)));
+  }
+}
+
+void recorderTick(uint8_t selectLevel) {
+  if (!active) {
+    return;
+  }
+  putLevels((levels & (RECORD_INPUT_CLK | RECORD_INPUT_DT)) | (selectLevel ? RECORD_INPUT_SELECT : 0));
+  flushHeld();
+  if (reserve(1)) {
+    put(RECORD_TICK);
+  }
+}
+
+void recorderSettings(const RecordedSettings &settings) {
+  if (!active) {
+    return;
+  }
+  noInterrupts();                                 // loop() shares the write side with the interrupts
+  putSettings(RECORD_SETTINGS, settings);
+  interrupts();
+}
+
+void recorderRemoteSet(const RecordedSettings &settings) {
+  if (!active) {
+    return;
+  }
+  noInterrupts();
+  putSettings(RECORD_REMOTE_SET, settings);
+  interrupts();
+}
+
+uint8_t recorderDrain(HardwareSerial &out) {
+  uint8_t sent = 0;
+  while (sent < RECORD_FRAMES_PER_DRAIN) {
+    uint8_t t = tail;
+    uint8_t count = (head - t) & RECORD_RING_MASK;
+    if (count < TELEMETRY_MAX_PAYLOAD) {
+      break;                                      // only full frames .. the frame overhead would swamp a byte or two
+    }
+    count = TELEMETRY_MAX_PAYLOAD;
+    RECORDER_BARRIER();
+    uint8_t payload[TELEMETRY_MAX_PAYLOAD];
+    for (uint8_t i = 0; i < count; i++) {
+      payload[i] = ring[(t + i) & RECORD_RING_MASK];
+    }
+    if (!telemetrySendFrame(out, TELEMETRY_FRAME_INPUTS, payload, count)) {
+      break;                                      // TX buffer full .. the bytes stay in the ring for the next pass
+    }
+    RECORDER_BARRIER();
+    tail = (t + count) & RECORD_RING_MASK;
+    sent++;
+  }
+  return sent;
+}
+
+uint16_t recorderLost() {
+  noInterrupts();
+  uint16_t count = lostCount;
+  interrupts();
+  return count;
+}
@@ -0,0 +1,73 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+/* Input recorder
+   Description : Captures everything the controller reads from the outside world, from reset, so that a unit's run can be
+                 replayed through ventilator.cpp on the host (sim/replay) and its actuator output compared tick by tick
+                 with what the unit actually did (the TELEMETRY_FRAME_TICK frames in the same capture):
+
+                   every raw pressure sample (as handed to the filter), encoder CLK / DT edges, the select button as seen
+                   by each control tick, the settings at start-up and on each commit, and each remote set
+
+                 The interrupts write a byte stream of tokens into a ring; loop() drains it to Serial in
+                 TELEMETRY_FRAME_INPUTS frames. Consecutive pressure samples rarely differ by more than a count or two,
+                 so they are delta-encoded, two to a byte where they fit .. about 6 bytes per control tick, sent in full
+                 frames of TELEMETRY_MAX_PAYLOAD bytes (the last partial frame of a run is never sent).
+
+   Tokens      : 00aaabbb            two samples, deltas a then b, each -4..+3
+                 01dddddd            one sample, delta -32..+31
+                 100000hh llllllll   one sample, absolute 10-bit value .. the first, and any delta too big for the above
+                 10010000            control tick .. everything before it happened before this tick ran
+                 10100scd            input levels changed: s select button, c encoder CLK, d encoder DT
+                 10110000 + 6 bytes  settings: mode, respRate, tidal (2 bytes, little-endian), iERatio x 10, inspPressure
+                 10110001 + 6 bytes  remote set: the settings a COMMAND_SET (command.h) set, laid out as above. Serial
+                                     input is not recorded, so this is all the replay has of it .. the settings token
+                                     of its commit follows
+                 11000000            bytes were lost here (ring full) .. the next sample is absolute
+
+   Note        : The interrupts never nest on the AVR, so the ADC interrupt, the control tick and the encoder interrupt can
+                 share the write side of the ring. loop() only writes settings and remote set tokens, with interrupts off.
+*/
+
+#include <Arduino.h>
+
+const uint8_t RECORD_PAIR = 0x00;
+const uint8_t RECORD_DELTA = 0x40;
+const uint8_t RECORD_ABSOLUTE = 0x80;
+const uint8_t RECORD_TICK = 0x90;
+const uint8_t RECORD_INPUTS = 0xA0;
+const uint8_t RECORD_SETTINGS = 0xB0;
+const uint8_t RECORD_REMOTE_SET = 0xB1;
+const uint8_t RECORD_OVERFLOW = 0xC0;
+
+const uint8_t RECORD_INPUT_SELECT = 0x04;         // RECORD_INPUTS level bits
+const uint8_t RECORD_INPUT_CLK = 0x02;
+const uint8_t RECORD_INPUT_DT = 0x01;
+
+const uint8_t RECORD_SETTINGS_BYTES = 6;
+const uint8_t RECORD_RING_SIZE = 128;             // power of two
+
+struct RecordedSettings {
+  uint8_t mode;
+  uint8_t respRate;
+  uint16_t tidal;
+  uint8_t iERatioTenths;
+  uint8_t inspPressure;
+};
+
+// Start recording (before the ADC and Timer1 are started, so that nothing is missed). Does nothing until called
+void recorderBegin(const RecordedSettings &settings);
+bool recorderActive();
+
+// Interrupt side
+void recorderSample(uint16_t raw);                // ADC interrupt, each raw pressure sample
+void recorderKnob(uint8_t clkDt);                 // encoder interrupt, CLK << 1 | DT after each edge
+void recorderTick(uint8_t selectLevel);           // first thing in the control tick, with the select button level
+
+// loop() side
+void recorderSettings(const RecordedSettings &settings);
+void recorderRemoteSet(const RecordedSettings &settings);   // before the commit it leads to
+uint8_t recorderDrain(HardwareSerial &out);       // frames sent .. never blocks
+uint16_t recorderLost();                          // times the ring was full
+
+#endif
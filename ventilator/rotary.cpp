@@ -0,0 +1,96 @@
+#include "rotary.h"
+
+const int8_t QUARTERS_PER_STEP = 2;
+
+// Quarter-step change for each (previous << 2 | current) pin state, where state = CLK << 1 | DT.
+// Clockwise runs 3 -> 1 -> 0 -> 2 -> 3 (CLK leads DT). Entries where both pins changed are invalid (0).
+static const int8_t QUADRATURE[16] = {
+   0, -1, +1,  0,
+  +1,  0,  0, -1,
+  -1,  0,  0, +1,
+   0, +1, -1,  0
+};
+
+static uint8_t rotaryClkPin;
+static uint8_t rotaryDtPin;
+static uint8_t pinState = 0;                // last CLK/DT state seen by the interrupt
+static int8_t quarters = 0;                 // quarter steps not yet making up a whole step
+static volatile int8_t steps = 0;           // whole steps waiting for loop()
+static volatile uint16_t errors = 0;
+static RotaryEdgeFn edgeFn = 0;
+
+#if defined(__AVR__)
+static volatile uint8_t *clkInput;
+static volatile uint8_t *dtInput;
+static uint8_t clkMask;
+static uint8_t dtMask;
+
+static inline uint8_t readPins() {         // direct port reads .. digitalRead() is too slow for an ISR
+  return ((*clkInput & clkMask) ? 2 : 0) | ((*dtInput & dtMask) ? 1 : 0);
+}
+#else
+static inline uint8_t readPins() {
+  return (digitalRead(rotaryClkPin) ? 2 : 0) | (digitalRead(rotaryDtPin) ? 1 : 0);
+}
+#endif
+
+void rotaryBegin(uint8_t clkPin, uint8_t dtPin, RotaryEdgeFn onEdge) {
+  rotaryClkPin = clkPin;
+  edgeFn = onEdge;
+  rotaryDtPin = dtPin;
+  pinMode(clkPin, INPUT);
+  pinMode(dtPin, INPUT);
+#if defined(__AVR__)
+  clkInput = portInputRegister(digitalPinToPort(clkPin));
+  dtInput = portInputRegister(digitalPinToPort(dtPin));
+  clkMask = digitalPinToBitMask(clkPin);
+  dtMask = digitalPinToBitMask(dtPin);
+#endif
+  pinState = readPins();
+  attachInterrupt(digitalPinToInterrupt(clkPin), rotaryInterrupt, CHANGE);
+  attachInterrupt(digitalPinToInterrupt(dtPin), rotaryInterrupt, CHANGE);
+}
+
+void rotaryInterrupt() {
+  uint8_t current = readPins();
+  if (current == pinState) {
+    return;                                 // bounce that settled back where it was
+  }
+  uint8_t transition = (pinState << 2) | current;
+  pinState = current;
+  if (edgeFn) {
+    edgeFn(current);
+  }
+  int8_t delta = QUADRATURE[transition];
+  if (delta == 0) {
+    errors++;
+    return;
+  }
+  quarters += delta;
+  if (quarters >= QUARTERS_PER_STEP) {
+    quarters = 0;
+    if (steps < 127) {
+      steps++;
+    }
+  } else if (quarters <= -QUARTERS_PER_STEP) {
+    quarters = 0;
+    if (steps > -127) {
+      steps--;
+    }
+  }
+}
+
+int8_t rotaryTakeSteps() {
+  noInterrupts();                           // read-and-clear must not lose a step arriving in between
+  int8_t taken = steps;
+  steps = 0;
+  interrupts();
+  return taken;
+}
+
+uint16_t rotaryErrors() {
+  noInterrupts();
+  uint16_t count = errors;
+  interrupts();
+  return count;
+}
@@ -0,0 +1,25 @@
+#ifndef ROTARY_H
+#define ROTARY_H
+
+/* Interrupt-decoded rotary encoder (KY-040)
+   Description : CLK and DT are on pins 2 and 3, the Uno's two external interrupt pins. Every edge on either pin runs
+                 rotaryInterrupt(), which looks the (previous, current) pin pair up in a quadrature table. Valid transitions
+                 move a quarter-step count one way or the other; transitions that skip a state (both pins changed - a
+                 missed edge or contact bounce) are counted as errors and ignored. Two quarter-steps make one step, which
+                 is the same as the old polled code (one step per CLK edge).
+                 loop() collects the steps with rotaryTakeSteps() whenever it gets round to it, so fast spins are
+                 never lost however long loop() takes.
+                 An optional callback sees the CLK / DT state after every edge (the input recorder uses it).
+*/
+
+#include <Arduino.h>
+
+// Called from the encoder interrupt with CLK << 1 | DT whenever the pins change. Keep it short.
+typedef void (*RotaryEdgeFn)(uint8_t clkDt);
+
+void rotaryBegin(uint8_t clkPin, uint8_t dtPin, RotaryEdgeFn onEdge = 0);
+int8_t rotaryTakeSteps();                  // steps since the last call, +ve = clockwise. Never blocks
+uint16_t rotaryErrors();                   // invalid quadrature transitions seen
+void rotaryInterrupt();
+
+#endif
@@ -0,0 +1,83 @@
+#include "scheduler.h"
+
+static SchedulerTask *table = 0;
+static uint8_t tableSize = 0;
+
+void schedulerBegin(SchedulerTask *tasks, uint8_t count) {
+  // Insertion sort on the period .. a handful of tasks, once, and it keeps equal periods in the order given
+  for (uint8_t i = 1; i < count; i++) {
+    SchedulerTask task = tasks[i];
+    uint8_t j = i;
+    while (j > 0 && tasks[j - 1].periodUs > task.periodUs) {
+      tasks[j] = tasks[j - 1];
+      j--;
+    }
+    tasks[j] = task;
+  }
+  table = tasks;
+  tableSize = count;
+  unsigned long now = micros();
+  for (uint8_t i = 0; i < count; i++) {
+    table[i].release = now + table[i].periodUs;
+  }
+  schedulerReset();
+}
+
+bool schedulerRun() {
+  unsigned long now = micros();
+  for (uint8_t i = 0; i < tableSize; i++) {
+    SchedulerTask &task = table[i];
+    if ((long) (now - task.release) < 0) {
+      continue;
+    }
+    task.run();
+    unsigned long end = micros();
+    unsigned long elapsed = end - now;
+    if (elapsed > task.budgetUs && task.overruns != 0xFFFF) {
+      task.overruns++;
+    }
+    if (elapsed > task.longestUs) {
+      task.longestUs = elapsed > 0xFFFF ? 0xFFFF : (uint16_t) elapsed;
+    }
+    task.runs++;
+    task.release += task.periodUs;
+    if ((long) (now - task.release) >= 0) {         // the next release had come before this one ran
+      if (task.late != 0xFFFF) {
+        task.late++;
+      }
+      task.release = now + task.periodUs;
+    }
+    return true;
+  }
+  return false;
+}
+
+void schedulerReset() {
+  for (uint8_t i = 0; i < tableSize; i++) {
+    table[i].runs = 0;
+    table[i].overruns = 0;
+    table[i].late = 0;
+    table[i].longestUs = 0;
+  }
+}
+
+void schedulerReport(Print &out) {
+  for (uint8_t i = 0; i < tableSize; i++) {
+    const SchedulerTask &task = table[i];
+    out.print(F("sched: "));
+    out.print(reinterpret_cast<const __FlashStringHelper *>(task.name));
+    out.print(F(" period "));
+    out.print(task.periodUs);
+    out.print(F(" us budget "));
+    out.print(task.budgetUs);
+    out.print(F(" us runs "));
+    out.print(task.runs);
+    out.print(F(" overruns "));
+    out.print(task.overruns);
+    out.print(F(" late "));
+    out.print(task.late);
+    out.print(F(" longest "));
+    out.print(task.longestUs);
+    out.println(F(" us"));
+  }
+}
@@ -0,0 +1,44 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+/* Cooperative task scheduler for loop()
+   Description : Everything outside the interrupts runs as a fixed-period task. Each call of schedulerRun() runs at most
+                 one task: the one with the shortest period of those that are due, so priority is by rate (rate-monotonic).
+                 A task that is due waits for the run in progress and for the tasks with shorter periods, never for a
+                 slower one. Tasks run to the end .. nothing is pre-empted but by the interrupts.
+
+                 A task is released every periodUs, the first a period after schedulerBegin(), on a grid that does not
+                 drift: a task that runs late keeps its next release where it was. One that misses a whole release (it
+                 was still waiting when the next came) counts as late and picks up a period after it ran, rather than
+                 running several times to catch up. Each run is timed with micros() against the task's budget .. a run
+                 over budget counts as an overrun. The time includes any interrupts that came in meanwhile, the control
+                 tick among them.
+
+                 schedulerReport() prints, for each task, its period and budget, runs, overruns, late releases and the
+                 longest run since the last schedulerReset() .. 's' on the serial monitor.
+
+   Note        : The table is the caller's, in RAM. schedulerBegin() puts it in order of period (equal periods keep the
+                 order they were given in), so a task's index is not its place in the table that was passed.
+*/
+
+#include <Arduino.h>
+
+struct SchedulerTask {
+  void (*run)();
+  const char *name;           // PROGMEM
+  uint32_t periodUs;
+  uint16_t budgetUs;
+  // Kept by the scheduler
+  uint32_t release;           // micros() the task is next due at
+  uint32_t runs;
+  uint16_t overruns;          // runs that took longer than budgetUs
+  uint16_t late;              // releases missed .. still waiting to run when the next was due
+  uint16_t longestUs;
+};
+
+void schedulerBegin(SchedulerTask *tasks, uint8_t count);   // the first releases, and the counters cleared
+bool schedulerRun();                                        // the highest priority task that is due, if any .. true if one ran
+void schedulerReset();                                      // clears the counters
+void schedulerReport(Print &out);
+
+#endif
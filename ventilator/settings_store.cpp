@@ -0,0 +1,164 @@
+#include <EEPROM.h>
+#include "settings_store.h"
+#include "telemetry.h"
+
+const uint16_t SEQUENCE_ERASED = 0xFFFF;          // what an erased slot reads .. never written
+const uint8_t NOT_WRITING = 0xFF;
+
+// One ring of slots, each  sequence (2 bytes) | payload | CRC-8 .. the settings have one, the calibration map another
+struct StoreRing {
+  int base;
+  uint8_t slots;
+  uint8_t payloadBytes;
+  uint8_t *record;                                // the newest record, stored or going in
+  uint8_t newestSlot;
+  uint16_t newestSequence;
+  bool haveRecord;
+  uint8_t writeSlot;
+  uint8_t writeStep;                              // bytes of the record written so far
+};
+
+static uint8_t settingsRecord[SETTINGS_STORE_SLOT_BYTES];
+static uint8_t calibrationRecord[CALIBRATION_STORE_SLOT_BYTES];
+static StoreRing settingsRing = { SETTINGS_STORE_BASE, SETTINGS_STORE_SLOTS, SETTINGS_STORE_BYTES, settingsRecord,
+                                  SETTINGS_STORE_SLOTS - 1, 0, false, 0, NOT_WRITING };   // first record in slot 0
+static StoreRing calibrationRing = { CALIBRATION_STORE_BASE, CALIBRATION_STORE_SLOTS, CALIBRATION_STORE_BYTES,
+                                     calibrationRecord, CALIBRATION_STORE_SLOTS - 1, 0, false, 0, NOT_WRITING };
+
+static int slotAddress(const StoreRing &ring, uint8_t slot) {
+  return ring.base + (int) slot * (ring.payloadBytes + 3);
+}
+
+static uint8_t recordCrc(const StoreRing &ring, const uint8_t *bytes) {
+  uint8_t crc = SETTINGS_STORE_CRC_SEED;
+  for (uint8_t i = 0; i < 2 + ring.payloadBytes; i++) {
+    crc = telemetryCrc8(crc, bytes[i]);
+  }
+  return crc;
+}
+
+// The newest valid record into ring.record .. false if there is none
+static bool ringLoad(StoreRing &ring) {
+  ring.haveRecord = false;
+  ring.newestSlot = ring.slots - 1;
+  ring.newestSequence = 0;
+  ring.writeStep = NOT_WRITING;
+  uint8_t slotBytes = ring.payloadBytes + 3;
+  for (uint8_t slot = 0; slot < ring.slots; slot++) {
+    uint8_t bytes[CALIBRATION_STORE_SLOT_BYTES];  // the larger of the two
+    for (uint8_t i = 0; i < slotBytes; i++) {
+      bytes[i] = EEPROM.read(slotAddress(ring, slot) + i);
+    }
+    uint16_t sequence = bytes[0] | (bytes[1] << 8);
+    if (sequence == SEQUENCE_ERASED || bytes[2 + ring.payloadBytes] != recordCrc(ring, bytes)) {
+      continue;
+    }
+    if (!ring.haveRecord || (int16_t) (sequence - ring.newestSequence) > 0) {   // serial number arithmetic .. it wraps
+      ring.haveRecord = true;
+      ring.newestSlot = slot;
+      ring.newestSequence = sequence;
+      memcpy(ring.record, bytes, slotBytes);
+    }
+  }
+  return ring.haveRecord;
+}
+
+static void ringSave(StoreRing &ring, const uint8_t *payload) {
+  if (ring.haveRecord && memcmp(payload, ring.record + 2, ring.payloadBytes) == 0) {
+    return;                                       // already stored, or on its way
+  }
+  if (ring.writeStep == NOT_WRITING) {            // otherwise the record going in is replaced, in the same slot
+    ring.writeSlot = (ring.newestSlot + 1) % ring.slots;
+    do {
+      ring.newestSequence++;
+    } while (ring.newestSequence == SEQUENCE_ERASED || ring.newestSequence == 0);
+    ring.newestSlot = ring.writeSlot;
+  }
+  ring.record[0] = ring.newestSequence & 0xFF;
+  ring.record[1] = ring.newestSequence >> 8;
+  memcpy(ring.record + 2, payload, ring.payloadBytes);
+  ring.record[2 + ring.payloadBytes] = recordCrc(ring, ring.record);
+  ring.haveRecord = true;
+  ring.writeStep = 0;
+}
+
+// One byte of the record going in, if the EEPROM is ready for it .. true while it is still going in
+static bool ringPoll(StoreRing &ring) {
+  if (ring.writeStep == NOT_WRITING) {
+    return false;
+  }
+  if (!eeprom_is_ready()) {
+    return true;                                  // the last byte is still going in
+  }
+  uint8_t slotBytes = ring.payloadBytes + 3;
+  uint8_t offset = (ring.writeStep + 2) % slotBytes;   // payload, CRC, then the sequence number
+  EEPROM.write(slotAddress(ring, ring.writeSlot) + offset, ring.record[offset]);
+  ring.writeStep++;
+  if (ring.writeStep == slotBytes) {
+    ring.writeStep = NOT_WRITING;
+    return false;
+  }
+  return true;
+}
+
+bool settingsStoreLoad(StoredSettings &settings) {
+  if (!ringLoad(settingsRing)) {
+    return false;
+  }
+  settings.mode = settingsRecord[2];
+  settings.respRate = settingsRecord[3];
+  settings.tidal = settingsRecord[4] | (settingsRecord[5] << 8);
+  settings.iERatioTenths = settingsRecord[6];
+  settings.inspPressure = settingsRecord[7];
+  return true;
+}
+
+void settingsStoreSave(const StoredSettings &settings) {
+  uint8_t payload[SETTINGS_STORE_BYTES] = {
+    settings.mode, settings.respRate, (uint8_t) (settings.tidal & 0xFF), (uint8_t) (settings.tidal >> 8),
+    settings.iERatioTenths, settings.inspPressure
+  };
+  ringSave(settingsRing, payload);
+}
+
+bool calibrationStoreLoad(CalibrationMap &map) {
+  if (!ringLoad(calibrationRing)) {
+    return false;
+  }
+  const uint8_t *p = calibrationRecord + 2;
+  map.points = p[0];
+  map.unsettled = p[1];
+  for (uint8_t i = 0; i < CALIBRATION_POINTS; i++) {
+    map.drive[i] = p[2 + 2 * i] | (p[3 + 2 * i] << 8);
+    map.pressure[i] = p[2 + 2 * CALIBRATION_POINTS + 2 * i] | (p[3 + 2 * CALIBRATION_POINTS + 2 * i] << 8);
+  }
+  return true;
+}
+
+void calibrationStoreSave(const CalibrationMap &map) {
+  uint8_t payload[CALIBRATION_STORE_BYTES];
+  payload[0] = map.points;
+  payload[1] = map.unsettled;
+  for (uint8_t i = 0; i < CALIBRATION_POINTS; i++) {
+    payload[2 + 2 * i] = map.drive[i] & 0xFF;
+    payload[3 + 2 * i] = map.drive[i] >> 8;
+    payload[2 + 2 * CALIBRATION_POINTS + 2 * i] = map.pressure[i] & 0xFF;
+    payload[3 + 2 * CALIBRATION_POINTS + 2 * i] = map.pressure[i] >> 8;
+  }
+  ringSave(calibrationRing, payload);
+}
+
+bool settingsStorePoll() {
+  if (ringPoll(settingsRing)) {                   // the settings first .. the map can wait a commit
+    return true;
+  }
+  return ringPoll(calibrationRing);
+}
+
+uint16_t settingsStoreSequence() {
+  return settingsRing.haveRecord ? settingsRing.newestSequence : 0;
+}
+
+uint16_t calibrationStoreSequence() {
+  return calibrationRing.haveRecord ? calibrationRing.newestSequence : 0;
+}
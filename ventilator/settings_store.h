@@ -0,0 +1,68 @@
+#ifndef SETTINGS_STORE_H
+#define SETTINGS_STORE_H
+
+/* Settings store
+   Description : Keeps the last committed settings in EEPROM, so that a unit that is reset (a brown-out, a knocked cable)
+                 comes back ventilating as it was set rather than at the defaults.
+
+                 Wear levelled: SETTINGS_STORE_SLOTS slots are used in turn, each record going into the slot after the
+                 newest, so a cell is only written once every SETTINGS_STORE_SLOTS commits (the EEPROM is good for
+                 100,000 writes a cell .. with 64 slots, a commit every minute for twelve years). Each slot holds
+
+                   sequence (2 bytes, little-endian) | settings (SETTINGS_STORE_BYTES) | CRC-8 of the bytes before it
+
+                 settingsStoreLoad() reads every slot at start-up and takes the valid one with the newest sequence number.
+                 settingsStoreSave() never waits: it queues the record, and settingsStorePoll() writes one byte each time
+                 the EEPROM is ready for it. It is polled from the serial task, once every 10 ms .. a byte takes the EEPROM
+                 3.4 ms, so the next poll always finds it ready and a 9-byte record is in after ~90 ms. Polling again
+                 within the task would gain nothing, as the byte just started is not done inside the task's 1 ms budget.
+                 The settings and the CRC go first and the sequence number last, so until a record is complete its slot
+                 still carries the oldest sequence number in the ring .. a record cut off by a reset fails its CRC, and
+                 even in the 1 in 256 cases where it does not, it is never the newest. The last complete record is the one
+                 that is restored.
+
+                 Settings that are the same as the last ones stored are not written again.
+                 The CRC is seeded with SETTINGS_STORE_CRC_SEED so that neither an erased slot (all 0xFF) nor a zeroed
+                 one passes it.
+
+                 The actuator calibration map (calibration.h) is kept the same way in a ring of its own, after the
+                 settings: CALIBRATION_STORE_SLOTS slots of sequence | map | CRC-8. A sweep is run now and then, not on
+                 every commit, so two slots are enough .. the record going in never overwrites the last complete one.
+                 settingsStorePoll() writes the map's bytes once the settings have none waiting (~730 ms a map).
+
+   Note        : The caller still has to check that the values are in range (calibrationMapValid() for the map) .. a
+                 valid record is only as good as the firmware that wrote it.
+*/
+
+#include <Arduino.h>
+#include "calibration.h"
+
+const uint8_t SETTINGS_STORE_BYTES = 6;
+const uint8_t SETTINGS_STORE_SLOT_BYTES = 2 + SETTINGS_STORE_BYTES + 1;
+const uint8_t SETTINGS_STORE_SLOTS = 64;
+const int SETTINGS_STORE_BASE = 0;                  // EEPROM address of the first slot .. the ring takes 576 bytes
+const uint8_t SETTINGS_STORE_CRC_SEED = 0x5A;
+
+const uint8_t CALIBRATION_STORE_BYTES = 2 + 4 * CALIBRATION_POINTS;
+const uint8_t CALIBRATION_STORE_SLOT_BYTES = 2 + CALIBRATION_STORE_BYTES + 1;
+const uint8_t CALIBRATION_STORE_SLOTS = 2;
+const int CALIBRATION_STORE_BASE = SETTINGS_STORE_BASE + SETTINGS_STORE_SLOTS * SETTINGS_STORE_SLOT_BYTES;   // 146 bytes
+
+struct StoredSettings {
+  uint8_t mode;
+  uint8_t respRate;
+  uint16_t tidal;
+  uint8_t iERatioTenths;
+  uint8_t inspPressure;
+};
+
+bool settingsStoreLoad(StoredSettings &settings);          // setup() .. false if there is no valid record
+void settingsStoreSave(const StoredSettings &settings);    // queues the record, replacing one that is still going in
+bool settingsStorePoll();                                  // taskSerial() .. writes at most one byte, true while a record is going in
+uint16_t settingsStoreSequence();                          // of the newest record (0 if none)
+
+bool calibrationStoreLoad(CalibrationMap &map);            // setup() .. false if there is no valid record
+void calibrationStoreSave(const CalibrationMap &map);      // queues the map .. goes in through settingsStorePoll()
+uint16_t calibrationStoreSequence();                       // of the newest map (0 if none)
+
+#endif
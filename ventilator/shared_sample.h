@@ -0,0 +1,31 @@
+#ifndef SHARED_SAMPLE_H
+#define SHARED_SAMPLE_H
+
+/* Double-buffered 16-bit value written by one interrupt and read from anywhere else without blocking
+   Description : A 16-bit read takes two instructions on the AVR, so a reader can be interrupted half way through.
+                 The writer always fills the slot the readers are NOT using and then flips the (single byte) index, so a
+                 reader that has already picked its slot can be interrupted by one whole publish and still see a
+                 consistent value. Readers never disable interrupts.
+*/
+
+#include <stdint.h>
+
+struct SharedSample {
+  volatile uint16_t value[2];
+  volatile uint8_t index;                 // slot readers should use
+  volatile uint8_t sequence;              // incremented on every publish (wraps) .. lets a reader spot a new value
+};
+
+// Writer side - call from the one interrupt that owns the value
+inline void sharedSamplePublish(SharedSample &s, uint16_t v) {
+  uint8_t next = s.index ^ 1;
+  s.value[next] = v;
+  s.index = next;
+  s.sequence++;
+}
+
+inline uint16_t sharedSampleRead(const SharedSample &s) {
+  return s.value[s.index];
+}
+
+#endif
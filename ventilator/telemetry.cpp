@@ -0,0 +1,87 @@
+#include "telemetry.h"
+
+// Stop the compiler moving the record copy past the index update (the ring itself is not volatile)
+#define TELEMETRY_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+const uint8_t TELEMETRY_RING_MASK = TELEMETRY_RING_SIZE - 1;
+
+static TelemetryRecord telemetryRing[TELEMETRY_RING_SIZE];
+static volatile uint8_t telemetryHead = 0;        // next slot the ISR writes .. only written by the ISR
+static volatile uint8_t telemetryTail = 0;        // next slot loop() reads .. only written by loop()
+static volatile uint16_t telemetryDropCount = 0;  // only written by the ISR
+
+bool telemetryPush(const TelemetryRecord &record) {
+  uint8_t head = telemetryHead;
+  uint8_t next = (head + 1) & TELEMETRY_RING_MASK;
+  if (next == telemetryTail) {
+    telemetryDropCount++;                  // ring full .. loop() has fallen behind, drop rather than wait
+    return false;
+  }
+  telemetryRing[head] = record;
+  TELEMETRY_BARRIER();
+  telemetryHead = next;
+  return true;
+}
+
+uint16_t telemetryDropped() {
+  noInterrupts();
+  uint16_t dropped = telemetryDropCount;
+  interrupts();
+  return dropped;
+}
+
+uint8_t telemetryCrc8(uint8_t crc, uint8_t data) {
+  crc ^= data;
+  for (uint8_t bit = 0; bit < 8; bit++) {
+    crc = (crc & 0x80) ? (uint8_t) ((crc << 1) ^ 0x07) : (uint8_t) (crc << 1);
+  }
+  return crc;
+}
+
+bool telemetrySendFrame(HardwareSerial &out, uint8_t type, const uint8_t *payload, uint8_t length) {
+  if (length > TELEMETRY_MAX_PAYLOAD || out.availableForWrite() < length + TELEMETRY_FRAME_OVERHEAD) {
+    return false;
+  }
+  uint8_t frame[TELEMETRY_MAX_PAYLOAD + TELEMETRY_FRAME_OVERHEAD];
+  uint8_t crc = telemetryCrc8(telemetryCrc8(0, type), length);
+  frame[0] = TELEMETRY_SYNC_1;
+  frame[1] = TELEMETRY_SYNC_2;
+  frame[2] = type;
+  frame[3] = length;
+  for (uint8_t i = 0; i < length; i++) {
+    frame[4 + i] = payload[i];
+    crc = telemetryCrc8(crc, payload[i]);
+  }
+  frame[4 + length] = crc;
+  out.write(frame, length + TELEMETRY_FRAME_OVERHEAD);
+  return true;
+}
+
+uint8_t telemetryDrain(HardwareSerial &out, uint8_t maxFrames) {
+  uint8_t sent = 0;
+  while (sent < maxFrames) {
+    uint8_t tail = telemetryTail;
+    if (tail == telemetryHead) {
+      break;                               // ring empty
+    }
+    if (out.availableForWrite() < TELEMETRY_RECORD_BYTES + TELEMETRY_FRAME_OVERHEAD) {
+      break;                               // TX buffer full .. leave the rest for the next pass
+    }
+    TELEMETRY_BARRIER();
+    const TelemetryRecord &record = telemetryRing[tail];
+    uint8_t payload[TELEMETRY_RECORD_BYTES];
+    payload[0] = record.tick & 0xFF;
+    payload[1] = record.tick >> 8;
+    payload[2] = record.state;
+    payload[3] = record.events;
+    payload[4] = record.drive & 0xFF;
+    payload[5] = record.drive >> 8;
+    payload[6] = record.pressure & 0xFF;
+    payload[7] = record.pressure >> 8;
+    TELEMETRY_BARRIER();
+    telemetryTail = (tail + 1) & TELEMETRY_RING_MASK;   // slot can now be reused by the ISR
+    telemetrySendFrame(out, TELEMETRY_FRAME_TICK, payload, TELEMETRY_RECORD_BYTES);
+    sent++;
+  }
+  return sent;
+}
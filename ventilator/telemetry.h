@@ -0,0 +1,61 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+/* Control-loop telemetry
+   Description : The control interrupt must never wait on the UART. Instead of printing, it pushes one fixed-size record
+                 per tick into a single-producer / single-consumer ring. loop() drains the ring to Serial as binary frames,
+                 only ever writing as many bytes as the serial TX buffer has room for.
+                 The ring indexes are single bytes, so reading or writing them is atomic on the AVR. The producer (ISR)
+                 only writes telemetryHead, the consumer (loop) only writes telemetryTail .. no locking is needed.
+
+   Frame       : 0xA5 0x5A <type> <length> <payload ...> <crc8>
+                 The CRC (polynomial 0x07) covers type, length and payload. Multi-byte fields are little-endian.
+                 Text printed with Serial.print is plain ASCII, so it can never contain the 0xA5 sync byte and a reader
+                 can pick the frames out of a mixed stream.
+*/
+
+#include <Arduino.h>
+
+const uint8_t TELEMETRY_SYNC_1 = 0xA5;
+const uint8_t TELEMETRY_SYNC_2 = 0x5A;
+const uint8_t TELEMETRY_FRAME_OVERHEAD = 5;        // two sync bytes, type, length, crc
+const uint8_t TELEMETRY_MAX_PAYLOAD = 32;
+
+const uint8_t TELEMETRY_FRAME_TICK = 0x01;         // one TelemetryRecord
+const uint8_t TELEMETRY_FRAME_BREATH = 0x02;       // one BreathMetrics, sent by loop() once per breath (breath_metrics.h)
+const uint8_t TELEMETRY_FRAME_INPUTS = 0x03;       // a run of recorded input tokens (recorder.h)
+const uint8_t TELEMETRY_FRAME_REPLY = 0x04;        // the answer to a command frame (command.h)
+
+// Event bits in TelemetryRecord::events
+const uint8_t TELEMETRY_EVENT_INHALE = 0x01;           // inhale started on this tick (timed)
+const uint8_t TELEMETRY_EVENT_EXHALE = 0x02;           // exhale started on this tick
+const uint8_t TELEMETRY_EVENT_PATIENT_TRIGGER = 0x04;  // inhale started on this tick because the patient tried to breathe
+const uint8_t TELEMETRY_EVENT_PARAMS_ADOPTED = 0x08;   // new control parameters were swapped in on this tick
+const uint8_t TELEMETRY_EVENT_ALARM = 0x10;            // an alarm was raised on this tick (alarms.h)
+
+struct TelemetryRecord {
+  uint16_t tick;              // free-running control tick counter (wraps)
+  uint8_t state;              // breathState
+  uint8_t events;             // TELEMETRY_EVENT_* bits
+  uint16_t drive;             // value sent to the actuator
+  uint16_t pressure;          // raw pressure sensor reading
+};
+
+const uint8_t TELEMETRY_RECORD_BYTES = 8;          // packed size on the wire
+const uint8_t TELEMETRY_RING_SIZE = 16;            // must be a power of two .. 160 ms of ticks before anything is dropped
+
+// Producer side - call from the control interrupt only
+bool telemetryPush(const TelemetryRecord &record);
+
+// Consumer side - call from loop(). Writes at most maxFrames frames, and never more than out.availableForWrite()
+// bytes, so it returns without blocking. Returns the number of frames written.
+uint8_t telemetryDrain(HardwareSerial &out, uint8_t maxFrames = TELEMETRY_RING_SIZE);
+
+uint16_t telemetryDropped();                       // records lost because the ring was full
+
+uint8_t telemetryCrc8(uint8_t crc, uint8_t data);
+
+// Frame any payload (used by the drain, and by other modules that publish over the same link)
+bool telemetrySendFrame(HardwareSerial &out, uint8_t type, const uint8_t *payload, uint8_t length);
+
+#endif
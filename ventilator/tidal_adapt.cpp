@@ -0,0 +1,95 @@
+#include "tidal_adapt.h"
+#include <math.h>
+#include "drive.h"
+#include "shared_sample.h"
+
+const float ADAPT_RATE = 0.3;                 // share of the error taken out each breath
+const float COMPLIANCE_SMOOTHING = 0.5;       // weight of the newest breath in the compliance
+const float STEP_MAX = 1.5;                   // the correction moves by at most this factor a breath
+const float CORRECTION_MIN = 0.25;
+const float CORRECTION_MAX = 3.99;            // under 4, the top of Q2.14
+const float FALL_MAX = 0.9;                   // r over this .. the exhale hardly fell, so it is not fitted
+const float SWING_MIN = 1.0;                  // cmH2O
+const uint16_t CORRECTION_ONE = 1 << DRIVE_CORRECTION_SHIFT;
+
+static TidalAdaptConfig config;
+static SharedSample published;                // Q2.14, written here (loop) and read by the control tick
+static float correction = 1;
+static float compliance = 0;
+static float volume = 0;
+
+void tidalAdaptConfigure(const TidalAdaptConfig &c) {
+  config = c;
+  tidalAdaptReset();
+}
+
+void tidalAdaptReset() {
+  correction = 1;
+  compliance = 0;
+  volume = 0;
+  sharedSamplePublish(published, CORRECTION_ONE);
+}
+
+bool tidalAdaptBreath(const BreathMetrics &breath, int tidalMl) {
+  if (!(breath.flags & BREATH_EXHALE_SEGMENTS) || (breath.exhaleSegmentSamples == 0)) {
+    return false;
+  }
+  float fall1 = (float) breath.exhaleSums[0] - breath.exhaleSums[1];
+  float fall2 = (float) breath.exhaleSums[1] - breath.exhaleSums[2];
+  if (fall1 <= 0) {
+    return false;
+  }
+  float r = fall2 > 0 ? fall2 / fall1 : 0;      // already down at the valve setting after the first segment
+  if (r > FALL_MAX) {
+    return false;
+  }
+  float area = fall1 / ((1 - r) * (1 - r));                                       // Q4 counts x samples
+  float valve = (breath.exhaleSums[0] - area * (1 - r)) / breath.exhaleSegmentSamples;
+  float swing = (breath.pip - valve) * config.countsToPressure;
+  if (r > 0) {
+    float perSample = 1.0 / breath.exhaleSegmentSamples;                         // segments
+    float skipped = config.settleSamples - config.samplesPerTick;                  // after the exhale drive went out
+    float exhale = (breath.periodTicks - breath.inhaleTicks) * config.samplesPerTick;
+    area *= powf(r, -skipped * perSample) - powf(r, (exhale - skipped) * perSample);
+  }
+  float exhaled = area * config.countsToPressure * config.sampleSeconds / config.valveResistance * 1000;
+  if ((swing < SWING_MIN) || (exhaled <= 0)) {
+    return false;
+  }
+
+  float measured = exhaled / swing;
+  compliance = compliance > 0 ? compliance + COMPLIANCE_SMOOTHING * (measured - compliance) : measured;
+  volume = exhaled;
+
+  float wanted = tidalMl / compliance;
+  float limit = (config.pressureLimit - valve) * config.countsToPressure;
+  if (wanted > limit) {
+    wanted = limit;
+  }
+  float step = 1 + ADAPT_RATE * (wanted / swing - 1);
+  if (step > STEP_MAX) {
+    step = STEP_MAX;
+  } else if (step < 1 / STEP_MAX) {
+    step = 1 / STEP_MAX;
+  }
+  correction *= step;
+  if (correction > CORRECTION_MAX) {
+    correction = CORRECTION_MAX;
+  } else if (correction < CORRECTION_MIN) {
+    correction = CORRECTION_MIN;
+  }
+  sharedSamplePublish(published, (uint16_t) (correction * CORRECTION_ONE + 0.5));
+  return true;
+}
+
+uint16_t tidalAdaptCorrection() {
+  return sharedSampleRead(published);
+}
+
+float tidalAdaptVolume() {
+  return volume;
+}
+
+float tidalAdaptCompliance() {
+  return compliance;
+}
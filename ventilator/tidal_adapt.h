@@ -0,0 +1,57 @@
+#ifndef TIDAL_ADAPT_H
+#define TIDAL_ADAPT_H
+
+/* Adaptive tidal drive gain
+   Description : The drive table is scaled by tidal / TIDAL_MAX (drive.h), as though the bag delivered a volume in
+                 proportion to the drive whatever it is pushing into. It does not: the bag is a pressure source, so a stiff
+                 lung takes far less than a compliant one for the same squeeze, and a worn bag pushes less for the same
+                 drive. With adaptation on, each breath is measured once it is over and the gain is corrected for the
+                 breaths after it (iterative learning, breath to breath) - all of it in loop(), in float, once a breath:
+
+                   exhaled volume - the exhale is passive, through the exhalation valve, so the pressure above the valve's
+                                    setting is the flow out times the valve's resistance. The breath metrics sum the
+                                    pressure over three equal segments of L samples from the exhale start (S1, S2, S3).
+                                    For an exponential fall to the valve setting, r = (S2 - S3) / (S1 - S2) is the fall
+                                    over one segment, the area above the setting - all of it, not just up to the next
+                                    inhale - is (S1 - S2) / (1 - r)^2, and the setting is (S1 - area x (1 - r)) / L.
+                                    The area is taken back over the samples skipped before the first segment, and only
+                                    the part of it up to the next inhale counts: a stiff lung is empty long before then,
+                                    but a compliant one is not, and what it keeps was not breathed.
+                                    Volume = area x sample time / valve resistance
+                   compliance     - exhaled volume / (PIP - valve setting) .. the dynamic compliance, smoothed over breaths
+                   correction     - the swing (PIP - valve setting) that the set volume needs at that compliance, against
+                                    the swing this breath had: correction x= 1 + ADAPT_RATE x (wanted / had - 1), and never
+                                    so far that PIP would be driven past the pressure limit
+
+                 The correction (Q2.14) multiplies the open-loop gain, so the tidal setting can change without starting
+                 again. The control tick takes it at the start of each inhale (tidalAdaptCorrection(), one read), so a
+                 breath is delivered with one gain throughout and the tick does no more than one multiply a breath. A
+                 breath that cannot be fitted - the patient cut the exhale short, or it did not fall as a passive exhale
+                 does - leaves the correction as it was. The correction for a breath goes out after the next one has
+                 started, so it is taken up a breath later.
+                 Pressures are Q4 raw counts (as pressureFilterFast).
+*/
+
+#include <Arduino.h>
+#include "breath_metrics.h"
+
+struct TidalAdaptConfig {
+  float valveResistance;        // cmH2O/(L/s), exhalation valve and expiratory limb
+  float sampleSeconds;          // between breath metrics samples
+  float samplesPerTick;         // breath metrics samples per control tick
+  uint8_t settleSamples;        // samples between breathMetricsExhale() and the first exhale segment
+  float countsToPressure;       // cmH2O per Q4 count
+  uint16_t pressureLimit;       // Q4 counts .. PIP is not to be driven past this
+};
+
+void tidalAdaptConfigure(const TidalAdaptConfig &config);   // and reset
+void tidalAdaptReset();                                     // forget the lung .. correction back to 1
+
+// loop(), once per breath. True if the breath was fitted and the correction updated
+bool tidalAdaptBreath(const BreathMetrics &breath, int tidalMl);
+
+uint16_t tidalAdaptCorrection();                            // Q2.14 .. safe to read from the control tick
+float tidalAdaptVolume();                                   // ml, the last breath fitted
+float tidalAdaptCompliance();                               // ml/cmH2O, smoothed (0 until a breath is fitted)
+
+#endif
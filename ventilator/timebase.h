@@ -0,0 +1,58 @@
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+/* Control tick timebase
+   Description : What calls the control tick every PERIOD_US, picked at compile time with -DVENT_TIMEBASE=...
+                 (ventilator.cpp). Types with static inline members, the tick function a template argument, so it is
+                 called directly .. as with the actuator (actuator.h), nothing is looked up at run time.
+
+                   Timer1Timebase   The Timer1 overflow interrupt (TimerOne), as V14 on. The PWM actuators share Timer1,
+                                    so their PWM period is the control tick
+                   LoopTimebase     Polled from loop() against micros(), as the millis() timed V9 - V12 sketches, for
+                                    hardware where Timer1 is not free. The tick runs with interrupts off, as it would in
+                                    the interrupt, but only when loop() comes round: it is late by up to a pass of loop()
+                                    (most of a millisecond, and longer while the LCD is being written). A late tick is
+                                    not dropped, the next is due a period after the last was due
+
+   Note        : With LoopTimebase the profiler's tick latency and execution time (Timer1 counts) mean nothing.
+*/
+
+#include <Arduino.h>
+#include <TimerOne.h>
+
+#define VENT_TIMEBASE_TIMER1 0
+#define VENT_TIMEBASE_LOOP 1
+
+#ifndef VENT_TIMEBASE
+#define VENT_TIMEBASE VENT_TIMEBASE_TIMER1
+#endif
+
+template <void (*TICK)(), long PERIOD_US>
+struct Timer1Timebase {
+  static void begin() {
+    Timer1.initialize(PERIOD_US);
+    Timer1.attachInterrupt(TICK, PERIOD_US);
+  }
+  static inline void poll() {}
+};
+
+template <void (*TICK)(), long PERIOD_US>
+struct LoopTimebase {
+  static unsigned long due;
+  static void begin() {
+    due = micros() + PERIOD_US;
+  }
+  static inline void poll() {
+    if ((long) (micros() - due) >= 0) {
+      due += PERIOD_US;
+      noInterrupts();
+      TICK();
+      interrupts();
+    }
+  }
+};
+
+template <void (*TICK)(), long PERIOD_US>
+unsigned long LoopTimebase<TICK, PERIOD_US>::due;
+
+#endif
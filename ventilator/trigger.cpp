@@ -0,0 +1,100 @@
+#include "trigger.h"
+
+const uint8_t HISTORY = 8;                        // power of two, more than TRIGGER_SLOPE_SAMPLES
+
+// Only the ADC interrupt and the control tick touch these, and neither interrupts the other
+static uint16_t dropThreshold = TRIGGER_DROP_AT_1;
+static uint16_t slopeThreshold = TRIGGER_SLOPE_AT_1;
+static uint16_t refractory = 0;
+static bool armed = false;
+static uint16_t holdOff = 0;                      // samples left in the refractory period
+static int32_t baseline = 0;                      // Q4 raw counts << TRIGGER_BASELINE_SHIFT
+static bool dropping = false;
+static uint8_t confirmed = 0;
+static uint16_t history[HISTORY];
+static uint8_t historyIndex = 0;
+static uint8_t historyFill = 0;
+static volatile bool detected = false;
+static volatile uint16_t detections = 0;
+
+void triggerConfigure(uint8_t sensitivity, uint16_t refractorySamples) {
+  if (sensitivity < TRIGGER_SENSITIVITY_MIN) {
+    sensitivity = TRIGGER_SENSITIVITY_MIN;
+  }
+  if (sensitivity > TRIGGER_SENSITIVITY_MAX) {
+    sensitivity = TRIGGER_SENSITIVITY_MAX;
+  }
+  dropThreshold = TRIGGER_DROP_AT_1 / sensitivity;     // set up time only .. the sample path does not divide
+  slopeThreshold = TRIGGER_SLOPE_AT_1 / sensitivity;
+  refractory = refractorySamples;
+}
+
+void triggerArm(uint16_t pressure) {
+  holdOff = refractory;
+  baseline = (int32_t) pressure << TRIGGER_BASELINE_SHIFT;
+  dropping = false;
+  confirmed = 0;
+  historyFill = 0;
+  detected = false;
+  armed = true;
+}
+
+void triggerDisarm() {
+  armed = false;
+}
+
+bool triggerSample(uint16_t pressure) {
+  if (!armed) {
+    return false;
+  }
+
+  history[historyIndex] = pressure;
+  uint16_t windowStart = history[(historyIndex - TRIGGER_SLOPE_SAMPLES) & (HISTORY - 1)];
+  historyIndex = (historyIndex + 1) & (HISTORY - 1);
+  if (historyFill <= TRIGGER_SLOPE_SAMPLES) {
+    historyFill++;
+  }
+
+  if (holdOff) {
+    holdOff--;
+    baseline += (((int32_t) pressure << TRIGGER_BASELINE_SHIFT) - baseline) >> TRIGGER_BASELINE_SHIFT;
+    return false;
+  }
+
+  int16_t drop = (int16_t) ((baseline >> TRIGGER_BASELINE_SHIFT) - pressure);       // +ve below the baseline
+  if (dropping) {
+    if (drop < (int16_t) (dropThreshold >> 1)) {
+      dropping = false;                           // back within half the threshold .. the dip is over
+    }
+  } else if (drop >= (int16_t) dropThreshold) {
+    dropping = true;
+  }
+  if (!dropping) {
+    baseline += (((int32_t) pressure << TRIGGER_BASELINE_SHIFT) - baseline) >> TRIGGER_BASELINE_SHIFT;
+  }
+
+  bool falling = historyFill > TRIGGER_SLOPE_SAMPLES && (int16_t) (windowStart - pressure) >= (int16_t) slopeThreshold;
+  if (dropping && falling) {
+    if (++confirmed >= TRIGGER_CONFIRM_SAMPLES) {
+      armed = false;                              // one detection per exhale
+      detected = true;
+      detections++;
+      return true;
+    }
+  } else {
+    confirmed = 0;
+  }
+  return false;
+}
+
+bool triggerTake() {
+  if (!detected) {
+    return false;
+  }
+  detected = false;
+  return true;
+}
+
+uint16_t triggerCount() {
+  return detections;
+}
@@ -0,0 +1,50 @@
+#ifndef TRIGGER_H
+#define TRIGGER_H
+
+/* Patient trigger detector for spontaneous mode
+   Description : Runs from the ADC interrupt on every fast-channel output of the pressure filter (240 per second) while
+                 armed. The control tick arms it at the start of each exhale and disarms it when the inhale starts.
+                 A patient effort pulls the airway pressure down below where the passive exhale was taking it, so the
+                 detector wants both of:
+
+                   drop  - pressure at least dropThreshold below a baseline that follows the exhale
+                   slope - pressure falling by at least slopeThreshold over the last TRIGGER_SLOPE_SAMPLES samples
+
+                 for TRIGGER_CONFIRM_SAMPLES samples in a row. The baseline is a first order IIR of the pressure that is
+                 frozen while a drop is in progress, so an effort cannot drag its own reference down. The drop has
+                 hysteresis: it starts at dropThreshold and only ends when the pressure is back within half of it.
+                 Nothing is looked at for refractorySamples after arming - the pressure falling from the plateau to PEEP
+                 at the start of the exhale is a steep negative slope that is not the patient.
+                 Pressures are Q4 raw counts (as pressureFilterFast), 1 cmH2O is about 120.
+
+   Note        : Noise and small efforts overlap, and no sensitivity separates them (sim/bench_trigger -s, 60 breaths a
+                 run). The shipped 5 (TRIGGER_SENSITIVITY, ventilator.cpp) catches 2 cmH2O efforts on a clean signal,
+                 and gives no false triggers with 0.2 cmH2O of sensor noise. But with 0.5 cmH2O of noise on a passive lung
+                 it gives 8 false triggers in 60 breaths, and 54 with 1 cmH2O. 4 gives none at 0.5 cmH2O, but then only
+                 efforts of 3 cmH2O or more are caught. Efforts of 1 cmH2O are not caught at any setting, and from 7 up
+                 even 0.2 cmH2O of noise triggers most breaths. With a noisy sensor, turn the sensitivity down.
+*/
+
+#include <stdint.h>
+
+const uint8_t TRIGGER_SLOPE_SAMPLES = 6;          // slope window, 25 ms at 240 samples/s
+const uint8_t TRIGGER_CONFIRM_SAMPLES = 3;        // consecutive samples that must agree
+const uint8_t TRIGGER_BASELINE_SHIFT = 4;         // baseline IIR: y += (x - y) / 16, time constant ~67 ms
+const uint8_t TRIGGER_SENSITIVITY_MIN = 1;
+const uint8_t TRIGGER_SENSITIVITY_MAX = 10;
+
+// Thresholds at sensitivity 1 (least sensitive). Sensitivity n divides them by n .. at 10, 30 and 7 counts: 0.25 cmH2O
+// and ~2.3 cmH2O/s
+const uint16_t TRIGGER_DROP_AT_1 = 300;           // Q4 raw counts, 2.5 cmH2O
+const uint16_t TRIGGER_SLOPE_AT_1 = 75;           // Q4 raw counts per slope window, ~0.63 cmH2O in 25 ms: 25 cmH2O/s
+
+void triggerConfigure(uint8_t sensitivity, uint16_t refractorySamples);
+void triggerArm(uint16_t pressure);               // start of exhale .. pressure is the current fast-channel output
+void triggerDisarm();
+
+// Call with each fast-channel output. Cheap when disarmed. Returns true on the sample that detects an effort
+bool triggerSample(uint16_t pressure);
+bool triggerTake();                               // true once for each detection since the last call
+uint16_t triggerCount();                          // detections since reset (wraps)
+
+#endif
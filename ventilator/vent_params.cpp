@@ -0,0 +1,29 @@
+#include "vent_params.h"
+
+// Stop the compiler moving the slot writes past the sequence update
+#define VENT_PARAMS_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+static VentParams slots[2];
+static volatile uint8_t sequence = 0;             // slots[sequence & 1] is the latest commit .. only written by loop()
+static volatile uint8_t adopted = 0;              // sequence last adopted .. only written by the control interrupt
+
+void ventParamsCommit(const VentParams &params) {
+  uint8_t next = sequence + 1;
+  slots[next & 1] = params;                       // the slot the interrupt may read is the other one
+  VENT_PARAMS_BARRIER();
+  sequence = next;
+}
+
+bool ventParamsAdopt(VentParams &active) {
+  uint8_t latest = sequence;
+  if (latest == adopted) {
+    return false;
+  }
+  active = slots[latest & 1];
+  adopted = latest;
+  return true;
+}
+
+bool ventParamsPending() {
+  return sequence != adopted;
+}
@@ -0,0 +1,41 @@
+#ifndef VENT_PARAMS_H
+#define VENT_PARAMS_H
+
+/* Control parameter handover between loop() and the control interrupt
+   Description : A breath must be delivered with one consistent set of parameters, and the set may only change at the
+                 start of a breath. loop() works out everything the control interrupt needs (phase timing, table step,
+                 gains - all the divisions) and commits the whole set; the control interrupt adopts it at the next
+                 breath boundary. Neither side ever waits and Timer1 is never stopped.
+
+                 Double buffered with a sequence number. loop() writes the slot the sequence does not point at, then
+                 advances the sequence (a single byte, so atomic on the AVR) to point at it. The control interrupt copies
+                 the slot the sequence points at when it differs from the last one it adopted. The interrupt only ever
+                 reads a slot that loop() has finished with, so it can never see half of an update. A second commit
+                 before the breath boundary replaces the first.
+*/
+
+#include <Arduino.h>
+#include "breath_timer.h"
+
+struct VentParams {
+  // As set by the user
+  uint8_t mode;
+  int respRate;
+  int tidal;
+  float iERatio;
+  int inspPressure;             // PCV target, cmH2O
+
+  // Derived in loop() before commit .. the control interrupt does no division
+  BreathTiming timing;          // phase lengths (breath_timer.h)
+  uint32_t driveTableStepQ16;   // Q16.16 table entries per inhale tick (drive.h)
+  uint16_t tidalDriveGain;      // Q1.15 scaling of the drive table for the tidal volume
+  uint16_t pcvTargetFiltered;   // PCV target pressure, Q4 raw sensor counts (as pressureFilterFast)
+  uint16_t pcvDriveGain;        // Q1.15 scaling of the drive table used as the PCV feedforward
+  uint16_t exhaleSegmentSamples;  // breath metrics samples in each of the exhale's segments (breath_metrics.h)
+};
+
+void ventParamsCommit(const VentParams &params);  // loop() - returns at once
+bool ventParamsAdopt(VentParams &active);         // control interrupt, at the breath boundary - true if a newer set was copied
+bool ventParamsPending();                         // committed but not adopted yet
+
+#endif
@@ -20,6 +20,72 @@
                : V22 : Changed to PWM output
                : V23 : Changed the max tidal volume to 700 ml (single change of the constant defining this value)
                : V24 : Added a spontaneous breathing mode - triggers a breath cycle when transucer pressure drops below PEEP threshold
+               : V25 : No more Serial.println from the control interrupt .. it pushes a binary telemetry record per tick into a lock-free
+                       ring (telemetry.h) which loop() drains to Serial. Serial runs at 115200 baud
+               : V26 : Inhale drive calculation is fixed point (drive.h) - the division and float scaling are done once per breath, the
+                       control interrupt only adds, shifts and does one integer multiply
+               : V27 : Pressure sensor is sampled by the free-running ADC interrupt at a fixed rate (pressure_adc.h). No more blocking
+                       analogRead() in loop() or in the control interrupt
+               : V28 : Pressure is filtered at the sample rate (pressure_filter.h) - a fast channel for spontaneous triggering and a slow
+                       channel for the display, replacing the 50 reading average that depended on how fast loop() went
+               : V29 : Display is drawn into a RAM frame buffer (lcd_frame.h) and only changed characters are sent over I2C
+               : V30 : Rotary encoder is decoded by pin-change interrupts (rotary.h) and the settings menu is a state machine that
+                       loop() steps once per pass (uiStep) .. pressure display, telemetry and LEDs keep running while settings change
+               : V31 : Pressure-controlled (PCV) mode. A PI loop (pressure_control.h) runs on every fast pressure sample and
+                       tracks the set inspiratory pressure, with the drive table as feedforward
+               : V32 : Drive waveforms (ramp, decelerating, sine, square and the old table) are generated at compile time into
+                       flash (waveform.h) and interpolated between entries. Each mode has its own waveform, the old table
+                       for all three as before
+               : V33 : All constant text is in flash (F() and PROGMEM). SRAM use, stack high-water mark and heap fragmentation
+                       are reported over serial (memory_probe.h); tools/memory_report.sh lists RAM and flash use per symbol
+               : V34 : Spontaneous breaths are detected by trigger.h at the pressure filter rate - a fall below the exhale baseline
+                       together with a falling slope, with sensitivity, hysteresis and a refractory period after each exhale starts
+               : V35 : Execution-time profiler (profiler.h) - latency, execution time and period jitter of the control tick from
+                       Timer1, with histograms, and the time taken by each section of loop(). 'p' over serial prints the report,
+                       'r' clears it, 'm' prints the memory report
+               : V36 : Breath metrics (breath_metrics.h) - PIP, PEEP, mean pressure, measured period and I:E, worked out sample
+                       by sample as the breath goes. Each breath is sent as a telemetry frame and PIP / PEEP are displayed
+               : V37 : Parameters are handed to the control interrupt through a double buffer (vent_params.h) with everything it
+                       needs already worked out, tick counts included. Timer1 is no longer stopped, the menu no longer waits
+                       for the end of the breath, and the first breath after a change no longer uses the old tick counts
+               : V38 : Input recorder (recorder.h) - with recordInputs set, every pressure sample, encoder edge, select button change
+                       and settings commit from reset is streamed over serial, delta-encoded, for replay on the host (sim/replay)
+               : V39 : Breath timebase (breath_timer.h) - the phases are timed by an integer phase clock that carries the part-tick
+                       left at the end of each phase into the next breath, so the breath period and I:E no longer lose up to a tick per
+                       phase every breath. The control tick (CONTROL_TICK_US) can be made faster without changing the breath;
+                       the PCV rise is set in ms and telemetry records stay at 100 per second whatever the tick
+               : V40 : Automatic calibration (calibration.h) replaces the hand calibration of V19 - holding select for 5 s sweeps the
+                       actuator up through its range from the control tick, waits for the pressure to settle at each point and
+                       fits a rising pressure-against-drive map, which PCV then uses for its feedforward. 'c' prints the map
+               : V41 : Fast boot. The settings are kept in EEPROM (settings_store.h) on every commit and restored at start-up, and
+                       ventilation starts straight after them .. the LCD, the LED self-test and the splash screen follow, the
+                       self-test running from loop() while the first breaths go. No more waiting for the serial port. The time
+                       from reset to the first control tick is reported over serial
+               : V42 : One controller for every hardware variant. The actuator (Timer1 PWM, 4-20 mA current loop or the servo
+                       of V17 - V19), the timebase (Timer1 interrupt, or polled from loop() as the millis() sketches) and the
+                       display (I2C LCD at either address, or none) are types picked at compile time - actuator.h, timebase.h,
+                       display.h - with static inline members, so there is no dispatch at run time. The forks this replaces -
+                       Controller_int_v14, v16, v18 and v19 (servo) and Controller_int_PWM_v22 and v23 (PWM) - are superseded
+                       and kept in the tree as history only, for the benchmarks' before figures. They are not built or
+                       maintained .. fixes go here, never into a fork
+               : V43 : Alarms (alarms.h), checked every control tick: high pressure, disconnection, apnea in spontaneous mode
+                       and low peak pressure, with hysteresis, latched and in priority order. Over-pressure ends the inhale and
+                       takes the drive to its minimum on the tick it is seen; apnea starts a backup breath. The alarm goes on
+                       the yellow LED, a buzzer on BUZZER_PIN and the second line of the display .. select (or 'a' over
+                       serial) acknowledges it, silencing the buzzer and clearing the alarms that are over
+               : V44 : loop() is a rate-monotonic cooperative scheduler (scheduler.h). Telemetry, serial requests, the menu, the
+                       LEDs, the LCD, the pressure display and the memory report are tasks, each with a fixed period and an
+                       execution budget; runs over budget and missed releases are counted, and 's' over serial prints them.
+                       The spontaneous LED flashes from millis() rather than counting passes of loop(), and the measured
+                       pressure is drawn 4 times a second rather than on every pass
+               : V45 : Serial command protocol (command.h) - framed, CRC-checked commands to get and set the settings and to
+                       read back the status, parsed a byte at a time with no heap. A set is checked against the menu's ranges
+                       and committed as the menu commits, to start with the next breath
+               : V46 : Adaptive tidal drive gain (tidal_adapt.h). With adaptTidal set ('v' over serial), the exhaled volume
+                       is worked out from each breath's passive exhale through the exhalation valve, the lung's compliance
+                       from that and the pressure swing, and the tidal gain corrected breath to breath until the set volume
+                       is delivered .. whatever the lung and however worn the bag. All of it in loop() once a breath; the
+                       control tick takes the correction at the start of each inhale
    Circuit     : https://www.circuito.io/app?components=512,9590,9591,11021,217614,417987
                : Also add a 10k pull-up resistor between Rotary centre switch (Middle pin, 'SELECT_BUTTON' ) and +5V .. this device has no built in pull-up for centre switch
    Status      : Untested
@@ -30,15 +96,45 @@
 #include <Wire.h>
 #include <LiquidCrystal_I2C.h>
 #include <TimerOne.h>                        // Interrupt library to keep the control cycle regular .. https://playground.arduino.cc/Code/Timer1/
+#include "telemetry.h"
+#include "drive.h"
+#include "pressure_adc.h"
+#include "pressure_filter.h"
+#include "lcd_frame.h"
+#include "rotary.h"
+#include "pressure_control.h"
+#include "waveform.h"
+#include "memory_probe.h"
+#include "trigger.h"
+#include "profiler.h"
+#include "breath_metrics.h"
+#include "vent_params.h"
+#include "recorder.h"
+#include "breath_timer.h"
+#include "calibration.h"
+#include "settings_store.h"
+#include "actuator.h"
+#include "timebase.h"
+#include "display.h"
+#include "alarms.h"
+#include "scheduler.h"
+#include "command.h"
+#include "tidal_adapt.h"
 
 const bool PRODUCTION_CODE = false;        // This is non-production code - not tested and includes calibration routines
+const bool RUN_DRIVE_BENCHMARK = false;    // Print cycle counts for the inhale drive calculation at start-up (see drive.h)
+const bool RUN_ACTUATOR_BENCHMARK = false; // Print cycle counts for the actuator output, against the hand-written calls (see actuator.h)
+const bool REPORT_MEMORY = true;           // Print SRAM use (memory_probe.h) at start-up and every MEMORY_REPORT_INTERVAL
+const unsigned long MEMORY_REPORT_INTERVAL = 60000;   // milli-seconds
+bool recordInputs = false;                 // Stream every input from reset for host replay (recorder.h) .. about 700 bytes/s of serial
+bool adaptTidal = false;                   // Correct the tidal drive gain breath by breath from the measured exhale (tidal_adapt.h)
 
-// Set the LCD address to 0x27 for a 16 chars and 2 line display
-LiquidCrystal_I2C lcd(0x27, 20, 4); // Address may sometimes be 0x3f
+#define FLASH_STRING(str) (reinterpret_cast<const __FlashStringHelper *>(str))   // Print a char array that was put in PROGMEM
 
-// Define shape of driver waveform
-const int INHALE_DRIVE[]={0,5,10,15,20,25,30,35,40,45,50,55,60,65,70,75,80,85,90,95,100,105,110,115,120,125,130,135,140,145,150,155,160,165,170,175,180,185,190,195,200,217,235,252,270,287,305,322,340,357,375,392,410,427,445,462,480,497,515,532,550,567,585,602,620,637,655,672,690,707,725,742,760,777,795,812,830,847,865,882,900,906,912,918,924,930,936,943,949,955,961,967,973,979,986,992,998,1004,1010,1016,1023};
-const int DRIVE_TABLE_SIZE = 100;            // length of the INHALE_DRIVE table
+LcdFrame lcdFrame;                  // Everything is drawn here first .. Display::flush() sends only what changed (display.h)
+const uint8_t LCD_FLUSH_CELLS_PER_RUN = 2;    // Most characters sent to the LCD per run of its task (each ~1 ms of I2C, ~2 ms with the cursor move)
+
+// Shape of the driver waveform comes from the flash tables in waveform.h .. which one depends on the mode (MODE_WAVEFORMS)
 const int DRIVE_VAL_MIN = 0;                 // minimum value for the output drive (position during exhale)
 
 // define control constants for the ventilator
@@ -46,6 +142,8 @@ const int INSP_PRESS_MAX = 20;           // Inspiratory pressure
 const int INSP_PRESS_MIN = 5;
 const int INSP_PRESS_DEFAULT = 15;
 const int INSP_PRESS_STEP = 1;
+const int ACTUATOR_PRESSURE_MAX = 40;    // Pressure the actuator develops at full drive (cmH2O) .. scales the PCV feedforward
+const long PCV_RISE_MS = 150;            // PCV plays the drive table over this long, rising from PEEP to the set pressure
 
 const int RESP_RATE_MAX = 30;             // Respratory rate
 const int RESP_RATE_MIN = 5;
@@ -67,40 +165,48 @@ const int EXHALE_STATE = 1;      // vent is driving exhlation
 
 const int RAW_ACTUATOR_MIN = 0;  // minimum, unscalled value direct to actuatory
 const int RAW_ACTUATOR_MAX = 1023; // max
-const int RAW_ACTUATOR_STEP = 20;
 
 const long int ENTER_CALIBRATION = 5000;  // Length of time in milli-seconds that the select button has to be pushed to enter calibration mode
-
-// Pressure reading smoothing
-const int PRESS_READ_SMOOTHING = 50 ;     // The number of pressure readings that get averaged to get a smooth result
-int pressReadings[ PRESS_READ_SMOOTHING ]; // Actual data from the pressure sensor
-int pressReadIndex = 0;                   // Index of the current pressure reading
-int pressTotal = 0;                       // Running total for the pressure
-int pressAverage = 0;                     // Average reading for the pressure
+const int CALIBRATION_RAMP_PER_S = 200;   // Actuator counts per second between calibration points .. as the 5 ms per count of V19
+const int CALIBRATION_PRESSURE_LIMIT = 40;  // cmH2O .. the sweep goes no higher
+
+// Alarm limits (alarms.h) .. the second of each pair clears the alarm
+const int ALARM_HIGH_PRESSURE_ON = 35;     // cmH2O .. the inhale is cut off here
+const int ALARM_HIGH_PRESSURE_OFF = 30;
+const int ALARM_DISCONNECT_ON = 2;         // cmH2O, well under PEEP
+const int ALARM_DISCONNECT_OFF = 3;
+const long ALARM_DISCONNECT_MS = 500;      // .. this long before it counts
+const int ALARM_LOW_PEAK_ON = 7;           // cmH2O, peak of the inhale
+const int ALARM_LOW_PEAK_OFF = 8;
+const uint8_t ALARM_LOW_PEAK_BREATHS = 2;  // .. this many breaths in a row
+const long ALARM_APNEA_S = 20;             // Spontaneous mode, no breath from the patient for this long
+const unsigned long ALARM_BEEP_MS = 200;           // Buzzer and LED on for this long ..
+const unsigned long ALARM_HIGH_PERIOD_MS = 400;    // .. every this long for a high priority alarm
+const unsigned long ALARM_MEDIUM_PERIOD_MS = 2000;  // .. or this for the others
+const unsigned long ALARM_SILENCE_MS = 120000;     // Acknowledging an alarm that is still going silences it this long
 
 // Pressure sensor convert from raw to CM H20
 const float PRESS_SENSOR_MULTIPLIER =  0.1331;
 const float PRESS_SENSOR_CONSTANT = -5.7;
+const float PRESS_FILTERED_SCALE = 1.0 / (1 << PRESSURE_FILTER_FRACTION_BITS);   // Filtered pressure is in 1/16ths of a raw count
 
 
-// control variables
+// control variables .. the settings as last committed from the menu. The control interrupt works from its own copy (params)
 float inspPressure =  INSP_PRESS_DEFAULT;
-int respRate = INSP_PRESS_DEFAULT;
+int respRate = RESP_RATE_DEFAULT;
 int tidal = TIDAL_DEFAULT;
+int targetInspPressure = INSP_PRESS_DEFAULT;   // PCV inspiratory pressure (inspPressure is the measured pressure)
 float iERatio = I_E_RATIO_DEFAULT;
 
 // updated control variables ..
 // Control parameters must only change at the end of a breath cycle
 // We can't have rates and values changing half-way through a breath and in an inconsistent manner
-// Therefore when the control parameters are updated they are stored in this variables, then 'swapped in' at the end of a stroke
-// ALSO .. we have to be careful about race-conditions for any shared variables. We can't have the interrupt driven control loop
-// using a variable that has been partially updated by the code that was interrupted
-// Therefore the use of a 'paramUpdateSemaphor' and a halting of interrupts to ensure that parameter updating is synchronised
+// Therefore the menu edits these variables, and only when it is finished is the whole set worked out and committed (vent_params.h)
+// The control interrupt swaps the set in at the start of the next breath
 int newInspPressure =  INSP_PRESS_DEFAULT;
-int newRespRate = INSP_PRESS_DEFAULT;
+int newRespRate = RESP_RATE_DEFAULT;
 int newTidal = TIDAL_DEFAULT;
 float newIERatio = I_E_RATIO_DEFAULT;
-volatile bool paramUpdateSemaphore;                  // TRUE -> Control parameters have been updated, reset to FALSE on use
 
 
 // Physical set up constants
@@ -111,209 +217,617 @@ const int SPONTANEOUS_LED = 7;        // Yellow LED
 const int ROTARY_CLK = 2;             // Connected to CLK on KY-040 ( ROTARYENCI_PIN_CLK on circuito.io )
 const int ROTARY_DT = 3;              // Connected to DT on KY-040 ( ROTARYENCI_PIN_D on circuito.io )
 const int SELECT_BUTTON = 4;          // Push switch built into the rotary encoder ( ROTARYENCI_PIN_S1 on circuito.io )
-const int PWM_PIN = 9;                // Pin for the final output
+const int BUZZER_PIN = 8;             // Alarm buzzer (active .. sounds while the pin is high)
+const int PWM_PIN = 9;                // Pin for the final output .. Timer1 PWM (the PWM and current loop actuators)
+const int SERVO_PIN = 10;             // .. or the servo (VENT_ACTUATOR_SERVO). Was 7 in V17 - V19, now the spontaneous LED
 const int PRESSURE_SENSOR_PIN = A0;   // Pin for the pressure sensor
-const int SERIAL_BAUD_RATE = 9600;    // Standard baud rate for the serial interface
+const int PRESSURE_SAMPLE_RATE_HZ = 1000;  // Pressure samples per second from the free-running ADC (nearest achievable rate is used)
+const float PRESSURE_FAST_RATE_HZ = (float) PRESSURE_ADC_CONVERSION_HZ /           // .. the rate achieved, after the filter's
+    ((PRESSURE_ADC_CONVERSION_HZ + PRESSURE_SAMPLE_RATE_HZ / 2) / PRESSURE_SAMPLE_RATE_HZ) / PRESSURE_FILTER_DECIMATION;   // decimation (240 Hz)
+const float EXHALE_VALVE_RESISTANCE = 5.0;  // cmH2O/(L/s), exhalation valve and expiratory limb .. turns the exhale pressure into flow
+const float EXHALE_FIT_SHARE = 0.9;         // The exhale segments (breath_metrics.h) take this much of the planned exhale
+const long SERIAL_BAUD_RATE = 115200; // Fast enough to carry a telemetry frame every control tick
 const short int NUM_LED_TEST_LOOPS = 38; // Number of times that the LEDs flash during start-up test
-
-unsigned long changeTime;
-
-int pinALast;      // last pin high on rotary encoder
-int ledFlashCount = 0; // only for debugging
-
-const long int TIME_BETWEEN_TICKS = 10000;                           // Time between the main-control interrupt being called in microseconds
-const long int TICKS_PER_MINUTE = 60000000 / TIME_BETWEEN_TICKS;       // assume milli-second clock tick .. calibrate to clock speed
-
-int ticksPerInhale = 0;                    // Number of clock-ticks per inhale
-int ticksPerExhale = 0;                    // Nmber of clock-ticks per exhale
+const unsigned long LED_TEST_STEP_MS = 100;   // .. each flash this long
+const unsigned long SPLASH_HOLD_MS = 2000;    // Splash screen stays up this long after the LED test
+
+// Settings menu .. a state machine stepped once per run of its task, so monitoring carries on while the knob is turned
+const int UI_IDLE = 0;                // Normal display, waiting for the select button
+const int UI_HOLD = 1;                // Select held down .. let go for the menu, keep holding for calibration (non-production only)
+const int UI_MODE = 2;
+const int UI_RESP_RATE = 3;
+const int UI_INSP_PRESSURE = 4;       // PCV mode only
+const int UI_IE_RATIO = 5;
+const int UI_TIDAL = 6;
+const int UI_CALIBRATE = 7;           // Calibration sweep running (non-production only) .. select aborts it
+const int UI_SELF_TEST = 8;           // Splash screen and LED self-test after reset, while ventilating .. select skips it
+const unsigned long BUTTON_DEBOUNCE_MS = 20;   // Select button has to be steady this long before a change counts
+
+int uiState = UI_IDLE;
+bool uiRedraw = false;                // The value being edited has to be drawn on this step
+unsigned long uiHoldStart;            // When the select button went down in UI_IDLE
+int newMode = 0;                      // Mode being chosen in the menu
+int selectStable = HIGH;              // Debounced level of the select button
+int selectLastReading = HIGH;
+unsigned long selectChangeTime = 0;
+bool selectPressed = false;           // TRUE for the one step of the menu in which the debounced button went down
+unsigned long selfTestStart;          // millis() when UI_SELF_TEST began
+volatile bool selfTestLeds = false;   // The self-test has the LEDs .. the control interrupt leaves them alone
+
+int ledFlashCount = 0; // Step of the LED self-test last shown
+uint8_t alarmShown = 0xFF;            // Alarm on the second line of the display (0 for none, 0xFF to draw it again)
+unsigned long alarmSilenceStart = 0;  // millis() when the alarms were last acknowledged
+uint8_t alarmsAcknowledged = 0;       // .. the ones still going then, silenced for ALARM_SILENCE_MS (any other sounds)
+
+#ifndef CONTROL_TICK_US
+#define CONTROL_TICK_US 10000                                        // 1000 or less for a 1 kHz (or faster) control loop
+#endif
+const long int TIME_BETWEEN_TICKS = CONTROL_TICK_US;                 // Time between the main-control interrupt being called in microseconds
+const float PRESSURE_SAMPLES_PER_TICK = PRESSURE_FAST_RATE_HZ * TIME_BETWEEN_TICKS / 1e6;
+const uint8_t EXHALE_SETTLE_SAMPLES = PRESSURE_SAMPLES_PER_TICK + 3;  // Not in the exhale segments .. the tick before the exhale
+                                                                      // drive goes out, and the filter's two outputs to clear it
+const long TELEMETRY_INTERVAL_US = 10000;                            // One telemetry record per 10 ms at most .. the serial line cannot carry more
+const int TICKS_PER_TELEMETRY = (TIME_BETWEEN_TICKS < TELEMETRY_INTERVAL_US) ? TELEMETRY_INTERVAL_US / TIME_BETWEEN_TICKS : 1;
+const long long ALARM_DISCONNECT_TICKS = ALARM_DISCONNECT_MS * 1000LL / TIME_BETWEEN_TICKS;   // Alarm times in control ticks (alarms.h)
+const long long ALARM_APNEA_TICKS = ALARM_APNEA_S * 1000000LL / TIME_BETWEEN_TICKS;        // .. the largest tick count there is
+static_assert(ALARM_APNEA_TICKS == (decltype(AlarmLimits::apneaTicks)) ALARM_APNEA_TICKS,
+              "CONTROL_TICK_US too short: the apnea time does not fit AlarmLimits::apneaTicks");
+static_assert(ALARM_DISCONNECT_TICKS > 0, "CONTROL_TICK_US longer than ALARM_DISCONNECT_MS");
+
+VentParams params;                        // The parameters for the breath in progress .. only the control interrupt changes them
 int tick = 0;                             // One tick each time the controller 'main-loop' interrupt is fired
+BreathClock breathClock = { 0, 0 };      // Phase clocks (breath_timer.h) .. how far into each phase, carried from breath to breath
 int breathState = INHALE_STATE;           // starts with machine driving breathing
-int positionInDriveTable = 0;             // the offset down the output drive table for current clock tick
 int unscaledDriveValue = 0;               // Drive value before being scalled by tidal volume
 int driveValue = 0;                       // The value output to the actuator
-
-String outPutLog = "";
+uint32_t drivePosition = 0;               // Q16.16 position down the drive table, advanced by driveTableStep each inhale tick
+uint32_t pcvTableStepQ16 = 0;             // Table entries per tick for PCV_RISE_MS
+uint16_t breathDriveGain = 0;             // params.tidalDriveGain with the adaptive correction (tidal_adapt.h), set as each inhale starts
+unsigned int controlTicks = 0;            // Free-running count of control interrupts (wraps) .. timestamps the telemetry
+uint8_t telemetryEvents = 0;              // TELEMETRY_EVENT_* since the last record went out
+uint8_t telemetryTicks = 0;               // Ticks since the last record went out
+CalibrationMap calibrationMap = { 0 };    // Actuator pressure against drive, from the last calibration sweep (none until one is run)
+bool calibrationRestored = false;         // .. it came from EEPROM at start-up (settings_store.h)
+volatile unsigned long firstTickUs = 0;   // micros() at the first control tick .. the boot time (0 until then)
+bool settingsRestored = false;            // The settings came from EEPROM at start-up (settings_store.h)
+bool bootReported = false;                // bootReport() has been sent
 
 // Constants and variables associated with different operating modes#
-const int NUMBER_OF_MODES = 2;                // There are two modes .. 'IPPV' (Intermittent Positive Pressure Ventilaition) and 'Spontaneous'
+const int NUMBER_OF_MODES = 3;                // 'IPPV' (Intermittent Positive Pressure Ventilaition), 'Spontaneous' and 'PCV' (Pressure Controlled Ventilation)
 const int MODE_IPPV = 0;
 const int MODE_SPONTANEOUS = 1;
+const int MODE_PCV = 2;
 const int MODE_MAX_STRING_LEN = 12;           // Maximum length of a string representing a mode
-char modeStrings [NUMBER_OF_MODES] [MODE_MAX_STRING_LEN] = {
+const char modeStrings [NUMBER_OF_MODES] [MODE_MAX_STRING_LEN] PROGMEM = {   // In flash .. print with FLASH_STRING()
   {"IPPV       "},
-  {"Spontaneous"}
+  {"Spontaneous"},
+  {"PCV        "}
+};
+const uint8_t MODE_WAVEFORMS [NUMBER_OF_MODES] = {   // Inhale drive shape for each mode (see waveform.h)
+  WAVEFORM_LEGACY,
+  WAVEFORM_LEGACY,
+  WAVEFORM_LEGACY                                   // PCV: rise from PEEP to the set pressure
 };
 int currentMode = MODE_IPPV;
-int spontLEDFlashCount = 0;                  // A counter that causes the spontaneous mode LED to flash
-const int SPONT_LED_FLASH_START = 20;        // Number of times around the main control loop that spontaneous LED stays illuminated for
-const int SPONT_LED_FLASH_FINISH = 40;       // Total times around the main loop before the spontLEDFlashCount is reset
+const unsigned long SPONT_LED_FLASH_ON_MS = 500;      // Spontaneous mode LED stays illuminated this long ..
+const unsigned long SPONT_LED_FLASH_PERIOD_MS = 1000; // .. once every this long
 
-const float SPONT_PRESSURE_THRESHOLD = 5.0;          // The threshold below which a breath is initiated in spontaneous mode
+const uint8_t TRIGGER_SENSITIVITY = 5;               // 1 (needs a big effort) .. 10 (most sensitive), see trigger.h for what noise it takes
+const uint16_t TRIGGER_REFRACTORY_MS = 300;          // No triggering this soon after an exhale starts
 
 // Declare forward references ???!?!??!
 void updateDisplay();
-void calcTicksPerCycle(int respRate, float iERatio );
+void paramsFromSettings(VentParams &p);
+void commitSettings();
+void settingsForRecord(RecordedSettings &r);
+void settingsForStore(StoredSettings &s);
+bool settingsRestore(const StoredSettings &s);
+void bootReport();
+void breathLeds(int inhale, int exhale);
+void alarmIndicate();
+void acknowledgeAlarms();
+void alarmsFromLimits(AlarmLimits &limits);
 void ventControlInterrupt();
-void calibrate();
-void changeSettings();
-float getKnob(float settingMin, float settingMax, float currentVal, float setStep, const String & units_str);
-int getMode(int currentMode);
+void logTick(uint8_t events, int outputDrive);
+void startInhale(uint8_t &events, unsigned int startTick, bool patientTriggered);
+void pressureSampleInterrupt(uint16_t raw);
+void startCalibration();
+void calibrationReport(Print &out);
+uint16_t pressureToFiltered(int pressure);
+float filteredToPressure(uint16_t filtered);
+void breathReport();
+void uiStep();
+void uiEnter(int state);
+void selectButtonUpdate();
+void serialRequest();
+void serialCommand();
+uint8_t remoteSet(const uint8_t *values, uint8_t length);
+uint8_t settingsReply(uint8_t *reply);
+void taskTelemetry();
+void taskSerial();
+void taskUi();
+void taskLeds();
+void taskLcd();
+void taskPressureDisplay();
+void taskMemoryReport();
+float knobAdjust(float currentVal, int steps, float settingMin, float settingMax, float setStep);
+
+// Hardware variant, picked at compile time: -DVENT_ACTUATOR=..., -DVENT_TIMEBASE=..., -DVENT_DISPLAY=... (the defaults
+// are the V22 on unit: Timer1 PWM, Timer1 interrupt, LCD at 0x27)
+#if VENT_ACTUATOR == VENT_ACTUATOR_SERVO
+typedef ServoActuator<SERVO_PIN> Actuator;
+#elif VENT_ACTUATOR == VENT_ACTUATOR_CURRENT_LOOP
+typedef CurrentLoopActuator<PWM_PIN> Actuator;
+#else
+typedef PwmActuator<PWM_PIN> Actuator;
+#endif
+#if VENT_TIMEBASE == VENT_TIMEBASE_LOOP
+typedef LoopTimebase<ventControlInterrupt, TIME_BETWEEN_TICKS> Timebase;
+#else
+typedef Timer1Timebase<ventControlInterrupt, TIME_BETWEEN_TICKS> Timebase;
+#endif
+#if VENT_DISPLAY == VENT_DISPLAY_NONE
+typedef NoDisplay Display;
+#else
+typedef LcdDisplay<VENT_LCD_ADDRESS> Display;
+#endif
+
+// loop() tasks (scheduler.h) .. the shortest period has the highest priority. Budgets are for the Uno at 16 MHz
+const char TASK_TELEMETRY[] PROGMEM = "telemetry";
+const char TASK_SERIAL[] PROGMEM = "serial";
+const char TASK_UI[] PROGMEM = "ui";
+const char TASK_LEDS[] PROGMEM = "leds";
+const char TASK_LCD[] PROGMEM = "lcd";
+const char TASK_PRESSURE[] PROGMEM = "pressure";
+const char TASK_MEMORY[] PROGMEM = "memory";
+SchedulerTask tasks[] = {
+  { taskTelemetry, TASK_TELEMETRY, 5000, 1000 },        // Telemetry out to Serial .. the TX buffer holds 5 ms and more
+  { taskSerial, TASK_SERIAL, 10000, 1000 },             // Commands and requests, boot report, EEPROM (a report overruns)
+  { taskUi, TASK_UI, 10000, 1000 },                     // Settings menu, select button debounce
+  { taskLcd, TASK_LCD, 10000, 5000 },                   // LCD_FLUSH_CELLS_PER_RUN changed characters over I2C
+  { taskLeds, TASK_LEDS, 20000, 200 },                  // Alarm buzzer and LED, spontaneous LED
+  { taskPressureDisplay, TASK_PRESSURE, 250000, 1000 }, // Measured pressure on the display
+  { taskMemoryReport, TASK_MEMORY, MEMORY_REPORT_INTERVAL * 1000, 20000 },   // .. out at the baud rate
+};
 
 void setup()
 {
+  // Ventilation first: the settings, then the ADC and Timer1 .. the display and the self-test come after, and the
+  // self-test runs from loop() while the first breaths go
   pinMode(INHALE_LED, OUTPUT);            // These are the red and green LEDS that indicate the breathing state
   pinMode(EXHALE_LED, OUTPUT);
+  pinMode(SPONTANEOUS_LED, OUTPUT);
+  pinMode(BUZZER_PIN, OUTPUT);
   digitalWrite(INHALE_LED, LOW);
   digitalWrite(EXHALE_LED, LOW);
+  digitalWrite(BUZZER_PIN, LOW);
+
+  Serial.begin(SERIAL_BAUD_RATE);         // No waiting for the port .. on a native USB board that held ventilation up until a computer was attached
+  commandReset();                         // Commands come in over the same port (command.h)
+
+  StoredSettings stored;
+  settingsRestored = settingsStoreLoad(stored) && settingsRestore(stored);   // The last committed settings, if there are any
+  calibrationRestored = calibrationStoreLoad(calibrationMap) && calibrationMapValid(calibrationMap, RAW_ACTUATOR_MAX);
+  if (!calibrationRestored) {
+    calibrationMap.points = 0;                // Pressure proportional to drive, as before any sweep
+  }
 
-  //Initialize serial and wait for port to open:
-  Serial.begin(SERIAL_BAUD_RATE);
-  while (!Serial) {
-    ; // wait for serial port to connect. Needed for native USB port only
+  pinMode(SELECT_BUTTON, INPUT);        // input from centre button of the rotary encoder
+  rotaryBegin(ROTARY_CLK, ROTARY_DT, recorderKnob);   // Rotary encoder is decoded by pin interrupts from here on (rotary.h)
+
+  paramsFromSettings(params);                // Parameters for the first breath, straight in .. the control interrupt is not running yet
+  pcvTableStepQ16 = driveTableStep(WAVEFORM_SEGMENTS, PCV_RISE_MS * 1000 / TIME_BETWEEN_TICKS);
+  AlarmLimits limits;
+  alarmsFromLimits(limits);
+  alarmConfigure(limits);
+  TidalAdaptConfig adapt;
+  adapt.valveResistance = EXHALE_VALVE_RESISTANCE;
+  adapt.sampleSeconds = 1 / PRESSURE_FAST_RATE_HZ;
+  adapt.samplesPerTick = PRESSURE_SAMPLES_PER_TICK;
+  adapt.settleSamples = EXHALE_SETTLE_SAMPLES;
+  adapt.countsToPressure = PRESS_FILTERED_SCALE * PRESS_SENSOR_MULTIPLIER;
+  adapt.pressureLimit = pressureToFiltered(ALARM_HIGH_PRESSURE_OFF);   // Never learnt up into the over-pressure alarm
+  tidalAdaptConfigure(adapt);                // Correction of 1 .. before the first control tick reads it
+  newInspPressure = targetInspPressure;
+
+  if (RUN_DRIVE_BENCHMARK) {
+    driveBenchmark(Serial, TIDAL_MAX);     // Must run before Timer1 is taken over below
+  }
+  if (RUN_ACTUATOR_BENCHMARK) {
+    actuatorBenchmark(Serial);             // .. this too
   }
 
-  for (int thisPressReading = 0; thisPressReading< PRESS_READ_SMOOTHING; thisPressReading++) {
-    pressReadings[ thisPressReading ];
+  breathState = INHALE_STATE;
+  Serial.println(F("Motor to squeeze BVM"));
+
+  if (recordInputs) {
+    RecordedSettings settings;
+    settingsForRecord(settings);
+    recorderBegin(settings);                 // Before the ADC and Timer1 start .. the replay has to see every sample
   }
+  triggerConfigure(TRIGGER_SENSITIVITY, (uint32_t) TRIGGER_REFRACTORY_MS * PRESSURE_SAMPLE_RATE_HZ / PRESSURE_FILTER_DECIMATION / 1000);
+  pressureFilterReset();                     // Empty, as at power-up .. the alarms must not see a pressure from before a reset
+  breathMetricsReset();                      // .. nor the tidal adaptation a breath
+  pressureAdcBegin(PRESSURE_SENSOR_PIN, PRESSURE_SAMPLE_RATE_HZ, pressureSampleInterrupt);   // Pressure sampling and filtering run on their own from here on
 
+  profilerBegin(TIME_BETWEEN_TICKS);                            // Converts Timer1 counts to microseconds for the report
+  Timebase::begin();                                            // The control tick runs every TIME_BETWEEN_TICKS from here on (timebase.h)
 
-  // initialize the LCD
-  lcd.begin();
+  Actuator::begin(TIME_BETWEEN_TICKS);  // By default -set the controller to 'fully open'
 
-  // Turn on the blacklight and print a message.
-  lcd.backlight();
+  // initialize the display .. the control tick is running from here on
+  Display::begin();
   if (not PRODUCTION_CODE )  {
-    lcd.setCursor(0, 0);
-    lcd.print("Test software only");
-    lcd.setCursor(0, 1);
-    lcd.print("Not for medical use");
-    lcd.setCursor(0,3);
-    lcd.print("Software version V24");
-    for (int i = 1; i<=NUM_LED_TEST_LOOPS; i++) {                    // Just a visible self-test to show that all of the LEDs are working
-      digitalWrite(INHALE_LED,(i % NUM_OF_LEDS));
-      digitalWrite(EXHALE_LED,((i+1) % NUM_OF_LEDS));
-      digitalWrite(SPONTANEOUS_LED, ((i+2) % NUM_OF_LEDS));
-      delay(100);
-    }
-    delay(2000);
-    lcd.clear();
+    uiEnter(UI_SELF_TEST);              // Splash screen and LED test, stepped by the menu task .. the frame goes out a few characters a run
+  } else {
+    updateDisplay();
   }
-  updateDisplay();
 
-  pinMode(SELECT_BUTTON, INPUT);        // input from centre button of the rotary encoder
-  pinMode (ROTARY_CLK, INPUT);               // Input from CLK of rotary encoder
-  pinMode (ROTARY_DT, INPUT);               // Input from DT of rotary encoder
-  pinALast = digitalRead(ROTARY_CLK);        // Remember the state of the rotary encoder CLK
+  if (REPORT_MEMORY) {
+    memoryReport(Serial);             // Everything is set up .. how much SRAM is left
+  }
+  schedulerBegin(tasks, sizeof(tasks) / sizeof(tasks[0]));   // Each task first runs a period from now
+}
+
+void loop() {
+  Timebase::poll();                             // Runs the control tick if it is due .. only when it is not run by Timer1
+  profilerSectionBegin(PROFILE_LOOP);
+  schedulerRun();                               // One task, the highest priority of those that are due (scheduler.h)
+  profilerSectionEnd(PROFILE_LOOP);
+}
 
-  calcTicksPerCycle(respRate, iERatio );     // Update breath tick rates based on default RR and I.E.
+void taskTelemetry() {
+  profilerSectionBegin(PROFILE_TELEMETRY);
+  telemetryDrain(Serial);                       // Send whatever the control interrupt has logged since last time
+  recorderDrain(Serial);                        // .. and the recorded inputs, if recording
+  breathReport();                               // Once per breath .. the last breath's numbers
+  profilerSectionEnd(PROFILE_TELEMETRY);
+}
 
-  changeTime = millis();
-  breathState = INHALE_STATE;
-  Serial.println("Motor to squeeze BVM");
+void taskSerial() {
+  serialRequest();                              // Single-letter requests typed into the serial monitor
+  bootReport();                                 // Once, after the first control tick
+  settingsStorePoll();                          // A byte of the last commit into EEPROM, if the EEPROM is ready for it
+}
 
-  paramUpdateSemaphore = false;               // determines access to the control parameters. Set to TRUE when the parameters have been updated
+void taskUi() {
+  profilerSectionBegin(PROFILE_UI);
+  uiStep();                                     // Settings menu .. one step, never waits
+  profilerSectionEnd(PROFILE_UI);
+}
 
-  Timer1.initialize(TIME_BETWEEN_TICKS);                        // Set the timer interrupt
-  Timer1.attachInterrupt(ventControlInterrupt, TIME_BETWEEN_TICKS);    // Call the ventilator control loop 100 times per second (probably does not need to be that fast! )
+void taskLeds() {
+  alarmIndicate();                              // Buzzer, and the alarm on the display
+  if (selfTestLeds) {
+    // The self-test has the LEDs
+  } else if (alarmLatched()) {
+    // The alarm has the yellow LED (alarmIndicate)
+  } else if (currentMode == MODE_SPONTANEOUS ) {
+    digitalWrite(SPONTANEOUS_LED, (millis() % SPONT_LED_FLASH_PERIOD_MS) < SPONT_LED_FLASH_ON_MS ? HIGH : LOW);
+  } else {
+    digitalWrite(SPONTANEOUS_LED, LOW);
+  }
+}
 
+void taskLcd() {
+  profilerSectionBegin(PROFILE_LCD);
+  Display::flush(lcdFrame, LCD_FLUSH_CELLS_PER_RUN);   // Only the digits that changed go over I2C
+  profilerSectionEnd(PROFILE_LCD);
+}
 
-  Timer1.pwm(PWM_PIN, DRIVE_VAL_MIN); // By default -set the controller to 'fully open'
+void taskPressureDisplay() {
+  // Pressure for the display comes from the slow (display) channel of the pressure filter
+  profilerSectionBegin(PROFILE_PRESSURE);
+  inspPressure = filteredToPressure(pressureFilterSlow());                     // In this version measured rather than set
 
+  if (inspPressure < 0) {
+    inspPressure = 0;
+  }
+  if (uiState == UI_IDLE) {                     // The menu has the screen while settings are being changed
+    static char pressStr[15];
+    dtostrf(inspPressure,4,1,pressStr);
+    lcdFrame.setCursor(10, 0);
+    lcdFrame.print(pressStr);           // As measured by sensor
+    lcdFrame.setCursor(15,0);
+    lcdFrame.print(F("cmH2O"));
+  }
+  profilerSectionEnd(PROFILE_PRESSURE);
 }
 
-void loop() {
-  int selectButtonData = digitalRead(SELECT_BUTTON);
-  // Serial.println(selectButtonData);
-  if (selectButtonData == LOW && (millis() - changeTime) > 500) {
-    changeSettings();
+void taskMemoryReport() {
+  if (REPORT_MEMORY) {
+    memoryReport(Serial);                       // The stack high-water mark takes in everything that has run since reset
   }
+}
 
-  // Now read the pressure from the sensor
- // subtract the last reading:
-  pressTotal = pressTotal - pressReadings[pressReadIndex];
-  // read from the sensor:
-  pressReadings[ pressReadIndex ] = analogRead( PRESSURE_SENSOR_PIN );
-  // add the reading to the total:
-  pressTotal = pressTotal + pressReadings[ pressReadIndex ];
-  // advance to the next position in the array:
-  pressReadIndex = pressReadIndex + 1;
+void breathReport() {
+  // The control interrupt publishes each breath as the next one starts. It goes out as a telemetry frame (held over
+  // to the next run if the TX buffer is full), and PIP and PEEP go on the third line of the display
+  static BreathMetrics breath;
+  static bool unsent = false;
+  if (breathMetricsTake(breath)) {
+    unsent = true;
+    if (adaptTidal && (currentMode != MODE_PCV)) {
+      tidalAdaptBreath(breath, tidal);          // The correction for the breath after next (tidal_adapt.h)
+    }
+    if (uiState == UI_IDLE) {
+      static char valueStr[8];
+      lcdFrame.setCursor(0, 2);
+      lcdFrame.print(F("PIP"));
+      lcdFrame.print(dtostrf(filteredToPressure(breath.pip), 5, 1, valueStr));
+      lcdFrame.setCursor(10, 2);
+      lcdFrame.print(F("PEEP"));
+      lcdFrame.print(dtostrf(filteredToPressure(breath.peep), 5, 1, valueStr));
+    }
+  }
+  if (unsent) {
+    uint8_t payload[BREATH_METRICS_BYTES];
+    breathMetricsPack(breath, payload);
+    unsent = not telemetrySendFrame(Serial, TELEMETRY_FRAME_BREATH, payload, BREATH_METRICS_BYTES);
+  }
+}
 
-  // if we're at the end of the array...
-  if ( pressReadIndex >= PRESS_READ_SMOOTHING ) {
-    // ...wrap around to the beginning:
-    pressReadIndex = 0;
+void serialRequest() {
+  // Command frames (command.h), and outside them the single letters typed into the serial monitor: 'p' profiler report,
+  // 'r' clear the profiler and the task counters, 'm' memory report, 'c' calibration map, 'a' acknowledge the alarms,
+  // 's' task report, 'v' tidal adaptation on / off .. anything else is ignored. Everything that has come in, unless the
+  // TX buffer has no room for a reply .. then the rest waits in the RX buffer for the next run
+  while (Serial.available() > 0) {
+    if (Serial.availableForWrite() < COMMAND_REPLY_MAX + TELEMETRY_FRAME_OVERHEAD) {
+      return;
+    }
+    int c = Serial.read();
+    switch (commandFeed(c)) {
+      case COMMAND_FEED_FRAME:
+        serialCommand();
+        break;
+      case COMMAND_FEED_TEXT:
+        switch (c) {
+          case 'p':
+            profilerReport(Serial);
+            break;
+          case 'r':
+            profilerReset();
+            schedulerReset();
+            break;
+          case 'm':
+            memoryReport(Serial);
+            break;
+          case 'c':
+            calibrationReport(Serial);
+            break;
+          case 'a':
+            acknowledgeAlarms();
+            break;
+          case 's':
+            schedulerReport(Serial);
+            break;
+          case 'v':
+            adaptTidal = not adaptTidal;
+            tidalAdaptReset();
+            Serial.println(adaptTidal ? F("tidal adaptation on") : F("tidal adaptation off"));
+            break;
+        }
+        break;
+      default:
+        break;
+    }
   }
+}
 
-  // calculate the average:
-  int sensorValue = pressTotal / PRESS_READ_SMOOTHING;
-  inspPressure = sensorValue * PRESS_SENSOR_MULTIPLIER + PRESS_SENSOR_CONSTANT ;                     // In this version measured rather than set
+void serialCommand() {
+  // Answer the command frame just received (command.h) .. serialRequest() has made sure there is room for the reply
+  const uint8_t *in = commandPayload();
+  uint8_t length = commandLength();
+  uint8_t reply[COMMAND_REPLY_MAX];
+  uint8_t replyLength = 3;
+  uint8_t status = COMMAND_STATUS_OK;
+  switch (commandType()) {
+    case COMMAND_GET:
+      if (length != 1) {
+        status = COMMAND_STATUS_LENGTH;
+      }
+      break;
+    case COMMAND_SET:
+      if ((length < 1) || ((length - 1) % 3 != 0)) {
+        status = COMMAND_STATUS_LENGTH;
+      } else {
+        status = remoteSet(in + 1, length - 1);
+      }
+      break;
+    case COMMAND_STATUS:
+      if (length != 1) {
+        status = COMMAND_STATUS_LENGTH;
+        break;
+      }
+      {
+        float measured = filteredToPressure(pressureFilterSlow()) * 10;
+        int pressure = int(measured + (measured < 0 ? -0.5 : 0.5));
+        noInterrupts();
+        unsigned int ticks = controlTicks;
+        interrupts();
+        reply[3] = breathState;
+        reply[4] = alarmActive();
+        reply[5] = alarmLatched();
+        reply[6] = pressure & 0xFF;
+        reply[7] = (pressure >> 8) & 0xFF;
+        reply[8] = ticks & 0xFF;
+        reply[9] = ticks >> 8;
+        replyLength = COMMAND_STATUS_REPLY_BYTES;
+      }
+      break;
+    default:
+      status = COMMAND_STATUS_UNKNOWN;
+      break;
+  }
+  if ((commandType() == COMMAND_GET || commandType() == COMMAND_SET) && status != COMMAND_STATUS_LENGTH) {
+    replyLength = settingsReply(reply);          // What is set now .. after the change, or as it was if it was refused
+  }
+  reply[0] = length ? in[0] : 0;                 // the sequence number
+  reply[1] = commandType();
+  reply[2] = status;
+  telemetrySendFrame(Serial, TELEMETRY_FRAME_REPLY, reply, replyLength);
+}
 
-  if (inspPressure < 0) {
-    inspPressure = 0;
+uint8_t remoteSet(const uint8_t *values, uint8_t length) {
+  // A COMMAND_SET: the settings as they are, with the changes, taken only if all of them are in range .. then committed
+  // as the menu commits them
+  if ((uiState != UI_IDLE) && (uiState != UI_SELF_TEST)) {
+    return COMMAND_STATUS_BUSY;                  // The menu has its own copy of the settings, or the sweep is running
   }
-  static char pressStr[15];
-  dtostrf(inspPressure,4,1,pressStr);
-  lcd.setCursor(10, 0);
-  lcd.print(pressStr);           // As measured by sensor
-  lcd.setCursor(15,0);
-  lcd.print("cmH2O");
-  // Serial.println(pressStr);
-
-  if (currentMode == MODE_SPONTANEOUS ) {
-    spontLEDFlashCount++;                         // Increate the count for flashing the LED
-    if (spontLEDFlashCount < SPONT_LED_FLASH_START) {
-          digitalWrite(SPONTANEOUS_LED, HIGH);
-    } else {
-      digitalWrite(SPONTANEOUS_LED,LOW);
+  StoredSettings s;
+  settingsForStore(s);
+  for (uint8_t i = 0; i < length; i += 3) {
+    int value = (int16_t) (values[i + 1] | (values[i + 2] << 8));
+    if ((value < 0) || ((values[i] != COMMAND_PARAM_TIDAL) && (value > 0xFF))) {
+      return COMMAND_STATUS_RANGE;
     }
-    if (spontLEDFlashCount >= SPONT_LED_FLASH_FINISH) {
-      spontLEDFlashCount = 0;
+    switch (values[i]) {
+      case COMMAND_PARAM_MODE:
+        s.mode = value;
+        break;
+      case COMMAND_PARAM_RESP_RATE:
+        s.respRate = value;
+        break;
+      case COMMAND_PARAM_TIDAL:
+        s.tidal = value;
+        break;
+      case COMMAND_PARAM_IE_RATIO:
+        s.iERatioTenths = value;
+        break;
+      case COMMAND_PARAM_INSP_PRESSURE:
+        s.inspPressure = value;
+        break;
+      default:
+        return COMMAND_STATUS_UNKNOWN;
     }
-  } else {
-    digitalWrite(SPONTANEOUS_LED, LOW);
   }
+  if (not settingsRestore(s)) {
+    return COMMAND_STATUS_RANGE;
+  }
+  RecordedSettings r;
+  settingsForRecord(r);
+  recorderRemoteSet(r);                          // The replay has no serial input .. it sets these as this does
+  commitSettings();
+  if (uiState == UI_IDLE) {
+    lcdFrame.clear();
+    updateDisplay();
+  }
+  return COMMAND_STATUS_OK;
+}
+
+uint8_t settingsReply(uint8_t *reply) {
+  // The settings last committed, from reply[3] on, in the COMMAND_GET layout .. returns the reply length
+  StoredSettings s;
+  settingsForStore(s);
+  reply[3] = s.mode;
+  reply[4] = s.respRate;
+  reply[5] = s.tidal & 0xFF;
+  reply[6] = s.tidal >> 8;
+  reply[7] = s.iERatioTenths;
+  reply[8] = s.inspPressure;
+  reply[9] = ventParamsPending() ? 1 : 0;
+  return COMMAND_GET_REPLY_BYTES;
 }
 
 void ventControlInterrupt() {
+  profilerTickEnter();                           // Before anything else .. Timer1 count at entry is the latency
+  if (recorderActive()) {
+    recorderTick(digitalRead(SELECT_BUTTON));    // Marks the tick in the recording, with the button as it is now
+  }
 
   tick = tick + 1;                               // This will be called, hence incremented every 'TIME_BETWEEN_TICKS' microseconds
+  controlTicks++;
+  if (firstTickUs == 0) {
+    firstTickUs = micros();                      // Reset to ventilating, for bootReport()
+  }
+  uint8_t events = 0;                            // TELEMETRY_EVENT_* that happen on this tick
+  int outputDrive = DRIVE_VAL_MIN;               // What actually went to the actuator on this tick
+
+  // While a calibration sweep (calibration.h) runs it has the actuator, and there are no breaths
+  // When it is over, breathing starts again from the beginning of an exhale
+  if (calibrationRunning()) {
+    pressureControlStop();
+    triggerDisarm();
+    outputDrive = calibrationTick(pressureFilterFast());
+    Actuator::write(outputDrive);
+    alarmPause();                                // The sweep goes up to CALIBRATION_PRESSURE_LIMIT on purpose
+    breathLeds(HIGH, HIGH);                      // Both on .. not ventilating
+    breathState = EXHALE_STATE;
+    breathClockReset(breathClock);
+    breathMetricsRestart();
+    tick = 0;
+    logTick(events, outputDrive);
+    profilerTickExit();
+    return;
+  }
 
-  // If we are in a spontaneous breathing mode, and during an Exhale the measured pressure falls below PEEP
-  // this means that the patient has sucked in air and therefore we need to trigger an inhalation
-  if ((currentMode == MODE_SPONTANEOUS) &&  (breathState == EXHALE_STATE)) {
-      int pressSensorRaw = analogRead( PRESSURE_SENSOR_PIN );                              // Get the instantaneous pressure
-      float inspPressure = pressSensorRaw * PRESS_SENSOR_MULTIPLIER + PRESS_SENSOR_CONSTANT;  // Convert to CM H20 (just for consistency)
-      if (inspPressure <= SPONT_PRESSURE_THRESHOLD) {                                      // PRessure is below PEEP .. implies that the patient is trying to breath in
-        tick = 0;
-        breathState = INHALE_STATE;
-        Serial.println("Patient triggered inhale");
-      }
-  } ;
+  // If we are in a spontaneous breathing mode, and during an Exhale the patient tries to breath in, we need to trigger an inhalation
+  // The trigger detector (trigger.h) watches every filtered pressure sample from the ADC interrupt .. here we only pick up its verdict
+  bool patientBreath = triggerTake() && (params.mode == MODE_SPONTANEOUS) && (breathState == EXHALE_STATE);
+  if (patientBreath) {
+    breathClockReset(breathClock);               // A new breath starts now .. the timed one it replaces never happened
+    startInhale(events, controlTicks, true);     // Drive starts on this tick
+    events |= TELEMETRY_EVENT_PATIENT_TRIGGER;
+  }
+
+  // Alarms (alarms.h) see this tick's pressure before the drive goes out, so the response is in force from this tick
+  uint8_t raised = alarmTick(pressureFilterFast(), breathState == INHALE_STATE, params.mode == MODE_SPONTANEOUS, patientBreath);
+  if (raised) {
+    events |= TELEMETRY_EVENT_ALARM;
+  }
+  if ((alarmActive() & ALARM_HIGH_PRESSURE) && (breathState == INHALE_STATE)) {
+    // Over-pressure .. the inhale ends now, and the exhale below takes the drive to DRIVE_VAL_MIN on this tick
+    events |= TELEMETRY_EVENT_EXHALE;
+    breathState = EXHALE_STATE;
+    tick = 0;
+    breathClock.inhale = 0;                      // Cut short .. nothing to carry
+    breathMetricsExhale(controlTicks, EXHALE_SETTLE_SAMPLES, params.exhaleSegmentSamples);
+    if (params.mode == MODE_SPONTANEOUS) {
+      triggerArm(pressureFilterFast());
+    }
+  } else if ((raised & ALARM_APNEA) && (breathState == EXHALE_STATE)) {
+    // No breath from the patient .. a backup breath now rather than at the end of the exhale
+    events |= TELEMETRY_EVENT_INHALE;
+    breathClockReset(breathClock);
+    startInhale(events, controlTicks, false);
+  }
 
 
   // Output the correct drive value to the actuator
   // This depends on if we are inhaling (breathState == INHALE_STATE) or exhaling (breathState = EXHALE_STATE)
   if (breathState == INHALE_STATE) {
-    positionInDriveTable = int((long) DRIVE_TABLE_SIZE * (long) tick / ticksPerInhale);       // How far down the drive table for drive value at this time (tick)?
-    if (positionInDriveTable > DRIVE_TABLE_SIZE) {
-      positionInDriveTable = DRIVE_TABLE_SIZE;
+    if (drivePosition == 0) {
+      breathDriveGain = driveGainCorrect(params.tidalDriveGain, tidalAdaptCorrection());   // Once a breath .. one gain for the whole inhale
+    }
+    drivePosition += (params.mode == MODE_PCV) ? pcvTableStepQ16 : params.driveTableStepQ16;  // How far down the drive table for drive value at this time (tick)?
+    unscaledDriveValue = waveformAt(MODE_WAVEFORMS[params.mode], drivePosition);     // Interpolated between table entries
+
+    if (params.mode == MODE_PCV) {
+      // The pressure loop drives the actuator from the ADC interrupt .. here the drive table only supplies its feedforward,
+      // scaled to the drive that would hold the target pressure
+      if (not pressureControlActive()) {
+        pressureControlStart(params.pcvTargetFiltered, pressureFilterFast());
+      }
+      driveValue = driveScale(unscaledDriveValue, params.pcvDriveGain);
+      pressureControlTrack(driveValue, unscaledDriveValue);
+      outputDrive = pressureControlOutput();
+    } else {
+      pressureControlStop();
+      driveValue = driveScale(unscaledDriveValue, breathDriveGain);                         // Scales the drive value as a proportion of the maximum allowed tidal volume
+      Actuator::write(driveValue);                                                    // To the actuator, whichever it is (actuator.h)
+      outputDrive = driveValue;
     }
-    unscaledDriveValue = INHALE_DRIVE[ positionInDriveTable ];
-    driveValue = unscaledDriveValue * (float) tidal / (float) TIDAL_MAX;              // Scales the drive value as a proportion of the maximum allowed tidal volume
-
-    Timer1.setPwmDuty(PWM_PIN, driveValue);                                           // PWM Output converted to 4-20mA control signal, externally
 
-    digitalWrite(INHALE_LED, HIGH);
-    digitalWrite(EXHALE_LED, LOW);
+    breathLeds(HIGH, LOW);
 
   } else {
     // by inference, we must be in the exhale state
-    // positionInDriveTable = 0;
 
-    Timer1.setPwmDuty(PWM_PIN, DRIVE_VAL_MIN);     // PWM Output converted to 4-20mA control signal externally
+    pressureControlStop();
+    Actuator::write(DRIVE_VAL_MIN);
 
-    digitalWrite(INHALE_LED, LOW);
-    digitalWrite(EXHALE_LED, HIGH);
+    breathLeds(LOW, HIGH);
 
   }
 
@@ -329,288 +843,578 @@ void ventControlInterrupt() {
   // This section manages the state transition
   // Depending on which state we are in (INHALE_STATE or EXHALE_STATE) .. we look at the elapsed time, and determine if it is time to change state
   // If it is time to change state, then we change the state (as stored in 'breathState')
+  // A phase that ends part way through a tick makes the same phase of the next breath that much shorter
 
-  if ((tick >= ticksPerInhale) && (breathState == INHALE_STATE))  {
+  bool phaseOver = breathClockStep(breathClock, params.timing, breathState == INHALE_STATE);
+  if (phaseOver && (breathState == INHALE_STATE))  {
     // Time to exhale
-    Serial.println("    Exhale");
+    events |= TELEMETRY_EVENT_EXHALE;
     breathState = EXHALE_STATE;              // switch to exhaling
     tick = 0;
-  };
-  if ((tick >= ticksPerExhale) && (breathState == EXHALE_STATE))  {
-    // Time to Inhale
-    Serial.println("Inhale");
-    breathState = INHALE_STATE;              // switch to inhaling
-    tick = 0;
-
-    // At the end of each cycle, check to see if control parameters have been updated
-    if (paramUpdateSemaphore == true) {            // Parameters have been updated, we need to use these on the next cycle
-      // inspPressure = newInspPressure;
-      respRate = newRespRate;
-      tidal = newTidal;
-      iERatio = newIERatio;
-      paramUpdateSemaphore = false;         // Signal that we have finished updating the control parameters
+    breathMetricsExhale(controlTicks + 1, EXHALE_SETTLE_SAMPLES, params.exhaleSegmentSamples);   // The state changes at the end of the tick .. exhale drive starts on the next
+    if (params.mode == MODE_SPONTANEOUS) {
+      triggerArm(pressureFilterFast());      // Start watching for the patient, from the pressure we are exhaling from
     }
+  } else if (phaseOver && (breathState == EXHALE_STATE))  {
+    // Time to Inhale
+    events |= TELEMETRY_EVENT_INHALE;
+    startInhale(events, controlTicks + 1, false);   // The state changes at the end of the tick .. inhale drive starts on the next
   }
 
+  logTick(events, outputDrive);
+  profilerTickExit();
 }
 
-void calcTicksPerCycle(int respRate, float iERatio ) {
-  // Calculates the number of clock cycles per inhale, exhale
-
-  int ticksPerBreath = TICKS_PER_MINUTE / respRate;
-  float iPlusE = 1 + iERatio;
-  ticksPerInhale = int ( ticksPerBreath / iPlusE);
-  ticksPerExhale = int ( ticksPerBreath * (iERatio / iPlusE));
-  //Serial.print("Ticks per inhale = ");
-  //Serial.println(ticksPerInhale);
-
-  //Serial.print("Ticks per exhale = ");
-  //Serial.println(ticksPerExhale);
-
+void startInhale(uint8_t &events, unsigned int startTick, bool patientTriggered) {
+  // Every breath starts here, however it was started (timed, by the patient, or as an apnea backup) .. so each one is a
+  // breath boundary for the settings as well
+  breathState = INHALE_STATE;
+  tick = 0;
+  drivePosition = 0;
+  triggerDisarm();
+  breathMetricsInhale(startTick, patientTriggered);
+
+  // Pick up the latest parameters committed from the menu or over serial (if any) .. tick counts and all
+  if (ventParamsAdopt(params)) {
+    breathClockReset(breathClock);           // The carry is in the old settings' units
+    events |= TELEMETRY_EVENT_PARAMS_ADOPTED;
+  }
 }
 
-
-void updateDisplay() {
-  // Turn on the blacklight and print a message.
-  lcd.setCursor(0, 0);
-  lcd.print(respRate);
-  lcd.setCursor(4, 0);
-  lcd.print("bpm |");
-
-  //lcd.setCursor(12, 0);
-  //lcd.print(inspPressure);           // As measured by sensor
-  lcd.setCursor(15, 0);
-  lcd.print("cmH20");
-
-  lcd.setCursor(0, 1);
-  lcd.print("________|___________");
-
-  lcd.setCursor(0, 2);
-  lcd.print("        |");
-
-  lcd.setCursor(0, 3);
-  lcd.print("1:");
-  lcd.print(iERatio);
-  lcd.setCursor(8, 3);
-  lcd.print("|");
-
-  lcd.setCursor(12, 3);
-  lcd.print(tidal);
-  lcd.setCursor(17, 3);
-  lcd.print("ml");
+void breathLeds(int inhale, int exhale) {
+  // Breath state on the LEDs .. unless the self-test is using them
+  if (not selfTestLeds) {
+    digitalWrite(INHALE_LED, inhale);
+    digitalWrite(EXHALE_LED, exhale);
+  }
 }
 
-void changeSettings() {
+void alarmIndicate() {
+  // Buzzer and yellow LED for the highest priority alarm (alarms.h): a fast beep for a high priority alarm, a slow one
+  // for the others, the LED on steady once the alarm is over but not yet acknowledged. Timed from millis() .. the LED
+  // task never waits on it
+  uint8_t latched = alarmLatched();
+  uint8_t active = alarmActive();
+  unsigned long now = millis();
+  if ((now - alarmSilenceStart) >= ALARM_SILENCE_MS) {
+    alarmsAcknowledged = 0;
+  }
+  alarmsAcknowledged &= latched;
 
-  lcd.clear();
+  bool on = false;
+  if (active) {
+    unsigned long period = (active & ALARM_HIGH_PRIORITY) ? ALARM_HIGH_PERIOD_MS : ALARM_MEDIUM_PERIOD_MS;
+    on = (now % period) < ALARM_BEEP_MS;
+  }
+  digitalWrite(BUZZER_PIN, (on && (active & ~alarmsAcknowledged)) ? HIGH : LOW);
+  if (latched && !selfTestLeds) {
+    digitalWrite(SPONTANEOUS_LED, (on || !active) ? HIGH : LOW);
+  }
 
-  // We don't actualy update the control parameters directly .. this is done within the control loop at the end of a cycle
-  // What we do here is to collect an updated set of parameters, and set a semaphore to indicate to the control loop to pick them up
-
-
-  // Next section triggers device calibration .. but only for non-production (test code).
-  if (not PRODUCTION_CODE) {
-    long int timeSelected = millis();                                          // Counts the number of loops that the select button has to be pushed for, before going into calibration mode
-    int selectButtonData = digitalRead(SELECT_BUTTON);
-    if (selectButtonData == LOW) {
-      lcd.setCursor(0, 0);
-      lcd.print("Keep button pushed");
-      lcd.setCursor(0, 1);
-      lcd.print("to calibrate");
-    }
-    while ((selectButtonData == LOW) && ((millis() - timeSelected) < ENTER_CALIBRATION )) {
-      selectButtonData = digitalRead(SELECT_BUTTON);
-    }
-    if ((selectButtonData == LOW) && ((millis() - timeSelected) >= ENTER_CALIBRATION )) {
-      calibrate();
+  // Second line of the display .. the separator when there is no alarm
+  uint8_t shown = alarmHighest(latched);
+  if ((uiState == UI_IDLE) && (shown != alarmShown)) {
+    alarmShown = shown;
+    lcdFrame.setCursor(0, 1);
+    if (shown) {
+      lcdFrame.print(F("! "));
+      lcdFrame.print(alarmName(shown));
+      lcdFrame.print(F("                  "));
+    } else {
+      lcdFrame.print(F("________|___________"));
     }
   }
+}
 
-  lcd.clear();
-  lcd.setCursor(0,0);
-  lcd.print("Mode:");
-  currentMode = getMode(currentMode);
+void acknowledgeAlarms() {
+  // Select in UI_IDLE, or 'a' over serial .. the alarms that are over are cleared, the buzzer stops for the rest
+  alarmAcknowledge();
+  alarmsAcknowledged = alarmLatched();
+  alarmSilenceStart = millis();
+}
 
+void alarmsFromLimits(AlarmLimits &limits) {
+  // The alarm limits in the units the control tick works in
+  limits.highOn = pressureToFiltered(ALARM_HIGH_PRESSURE_ON);
+  limits.highOff = pressureToFiltered(ALARM_HIGH_PRESSURE_OFF);
+  limits.disconnectOn = pressureToFiltered(ALARM_DISCONNECT_ON);
+  limits.disconnectOff = pressureToFiltered(ALARM_DISCONNECT_OFF);
+  limits.disconnectTicks = ALARM_DISCONNECT_TICKS;
+  limits.lowPeakOn = pressureToFiltered(ALARM_LOW_PEAK_ON);
+  limits.lowPeakOff = pressureToFiltered(ALARM_LOW_PEAK_OFF);
+  limits.lowPeakBreaths = ALARM_LOW_PEAK_BREATHS;
+  limits.apneaTicks = ALARM_APNEA_TICKS;
+}
 
-  // Serial.println("Respiratory rate");
-  lcd.clear();
-  lcd.setCursor(0, 0);
-  lcd.print("Respiratory rate:");
-  newRespRate = int(getKnob(RESP_RATE_MIN, RESP_RATE_MAX, respRate, RESP_RATE_STEP, "bpm"));
+void logTick(uint8_t events, int outputDrive) {
+  // Log this tick .. never blocks, if loop() has fallen behind the record is dropped and counted
+  // With a fast control tick only every TICKS_PER_TELEMETRY'th tick is logged, carrying the events of the ticks in between
+  telemetryEvents |= events;
+  if (++telemetryTicks >= TICKS_PER_TELEMETRY) {
+    TelemetryRecord record;
+    record.tick = controlTicks;
+    record.state = breathState;
+    record.events = telemetryEvents;
+    record.drive = outputDrive;
+    record.pressure = pressureAdcLatest();
+    telemetryPush(record);
+    telemetryEvents = 0;
+    telemetryTicks = 0;
+  }
+}
 
-  // Serial.println("Inspiratory Pressure");               // Not implemented in this version
-  // lcd.clear();
-  // lcd.setCursor(0, 0);
-  // lcd.print("Inspiratory Press:");
-  // newInspPressure = int(getKnob(INSP_PRESS_MIN, INSP_PRESS_MAX, inspPressure, 1.0, "cmH20"));
+void pressureSampleInterrupt(uint16_t raw) {
+  // Called from the ADC interrupt with every pressure sample
+  recorderSample(raw);                                                               // Does nothing unless recording
+  if (pressureFilterSample(raw)) {                                                   // A new fast-channel output (240 per second)
+    uint16_t pressure = pressureFilterFast();
+    if (pressureControlActive()) {
+      Actuator::write(pressureControlStep(pressure));                                 // PCV inner loop
+    }
+    triggerSample(pressure);                                                          // Does nothing unless armed (spontaneous exhale)
+    breathMetricsSample(pressure);
+    alarmSample(pressure);
+  }
+}
 
-  // Serial.println("I.E. Ratio");
-  lcd.clear();
-  lcd.setCursor(0, 0);
-  lcd.print("I.E. Ratio:");
-  newIERatio = getKnob(I_E_RATIO_MIN, I_E_RATIO_MAX, iERatio, I_E_RATIO_STEP, "");
+uint16_t pressureToFiltered(int pressure) {
+  // cmH2O to the filtered sensor units (Q4 raw counts) that the control interrupts work in
+  return (pressure - PRESS_SENSOR_CONSTANT) / PRESS_SENSOR_MULTIPLIER / PRESS_FILTERED_SCALE;
+}
 
-  // Serial.println("TIDAL");
-  lcd.clear();
-  lcd.setCursor(0, 0);
-  lcd.print("TIDAL:");
-  newTidal = int(getKnob(TIDAL_MIN, TIDAL_MAX, tidal, TIDAL_STEP, "ml"));
+float filteredToPressure(uint16_t filtered) {
+  // Filtered sensor units (Q4 raw counts) to cmH2O
+  return filtered * PRESS_FILTERED_SCALE * PRESS_SENSOR_MULTIPLIER + PRESS_SENSOR_CONSTANT;
+}
 
-  // Now signal to the interrup-driven control loop that it can pick up the new control parameters when it is ready to do to (at the start of a cycle)
-  Timer1.stop();                   // Halt the interrupt so that there is no chance of a race condition
-  paramUpdateSemaphore = true;     // Inform the main control loop that it can pick up the new control parameters
-  Timer1.start();                  // Re-start the main control-loop interrupt
+void paramsFromSettings(VentParams &p) {
+  // The control interrupt's parameters for the current settings .. every division is done here, none in the interrupt
+  p.mode = currentMode;
+  p.respRate = respRate;
+  p.tidal = tidal;
+  p.iERatio = iERatio;
+  p.inspPressure = targetInspPressure;
+
+  // Phase lengths for the breath timebase .. I:E goes over in tenths, as the menu steps it
+  breathTimingSet(p.timing, respRate, int(iERatio * BREATH_IE_SCALE + 0.5), TIME_BETWEEN_TICKS);
+
+  p.driveTableStepQ16 = driveTableStep(WAVEFORM_SEGMENTS, breathTimingInhaleTicks(p.timing));
+  p.tidalDriveGain = driveGain(tidal, TIDAL_MAX);
+  float exhaleSeconds = 60.0 * iERatio / (respRate * (1 + iERatio));
+  p.exhaleSegmentSamples = exhaleSeconds * PRESSURE_FAST_RATE_HZ * EXHALE_FIT_SHARE / BREATH_EXHALE_SEGMENT_COUNT;
+  p.pcvTargetFiltered = pressureToFiltered(targetInspPressure);
+  if (calibrationMap.points > 0) {
+    p.pcvDriveGain = driveGain(calibrationDriveFor(calibrationMap, p.pcvTargetFiltered), RAW_ACTUATOR_MAX);   // As measured
+  } else {
+    p.pcvDriveGain = driveGain(targetInspPressure, ACTUATOR_PRESSURE_MAX);   // Pressure taken as proportional to drive
+  }
+}
 
-  lcd.clear();
-  lcd.setCursor(0, 0);
-  lcd.print("Adjusting ...");
+void commitSettings() {
+  // Hand the settings to the control interrupt .. it swaps them in at the start of the next breath. Never waits
+  VentParams p;
+  paramsFromSettings(p);
+  ventParamsCommit(p);
 
-  while (paramUpdateSemaphore) {};  // wait until this update has been picked up
+  RecordedSettings r;
+  settingsForRecord(r);
+  recorderSettings(r);
 
-  // Finished sending updated parameters to control loop
+  StoredSettings stored;
+  settingsForStore(stored);
+  settingsStoreSave(stored);                     // Goes into EEPROM a byte at a time from the serial task (settingsStorePoll)
+}
 
+void settingsForRecord(RecordedSettings &r) {
+  r.mode = currentMode;
+  r.respRate = respRate;
+  r.tidal = tidal;
+  r.iERatioTenths = int(iERatio * BREATH_IE_SCALE + 0.5);
+  r.inspPressure = targetInspPressure;
+}
 
-  lcd.clear();
-  updateDisplay();
+void settingsForStore(StoredSettings &s) {
+  s.mode = currentMode;
+  s.respRate = respRate;
+  s.tidal = tidal;
+  s.iERatioTenths = int(iERatio * BREATH_IE_SCALE + 0.5);
+  s.inspPressure = targetInspPressure;
+}
 
-  calcTicksPerCycle(respRate, iERatio );           // Update the breath cycles based on the new settings of RR and I.E. ratio
+bool settingsRestore(const StoredSettings &s) {
+  // Settings from EEPROM, or a remote set (command.h) .. only taken if every one of them is something the menu could
+  // have set
+  if ((s.mode >= NUMBER_OF_MODES) ||
+      (s.respRate < RESP_RATE_MIN) || (s.respRate > RESP_RATE_MAX) ||
+      (s.tidal < TIDAL_MIN) || (s.tidal > TIDAL_MAX) ||
+      (s.iERatioTenths < int(I_E_RATIO_MIN * BREATH_IE_SCALE + 0.5)) || (s.iERatioTenths > int(I_E_RATIO_MAX * BREATH_IE_SCALE + 0.5)) ||
+      (s.inspPressure < INSP_PRESS_MIN) || (s.inspPressure > INSP_PRESS_MAX)) {
+    return false;
+  }
+  currentMode = s.mode;
+  respRate = newRespRate = s.respRate;
+  tidal = newTidal = s.tidal;
+  iERatio = newIERatio = s.iERatioTenths / float(BREATH_IE_SCALE);
+  targetInspPressure = newInspPressure = s.inspPressure;
+  return true;
+}
 
-  changeTime = millis(); // manage the keyboard de-bounce
+void bootReport() {
+  // Once, as soon as the control interrupt has run .. how long from reset (not counting the bootloader) to ventilating
+  if (bootReported) {
+    return;
+  }
+  noInterrupts();
+  unsigned long ventilatingUs = firstTickUs;
+  interrupts();
+  if (ventilatingUs == 0) {
+    return;
+  }
+  bootReported = true;
+  Serial.print(F("boot: ventilating "));
+  Serial.print(ventilatingUs / 1000);
+  Serial.print(F(" ms after reset, "));
+  if (settingsRestored) {
+    Serial.print(F("settings from EEPROM record "));
+    Serial.println(settingsStoreSequence());
+  } else {
+    Serial.println(F("default settings"));
+  }
+  if (calibrationRestored) {
+    Serial.print(F("boot: calibration from EEPROM record "));
+    Serial.println(calibrationStoreSequence());
+  } else {
+    Serial.println(F("boot: not calibrated"));
+  }
 }
 
-float getKnob(float settingMin, float settingMax, float currentVal, float setStep, const String & units_str) {
 
-  int selectButtonData = digitalRead(SELECT_BUTTON);
-  int aVal;
-  boolean bCW;
+void updateDisplay() {
+  // Turn on the blacklight and print a message.
+  lcdFrame.setCursor(0, 0);
+  lcdFrame.print(respRate);
+  lcdFrame.setCursor(4, 0);
+  lcdFrame.print(F("bpm |"));
 
-  // wait for the selection button to go get released again
-  while (selectButtonData == LOW) {
-    selectButtonData = digitalRead(SELECT_BUTTON);
-    // Serial.println(selectButtonData);
+  //lcd.setCursor(12, 0);
+  //lcd.print(inspPressure);           // As measured by sensor
+  lcdFrame.setCursor(15, 0);
+  lcdFrame.print(F("cmH2O"));
+
+  lcdFrame.setCursor(0, 1);
+  lcdFrame.print(F("________|___________"));
+  alarmShown = 0xFF;                             // .. unless there is an alarm to show there (alarmIndicate)
+
+  lcdFrame.setCursor(0, 2);
+  lcdFrame.print(F("        |"));
+
+  lcdFrame.setCursor(0, 3);
+  lcdFrame.print(F("1:"));
+  lcdFrame.print(iERatio);
+  lcdFrame.setCursor(8, 3);
+  lcdFrame.print(F("|"));
+
+  lcdFrame.setCursor(9, 3);
+  if (currentMode == MODE_PCV) {
+    lcdFrame.print(F("  P"));                      // Set inspiratory pressure in place of the tidal volume
+    lcdFrame.print(targetInspPressure);
+    lcdFrame.print(F("  "));
+    lcdFrame.setCursor(15, 3);
+    lcdFrame.print(F("cmH2O"));
+  } else {
+    lcdFrame.print(F("   "));
+    lcdFrame.print(tidal);
+    lcdFrame.print(F("  "));
+    lcdFrame.setCursor(15, 3);
+    lcdFrame.print(F("  ml "));
   }
+}
 
-  while (selectButtonData == HIGH) {
-
-    aVal = digitalRead(ROTARY_CLK);
-    if (aVal != pinALast) { // Means the knob is rotating
-      // if the knob is rotating, we need to determine direction
-      // We do that by reading pin B.
-      if (digitalRead(ROTARY_DT) != aVal) {  // Means pin A Changed first - We're Rotating Clockwise
-        bCW = true;
-      } else {// Otherwise B changed first and we're moving CCW
-        bCW = false;
-      }
-      // Serial.print ("Rotated: ");
-      if (bCW) {
-        // Serial.println ("clockwise");
-        if (currentVal < (settingMax - setStep)) {
-          currentVal = currentVal + setStep;
-        }
-      } else {
-        // Serial.println("counterclockwise");
-        if (currentVal > (settingMin + setStep)) {
-          currentVal = currentVal - setStep;
-        }
-      }
-    }
-    pinALast = aVal;
-
-    lcd.setCursor(2, 2);
-    lcd.print(currentVal);
-    lcd.print("  ");
-    lcd.setCursor(15, 2);
-    lcd.print(units_str);
-    selectButtonData = digitalRead(SELECT_BUTTON);
+void selectButtonUpdate() {
+  // Debounce the select button .. the level has to hold for BUTTON_DEBOUNCE_MS before it counts
+  int reading = digitalRead(SELECT_BUTTON);
+  unsigned long now = millis();
+  selectPressed = false;
+  if (reading != selectLastReading) {
+    selectLastReading = reading;
+    selectChangeTime = now;
+  } else if ((reading != selectStable) && ((now - selectChangeTime) >= BUTTON_DEBOUNCE_MS)) {
+    selectStable = reading;
+    selectPressed = (reading == LOW);            // Button pulls the pin low
   }
+}
 
+float knobAdjust(float currentVal, int steps, float settingMin, float settingMax, float setStep) {
+  // Move a setting by a number of knob steps, stopping at (and able to reach) either end of its range
+  currentVal = currentVal + steps * setStep;
+  if (currentVal > settingMax) {
+    currentVal = settingMax;
+  }
+  if (currentVal < settingMin) {
+    currentVal = settingMin;
+  }
   return (currentVal);
 }
 
-int getMode(int currentMode) {
-
-  int selectButtonData = digitalRead(SELECT_BUTTON);
-  int aVal;
-  boolean bCW;
-
-  // wait for the selection button to go get released again
-  while (selectButtonData == LOW) {
-    selectButtonData = digitalRead(SELECT_BUTTON);
-    // Serial.println(selectButtonData);
+void uiEnter(int state) {
+  // Draw the heading for a menu state .. the value itself is drawn by uiStep() when uiRedraw is set
+  uiState = state;
+  uiRedraw = true;
+  lcdFrame.clear();
+  lcdFrame.setCursor(0, 0);
+  switch (state) {
+    case UI_SELF_TEST:
+      lcdFrame.print(F("Test software only"));
+      lcdFrame.setCursor(0, 1);
+      lcdFrame.print(F("Not for medical use"));
+      lcdFrame.setCursor(0, 3);
+      lcdFrame.print(F("Software version V46"));
+      selfTestStart = millis();
+      ledFlashCount = 0;
+      selfTestLeds = true;
+      break;
+    case UI_HOLD:
+      lcdFrame.print(F("Keep button pushed"));
+      lcdFrame.setCursor(0, 1);
+      lcdFrame.print(F("to calibrate"));
+      break;
+    case UI_CALIBRATE:
+      lcdFrame.print(F("Calibrating"));
+      lcdFrame.setCursor(0, 3);
+      lcdFrame.print(F("Push to stop"));
+      break;
+    case UI_MODE:
+      lcdFrame.print(F("Mode:"));
+      break;
+    case UI_RESP_RATE:
+      lcdFrame.print(F("Respiratory rate:"));
+      lcdFrame.setCursor(15, 2);
+      lcdFrame.print(F("bpm"));
+      break;
+    case UI_INSP_PRESSURE:
+      lcdFrame.print(F("Inspiratory Press:"));
+      lcdFrame.setCursor(15, 2);
+      lcdFrame.print(F("cmH2O"));
+      break;
+    case UI_IE_RATIO:
+      lcdFrame.print(F("I.E. Ratio:"));
+      break;
+    case UI_TIDAL:
+      lcdFrame.print(F("TIDAL:"));
+      lcdFrame.setCursor(15, 2);
+      lcdFrame.print(F("ml"));
+      break;
   }
+}
 
-  while (selectButtonData == HIGH) {
+void uiStep() {
+  // One step of the settings menu per run of its task .. nothing in here waits for the user or for the control loop.
+  // We don't actualy update the control parameters directly .. this is done within the control loop at the end of a cycle
+  // What we do here is to collect an updated set of parameters, and commit them for the control loop to pick up (commitSettings)
+  selectButtonUpdate();
+  int steps = rotaryTakeSteps();                 // Knob steps since the last step (counted by the encoder interrupt)
+
+  switch (uiState) {
+    case UI_SELF_TEST:
+      {
+        // Just a visible self-test to show that all of the LEDs are working .. then the splash screen stays up a while
+        unsigned long elapsed = millis() - selfTestStart;
+        if (selectPressed || (elapsed >= NUM_LED_TEST_LOOPS * LED_TEST_STEP_MS + SPLASH_HOLD_MS)) {
+          selfTestLeds = false;                  // The control interrupt sets the breath LEDs again from its next tick
+          digitalWrite(SPONTANEOUS_LED, LOW);
+          lcdFrame.clear();
+          updateDisplay();
+          uiState = UI_IDLE;
+          return;
+        }
+        int i = (elapsed < NUM_LED_TEST_LOOPS * LED_TEST_STEP_MS) ? elapsed / LED_TEST_STEP_MS + 1 : NUM_LED_TEST_LOOPS;
+        if (i != ledFlashCount) {
+          ledFlashCount = i;
+          digitalWrite(INHALE_LED, (i % NUM_OF_LEDS));
+          digitalWrite(EXHALE_LED, ((i + 1) % NUM_OF_LEDS));
+          digitalWrite(SPONTANEOUS_LED, ((i + 2) % NUM_OF_LEDS));
+        }
+      }
+      break;
+
+    case UI_IDLE:
+      if (selectPressed && (alarmLatched() & ~alarmsAcknowledged)) {
+        acknowledgeAlarms();                     // An alarm not yet acknowledged has the button .. the next press is the menu's
+      } else if (selectPressed) {
+        uiHoldStart = millis();
+        if (not PRODUCTION_CODE) {
+          uiEnter(UI_HOLD);                      // Calibration is only reachable in non-production (test code)
+        } else {
+          newMode = currentMode;
+          uiEnter(UI_MODE);
+        }
+      }
+      break;
+
+    case UI_HOLD:
+      if (selectStable == HIGH) {                // Let go before the calibration time .. on into the menu
+        newMode = currentMode;
+        uiEnter(UI_MODE);
+      } else if ((millis() - uiHoldStart) >= ENTER_CALIBRATION) {
+        startCalibration();
+        uiEnter(UI_CALIBRATE);
+      }
+      break;
 
-    aVal = digitalRead(ROTARY_CLK);
-    if (aVal != pinALast) { // Means the knob is rotating
-      // if the knob is rotating, we need to determine direction
-      // We do that by reading pin B.
-      if (digitalRead(ROTARY_DT) != aVal) {  // Means pin A Changed first - We're Rotating Clockwise
-        bCW = true;
-      } else {// Otherwise B changed first and we're moving CCW
-        bCW = false;
+    case UI_CALIBRATE:
+      if (selectPressed) {
+        calibrationAbort();
+      }
+      if (calibrationState() == CALIBRATION_RUNNING) {
+        lcdFrame.setCursor(0, 1);
+        lcdFrame.print(F("Point "));
+        lcdFrame.print(calibrationPoint() + 1);
+        lcdFrame.print(F("/"));
+        lcdFrame.print(CALIBRATION_POINTS);
+        lcdFrame.print(F(" "));
+        lcdFrame.setCursor(0, 2);
+        lcdFrame.print(inspPressure, 1);
+        lcdFrame.print(F(" cmH2O  "));
+        break;
       }
-      // Serial.print ("Rotated: ");
-      if (bCW) {
-        // Serial.println ("clockwise");
-          currentMode++;
-          if (currentMode >= NUMBER_OF_MODES) {
-            currentMode = 0;
+      if (calibrationTakeResult(calibrationMap)) {
+        calibrationReport(Serial);
+        calibrationStoreSave(calibrationMap);    // Into EEPROM after any settings waiting, so a reset keeps it
+        commitSettings();                        // PCV picks up the new map from the next breath
+      }
+      lcdFrame.clear();
+      updateDisplay();
+      uiState = UI_IDLE;
+      return;
+
+    case UI_MODE:
+      if (steps != 0) {
+        newMode = (newMode + steps) % NUMBER_OF_MODES;
+        if (newMode < 0) {
+          newMode = newMode + NUMBER_OF_MODES;
         }
-      } else {
-        // Serial.println("counterclockwise");
-          currentMode--;
-          if (currentMode <0) {
-            currentMode = ( NUMBER_OF_MODES - 1);  // array index is zero based remember
+        uiRedraw = true;
+      }
+      if (uiRedraw) {
+        lcdFrame.setCursor(2, 2);
+        lcdFrame.print(FLASH_STRING(modeStrings[newMode]));
+      }
+      if (selectPressed) {
+        newRespRate = respRate;
+        uiEnter(UI_RESP_RATE);
+        return;
+      }
+      break;
+
+    case UI_RESP_RATE:
+      if (steps != 0) {
+        newRespRate = int(knobAdjust(newRespRate, steps, RESP_RATE_MIN, RESP_RATE_MAX, RESP_RATE_STEP));
+        uiRedraw = true;
+      }
+      if (uiRedraw) {
+        lcdFrame.setCursor(2, 2);
+        lcdFrame.print(newRespRate);
+        lcdFrame.print(F("  "));
+      }
+      if (selectPressed) {
+        if (newMode == MODE_PCV) {
+          newInspPressure = targetInspPressure;
+          uiEnter(UI_INSP_PRESSURE);
+        } else {
+          newIERatio = iERatio;
+          uiEnter(UI_IE_RATIO);
         }
+        return;
       }
-    }
-    pinALast = aVal;
+      break;
 
-    lcd.setCursor(2, 2);
-    lcd.print(modeStrings[currentMode]);
+    case UI_INSP_PRESSURE:
+      if (steps != 0) {
+        newInspPressure = int(knobAdjust(newInspPressure, steps, INSP_PRESS_MIN, INSP_PRESS_MAX, INSP_PRESS_STEP));
+        uiRedraw = true;
+      }
+      if (uiRedraw) {
+        lcdFrame.setCursor(2, 2);
+        lcdFrame.print(newInspPressure);
+        lcdFrame.print(F("  "));
+      }
+      if (selectPressed) {
+        newIERatio = iERatio;
+        uiEnter(UI_IE_RATIO);
+        return;
+      }
+      break;
 
-    selectButtonData = digitalRead(SELECT_BUTTON);
-  }
+    case UI_IE_RATIO:
+      if (steps != 0) {
+        newIERatio = knobAdjust(newIERatio, steps, I_E_RATIO_MIN, I_E_RATIO_MAX, I_E_RATIO_STEP);
+        uiRedraw = true;
+      }
+      if (uiRedraw) {
+        lcdFrame.setCursor(2, 2);
+        lcdFrame.print(newIERatio);
+        lcdFrame.print(F("  "));
+      }
+      if (selectPressed) {
+        newTidal = tidal;
+        uiEnter(UI_TIDAL);
+        return;
+      }
+      break;
 
-  return (currentMode);
+    case UI_TIDAL:
+      if (steps != 0) {
+        newTidal = int(knobAdjust(newTidal, steps, TIDAL_MIN, TIDAL_MAX, TIDAL_STEP));
+        uiRedraw = true;
+      }
+      if (uiRedraw) {
+        lcdFrame.setCursor(2, 2);
+        lcdFrame.print(newTidal);
+        lcdFrame.print(F("  "));
+      }
+      if (selectPressed) {
+        currentMode = newMode;
+        respRate = newRespRate;
+        targetInspPressure = newInspPressure;
+        iERatio = newIERatio;
+        tidal = newTidal;
+        // Now hand the new control parameters to the interrupt-driven control loop, which picks them up at the start of the next breath
+        commitSettings();
+        lcdFrame.clear();
+        updateDisplay();
+        uiState = UI_IDLE;
+        return;
+      }
+      break;
+  }
+  uiRedraw = false;
 }
 
 
 
 
-void calibrate() {
-  Timer1.stop();                   // Halt the main control interrupt - we are now in calibration mode
-  Timer1.detachInterrupt();
-  Timer1.pwm(PWM_PIN, RAW_ACTUATOR_MIN);
-
-  int rawActuatorSetting  = RAW_ACTUATOR_MIN;             // set the actuator to its minumum value
-  int lastRawActSetting = RAW_ACTUATOR_MIN;
-  int setting = RAW_ACTUATOR_MIN;
-
-  lcd.clear();
-  lcd.print("Calibration mode");
+void startCalibration() {
+  // Sweep the actuator from the control tick (calibration.h) .. loop() and the display carry on
+  calibrationStart(RAW_ACTUATOR_MIN, RAW_ACTUATOR_MAX, pressureToFiltered(CALIBRATION_PRESSURE_LIMIT),
+                   CALIBRATION_RAMP_PER_S, TIME_BETWEEN_TICKS);
+}
 
-  while (1) {                        // lock-up .. no exit from here without hard-reset!
-    lcd.setCursor(0, 1);
-    lcd.print("Raw actuator value:");
-    rawActuatorSetting = int(getKnob(RAW_ACTUATOR_MIN, RAW_ACTUATOR_MAX, lastRawActSetting, RAW_ACTUATOR_STEP, "(raw)"));
-    if (rawActuatorSetting > lastRawActSetting) {
-      for (setting = lastRawActSetting; setting <= rawActuatorSetting; setting++) {
-        Timer1.setPwmDuty(PWM_PIN, setting);
-        delay(5);                                       // slow things down to remove abrupt changes
-      }
-    } else {
-      for (setting = lastRawActSetting;  setting >= rawActuatorSetting; setting--) {
-        Timer1.setPwmDuty(PWM_PIN, setting);
-        delay(5);                                       // slow things down to remove abrupt changes
-      }
-    }
-    lastRawActSetting = rawActuatorSetting;
-    int pressureRaw = analogRead( PRESSURE_SENSOR_PIN );                 // Read the raw input from the pressure sensor
-    lcd.setCursor(0,3);
-    lcd.print("Raw pressure =      ");
-    lcd.setCursor(16,3);
-    lcd.print(pressureRaw);
+void calibrationReport(Print &out) {
+  // The calibration map over serial, one point per line
+  if (calibrationMap.points == 0) {
+    out.println(F("cal: not calibrated"));
+    return;
+  }
+  for (uint8_t i = 0; i < calibrationMap.points; i++) {
+    out.print(F("cal: drive "));
+    out.print(calibrationMap.drive[i]);
+    out.print(F(" = "));
+    out.print(filteredToPressure(calibrationMap.pressure[i]), 1);
+    out.println(F(" cmH2O"));
+  }
+  if (calibrationMap.unsettled > 0) {
+    out.print(F("cal: "));
+    out.print(calibrationMap.unsettled);
+    out.println(F(" points did not settle"));
   }
 }
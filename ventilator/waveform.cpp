@@ -0,0 +1,96 @@
+#include "waveform.h"
+
+// Every table is generated here at compile time. Written for C++11 (the Arduino toolchain): constexpr functions are a
+// single return statement, and the table is expanded from an index pack rather than filled in by a loop.
+
+template<int... I> struct WaveformIndices {};
+template<int N, int... I> struct MakeWaveformIndices : MakeWaveformIndices<N - 1, N - 1, I...> {};
+template<int... I> struct MakeWaveformIndices<0, I...> {
+  typedef WaveformIndices<I...> type;
+};
+
+constexpr double PI_OVER_2 = 1.57079632679489662;
+
+constexpr double waveformX(int i) {
+  return (double) i / WAVEFORM_SEGMENTS;
+}
+
+constexpr uint16_t waveformRound(double y) {
+  return (uint16_t) (y * WAVEFORM_FULL_SCALE + 0.5);
+}
+
+// sin(t) for 0 <= t <= pi/2 from its Taylor series to t^9 (error below 4e-6)
+constexpr double waveformSinSeries(double t, double t2) {
+  return t * (1 - t2 / 6 * (1 - t2 / 20 * (1 - t2 / 42 * (1 - t2 / 72))));
+}
+
+constexpr double waveformSin(double t) {
+  return waveformSinSeries(t, t * t);
+}
+
+constexpr double waveformSquared(double s) {
+  return s * s;
+}
+
+constexpr uint16_t rampAt(int i) {
+  return waveformRound(waveformX(i));
+}
+
+constexpr uint16_t deceleratingAt(int i) {
+  return waveformRound(1 - waveformSquared(1 - waveformX(i)));
+}
+
+constexpr uint16_t sineAt(int i) {
+  return waveformRound(waveformSquared(waveformSin(PI_OVER_2 * waveformX(i))));     // sin^2(pi x / 2) = (1 - cos(pi x)) / 2
+}
+
+constexpr uint16_t squareAt(int i) {
+  return (void) i, WAVEFORM_FULL_SCALE;
+}
+
+// The old INHALE_DRIVE table: 5 per 1 % to 200 at 40 %, 17.5 per 1 % to 900 at 80 %, then on to 1023
+constexpr double legacyDrive(double percent) {
+  return percent <= 40 ? 5 * percent
+         : percent <= 80 ? 200 + 17.5 * (percent - 40)
+         : 900 + 6.15 * (percent - 80);
+}
+
+constexpr uint16_t legacyAt(int i) {
+  return (uint16_t) (legacyDrive(100 * waveformX(i)) + 0.5);
+}
+
+template<int... I>
+constexpr WaveformTables makeWaveforms(WaveformIndices<I...>) {
+  return WaveformTables { {
+    { rampAt(I)... },
+    { deceleratingAt(I)... },
+    { sineAt(I)... },
+    { squareAt(I)... },
+    { legacyAt(I)... }
+  } };
+}
+
+// Largest step between neighbouring entries, over every table from one segment (counted across the tables) on
+constexpr int waveformStep(const WaveformTables &t, int w, int i) {
+  return t.table[w][i + 1] > t.table[w][i] ? t.table[w][i + 1] - t.table[w][i] : t.table[w][i] - t.table[w][i + 1];
+}
+
+constexpr int waveformLarger(int a, int b) {
+  return a > b ? a : b;
+}
+
+constexpr int waveformStepMax(const WaveformTables &t, int segment) {
+  return segment == NUMBER_OF_WAVEFORMS * WAVEFORM_SEGMENTS ? 0
+         : waveformLarger(waveformStep(t, segment / WAVEFORM_SEGMENTS, segment % WAVEFORM_SEGMENTS),
+                          waveformStepMax(t, segment + 1));
+}
+
+typedef MakeWaveformIndices<WAVEFORM_SEGMENTS + 1>::type AllWaveformEntries;
+
+static_assert(makeWaveforms(AllWaveformEntries()).table[WAVEFORM_SINE][WAVEFORM_SEGMENTS] == WAVEFORM_FULL_SCALE &&
+              makeWaveforms(AllWaveformEntries()).table[WAVEFORM_LEGACY][WAVEFORM_SEGMENTS] == WAVEFORM_FULL_SCALE,
+              "waveforms must be generated at compile time and end at full scale");
+static_assert(waveformStepMax(makeWaveforms(AllWaveformEntries()), 0) <= WAVEFORM_STEP_MAX,
+              "a step between waveform entries is too large for waveformAt()'s 16 bit interpolation");
+
+const WaveformTables waveforms PROGMEM = makeWaveforms(AllWaveformEntries());
@@ -0,0 +1,55 @@
+#ifndef WAVEFORM_H
+#define WAVEFORM_H
+
+/* Inhale drive waveforms
+   Description : The drive shapes played out over an inhale, generated by the compiler (waveform.cpp) and kept in flash,
+                 so they take no SRAM. Every table has WAVEFORM_SEGMENTS + 1 entries and ends at WAVEFORM_FULL_SCALE; all
+                 but WAVEFORM_SQUARE start from 0.
+                 The control interrupt looks them up at a Q16.16 position (see drive.h) and interpolates linearly
+                 between neighbouring entries on the top 8 fraction bits, so the output moves on every tick instead of in
+                 stairs. Interpolation costs two flash reads and one 16 x 8 bit multiply, in 16 bits: no step between
+                 neighbouring entries is over WAVEFORM_STEP_MAX (checked at compile time), so step x fraction cannot overflow.
+
+                   WAVEFORM_RAMP          - constant rate
+                   WAVEFORM_DECELERATING  - 1 - (1 - x)^2, fast at first and easing off (linearly decelerating flow)
+                   WAVEFORM_SINE          - (1 - cos(pi x)) / 2, S shaped
+                   WAVEFORM_SQUARE        - full scale for the whole inhale
+                   WAVEFORM_LEGACY        - the hand-typed INHALE_DRIVE table of V15 - V30 (slow, steep, slow)
+*/
+
+#include <Arduino.h>
+
+const uint8_t WAVEFORM_RAMP = 0;
+const uint8_t WAVEFORM_DECELERATING = 1;
+const uint8_t WAVEFORM_SINE = 2;
+const uint8_t WAVEFORM_SQUARE = 3;
+const uint8_t WAVEFORM_LEGACY = 4;
+const uint8_t NUMBER_OF_WAVEFORMS = 5;
+
+const int WAVEFORM_SEGMENTS = 64;                 // table length - 1, a power of two
+const int WAVEFORM_FULL_SCALE = 1023;
+const uint8_t WAVEFORM_POSITION_SHIFT = 16;       // positions are Q16.16 table entries (as drive.h)
+const uint8_t WAVEFORM_FRACTION_BITS = 8;         // interpolation resolution, 1/256 of an entry
+const int WAVEFORM_STEP_MAX = 127;                // largest step between entries .. 127 x 255 still fits an int16_t
+
+struct WaveformTables {
+  uint16_t table[NUMBER_OF_WAVEFORMS][WAVEFORM_SEGMENTS + 1];
+};
+
+extern const WaveformTables waveforms PROGMEM;
+
+// Drive (0 .. WAVEFORM_FULL_SCALE) at a Q16.16 position down a waveform. Positions past the end give the last entry
+inline uint16_t waveformAt(uint8_t waveform, uint32_t position) {
+  uint16_t index = position >> WAVEFORM_POSITION_SHIFT;
+  const uint16_t *entry = &waveforms.table[waveform][0];
+  if (index >= WAVEFORM_SEGMENTS) {
+    return pgm_read_word(entry + WAVEFORM_SEGMENTS);
+  }
+  entry += index;
+  uint8_t fraction = (uint16_t) position >> (WAVEFORM_POSITION_SHIFT - WAVEFORM_FRACTION_BITS);
+  uint16_t from = pgm_read_word(entry);
+  int16_t rise = (int16_t) (pgm_read_word(entry + 1) - from);
+  return from + ((int16_t) (rise * fraction) >> WAVEFORM_FRACTION_BITS);
+}
+
+#endif